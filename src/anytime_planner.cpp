@@ -0,0 +1,303 @@
+#include "anytime_planner.h"
+#include "graph_search.h"
+#include "log.h"
+
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+#define OPEN 1
+#define INCONSISTENT 2
+#define QUEUED 4
+
+namespace {
+    // Distances to target along incoming edges
+    void reverse_distances(MapGraph const &map, uint32_t target, vector<unsigned> &weights) {
+        weights.assign(map.size(), UINT_MAX);
+        vector<pair<unsigned, uint32_t>> queue{{0, target}};
+        weights[target] = 0;
+        while (!queue.empty()) {
+            pop_heap(queue.begin(), queue.end(), greater<pair<unsigned, uint32_t>>());
+            auto [weight, node] = queue.back();
+            queue.pop_back();
+            if (weight > weights[node])
+                continue;
+            MapEdge const *incoming = map.get_incoming(node);
+            for (unsigned i{0}; i < map.get_in_degree(node); ++i) {
+                MapEdge edge = incoming[i];
+                if (weight + edge.weight < weights[edge.node]) {
+                    weights[edge.node] = weight + edge.weight;
+                    queue.emplace_back(weights[edge.node], edge.node);
+                    push_heap(queue.begin(), queue.end(), greater<pair<unsigned, uint32_t>>());
+                }
+            }
+        }
+    }
+}
+
+AnytimePlanner::AnytimePlanner(shared_ptr<MapGraph const> map, unsigned landmarks)
+: map{map} {
+    find_landmarks(landmarks);
+    Logger::log(DEBUG, __FILE__, "constructor", "AnytimePlanner created");
+}
+
+AnytimePlanner::~AnytimePlanner() {
+    stop_improving();
+}
+
+void AnytimePlanner::find_landmarks(unsigned count) {
+    size_t size = map->size();
+    landmarks = min<size_t>(count, size);
+    from_landmark.assign(size * landmarks, UINT_MAX);
+    to_landmark.assign(size * landmarks, UINT_MAX);
+    if (landmarks == 0)
+        return;
+
+    // Farthest point selection: every landmark is the node farthest from
+    // the landmarks so far (unreachable counts as farthest), starting far
+    // from node 0
+    vector<unsigned> weights{};
+    vector<uint32_t> parents{};
+    SearchQueue queue{};
+    shortest_paths(*map, 0, NO_NODE, weights, parents, queue);
+    vector<unsigned> nearest = weights;
+    for (unsigned i{0}; i < landmarks; ++i) {
+        uint32_t landmark{0};
+        for (uint32_t id{1}; id < size; ++id) {
+            if (nearest[id] > nearest[landmark])
+                landmark = id;
+        }
+        shortest_paths(*map, landmark, NO_NODE, weights, parents, queue);
+        for (uint32_t id{0}; id < size; ++id) {
+            from_landmark[id * landmarks + i] = weights[id];
+            nearest[id] = i == 0 ? weights[id] : min(nearest[id], weights[id]);
+        }
+        reverse_distances(*map, landmark, weights);
+        for (uint32_t id{0}; id < size; ++id) {
+            to_landmark[id * landmarks + i] = weights[id];
+        }
+    }
+}
+
+unsigned AnytimePlanner::heuristic(uint32_t id) {
+    if (h[id] != UINT_MAX || landmarks == 0)
+        return landmarks == 0 ? 0 : h[id];
+    // d(id, goal) >= d(L, goal) - d(L, id) and >= d(id, L) - d(goal, L)
+    unsigned bound{0};
+    unsigned const *from = &from_landmark[id * landmarks];
+    unsigned const *to = &to_landmark[id * landmarks];
+    unsigned const *goal_from = &from_landmark[goal * landmarks];
+    unsigned const *goal_to = &to_landmark[goal * landmarks];
+    for (unsigned i{0}; i < landmarks; ++i) {
+        if (goal_from[i] != UINT_MAX && from[i] < goal_from[i])
+            bound = max(bound, goal_from[i] - from[i]);
+        if (to[i] != UINT_MAX && goal_to[i] < to[i])
+            bound = max(bound, to[i] - goal_to[i]);
+    }
+    h[id] = bound;
+    return bound;
+}
+
+bool AnytimePlanner::plan(string const &start_node_name, string const &stop_node_name,
+                          long budget_us, double epsilon) {
+    int start = map->get_id(start_node_name);
+    int stop = map->get_id(stop_node_name);
+    return plan(start < 0 ? UINT_MAX : map->get_map_id(start),
+                stop < 0 ? UINT_MAX : map->get_map_id(stop), budget_us, epsilon);
+}
+
+bool AnytimePlanner::plan(unsigned start_id, unsigned stop_id, long budget_us, double epsilon) {
+    Deadline deadline = chrono::steady_clock::now() + chrono::microseconds(budget_us);
+    stop_improving();
+    this->epsilon = max(1.0, epsilon);
+    plan_ids(start_id < map->size() ? map->from_map_id(start_id) : NO_NODE,
+             stop_id < map->size() ? map->from_map_id(stop_id) : NO_NODE);
+    if (!finished)
+        run(deadline);
+    return get_route().distance != UINT_MAX;
+}
+
+void AnytimePlanner::plan_ids(uint32_t start, uint32_t stop) {
+    {
+        lock_guard<mutex> lock{route_mutex};
+        route = AnytimeRoute{};
+    }
+    finished = true;
+    if (start >= map->size() || stop >= map->size()) {
+        Logger::log(WARNING, __FILE__, "plan", "Unknown start or stop node");
+        return;
+    }
+
+    // Only nodes touched by this plan are reset, see touch()
+    if (seen_in.size() != map->size() || ++plan_count == 0) {
+        g.resize(map->size());
+        parents.resize(map->size());
+        h.resize(map->size());
+        closed_in.resize(map->size());
+        flags.resize(map->size());
+        seen_in.assign(map->size(), 0);
+        plan_count = 1;
+    }
+    goal = stop;
+    iteration = 1;
+    open.clear();
+    inconsistent.clear();
+    finished = false;
+
+    touch(goal);
+    touch(start);
+    g[start] = 0;
+    push_open(start);
+}
+
+bool AnytimePlanner::run(Deadline deadline) {
+    while (!finished) {
+        if (!improve_path(deadline))
+            return false;
+        publish();
+        if (epsilon <= 1 || g[goal] == UINT_MAX) {
+            finished = true;
+        } else {
+            next_iteration();
+        }
+    }
+    return true;
+}
+
+void AnytimePlanner::push_open(uint32_t id) {
+    flags[id] |= OPEN;
+    open.emplace_back(key(id), id);
+    push_heap(open.begin(), open.end(), greater<pair<double, uint32_t>>());
+}
+
+bool AnytimePlanner::improve_path(Deadline deadline) {
+    MapEdge edges[2];
+    for (unsigned long expanded{0}; ; ++expanded) {
+        // Entries of nodes that were improved or expanded since are stale
+        while (!open.empty() && (!(flags[open.front().second] & OPEN)
+                                 || open.front().first != key(open.front().second))) {
+            pop_heap(open.begin(), open.end(), greater<pair<double, uint32_t>>());
+            open.pop_back();
+        }
+        if (open.empty() || open.front().first >= g[goal])
+            return true;
+        if (expanded % 64 == 63 && (stop_requested || chrono::steady_clock::now() > deadline))
+            return false;
+
+        pop_heap(open.begin(), open.end(), greater<pair<double, uint32_t>>());
+        uint32_t node = open.back().second;
+        open.pop_back();
+        flags[node] &= ~OPEN;
+        closed_in[node] = iteration;
+
+        unsigned degree = map->get_edges(node, edges);
+        for (unsigned i{0}; i < degree; ++i) {
+            MapEdge edge = edges[i];
+            touch(edge.node);
+            if (g[node] + edge.weight >= g[edge.node])
+                continue;
+            g[edge.node] = g[node] + edge.weight;
+            parents[edge.node] = node;
+            if (closed_in[edge.node] != iteration) {
+                push_open(edge.node);
+            } else if (!(flags[edge.node] & INCONSISTENT)) {
+                // Expanded already with this epsilon, repaired in the next iteration
+                flags[edge.node] |= INCONSISTENT;
+                inconsistent.push_back(edge.node);
+            }
+        }
+    }
+}
+
+void AnytimePlanner::next_iteration() {
+    epsilon = max(1.0, epsilon - ANYTIME_EPSILON_STEP);
+    ++iteration;
+
+    // Rebuild the open list with the new epsilon, inconsistent nodes included
+    vector<pair<double, uint32_t>> entries{};
+    entries.swap(open);
+    for (uint32_t id : inconsistent) {
+        flags[id] = (flags[id] & ~INCONSISTENT) | OPEN;
+        entries.emplace_back(0, id);
+    }
+    inconsistent.clear();
+    for (auto &entry : entries) {
+        uint32_t id = entry.second;
+        if ((flags[id] & OPEN) && !(flags[id] & QUEUED)) {
+            flags[id] |= QUEUED;
+            open.emplace_back(key(id), id);
+        }
+    }
+    for (auto &entry : open) {
+        flags[entry.second] &= ~QUEUED;
+    }
+    make_heap(open.begin(), open.end(), greater<pair<double, uint32_t>>());
+}
+
+void AnytimePlanner::publish() {
+    AnytimeRoute best{};
+    if (g[goal] != UINT_MAX) {
+        vector<uint32_t> ids{};
+        for (uint32_t node = goal; node != NO_NODE; node = parents[node]) {
+            ids.push_back(node);
+        }
+        reverse(ids.begin(), ids.end());
+
+        // Parents may have improved after their children, so sum the edges
+        best.distance = 0;
+        MapEdge edges[2];
+        for (size_t i{0}; i + 1 < ids.size(); ++i) {
+            map->get_edges(ids[i], edges);
+            best.distance += edges[0].node == ids[i+1] ? edges[0].weight : edges[1].weight;
+        }
+        for (uint32_t id : ids) {
+            best.nodes.push_back(map->get_name(id));
+        }
+        best.drive_mission = route_instructions(*map, ids);
+
+        // Every node still to be expanded is a lower bound for the shortest route
+        unsigned lower = g[goal];
+        for (auto &entry : open) {
+            if (flags[entry.second] & OPEN)
+                lower = min(lower, g[entry.second] + heuristic(entry.second));
+        }
+        for (uint32_t id : inconsistent) {
+            lower = min(lower, g[id] + heuristic(id));
+        }
+        best.bound = lower > 0 ? min(epsilon, static_cast<double>(best.distance) / lower) : 1;
+        best.bound = max(1.0, best.bound);
+    }
+    lock_guard<mutex> lock{route_mutex};
+    route = best;
+}
+
+void AnytimePlanner::improve_in_background() {
+    stop_improving();
+    if (finished)
+        return;
+    improving = true;
+    background = thread{[this] {
+        run(Deadline::max());
+        improving = false;
+    }};
+}
+
+void AnytimePlanner::stop_improving() {
+    stop_requested = true;
+    if (background.joinable())
+        background.join();
+    stop_requested = false;
+    improving = false;
+}
+
+AnytimeRoute AnytimePlanner::get_route() const {
+    lock_guard<mutex> lock{route_mutex};
+    return route;
+}
@@ -0,0 +1,146 @@
+/*
+ * Anytime route planning for reroutes under a latency budget.
+ *
+ * Anytime Repairing A* (ARA*): a weighted A* search with inflation epsilon
+ * finds a route at most epsilon times longer than the shortest one, then
+ * epsilon is lowered step by step and the search repairs the route, reusing
+ * what it already explored, until epsilon is 1 and the route is optimal.
+ *
+ * The map has no coordinates, so the A* heuristic uses landmarks: exact
+ * distances to and from a few far apart nodes, computed once per planner,
+ * bound the distance between any two nodes through the triangle inequality.
+ *
+ * Use:
+ *     AnytimePlanner planner{map};
+ *     planner.plan("A1", "B2", 2000);       // At most 2 ms
+ *     AnytimeRoute route = planner.get_route();
+ *     planner.improve_in_background();      // Optional, see below
+ *
+ * get_route() can be called at any time, also from other threads, and
+ * returns the best route found so far with its suboptimality bound.
+ */
+
+#ifndef ANYTIME_PLANNER_H
+#define ANYTIME_PLANNER_H
+
+#include "raspi_common.h"
+#include "map_graph.h"
+
+#include <atomic>
+#include <chrono>
+#include <climits>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#define ANYTIME_INITIAL_EPSILON 3.0
+#define ANYTIME_EPSILON_STEP 0.5
+#define ANYTIME_LANDMARKS 8
+
+struct AnytimeRoute {
+    std::vector<std::string> nodes{};
+    std::vector<instruction::InstructionNumber> drive_mission{};
+    unsigned distance{UINT_MAX};  // UINT_MAX if no route found (yet)
+    double bound{0};  // distance <= bound * shortest distance, 1 when optimal
+};
+
+class AnytimePlanner {
+public:
+    AnytimePlanner(std::shared_ptr<MapGraph const> map, unsigned landmarks=ANYTIME_LANDMARKS);
+    ~AnytimePlanner();
+
+    AnytimePlanner(AnytimePlanner const&) = delete;
+    AnytimePlanner operator=(AnytimePlanner const&) = delete;
+
+    /* Plan a route for at most budget_us microseconds, starting the search
+     * with the given epsilon. Stops any background improvement of the
+     * previous plan. Return true if a route was found within the budget. */
+    bool plan(std::string const &start_node_name, std::string const &stop_node_name,
+              long budget_us, double epsilon=ANYTIME_INITIAL_EPSILON);
+
+    /* Same with map ids. */
+    bool plan(unsigned start_id, unsigned stop_id, long budget_us,
+              double epsilon=ANYTIME_INITIAL_EPSILON);
+
+    /* Keep improving the last plan in a background thread until it is
+     * optimal or stop_improving() is called. */
+    void improve_in_background();
+    void stop_improving();
+    bool is_improving() const {
+        return improving;
+    }
+
+    /* Best route so far for the last plan. */
+    AnytimeRoute get_route() const;
+
+private:
+    typedef std::chrono::steady_clock::time_point Deadline;
+
+    void find_landmarks(unsigned count);
+
+    /* Landmark lower bound on the distance from id to goal, cached. */
+    unsigned heuristic(uint32_t id);
+    double key(uint32_t id) {
+        return g[id] + epsilon * heuristic(id);
+    }
+
+    void plan_ids(uint32_t start, uint32_t stop);
+
+    /* Reset the search state of a node the first time a plan sees it. */
+    void touch(uint32_t id) {
+        if (seen_in[id] != plan_count) {
+            seen_in[id] = plan_count;
+            g[id] = UINT_MAX;
+            parents[id] = NO_NODE;
+            h[id] = UINT_MAX;
+            closed_in[id] = 0;
+            flags[id] = 0;
+        }
+    }
+
+    /* ARA* iterations until optimal or deadline (or a stop request).
+     * Return true when optimal or there is no route. */
+    bool run(Deadline deadline);
+
+    /* Expand nodes until the route cannot be improved with the current
+     * epsilon. Return false if interrupted. */
+    bool improve_path(Deadline deadline);
+    void push_open(uint32_t id);
+    void next_iteration();
+    void publish();
+
+    std::shared_ptr<MapGraph const> map;
+
+    // Landmark distances, node major: from_landmark[id * landmarks + i]
+    unsigned landmarks{0};
+    std::vector<unsigned> from_landmark{};
+    std::vector<unsigned> to_landmark{};
+
+    // Search state of the current plan
+    uint32_t goal{NO_NODE};
+    double epsilon{1};
+    unsigned iteration{0};
+    bool finished{true};
+    unsigned plan_count{0};
+    std::vector<unsigned> seen_in{};  // Plan that last touched the node
+    std::vector<unsigned> g{};
+    std::vector<uint32_t> parents{};
+    std::vector<unsigned> h{};
+    std::vector<unsigned> closed_in{};  // Iteration the node was expanded in
+    std::vector<uint8_t> flags{};
+    std::vector<std::pair<double, uint32_t>> open{};
+    std::vector<uint32_t> inconsistent{};
+
+    mutable std::mutex route_mutex{};
+    AnytimeRoute route{};
+
+    std::thread background{};
+    std::atomic<bool> improving{false};
+    std::atomic<bool> stop_requested{false};
+};
+
+#endif // ANYTIME_PLANNER_H
@@ -0,0 +1,215 @@
+#include "checkpoint.h"
+#include "log.h"
+
+#include <cerrno>
+#include <cstddef>
+#include <cstring>
+#include <list>
+#include <string>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+
+namespace {
+    struct FileHeader {
+        uint32_t magic;
+        uint32_t version;
+        uint32_t progress_size;
+        uint32_t id_length;
+    };
+
+    // Header, then the two progress slots, then missions
+    size_t const slot_offset = 64;
+    size_t const missions_offset = slot_offset + 2 * ((sizeof(CheckpointProgress) + 63) / 64 * 64);
+    size_t const instruction_size = 4 + CHECKPOINT_ID_LEN;
+
+    uint32_t fnv1a(uint8_t const *bytes, size_t length) {
+        uint32_t hash{2166136261u};
+        for (size_t i{0}; i < length; ++i) {
+            hash = (hash ^ bytes[i]) * 16777619u;
+        }
+        return hash;
+    }
+
+    uint32_t progress_checksum(CheckpointProgress const &progress) {
+        size_t start = offsetof(CheckpointProgress, checksum) + sizeof(progress.checksum);
+        return fnv1a(reinterpret_cast<uint8_t const*>(&progress) + start, sizeof(progress) - start);
+    }
+
+    size_t mission_size(uint32_t instruction_count, uint32_t segment_count) {
+        return instruction_count * instruction_size + segment_count * CHECKPOINT_ID_LEN;
+    }
+
+    void put_id(uint8_t *out, string const &id) {
+        if (id.size() >= CHECKPOINT_ID_LEN)
+            Logger::log(WARNING, __FILE__, "checkpoint", "Id too long, truncated: " + id);
+        memset(out, 0, CHECKPOINT_ID_LEN);
+        memcpy(out, id.data(), min<size_t>(id.size(), CHECKPOINT_ID_LEN - 1));
+    }
+
+    string get_id(uint8_t const *in) {
+        return string(reinterpret_cast<char const*>(in), strnlen(reinterpret_cast<char const*>(in),
+                                                                   CHECKPOINT_ID_LEN - 1));
+    }
+}
+
+CheckpointFile::CheckpointFile(string path)
+: path{path} {
+    fd = open(path.c_str(), O_RDWR | O_CREAT, 0644);
+    struct stat status{};
+    if (fd < 0 || fstat(fd, &status) < 0) {
+        Logger::log(ERROR, __FILE__, "CheckpointFile", "Could not open " + path + ": " + strerror(errno));
+        return;
+    }
+
+    bool fresh = static_cast<size_t>(status.st_size) < missions_offset;
+    if (!reserve(fresh ? missions_offset : status.st_size))
+        return;
+    FileHeader *header = reinterpret_cast<FileHeader*>(data);
+    if (fresh || header->magic != CHECKPOINT_MAGIC || header->version != CHECKPOINT_VERSION
+            || header->progress_size != sizeof(CheckpointProgress)
+            || header->id_length != CHECKPOINT_ID_LEN) {
+        memset(data, 0, missions_offset);
+        *header = FileHeader{CHECKPOINT_MAGIC, CHECKPOINT_VERSION,
+                             sizeof(CheckpointProgress), CHECKPOINT_ID_LEN};
+    }
+
+    int slot = latest_slot();
+    if (slot >= 0)
+        memcpy(&current, data + slot_offset + slot * sizeof(CheckpointProgress), sizeof(current));
+}
+
+CheckpointFile::~CheckpointFile() {
+    if (data != nullptr)
+        munmap(data, size);
+    if (fd >= 0)
+        close(fd);
+}
+
+bool CheckpointFile::reserve(size_t new_size) {
+    if (data != nullptr && new_size <= size)
+        return true;
+    if (data != nullptr) {
+        // Keep the file growing in big steps
+        new_size = max(new_size, 2 * size);
+        munmap(data, size);
+        data = nullptr;
+    }
+    if (ftruncate(fd, new_size) < 0) {
+        Logger::log(ERROR, __FILE__, "reserve", "Could not grow " + path + ": " + strerror(errno));
+        return false;
+    }
+    void *mapping = mmap(nullptr, new_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (mapping == MAP_FAILED) {
+        Logger::log(ERROR, __FILE__, "reserve", "Could not map " + path + ": " + strerror(errno));
+        return false;
+    }
+    data = static_cast<uint8_t*>(mapping);
+    size = new_size;
+    return true;
+}
+
+int CheckpointFile::latest_slot() const {
+    int latest{-1};
+    uint64_t latest_sequence{0};
+    for (int slot{0}; slot < 2; ++slot) {
+        CheckpointProgress progress{};
+        memcpy(&progress, data + slot_offset + slot * sizeof(CheckpointProgress), sizeof(progress));
+        if (progress.sequence == 0 || progress.checksum != progress_checksum(progress))
+            continue;
+        size_t end = progress.mission_offset + mission_size(progress.instruction_count,
+                                                             progress.segment_count);
+        if (progress.mission_offset < missions_offset || end > size
+                || progress.mission_checksum != fnv1a(data + progress.mission_offset,
+                                                      end - progress.mission_offset))
+            continue;
+        if (progress.sequence > latest_sequence) {
+            latest = slot;
+            latest_sequence = progress.sequence;
+        }
+    }
+    return latest;
+}
+
+bool CheckpointFile::read(CheckpointProgress &progress, list<drive_instruction_t> &instructions,
+                          list<string> &segments) const {
+    int slot = is_open() ? latest_slot() : -1;
+    if (slot < 0)
+        return false;
+    memcpy(&progress, data + slot_offset + slot * sizeof(CheckpointProgress), sizeof(progress));
+
+    instructions.clear();
+    segments.clear();
+    uint8_t const *in = data + progress.mission_offset;
+    for (uint32_t i{0}; i < progress.instruction_count; ++i, in += instruction_size) {
+        if (i < progress.instructions_done)
+            continue;
+        drive_instruction_t instruction{};
+        int32_t number{0};
+        memcpy(&number, in, 4);
+        instruction.number = static_cast<instruction::InstructionNumber>(number);
+        instruction.id = get_id(in + 4);
+        instructions.push_back(instruction);
+    }
+    for (uint32_t i{0}; i < progress.segment_count; ++i, in += CHECKPOINT_ID_LEN) {
+        if (i >= progress.segments_done)
+            segments.push_back(get_id(in));
+    }
+    return true;
+}
+
+void CheckpointFile::write_mission(list<drive_instruction_t> const &instructions,
+                                   list<string> const &segments, CheckpointProgress &progress) {
+    if (!is_open())
+        return;
+
+    // First fit before the current mission, else after it
+    size_t length = mission_size(instructions.size(), segments.size());
+    size_t offset = missions_offset;
+    if (current.sequence != 0 && offset + length > current.mission_offset)
+        offset = current.mission_offset + mission_size(current.instruction_count,
+                                                       current.segment_count);
+    if (!reserve(offset + length))
+        return;
+
+    uint8_t *out = data + offset;
+    for (drive_instruction_t const &instruction : instructions) {
+        int32_t number = instruction.number;
+        memcpy(out, &number, 4);
+        put_id(out + 4, instruction.id);
+        out += instruction_size;
+    }
+    for (string const &segment : segments) {
+        put_id(out, segment);
+        out += CHECKPOINT_ID_LEN;
+    }
+
+    current.mission_offset = offset;
+    current.mission_checksum = fnv1a(data + offset, length);
+    current.instruction_count = instructions.size();
+    current.segment_count = segments.size();
+    progress.instructions_done = 0;
+    progress.segments_done = 0;
+    write_progress(progress);
+}
+
+void CheckpointFile::write_progress(CheckpointProgress &progress) {
+    if (!is_open())
+        return;
+    progress.sequence = current.sequence + 1;
+    progress.mission_offset = current.mission_offset;
+    progress.mission_checksum = current.mission_checksum;
+    progress.instruction_count = current.instruction_count;
+    progress.segment_count = current.segment_count;
+    progress.checksum = progress_checksum(progress);
+
+    // Overwrite the older slot, the newer one stays valid meanwhile
+    int slot = progress.sequence % 2;
+    memcpy(data + slot_offset + slot * sizeof(CheckpointProgress), &progress, sizeof(progress));
+    msync(data, size, MS_ASYNC);
+    current = progress;
+}
@@ -0,0 +1,98 @@
+/*
+ * Checkpoints of the control center in a memory-mapped file, so a
+ * restarted control process can continue the mission where it was.
+ *
+ * The file has two progress slots and room for missions (instruction and
+ * road segment lists). A mission is written once, when it is set, to a
+ * place in the file that does not overlap the current one. Progress (how
+ * many instructions are done, the state machine, the line detector and
+ * unreported finished ids) is a small record written at every instruction
+ * boundary into the older of the two slots, with a sequence number and a
+ * checksum. If the process dies while writing, the other slot is still
+ * complete, and it points to a mission that is still intact.
+ *
+ * Data is in the page cache as soon as it is written, so it survives the
+ * process but not necessarily a power cut.
+ */
+
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include "raspi_common.h"
+#include "line_detector.h"
+
+#include <cstdint>
+#include <list>
+#include <string>
+
+#define CHECKPOINT_MAGIC 0x54504b43
+#define CHECKPOINT_VERSION 1
+#define CHECKPOINT_ID_LEN 32          // Ids and road segments, null terminated
+#define CHECKPOINT_MAX_FINISHED 16    // Newest unreported finished ids kept
+
+struct CheckpointProgress {
+    uint64_t sequence;
+    uint32_t checksum;     // Of everything after this field
+    uint32_t map_version;
+
+    // Mission in the file and how much of it is done
+    uint32_t mission_offset;
+    uint32_t mission_checksum;
+    uint32_t instruction_count;
+    uint32_t segment_count;
+    uint32_t instructions_done;
+    uint32_t segments_done;
+
+    // ControlCenter
+    int32_t state;
+    int32_t stop_reason;
+    int32_t finish_when_stopped;
+    uint32_t consecutive_0_status_codes;
+    int32_t last_image_status_code;
+    int32_t last_angle;
+    LineDetectorState line_detector;
+
+    uint32_t finished_count;
+    char finished[CHECKPOINT_MAX_FINISHED][CHECKPOINT_ID_LEN];
+};
+
+class CheckpointFile {
+public:
+    /* Open or create the checkpoint file. */
+    CheckpointFile(std::string path);
+    ~CheckpointFile();
+
+    CheckpointFile(CheckpointFile const&) = delete;
+    CheckpointFile operator=(CheckpointFile const&) = delete;
+
+    bool is_open() const {
+        return data != nullptr;
+    }
+
+    /* The newest complete checkpoint. Return false if there is none. */
+    bool read(CheckpointProgress &progress, std::list<drive_instruction_t> &instructions,
+              std::list<std::string> &segments) const;
+
+    /* Save a new mission and then progress (with nothing done yet). */
+    void write_mission(std::list<drive_instruction_t> const &instructions,
+                       std::list<std::string> const &segments, CheckpointProgress &progress);
+
+    /* Save progress on the current mission. The mission fields of progress
+     * are filled in. */
+    void write_progress(CheckpointProgress &progress);
+
+private:
+    /* Latest valid slot, -1 if none. */
+    int latest_slot() const;
+
+    /* Make the file (and mapping) at least size bytes. */
+    bool reserve(size_t size);
+
+    std::string path;
+    int fd{-1};
+    size_t size{0};
+    uint8_t *data{nullptr};
+    CheckpointProgress current{};  // Last progress written
+};
+
+#endif // CHECKPOINT_H
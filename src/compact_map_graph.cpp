@@ -0,0 +1,303 @@
+#include "compact_map_graph.h"
+#include "graph_search.h"
+#include "log.h"
+
+#include <algorithm>
+#include <cstring>
+#include <memory>
+#include <numeric>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+namespace {
+    void put_varint(vector<uint8_t> &out, uint64_t value) {
+        while (value >= 0x80) {
+            out.push_back(static_cast<uint8_t>(value | 0x80));
+            value >>= 7;
+        }
+        out.push_back(static_cast<uint8_t>(value));
+    }
+
+    uint64_t get_varint(uint8_t const *&in) {
+        uint64_t value{0};
+        for (unsigned shift{0}; ; shift += 7) {
+            uint8_t byte = *in++;
+            value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+            if (byte < 0x80)
+                return value;
+        }
+    }
+
+    // Signed differences as unsigned: 0, -1, 1, -2, ... -> 0, 1, 2, 3, ...
+    uint64_t zigzag(int64_t value) {
+        return (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63);
+    }
+
+    int64_t unzigzag(uint64_t value) {
+        return static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1);
+    }
+
+    void put_weight(vector<uint8_t> &out, uint32_t weight, unsigned bytes) {
+        for (unsigned i{0}; i < bytes; ++i) {
+            out.push_back(static_cast<uint8_t>(weight >> (8 * i)));
+        }
+    }
+
+    uint32_t get_weight(uint8_t const *&in, unsigned bytes) {
+        uint32_t weight{0};
+        for (unsigned i{0}; i < bytes; ++i) {
+            weight |= static_cast<uint32_t>(*in++) << (8 * i);
+        }
+        return weight;
+    }
+
+    size_t common_prefix(string const &a, string const &b) {
+        size_t length{0};
+        while (length < a.size() && length < b.size() && a[length] == b[length])
+            ++length;
+        return length;
+    }
+}
+
+PackedArray::PackedArray(vector<uint32_t> const &values) {
+    uint32_t largest = values.empty() ? 0 : *max_element(values.begin(), values.end());
+    bits = 1;
+    while (bits < 32 && (largest >> bits) != 0)
+        ++bits;
+    mask = (uint64_t{1} << bits) - 1;
+    words.assign((values.size() * bits + 63) / 64 + 1, 0);
+    for (size_t i{0}; i < values.size(); ++i) {
+        size_t bit = i * bits;
+        words[bit / 64] |= static_cast<uint64_t>(values[i]) << (bit % 64);
+        if (bit % 64 + bits > 64)
+            words[bit / 64 + 1] |= static_cast<uint64_t>(values[i]) >> (64 - bit % 64);
+    }
+}
+
+shared_ptr<CompactMapGraph const> CompactMapGraph::from_json(json const &m) {
+    return from_graph(*MapGraph::from_json(m));
+}
+
+shared_ptr<CompactMapGraph const> CompactMapGraph::from_graph(MapGraph const &graph) {
+    shared_ptr<CompactMapGraph> compact{new CompactMapGraph{}};
+    compact->count = graph.size();
+    compact->version = graph.get_version();
+
+    // Smallest weight width that holds every weight exactly
+    uint32_t largest{0};
+    MapEdge edges[2];
+    for (unsigned id{0}; id < graph.size(); ++id) {
+        unsigned degree = graph.get_edges(id, edges);
+        for (unsigned i{0}; i < degree; ++i) {
+            largest = max(largest, edges[i].weight);
+        }
+    }
+    compact->weight_bytes = largest <= UINT8_MAX ? 1 : largest <= UINT16_MAX ? 2 : 4;
+
+    // Node: 0 without edges, else varint (zigzag(left - id) << 1 | has right) + 1,
+    // left weight, then for a right edge varint zigzag(right - left), right weight
+    vector<uint8_t> &data = compact->node_data;
+    for (unsigned id{0}; id < graph.size(); ++id) {
+        if (id % COMPACT_BLOCK_SIZE == 0)
+            compact->node_blocks.push_back(data.size());
+        unsigned degree = graph.get_edges(id, edges);
+        if (degree == 0) {
+            put_varint(data, 0);
+            continue;
+        }
+        int64_t left = edges[0].node;
+        put_varint(data, (zigzag(left - id) << 1 | (degree == 2)) + 1);
+        put_weight(data, edges[0].weight, compact->weight_bytes);
+        if (degree == 2) {
+            put_varint(data, zigzag(static_cast<int64_t>(edges[1].node) - left));
+            put_weight(data, edges[1].weight, compact->weight_bytes);
+        }
+    }
+
+    // Names: varint shared prefix length, varint rest length, rest. The
+    // first name of every block is stored whole.
+    vector<uint32_t> sorted(graph.size());
+    iota(sorted.begin(), sorted.end(), 0);
+    sort(sorted.begin(), sorted.end(), [&graph] (uint32_t a, uint32_t b) {
+        return graph.get_name(a) < graph.get_name(b);
+    });
+    vector<uint32_t> positions(graph.size());
+    string previous{};
+    for (uint32_t position{0}; position < sorted.size(); ++position) {
+        string const &name = graph.get_name(sorted[position]);
+        size_t prefix{0};
+        if (position % COMPACT_BLOCK_SIZE == 0) {
+            compact->name_blocks.push_back(compact->name_data.size());
+        } else {
+            prefix = common_prefix(previous, name);
+        }
+        put_varint(compact->name_data, prefix);
+        put_varint(compact->name_data, name.size() - prefix);
+        compact->name_data.insert(compact->name_data.end(), name.begin() + prefix, name.end());
+        positions[sorted[position]] = position;
+        previous = name;
+    }
+    compact->sorted_ids = PackedArray{sorted};
+    compact->name_positions = PackedArray{positions};
+
+    vector<uint32_t> map_ids(graph.size());
+    vector<uint32_t> internal_ids(graph.size());
+    bool identity{true};
+    for (unsigned id{0}; id < graph.size(); ++id) {
+        map_ids[id] = graph.get_map_id(id);
+        internal_ids[map_ids[id]] = id;
+        identity = identity && map_ids[id] == id;
+    }
+    if (!identity) {
+        compact->map_ids = PackedArray{map_ids};
+        compact->internal_ids = PackedArray{internal_ids};
+    }
+
+    compact->node_data.shrink_to_fit();
+    compact->node_blocks.shrink_to_fit();
+    compact->name_data.shrink_to_fit();
+    compact->name_blocks.shrink_to_fit();
+    return compact;
+}
+
+uint8_t const *CompactMapGraph::find_node(unsigned id) const {
+    uint8_t const *in = node_data.data() + node_blocks[id / COMPACT_BLOCK_SIZE];
+    for (unsigned skip = id % COMPACT_BLOCK_SIZE; skip > 0; --skip) {
+        uint64_t head = get_varint(in);
+        if (head == 0)
+            continue;
+        in += weight_bytes;
+        if ((head - 1) & 1) {
+            get_varint(in);
+            in += weight_bytes;
+        }
+    }
+    return in;
+}
+
+unsigned CompactMapGraph::get_edges(unsigned id, MapEdge out[2]) const {
+    uint8_t const *in = find_node(id);
+    out[0] = MapEdge{};
+    out[1] = MapEdge{};
+    uint64_t head = get_varint(in);
+    if (head == 0)
+        return 0;
+    int64_t left = static_cast<int64_t>(id) + unzigzag((head - 1) >> 1);
+    out[0] = MapEdge{static_cast<uint32_t>(left), get_weight(in, weight_bytes)};
+    if (((head - 1) & 1) == 0)
+        return 1;
+    uint32_t right = static_cast<uint32_t>(left + unzigzag(get_varint(in)));
+    out[1] = MapEdge{right, get_weight(in, weight_bytes)};
+    return 2;
+}
+
+string CompactMapGraph::block_name(unsigned block) const {
+    uint8_t const *in = name_data.data() + name_blocks[block];
+    get_varint(in);
+    size_t length = get_varint(in);
+    return string(reinterpret_cast<char const*>(in), length);
+}
+
+string CompactMapGraph::get_name(unsigned id) const {
+    uint32_t position = name_positions[id];
+    uint8_t const *in = name_data.data() + name_blocks[position / COMPACT_BLOCK_SIZE];
+    string name{};
+    for (unsigned i{0}; i <= position % COMPACT_BLOCK_SIZE; ++i) {
+        size_t prefix = get_varint(in);
+        size_t rest = get_varint(in);
+        name.resize(prefix);
+        name.append(reinterpret_cast<char const*>(in), rest);
+        in += rest;
+    }
+    return name;
+}
+
+int CompactMapGraph::get_id(string const &name) const {
+    if (count == 0)
+        return -1;
+
+    // Last block starting at or before name
+    unsigned low{0};
+    unsigned high = name_blocks.size();
+    while (high - low > 1) {
+        unsigned middle = (low + high) / 2;
+        if (block_name(middle) <= name) {
+            low = middle;
+        } else {
+            high = middle;
+        }
+    }
+
+    uint8_t const *in = name_data.data() + name_blocks[low];
+    string current{};
+    size_t end = min<size_t>(count, (low + 1) * COMPACT_BLOCK_SIZE);
+    for (size_t position = low * COMPACT_BLOCK_SIZE; position < end; ++position) {
+        size_t prefix = get_varint(in);
+        size_t rest = get_varint(in);
+        current.resize(prefix);
+        current.append(reinterpret_cast<char const*>(in), rest);
+        in += rest;
+        if (current == name)
+            return sorted_ids[position];
+        if (current > name)
+            break;
+    }
+    return -1;
+}
+
+size_t CompactMapGraph::get_memory_usage() const {
+    return sizeof(*this) + node_data.capacity() + name_data.capacity()
+         + (node_blocks.capacity() + name_blocks.capacity()) * sizeof(uint32_t)
+         + sorted_ids.get_memory_usage() + name_positions.get_memory_usage()
+         + map_ids.get_memory_usage() + internal_ids.get_memory_usage();
+}
+
+CompactPathFinder::CompactPathFinder(shared_ptr<CompactMapGraph const> map)
+: map{map} {
+    Logger::log(DEBUG, __FILE__, "constructor", "CompactPathFinder created");
+}
+
+void CompactPathFinder::solve(string const &start_node_name, string const &stop_node_name) {
+    int start = map->get_id(start_node_name);
+    int stop = map->get_id(stop_node_name);
+    solve_ids(start < 0 ? NO_NODE : start, stop < 0 ? NO_NODE : stop);
+}
+
+void CompactPathFinder::solve(unsigned start_id, unsigned stop_id) {
+    solve_ids(start_id < map->size() ? map->from_map_id(start_id) : NO_NODE,
+              stop_id < map->size() ? map->from_map_id(stop_id) : NO_NODE);
+}
+
+void CompactPathFinder::solve_ids(uint32_t start, uint32_t stop) {
+    drive_mission.clear();
+    route.clear();
+    distance = UINT_MAX;
+
+    if (start >= map->size() || stop >= map->size()) {
+        Logger::log(WARNING, __FILE__, "solve", "Unknown start or stop node");
+        return;
+    }
+    shortest_paths(*map, start, stop, weights, parents, queue);
+    if (weights[stop] == UINT_MAX) {
+        Logger::log(WARNING, __FILE__, "solve", "No route to stop node");
+        return;
+    }
+
+    distance = weights[stop];
+    for (uint32_t node = stop; node != NO_NODE; node = parents[node]) {
+        route.push_back(node);
+    }
+    reverse(route.begin(), route.end());
+
+    drive_mission = route_instructions(*map, route);
+}
+
+vector<string> CompactPathFinder::get_route() const {
+    vector<string> names{};
+    for (uint32_t node : route) {
+        names.push_back(map->get_name(node));
+    }
+    return names;
+}
@@ -0,0 +1,145 @@
+/*
+ * Read-only map for boards with little memory, built from a MapGraph.
+ *
+ * Every node is a few bytes in one byte string: the edge targets as varint
+ * encoded differences to the node's own id (small, since MapGraph orders
+ * nodes for locality) followed by the edge weights in 1, 2 or 4 bytes,
+ * whichever fits the largest weight of the map. An offset every
+ * COMPACT_BLOCK_SIZE nodes allows jumping to any node without decoding the
+ * rest of the graph.
+ *
+ * Names are sorted and front coded (shared prefix length with the previous
+ * name + the rest) in blocks of COMPACT_BLOCK_SIZE names. The tables
+ * between ids and sorted name positions, and between ids and map ids, are
+ * bit packed.
+ *
+ * Ids, map ids and the version are the same as in the MapGraph it was
+ * built from. Route on it with CompactPathFinder.
+ */
+
+#ifndef COMPACT_MAP_GRAPH_H
+#define COMPACT_MAP_GRAPH_H
+
+#include "raspi_common.h"
+#include "map_graph.h"
+
+#include <climits>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#define COMPACT_BLOCK_SIZE 16
+
+/* Fixed width unsigned integers, bits wide each. */
+class PackedArray {
+public:
+    PackedArray() = default;
+    PackedArray(std::vector<uint32_t> const &values);
+
+    uint32_t operator[](size_t i) const {
+        size_t bit = i * bits;
+        uint64_t value = words[bit / 64] >> (bit % 64);
+        if (bit % 64 + bits > 64)
+            value |= words[bit / 64 + 1] << (64 - bit % 64);
+        return value & mask;
+    }
+    bool empty() const {
+        return words.empty();
+    }
+    size_t get_memory_usage() const {
+        return words.capacity() * sizeof(uint64_t);
+    }
+
+private:
+    unsigned bits{0};
+    uint64_t mask{0};
+    std::vector<uint64_t> words{};
+};
+
+class CompactMapGraph {
+public:
+    static std::shared_ptr<CompactMapGraph const> from_graph(MapGraph const &graph);
+    static std::shared_ptr<CompactMapGraph const> from_json(json const &m);
+
+    size_t size() const {
+        return count;
+    }
+
+    /* Return -1 for unknown names. */
+    int get_id(std::string const &name) const;
+    std::string get_name(unsigned id) const;
+
+    /* Decode the outgoing edges, left first, and return how many there are. */
+    unsigned get_edges(unsigned id, MapEdge out[2]) const;
+
+    uint32_t get_map_id(unsigned id) const {
+        return map_ids.empty() ? id : map_ids[id];
+    }
+    uint32_t from_map_id(unsigned map_id) const {
+        return internal_ids.empty() ? map_id : internal_ids[map_id];
+    }
+    uint32_t get_version() const {
+        return version;
+    }
+
+    /* Heap usage in bytes. */
+    size_t get_memory_usage() const;
+
+private:
+    CompactMapGraph() = default;
+
+    /* Position in node_data of the node, after skipping from the block start. */
+    uint8_t const *find_node(unsigned id) const;
+
+    /* Decode the name at the start of a name block. */
+    std::string block_name(unsigned block) const;
+
+    size_t count{0};
+    unsigned weight_bytes{1};
+    std::vector<uint8_t> node_data{};
+    std::vector<uint32_t> node_blocks{};
+    std::vector<uint8_t> name_data{};
+    std::vector<uint32_t> name_blocks{};
+    PackedArray sorted_ids{};      // Sorted name position -> id
+    PackedArray name_positions{};  // Id -> sorted name position
+    PackedArray map_ids{};         // Empty if ids are map ids
+    PackedArray internal_ids{};
+    uint32_t version{0};
+};
+
+/* Shortest routes on a CompactMapGraph, like PathFinder::solve(start, stop). */
+class CompactPathFinder {
+public:
+    CompactPathFinder(std::shared_ptr<CompactMapGraph const> map);
+
+    void solve(std::string const &start_node_name, std::string const &stop_node_name);
+
+    /* Same with map ids. */
+    void solve(unsigned start_id, unsigned stop_id);
+
+    std::vector<instruction::InstructionNumber> const &get_drive_mission() const {
+        return drive_mission;
+    }
+    std::vector<std::string> get_route() const;
+
+    /* UINT_MAX if there was no route. */
+    unsigned get_distance() const {
+        return distance;
+    }
+
+private:
+    void solve_ids(uint32_t start, uint32_t stop);
+
+    std::shared_ptr<CompactMapGraph const> map;
+
+    std::vector<unsigned> weights{};
+    std::vector<uint32_t> parents{};
+    std::vector<std::pair<unsigned, uint32_t>> queue{};
+
+    std::vector<uint32_t> route{};
+    std::vector<instruction::InstructionNumber> drive_mission{};
+    unsigned distance{UINT_MAX};
+};
+
+#endif // COMPACT_MAP_GRAPH_H
@@ -9,3 +9,9 @@
 
 #define EXPECTED_ANGLE_THESHOLD 20
 
+
+#define ETA_SCALE_SMOOTHING 0.25     // Per road segment driven
+#define ETA_SPEED_SMOOTHING 0.05     // Per cycle
+
+#define DROPOUT_HORIZON_MS 500       // Longest image dropout bridged
+#define DROPOUT_RATE_SMOOTHING 0.5   // Per good frame
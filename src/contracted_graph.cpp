@@ -0,0 +1,88 @@
+#include "contracted_graph.h"
+
+#include <vector>
+
+using namespace std;
+
+ContractedGraph::ContractedGraph(MapGraph const &graph) {
+    // Chain nodes have one edge in and one out, everything else is core
+    size_t count = graph.size();
+    vector<bool> core(count);
+    for (uint32_t id{0}; id < count; ++id) {
+        core[id] = graph.get_degree(id) != 1 || graph.get_in_degree(id) != 1;
+    }
+    vector<bool> reached(count, false);
+    auto walk = [&] (uint32_t id) {
+        for (MapEdge edge : {graph.get_left(id), graph.get_right(id)}) {
+            for (uint32_t node = edge.node; node != NO_NODE && !core[node] && !reached[node];
+                 node = graph.get_left(node).node) {
+                reached[node] = true;
+            }
+        }
+    };
+    for (uint32_t id{0}; id < count; ++id) {
+        if (core[id])
+            walk(id);
+    }
+    for (uint32_t id{0}; id < count; ++id) {
+        if (!core[id] && !reached[id]) {
+            // A cycle without a way in or out
+            core[id] = true;
+            walk(id);
+        }
+    }
+
+    cores.assign(count, NO_NODE);
+    for (uint32_t id{0}; id < count; ++id) {
+        if (core[id]) {
+            cores[id] = nodes.size();
+            nodes.push_back(id);
+        }
+    }
+
+    // Follow every edge out of a core node to the next core node
+    positions.assign(count, ChainPosition{});
+    edges.assign(2 * nodes.size(), MapEdge{});
+    chain_first.reserve(2 * nodes.size() + 1);
+    chain_first.push_back(0);
+    for (uint32_t c{0}; c < nodes.size(); ++c) {
+        for (uint32_t side{0}; side < 2; ++side) {
+            MapEdge edge = side == 0 ? graph.get_left(nodes[c]) : graph.get_right(nodes[c]);
+            if (edge.node != NO_NODE) {
+                uint32_t weight = edge.weight;
+                uint32_t node = edge.node;
+                for (uint32_t index{0}; !core[node]; ++index) {
+                    positions[node] = ChainPosition{2 * c + side, index, weight};
+                    chain_nodes.push_back(node);
+                    chain_offsets.push_back(weight);
+                    MapEdge next = graph.get_left(node);
+                    weight += next.weight;
+                    node = next.node;
+                }
+                edges[2 * c + side] = MapEdge{cores[node], weight};
+            }
+            chain_first.push_back(chain_nodes.size());
+        }
+    }
+}
+
+void ContractedGraph::unpack(unsigned from, unsigned to, vector<uint32_t> &route) const {
+    // Parallel edges to the same core node: the search took the cheaper one
+    unsigned edge = 2 * from;
+    if (edges[edge].node != to
+            || (edges[edge + 1].node == to && edges[edge + 1].weight < edges[edge].weight))
+        ++edge;
+    unpack_edge(edge, route);
+}
+
+void ContractedGraph::unpack_edge(unsigned edge, vector<uint32_t> &route) const {
+    route.push_back(nodes[edge / 2]);
+    route.insert(route.end(), get_chain(edge), get_chain(edge) + get_chain_length(edge));
+}
+
+size_t ContractedGraph::get_memory_usage() const {
+    return sizeof(*this) + edges.capacity() * sizeof(MapEdge)
+         + positions.capacity() * sizeof(ChainPosition)
+         + (nodes.capacity() + cores.capacity() + chain_first.capacity() + chain_nodes.capacity()
+            + chain_offsets.capacity()) * sizeof(uint32_t);
+}
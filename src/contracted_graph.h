@@ -0,0 +1,102 @@
+/*
+ * A MapGraph with its single-successor chains collapsed, built once when
+ * the map is loaded (see MapGraph::get_contracted()).
+ *
+ * Most nodes of our maps have one edge in and one edge out (A1->K1->J1).
+ * A search passing them makes no decision, so only the other nodes, the
+ * core nodes, are kept. Every edge out of a core node is extended through
+ * the chain behind it to the next core node, with the summed weight. The
+ * chain nodes are kept in order as the unpacking record of that edge, so
+ * a route of core nodes can be expanded to every node of the map again.
+ *
+ * Core nodes are numbered from 0 in MapGraph order; the graph has size()
+ * and get_edges() like MapGraph and can be searched with graph_search.h.
+ * A cycle of nothing but chain nodes keeps one of them as core node.
+ */
+
+#ifndef CONTRACTED_GRAPH_H
+#define CONTRACTED_GRAPH_H
+
+#include "map_graph.h"
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+class ContractedGraph {
+public:
+    ContractedGraph(MapGraph const &graph);
+
+    ContractedGraph(ContractedGraph const&) = delete;
+    ContractedGraph operator=(ContractedGraph const&) = delete;
+
+    /* Number of core nodes. */
+    size_t size() const {
+        return nodes.size();
+    }
+
+    /* Edges to the next core nodes, left first, with the weight of the
+     * whole chain. */
+    unsigned get_edges(unsigned core, MapEdge out[2]) const {
+        out[0] = edges[2 * core];
+        out[1] = edges[2 * core + 1];
+        return (out[0].node != NO_NODE) + (out[1].node != NO_NODE);
+    }
+
+    /* MapGraph id of a core node, and the core node of a MapGraph id
+     * (NO_NODE for chain nodes). */
+    uint32_t get_node(unsigned core) const {
+        return nodes[core];
+    }
+    uint32_t get_core(unsigned id) const {
+        return cores[id];
+    }
+
+    /* Where a chain node is: on the edge (2 * core + side) out of a core
+     * node, at index of its chain, offset from that core node. */
+    struct ChainPosition {
+        uint32_t edge{NO_NODE};
+        uint32_t index{0};
+        uint32_t offset{0};
+    };
+    ChainPosition get_position(unsigned id) const {
+        return positions[id];
+    }
+
+    /* Chain nodes of the edge (2 * core + side), MapGraph ids in driving
+     * order, and the distance from the core node to each of them. */
+    uint32_t const *get_chain(unsigned edge) const {
+        return chain_nodes.data() + chain_first[edge];
+    }
+    uint32_t const *get_chain_offsets(unsigned edge) const {
+        return chain_offsets.data() + chain_first[edge];
+    }
+    unsigned get_chain_length(unsigned edge) const {
+        return chain_first[edge + 1] - chain_first[edge];
+    }
+    MapEdge get_edge(unsigned edge) const {
+        return edges[edge];
+    }
+
+    /* Append the MapGraph ids from core node `from` up to, but not
+     * including, core node `to` along the cheapest edge between them. */
+    void unpack(unsigned from, unsigned to, std::vector<uint32_t> &route) const;
+
+    /* Same along the edge (2 * core + side), for searches with other
+     * weights. */
+    void unpack_edge(unsigned edge, std::vector<uint32_t> &route) const;
+
+    /* Approximate heap usage in bytes. */
+    size_t get_memory_usage() const;
+
+private:
+    std::vector<uint32_t> nodes{};
+    std::vector<uint32_t> cores{};
+    std::vector<MapEdge> edges{};
+    std::vector<uint32_t> chain_first{};  // 2 * size() + 1 entries
+    std::vector<uint32_t> chain_nodes{};
+    std::vector<uint32_t> chain_offsets{};
+    std::vector<ChainPosition> positions{};
+};
+
+#endif // CONTRACTED_GRAPH_H
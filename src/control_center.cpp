@@ -2,6 +2,10 @@
 #include "map_node.h"
 #include "log.h"
 
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iterator>
 #include <list>
 #include <vector>
 #include <string>
@@ -14,32 +18,69 @@ ControlCenter::ControlCenter(size_t obstacle_distance_filter_len,
                              int consecutive_param,
                              int high_count_param,
                              unsigned status_code_threshold)
-: obstacle_distance_filter{obstacle_distance_filter_len, 100},
-  stop_distance_filter{stop_distance_filter_len, 0},
+: status_code_threshold{status_code_threshold},
   stop_line_detector{consecutive_param, high_count_param},
-  status_code_threshold{status_code_threshold} {
+  obstacle_distance_filter{obstacle_distance_filter_len, 100},
+  stop_distance_filter{stop_distance_filter_len, 0} {
     Logger::log(INFO, __FILE__, "ControlCenter", "Initialize ControlCenter");
 }
 
 void ControlCenter::update_map(json m) {
-    path_finder.update_map(m);
+    mission_data->path_finder.update_map(m);
+    if (mission_data->detours)
+        precompute_detours();
+}
+
+void ControlCenter::set_map(shared_ptr<MapGraph const> map) {
+    mission_data->path_finder.set_map(map);
+    if (mission_data->detours)
+        precompute_detours();
+}
+
+shared_ptr<MapGraph const> ControlCenter::get_map() const {
+    return mission_data->path_finder.get_map();
+}
+
+void ControlCenter::instructions_changed() {
+    list<drive_instruction_t> const &instructions = mission_data->drive_instructions;
+    instruction_count = instructions.size();
+    next_instruction = instructions.empty() ? instruction::forward : instructions.front().number;
+    // The next intersection may be another one
+    release_slot();
+    slot_requested = false;
+    slot_start_ms = -1;
+    speed_limit = DEFAULT_SPEED;
 }
 
 void ControlCenter::add_drive_instruction(drive_instruction_t drive_instruction) {
-    drive_instructions.push_back(drive_instruction);
+    mission_data->drive_instructions.push_back(drive_instruction);
+    instructions_changed();
+    mission_changed = true;
 }
 
 void ControlCenter::add_drive_instruction(instruction::InstructionNumber instruction, string id) {
     drive_instruction_t drive_instruction{};
     drive_instruction.number = instruction;
     drive_instruction.id = id;
-    drive_instructions.push_back(drive_instruction);
+    mission_data->drive_instructions.push_back(drive_instruction);
+    instructions_changed();
+    mission_changed = true;
 }
 
 control_t ControlCenter::operator()(
         int obstacle_distance, int stop_distance, int speed,
         int angle_left, int angle_right, int lateral_left, int lateral_right,
         int image_processing_status_code) {
+    chrono::steady_clock::time_point cycle_start{};
+    if (metrics) {
+        // Time since the last cycle was spent in the state it left
+        cycle_start = chrono::steady_clock::now();
+        if (metrics->last_cycle != chrono::steady_clock::time_point{})
+            metrics->state_time[state]->add(chrono::duration_cast<chrono::nanoseconds>(
+                    cycle_start - metrics->last_cycle).count());
+        metrics->last_cycle = cycle_start;
+    }
+
     stringstream ss;
     ss << "obstacle_distance=" << obstacle_distance
        << ", stop_distance=" << stop_distance
@@ -55,6 +96,29 @@ control_t ControlCenter::operator()(
     if (obstacle_distance == 0)
         obstacle_distance = 1000;
 
+    if (dropouts) {
+        image_proc_t image{};
+        image.angle_left = angle_left;
+        image.angle_right = angle_right;
+        image.lateral_left = lateral_left;
+        image.lateral_right = lateral_right;
+        image.stop_distance = stop_distance;
+        int64_t now_ms = chrono::duration_cast<chrono::milliseconds>(
+                chrono::steady_clock::now().time_since_epoch()).count();
+        if (image_processing_status_code == 0) {
+            dropouts->update(image, now_ms);
+        } else if (dropouts->predict(image, speed, now_ms)) {
+            // Carry on with the prediction as if the frame was good
+            angle_left = image.angle_left;
+            angle_right = image.angle_right;
+            lateral_left = image.lateral_left;
+            lateral_right = image.lateral_right;
+            stop_distance = image.stop_distance;
+            image_processing_status_code = 0;
+            Logger::log(DEBUG, __FILE__, "Image dropout", "Bridged with predicted values");
+        }
+    }
+
     obstacle_distance = obstacle_distance_filter(obstacle_distance);
     stop_distance = stop_distance_filter(stop_distance);
     ss.str("");
@@ -63,6 +127,10 @@ control_t ControlCenter::operator()(
     Logger::log(DEBUG, __FILE__, "Filtered values", ss.str());
 
     update_state(obstacle_distance, stop_distance, speed);
+    if (reserve_slots)
+        update_reservation(stop_distance, speed);
+    if (eta_enabled)
+        update_eta(speed);
 
     choose_regulation_mode(&control_data, image_processing_status_code);
     control_data.angle = calculate_angle(angle_left, angle_right);
@@ -77,13 +145,62 @@ control_t ControlCenter::operator()(
        << ", drive mode=" << control_data.regulation_mode;
     Logger::log(DEBUG, __FILE__, "done", ss.str());
 
+    if (telemetry)
+        publish_cycle(obstacle_distance, stop_distance, speed, control_data);
+    if ((mission_changed || progress_changed) && checkpoint)
+        save_checkpoint();
+    if (metrics) {
+        long cycle_ns = chrono::duration_cast<chrono::nanoseconds>(
+                chrono::steady_clock::now() - cycle_start).count();
+        metrics->cycle_time->observe(cycle_ns);
+        if (cycle_ns > metrics->cycle_budget_ns)
+            metrics->overruns->add();
+        metrics->state->set(state);
+        metrics->instructions_left->set(instruction_count);
+    }
+
     return control_data;
 }
 
-void ControlCenter::update_state(int obstacle_distance, int stop_distance, int speed) {
-    drive_instruction_t intr{};
+control_t ControlCenter::operator()(InputChannelConsumer &inputs) {
+    // Only the newest data of each kind matters, older records are skipped
+    while (InputRecord const *record = inputs.peek()) {
+        InputRecord copy = *record;
+        if (!inputs.release())
+            continue;  // Dropped by the producer while we read it
+        if (copy.kind == input::sensor) {
+            input_sensor_data = copy.sensor;
+        } else {
+            input_image_data = copy.image;
+        }
+    }
+    return (*this)(input_sensor_data, input_image_data);
+}
 
-    if (drive_instructions.empty()) {
+void ControlCenter::publish_telemetry(string shm_name, uint32_t capacity) {
+    telemetry.reset(new TelemetryPublisher{shm_name, capacity});
+}
+
+void ControlCenter::publish_cycle(int obstacle_distance, int stop_distance, int speed,
+                                  control_t const &control_data) {
+    TelemetryRecord record{};
+    record.timestamp_ns = chrono::duration_cast<chrono::nanoseconds>(
+            chrono::steady_clock::now().time_since_epoch()).count();
+    record.state = state;
+    record.instruction = instruction_count == 0 ? -1 : next_instruction;
+    if (!mission_data->road_segments.empty()) {
+        strncpy(record.road_segment, mission_data->road_segments.front().c_str(),
+                TELEMETRY_SEGMENT_LEN - 1);
+    }
+    record.obstacle_distance = obstacle_distance;
+    record.stop_distance = stop_distance;
+    record.speed = speed;
+    record.control = control_data;
+    telemetry->publish(record);
+}
+
+void ControlCenter::update_state(int obstacle_distance, int stop_distance, int speed) {
+    if (instruction_count == 0) {
         // No instruction
         if (state != state::stop_line) {
             Logger::log(ERROR, __FILE__, "Update state", "No instruction but state not stop_line");
@@ -95,8 +212,6 @@ void ControlCenter::update_state(int obstacle_distance, int stop_distance, int s
             state = state::stop_line;
         }
         return;
-    } else {
-        intr = drive_instructions.front();
     }
 
     switch (state) {
@@ -104,11 +219,13 @@ void ControlCenter::update_state(int obstacle_distance, int stop_distance, int s
         case state::intersection:
             if (path_blocked(obstacle_distance)) {
                 Logger::log(INFO, __FILE__, "Update state", "Path blocked, stopping");
+                if (metrics)
+                    metrics->blocked->add();
                 state = state::stopping;
                 stop_reason = state::blocked;
             } else if (stop_line_detector.at_line(stop_distance)) {
                 // At node
-                if (drive_instructions.size() > 1) {
+                if (instruction_count > 1) {
                     finish_instruction();
                     set_new_state(speed);
                 } else {
@@ -127,9 +244,11 @@ void ControlCenter::update_state(int obstacle_distance, int stop_distance, int s
             if (path_blocked(obstacle_distance)) {
                 state = state::blocked;
                 Logger::log(INFO, __FILE__, "Update state", "Path blocked");
+                if (metrics)
+                    metrics->blocked->add();
                 break;
             }
-            if (drive_instructions.front().number == instruction::stop) {
+            if (next_instruction == instruction::stop) {
                 finish_instruction();
             }
             if (stop_line_detector.at_line(stop_distance)) {
@@ -166,11 +285,11 @@ void ControlCenter::set_new_state(int speed) {
     enum instruction::InstructionNumber instr{};
     enum state::ControlState new_state{};
     string state_name{};
-    if (drive_instructions.empty()) {
+    if (instruction_count == 0) {
         // No instruction
         instr = instruction::stop;
     } else {
-        instr = drive_instructions.front().number;
+        instr = next_instruction;
     }
     switch (instr) {
         case instruction::forward:
@@ -204,43 +323,93 @@ void ControlCenter::set_new_state(int speed) {
 }
 
 void ControlCenter::finish_instruction() {
-    Logger::log(INFO, __FILE__, "ControlCenter", "Finishing instruction");
-    string id = drive_instructions.front().id;
-    drive_instructions.pop_front();
-    if (!road_segments.empty())
-        road_segments.pop_front();
-    finished_id_buffer.push_back(id);
+    string id = mission_data->drive_instructions.front().id;
+    Logger::log(INFO, __FILE__, "ControlCenter", "Finishing instruction " + id);
+    mission_data->drive_instructions.pop_front();
+    instructions_changed();
+    ++instructions_done;
+    if (eta_enabled) {
+        // Learn how far a unit of speed goes from the segment just driven
+        if (segment_length > 0 && segment_driven > 0)
+            eta_scale += ETA_SCALE_SMOOTHING * (segment_length / segment_driven - eta_scale);
+        vector<double> const &ends = mission_data->instruction_ends;
+        size_t first = ++mission_data->eta_first;
+        segment_length = first < ends.size() ? ends[first] - ends[first - 1] : 0;
+        segment_driven = 0;
+    }
+    if (mission_data->detours)
+        mission_data->detours->advance();
+    if (!mission_data->road_segments.empty()) {
+        mission_data->road_segments.pop_front();
+        ++segments_done;
+        if (mission_data->occupancy)
+            mission_data->occupancy->advance(mission_data->occupancy_vehicle_id);
+    }
+    mission_data->finished_id_buffer.push_back(id);
+    progress_changed = true;
+    if (metrics)
+        metrics->instructions->add();
 }
 
 string ControlCenter::get_current_road_segment() {
-    if (road_segments.empty()) {
+    if (mission_data->road_segments.empty()) {
         return "end";
     } else {
-        return road_segments.front();
+        return mission_data->road_segments.front();
     }
 }
 
 drive_instruction_t ControlCenter::get_current_drive_instruction() {
-    return drive_instructions.front();
+    return mission_data->drive_instructions.front();
+}
+
+void ControlCenter::use_planner(string socket_path, unsigned timeout_ms) {
+    mission_data->planner.reset(new PlannerClient{socket_path, timeout_ms});
 }
 
 void ControlCenter::set_drive_missions(list<string> target_list) {
+    auto begin = chrono::steady_clock::now();
     string start_node = target_list.front();
     target_list.pop_front();
 
     // Reset position
-    drive_instructions.clear();
-    road_segments.clear();
+    clear_route();
+
+    // Ask the planner daemon for all legs at once
+    vector<PlannerReply> replies{};
+    // Replies are planner::no_planner while the daemon is away
+    if (mission_data->planner) {
+        vector<PlannerQuery> queries{};
+        string leg_start = start_node;
+        for (string target_node : target_list) {
+            PlannerQuery query{};
+            query.start = leg_start;
+            query.stop = target_node;
+            queries.push_back(query);
+            leg_start = target_node;
+        }
+        replies = mission_data->planner->query(queries);
+    }
 
+    auto reply = replies.begin();
     for (string target_node : target_list) {
         // Stop instruction between missions
         add_drive_instruction(instruction::stop, start_node);
-        road_segments.push_back(start_node);
+        mission_data->road_segments.push_back(start_node);
 
         // Solve
-        path_finder.solve(start_node, target_node);
-        vector<instruction::InstructionNumber> new_instructions = path_finder.get_drive_mission();
-        list<string> new_segments = path_finder.get_road_segments();
+        vector<instruction::InstructionNumber> new_instructions{};
+        list<string> new_segments{};
+        if (reply != replies.end() && reply->status != planner::no_planner
+                && reply->status != planner::too_long) {
+            new_instructions = reply->instructions;
+            vector<string> segments = reply->get_road_segments();
+            new_segments.assign(segments.begin(), segments.end());
+        } else {
+            mission_data->path_finder.solve(start_node, target_node);
+            new_instructions = mission_data->path_finder.get_drive_mission();
+            new_segments = mission_data->path_finder.get_road_segments();
+        }
 
         // Save path
         auto inst_itr = new_instructions.begin();
@@ -250,19 +419,455 @@ void ControlCenter::set_drive_missions(list<string> target_list) {
             ++inst_itr;
             ++segm_itr;
         }
-        road_segments.splice(road_segments.end(), new_segments);
+        mission_data->road_segments.splice(mission_data->road_segments.end(), new_segments);
+
+        start_node = target_node;
+        if (reply != replies.end())
+            ++reply;
+    }
+    mission_planned();
+    if (checkpoint)
+        save_checkpoint();
+    observe_solve(begin);
+}
+
+bool ControlCenter::set_drive_missions(string road_segment, unsigned offset,
+                                       list<string> target_list) {
+    auto begin = chrono::steady_clock::now();
+
+    // Solve everything before the route being driven is touched
+    list<drive_instruction_t> instructions{};
+    list<string> segments{};
+    string start_node{};
+    for (string target_node : target_list) {
+        if (start_node.empty()) {
+            mission_data->path_finder.solve_from_segment(road_segment, offset, target_node);
+        } else {
+            // Stop instruction between missions
+            instructions.push_back(drive_instruction_t{instruction::stop, start_node});
+            segments.push_back(start_node);
+            mission_data->path_finder.solve(start_node, target_node);
+        }
+        if (mission_data->path_finder.get_distance() == UINT_MAX) {
+            Logger::log(WARNING, __FILE__, "set_drive_missions",
+                        "No route from " + road_segment + " to " + target_node + ", missions kept");
+            return false;
+        }
+        vector<instruction::InstructionNumber> new_instructions =
+                mission_data->path_finder.get_drive_mission();
+        list<string> new_segments = mission_data->path_finder.get_road_segments();
+
+        // Save path
+        auto inst_itr = new_instructions.begin();
+        auto segm_itr = new_segments.begin();
+        while (inst_itr != new_instructions.end()) {
+            instructions.push_back(drive_instruction_t{*inst_itr, *segm_itr});
+            ++inst_itr;
+            ++segm_itr;
+        }
+        segments.splice(segments.end(), new_segments);
 
         start_node = target_node;
     }
+
+    // Replace the route, the state stays since the vehicle keeps driving
+    clear_route();
+    mission_data->drive_instructions.swap(instructions);
+    mission_data->road_segments.swap(segments);
+    instructions_changed();
+    mission_planned(offset);
+    if (checkpoint)
+        save_checkpoint();
+    observe_solve(begin);
+    return true;
+}
+
+mission::Status ControlCenter::set_drive_missions(uint8_t const *message, size_t size) {
+    auto begin = chrono::steady_clock::now();
+    MissionView missions{};
+    PathFinder const &path_finder = mission_data->path_finder;
+    mission::Status status = missions.decode(message, size, path_finder.get_map_version(),
+                                             path_finder.get_node_count());
+    if (status != mission::ok) {
+        Logger::log(WARNING, __FILE__, "set_drive_missions", "Rejected mission message");
+        return status;
+    }
+
+    // Reset position
+    clear_route();
+
+    for (size_t i{0}; i < missions.size(); ++i) {
+        unsigned node = missions.get_node(i);
+        bool last = i + 1 == missions.size();
+
+        // Stop at the target unless we just pass it
+        if (last || !(missions.get_flags(i) & mission::pass_through)) {
+            add_drive_instruction(instruction::stop, to_string(missions.get_mission_id(i)));
+            mission_data->road_segments.push_back(mission_data->path_finder.get_node_name(node));
+        }
+        if (last)
+            break;
+
+        // Solve
+        mission_data->path_finder.solve(node, missions.get_node(i + 1));
+        vector<instruction::InstructionNumber> new_instructions =
+                mission_data->path_finder.get_drive_mission();
+        list<string> new_segments = mission_data->path_finder.get_road_segments();
+
+        // Save path
+        auto inst_itr = new_instructions.begin();
+        auto segm_itr = new_segments.begin();
+        while (inst_itr != new_instructions.end()) {
+            add_drive_instruction(*inst_itr, *segm_itr);
+            ++inst_itr;
+            ++segm_itr;
+        }
+        mission_data->road_segments.splice(mission_data->road_segments.end(), new_segments);
+    }
+    mission_planned();
+    if (checkpoint)
+        save_checkpoint();
+    observe_solve(begin);
+    return mission::ok;
+}
+
+void ControlCenter::record_metrics(MetricsRegistry &registry, long cycle_budget_us) {
+    metrics.reset(new Metrics{});
+    char const *state_names[]{"normal", "intersection", "stopping", "blocked", "stop_line", "waiting"};
+    for (int s{0}; s <= state::waiting; ++s) {
+        metrics->state_time[s] = &registry.counter("control_center_state_seconds_total",
+                                                   "Time spent in each control state",
+                                                   string("state=\"") + state_names[s] + "\"", 1e-9);
+    }
+    metrics->blocked = &registry.counter("control_center_blocked_total",
+                                         "Times the path was blocked by an obstacle");
+    metrics->instructions = &registry.counter("control_center_instructions_finished_total",
+                                              "Drive instructions finished");
+    metrics->overruns = &registry.counter("control_center_cycle_overruns_total",
+                                          "Cycles that took longer than the cycle budget");
+    metrics->cycle_time = &registry.histogram("control_center_cycle_seconds",
+                                              "Time to run one control cycle",
+                                              {10000, 50000, 100000, 500000, 1000000, 5000000, 10000000},
+                                              "", 1e-9);
+    metrics->solve_time = &registry.histogram("control_center_solve_seconds",
+                                              "Time to plan a set of drive missions",
+                                              {10000, 100000, 1000000, 10000000, 100000000, 1000000000},
+                                              "", 1e-9);
+    metrics->state = &registry.gauge("control_center_state", "Current control state as a number");
+    metrics->instructions_left = &registry.gauge("control_center_instructions_left",
+                                                 "Drive instructions not yet finished");
+    metrics->cycle_budget_ns = cycle_budget_us * 1000;
+}
+
+void ControlCenter::observe_solve(chrono::steady_clock::time_point begin) {
+    if (metrics)
+        metrics->solve_time->observe(chrono::duration_cast<chrono::nanoseconds>(
+                chrono::steady_clock::now() - begin).count());
+}
+
+void ControlCenter::write_checkpoints(string path) {
+    checkpoint.reset(new CheckpointFile{path});
+    mission_changed = true;
+    save_checkpoint();
+}
+
+bool ControlCenter::restore_checkpoint(string path) {
+    // Later checkpoints go to the same file and continue its sequence
+    checkpoint.reset(new CheckpointFile{path});
+    CheckpointProgress saved{};
+    list<drive_instruction_t> saved_instructions{};
+    list<string> saved_segments{};
+    if (!checkpoint->read(saved, saved_instructions, saved_segments)) {
+        Logger::log(INFO, __FILE__, "restore_checkpoint", "No checkpoint in " + path);
+        return false;
+    }
+    if (saved.map_version != mission_data->path_finder.get_map_version()) {
+        Logger::log(WARNING, __FILE__, "restore_checkpoint", "Checkpoint is for another map");
+        return false;
+    }
+
+    mission_data->drive_instructions.swap(saved_instructions);
+    instructions_changed();
+    mission_data->road_segments.swap(saved_segments);
+    mission_data->finished_id_buffer.clear();
+    for (uint32_t i{0}; i < saved.finished_count && i < CHECKPOINT_MAX_FINISHED; ++i) {
+        mission_data->finished_id_buffer.push_back(
+                string(saved.finished[i], strnlen(saved.finished[i], CHECKPOINT_ID_LEN - 1)));
+    }
+    state = static_cast<state::ControlState>(saved.state);
+    stop_reason = static_cast<state::ControlState>(saved.stop_reason);
+    finish_when_stopped = saved.finish_when_stopped;
+    consecutive_0_status_codes = saved.consecutive_0_status_codes;
+    last_image_status_code = saved.last_image_status_code;
+    last_angle = saved.last_angle;
+    stop_line_detector.set_state(saved.line_detector);
+    mission_changed = true;
+    mission_planned();
+    save_checkpoint();  // The rest of the mission, nothing of it done
+    Logger::log(INFO, __FILE__, "restore_checkpoint", "Restored checkpoint from " + path);
+    return true;
+}
+
+void ControlCenter::save_checkpoint() {
+    CheckpointProgress progress{};
+    progress.map_version = mission_data->path_finder.get_map_version();
+    progress.instructions_done = instructions_done;
+    progress.segments_done = segments_done;
+    progress.state = state;
+    progress.stop_reason = stop_reason;
+    progress.finish_when_stopped = finish_when_stopped;
+    progress.consecutive_0_status_codes = consecutive_0_status_codes;
+    progress.last_image_status_code = last_image_status_code;
+    progress.last_angle = last_angle;
+    progress.line_detector = stop_line_detector.get_state();
+
+    // Keep the newest unreported ids
+    auto id = mission_data->finished_id_buffer.begin();
+    if (mission_data->finished_id_buffer.size() > CHECKPOINT_MAX_FINISHED) {
+        Logger::log(WARNING, __FILE__, "save_checkpoint", "Too many unreported finished ids");
+        advance(id, mission_data->finished_id_buffer.size() - CHECKPOINT_MAX_FINISHED);
+    }
+    for (; id != mission_data->finished_id_buffer.end(); ++id) {
+        strncpy(progress.finished[progress.finished_count++], id->c_str(), CHECKPOINT_ID_LEN - 1);
+    }
+
+    if (mission_changed) {
+        checkpoint->write_mission(mission_data->drive_instructions, mission_data->road_segments, progress);
+    } else {
+        checkpoint->write_progress(progress);
+    }
+    mission_changed = false;
+    progress_changed = false;
+    instructions_done = progress.instructions_done;
+    segments_done = progress.segments_done;
+}
+
+void ControlCenter::use_intersection_manager(shared_ptr<IntersectionManager> manager,
+                                             string vehicle_id) {
+    release_slot();
+    mission_data->intersections = manager;
+    mission_data->vehicle_id = vehicle_id;
+    reserve_slots = manager != nullptr;
+}
+
+void ControlCenter::update_reservation(int stop_distance, int speed) {
+    if ((state != state::normal && state != state::intersection) || instruction_count < 2) {
+        speed_limit = DEFAULT_SPEED;
+        return;
+    }
+    int64_t now_ms = chrono::duration_cast<chrono::milliseconds>(
+            chrono::steady_clock::now().time_since_epoch()).count();
+    if (!slot_requested) {
+        if (stop_distance >= 1000)
+            return;  // No stop line in sight
+        request_slot(stop_distance, speed, now_ms);
+    }
+    if (slot_start_ms <= now_ms) {
+        speed_limit = DEFAULT_SPEED;
+    } else {
+        speed_limit = stop_distance * 1000 / (slot_start_ms - now_ms);
+    }
+}
+
+void ControlCenter::request_slot(int stop_distance, int speed, int64_t now_ms) {
+    slot_requested = true;
+    slot_start_ms = -1;
+
+    // The intersection is at the end of the current segment, e.g. "A1->K1"
+    if (mission_data->road_segments.empty())
+        return;
+    string const &segment = mission_data->road_segments.front();
+    size_t arrow = segment.find("->");
+    instruction::InstructionNumber turn = next(mission_data->drive_instructions.begin())->number;
+    if (arrow == string::npos || turn == instruction::stop)
+        return;
+
+    int64_t eta_ms = now_ms + stop_distance * 1000 / (speed > 0 ? speed : DEFAULT_SPEED);
+    string intersection = segment.substr(arrow + 2);
+    mission_data->intersections->expire(now_ms);
+    IntersectionSlot slot = mission_data->intersections->reserve(
+            mission_data->vehicle_id, intersection, segment.substr(0, arrow), turn, eta_ms);
+    slot_start_ms = slot.start_ms;
+    if (slot.start_ms >= 0)
+        mission_data->slot_intersection = intersection;
+}
+
+void ControlCenter::release_slot() {
+    if (mission_data->slot_intersection.empty())
+        return;
+    if (mission_data->intersections)
+        mission_data->intersections->release(mission_data->vehicle_id, mission_data->slot_intersection);
+    mission_data->slot_intersection.clear();
+}
+
+void ControlCenter::precompute_detours(unsigned lookahead) {
+    mission_data->detours.reset(new DetourPlanner{mission_data->path_finder.get_map(), lookahead});
+    mission_planned();
+}
+
+bool ControlCenter::avoid_segment(string const &road_segment) {
+    if (!mission_data->detours)
+        return false;
+    list<drive_instruction_t> &instructions = mission_data->drive_instructions;
+    list<string> &segments = mission_data->road_segments;
+    if (instructions.size() != segments.size() || segments.size() < 2)
+        return false;
+
+    // The vehicle is on the current segment already, look further ahead
+    auto instruction = instructions.begin();
+    auto segment = segments.begin();
+    size_t ahead{0};
+    do {
+        ++instruction;
+        ++segment;
+        ++ahead;
+    } while (segment != segments.end() && *segment != road_segment);
+    if (segment == segments.end())
+        return false;
+    shared_ptr<Detour const> detour = mission_data->detours->get_detour(ahead);
+    if (!detour || detour->drive_mission.empty()) {
+        Logger::log(INFO, __FILE__, "avoid_segment", "No detour ready around " + road_segment);
+        return false;
+    }
+
+    // Replace the route up to the next stop
+    auto stop_instruction = instruction;
+    auto stop_segment = segment;
+    while (stop_instruction != instructions.end() && stop_instruction->number != instruction::stop) {
+        ++stop_instruction;
+        ++stop_segment;
+    }
+    instructions.erase(instruction, stop_instruction);
+    segments.erase(segment, stop_segment);
+    for (size_t i{0}; i < detour->drive_mission.size(); ++i) {
+        instructions.insert(stop_instruction, drive_instruction_t{detour->drive_mission[i],
+                                                                  detour->road_segments[i]});
+        segments.insert(stop_segment, detour->road_segments[i]);
+    }
+    Logger::log(INFO, __FILE__, "avoid_segment", "Detour around " + road_segment);
+    instructions_changed();
+    mission_changed = true;
+    double driven = segment_driven;
+    mission_planned();
+    segment_driven = driven;  // Still on the same segment
+    return true;
+}
+
+void ControlCenter::share_occupancy(shared_ptr<OccupancyTable> table, string vehicle_id) {
+    if (mission_data->occupancy)
+        mission_data->occupancy->remove_vehicle(mission_data->occupancy_vehicle_id);
+    mission_data->occupancy = table;
+    mission_data->occupancy_vehicle_id = vehicle_id;
+    mission_data->path_finder.set_occupancy(table);
+    mission_planned();
+}
+
+void ControlCenter::clear_route() {
+    mission_data->drive_instructions.clear();
+    mission_data->road_segments.clear();
+    instructions_changed();
+    mission_changed = true;
+    if (mission_data->occupancy)
+        mission_data->occupancy->remove_vehicle(mission_data->occupancy_vehicle_id);
+}
+
+void ControlCenter::mission_planned(unsigned offset) {
+    if (eta_enabled)
+        plan_etas(offset);
+    if (mission_data->occupancy)
+        mission_data->occupancy->set_route(mission_data->occupancy_vehicle_id, mission_data->road_segments);
+    if (mission_data->detours) {
+        list<string> const &segments = mission_data->road_segments;
+        mission_data->detours->set_route(vector<string>(segments.begin(), segments.end()));
+    }
+}
+
+void ControlCenter::bridge_dropouts(unsigned horizon_ms) {
+    dropouts.reset(new DropoutPredictor{horizon_ms});
+}
+
+void ControlCenter::track_eta(double scale) {
+    eta_enabled = true;
+    eta_scale = scale;
+    plan_etas();
+}
+
+void ControlCenter::plan_etas(unsigned offset) {
+    vector<double> &ends = mission_data->instruction_ends;
+    vector<uint32_t> &stops = mission_data->stop_indices;
+    ends.clear();
+    stops.clear();
+    mission_data->eta_first = 0;
+
+    // Instructions added by hand may have no road segment
+    double length{0};
+    auto segment = mission_data->road_segments.begin();
+    for (drive_instruction_t const &instruction : mission_data->drive_instructions) {
+        if (instruction.number == instruction::stop)
+            stops.push_back(ends.size());
+        if (segment != mission_data->road_segments.end()) {
+            unsigned weight = mission_data->path_finder.get_segment_length(*segment);
+            if (weight != UINT_MAX && ends.empty())
+                length += offset < weight ? weight - offset : 0;
+            else if (weight != UINT_MAX)
+                length += weight;
+            ++segment;
+        }
+        ends.push_back(length);
+    }
+    segment_length = ends.empty() ? 0 : ends[0];
+    segment_driven = 0;
+}
+
+void ControlCenter::update_eta(int speed) {
+    chrono::steady_clock::time_point now = chrono::steady_clock::now();
+    if (last_eta_cycle != chrono::steady_clock::time_point{})
+        segment_driven += speed * chrono::duration<double>(now - last_eta_cycle).count();
+    last_eta_cycle = now;
+    if (speed > 0)
+        speed_estimate += ETA_SPEED_SMOOTHING * (speed - speed_estimate);
+
+    // While standing still the estimate moves with the clock
+    double remaining = max(0.0, segment_length - eta_scale * segment_driven);
+    eta_rate = eta_scale * speed_estimate;
+    eta_base = now;
+    if (eta_rate > 0) {
+        eta_base += chrono::duration_cast<chrono::steady_clock::duration>(
+                chrono::duration<double>(remaining / eta_rate));
+    }
+}
+
+chrono::steady_clock::time_point ControlCenter::get_instruction_eta(size_t ahead) const {
+    vector<double> const &ends = mission_data->instruction_ends;
+    size_t first = mission_data->eta_first;
+    if (first + ahead >= ends.size() || eta_rate <= 0)
+        return eta_base;
+    return eta_base + chrono::duration_cast<chrono::steady_clock::duration>(
+            chrono::duration<double>((ends[first + ahead] - ends[first]) / eta_rate));
+}
+
+vector<chrono::steady_clock::time_point> ControlCenter::get_stop_etas() const {
+    vector<chrono::steady_clock::time_point> etas{};
+    for (uint32_t stop : mission_data->stop_indices) {
+        if (stop >= mission_data->eta_first)
+            etas.push_back(get_instruction_eta(stop - mission_data->eta_first));
+    }
+    return etas;
+}
+
+chrono::steady_clock::time_point ControlCenter::get_mission_eta() const {
+    size_t count = mission_data->instruction_ends.size();
+    size_t first = mission_data->eta_first;
+    return get_instruction_eta(count > first ? count - first - 1 : 0);
 }
 
 int ControlCenter::calculate_speed() const {
     switch (state) {
         case state::normal:
-            return DEFAULT_SPEED;
+            return min(DEFAULT_SPEED, speed_limit);
 
         case state::intersection:
-            return INTERSECTION_SPEED;
+            return min(INTERSECTION_SPEED, speed_limit);
 
         case state::stop_line:
         case state::stopping:
@@ -291,7 +896,7 @@ void ControlCenter::choose_regulation_mode(control_t *control_data, int status_c
 }
 
 int ControlCenter::calculate_lateral_position(int lateral_left, int lateral_right) const {
-    instruction::InstructionNumber instr{drive_instructions.front().number};
+    instruction::InstructionNumber instr{current_instruction_number()};
     switch (instr) {
         case instruction::forward:
             return (lateral_left + lateral_right) / 2;
@@ -312,7 +917,7 @@ int ControlCenter::calculate_angle(int angle_left, int angle_right) {
      * bad and the angle changes abruptly. Often only one angle is bad so we
      * then use the other one and hope to recover. */
     int angle{};
-    instruction::InstructionNumber instr{drive_instructions.front().number};
+    instruction::InstructionNumber instr{current_instruction_number()};
     switch (instr) {
         case instruction::forward:
             if (is_expected(angle_left) && is_expected(angle_right)) {
@@ -355,15 +960,17 @@ int ControlCenter::calculate_angle(int angle_left, int angle_right) {
 }
 
 bool ControlCenter::finished_instruction() {
-    return !finished_id_buffer.empty();
+    return !mission_data->finished_id_buffer.empty();
 }
 
 string ControlCenter::get_finished_instruction_id() {
-    if (finished_id_buffer.empty()) {
+    if (mission_data->finished_id_buffer.empty()) {
         return "";
     } else {
-        string id = finished_id_buffer.front();
-        finished_id_buffer.pop_front();
+        string id = mission_data->finished_id_buffer.front();
+        mission_data->finished_id_buffer.pop_front();
+        if (checkpoint)
+            save_checkpoint();
         return id;
     }
 }
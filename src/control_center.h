@@ -7,17 +7,37 @@
 #include "raspi_common.h"
 #include "filter.h"
 #include "line_detector.h"
+#include "planner_client.h"
+#include "telemetry.h"
+#include "input_channel.h"
+#include "mission_message.h"
+#include "checkpoint.h"
+#include "metrics.h"
+#include "intersection_manager.h"
+#include "detour_planner.h"
+#include "dropout_predictor.h"
+#include "occupancy_table.h"
 #include "constants.h"
 
+#include <chrono>
 #include <string>
 #include <list>
+#include <memory>
 #include <vector>
 
 namespace state {
     enum ControlState {normal, intersection, stopping, blocked, stop_line, waiting};
 }
 
-class ControlCenter {
+/* Fields read or written every cycle come first in the object. With
+ * mission_data and the pointers to the optional features a cycle checks
+ * they take the first three of its cache lines (192 bytes on x86-64).
+ * The latest channel input and the ETA state follow, only touched by the
+ * features that use them, then the counters of instruction boundaries.
+ * Missions, road segments, the PathFinder and the rest of the planning
+ * state live in a separate MissionData object that a cycle only touches
+ * at instruction boundaries. */
+class alignas(64) ControlCenter {
 public:
     ControlCenter(
             size_t obstacle_distance_filter_len=1,
@@ -26,8 +46,102 @@ public:
             int high_count_param=0,
             unsigned status_code_threshold=1);
     void update_map(json m);
+
+    /* Use a map shared with other ControlCenters, see map_graph.h. */
+    void set_map(std::shared_ptr<MapGraph const> map);
+    std::shared_ptr<MapGraph const> get_map() const;
     void set_drive_missions(std::list<std::string> target_list);
 
+    /* Replan while driving: the vehicle is offset (in edge weight units)
+     * into road_segment, e.g. "A1->K1". The new missions start on that
+     * segment and replace the old ones at once, without a stop. There is a
+     * stop at every target but the last, like above. Returns false and
+     * keeps the current missions if any target cannot be reached. */
+    bool set_drive_missions(std::string road_segment, unsigned offset,
+                            std::list<std::string> target_list);
+
+    /* Same as above but from a binary mission message (mission_message.h),
+     * solved with the local map. The stop at each target finishes with the
+     * target's mission id (in decimal) as instruction id, and there is a
+     * stop at the last target too. Messages for another map version are
+     * rejected and leave the current missions untouched. */
+    mission::Status set_drive_missions(uint8_t const *message, size_t size);
+
+    /* Plan drive missions with the planner daemon listening on socket_path
+     * instead of the local PathFinder. Falls back to the local PathFinder
+     * if the daemon can not be reached or does not reply within
+     * timeout_ms, and tries the daemon again for later missions. */
+    void use_planner(std::string socket_path, unsigned timeout_ms=PLANNER_TIMEOUT_MS);
+
+    /* Publish a TelemetryRecord every cycle in the shared memory object
+     * shm_name (see telemetry.h). */
+    void publish_telemetry(std::string shm_name, uint32_t capacity=1024);
+
+    /* Keep a checkpoint of the missions and state in the file at path
+     * (see checkpoint.h), updated at every instruction boundary. Starts
+     * over with the current missions, so a restarted process must call
+     * restore_checkpoint() instead, not both. */
+    void write_checkpoints(std::string path);
+
+    /* Continue from the checkpoint in the file at path, if there is one
+     * for the current map, and keep checkpointing to it from there on as
+     * write_checkpoints() does. Call after the map is set and before the
+     * first cycle. Return false if there was nothing to restore. */
+    bool restore_checkpoint(std::string path);
+
+    /* Count time per state, blocked events, finished instructions, cycle
+     * and planning times in registry (see metrics.h), which must outlive
+     * the control center. A cycle that takes longer than cycle_budget_us
+     * counts as an overrun. */
+    void record_metrics(MetricsRegistry &registry, long cycle_budget_us=10000);
+
+    /* Reserve a slot with manager (see intersection_manager.h) when the
+     * stop line before an intersection comes in sight, and slow down to
+     * reach the line when the slot starts. The ETA assumes speed is in
+     * stop distance units per second. vehicle_id names this vehicle to the
+     * manager. */
+    void use_intersection_manager(std::shared_ptr<IntersectionManager> manager,
+                                  std::string vehicle_id);
+
+    /* Report the route to table (see occupancy_table.h), shared with the
+     * other vehicles of the fleet, whenever it is planned and at every
+     * segment driven, and plan around the congestion it shows. vehicle_id
+     * names this vehicle to the table. */
+    void share_occupancy(std::shared_ptr<OccupancyTable> table, std::string vehicle_id);
+
+    /* Compute detours around the segments of the route ahead in the
+     * background (see detour_planner.h), for lookahead instructions. Call
+     * after the map is set. */
+    void precompute_detours(unsigned lookahead=DETOUR_LOOKAHEAD);
+
+    /* road_segment, ahead of the current one, is blocked: drive the
+     * precomputed detour around it to the next stop instead. Return false
+     * if there is no detour (yet), the route is then unchanged. */
+    bool avoid_segment(std::string const &road_segment);
+
+    /* Bridge image processing dropouts (bad status codes) of up to
+     * horizon_ms with values predicted from the last good frames and the
+     * speed (see dropout_predictor.h), and stay in nominal mode while
+     * doing so. Longer dropouts go critical as before. */
+    void bridge_dropouts(unsigned horizon_ms=DROPOUT_HORIZON_MS);
+
+    /* Keep estimates of when the instructions and missions will be done,
+     * updated every cycle from the time on the current road segment, its
+     * length and the measured speed. scale is a first guess of the edge
+     * weight units driven per second and unit of speed, it is then learned
+     * from every road segment driven. */
+    void track_eta(double scale);
+
+    /* When the instruction ahead of the current one (0) will be finished.
+     * The last cycle's time if there is no estimate for it. Constant time. */
+    std::chrono::steady_clock::time_point get_instruction_eta(size_t ahead=0) const;
+
+    /* When each of the stops left will be reached, in mission order. */
+    std::vector<std::chrono::steady_clock::time_point> get_stop_etas() const;
+
+    /* When the last instruction will be finished. */
+    std::chrono::steady_clock::time_point get_mission_eta() const;
+
     void add_drive_instruction(enum instruction::InstructionNumber instr_number, std::string id);
     void add_drive_instruction(drive_instruction_t drive_instruction);
 
@@ -46,6 +160,10 @@ public:
         );
     }
 
+    /* Read every waiting record in the input channel and run one cycle on
+     * the newest sensor and image data. Call after inputs.wait(). */
+    control_t operator()(InputChannelConsumer &inputs);
+
     std::string get_current_road_segment();
 
     drive_instruction_t get_current_drive_instruction();
@@ -73,6 +191,26 @@ private:
         return obstacle_distance <= OBST_DISTANCE_CLOSE;
     }
 
+    /* Ask for a slot at the next intersection once, then keep speed_limit
+     * at the speed that reaches the stop line when the slot starts. */
+    void update_reservation(int stop_distance, int speed);
+    void request_slot(int stop_distance, int speed, int64_t now_ms);
+
+    /* Give back the slot the vehicle holds, if any. */
+    void release_slot();
+
+    /* Drop the old route, also from the occupancy table so that the
+     * vehicle does not plan around itself. */
+    void clear_route();
+
+    /* Missions were replaced, the first one offset into its segment. */
+    void mission_planned(unsigned offset=0);
+
+    /* Lengths of the instructions from the road segments, the first one
+     * offset into its segment. */
+    void plan_etas(unsigned offset=0);
+    void update_eta(int speed);
+
     /* Call after update_state(). */
     int calculate_speed() const;
 
@@ -87,20 +225,95 @@ private:
 
     int calculate_lateral_position(int lateral_left, int lateral_right) const;
 
-    Filter<int> obstacle_distance_filter;
-    Filter<int> stop_distance_filter;
+    /* Steer as if going forward when there are no instructions left. */
+    inline instruction::InstructionNumber current_instruction_number() const {
+        return instruction_count == 0 ? instruction::forward : next_instruction;
+    }
+
+    /* Copy the front of the drive instructions into the hot fields. Call
+     * after every change to mission_data->drive_instructions. */
+    void instructions_changed();
+
+    void publish_cycle(int obstacle_distance, int stop_distance, int speed,
+                       control_t const &control_data);
+
+    /* Write the checkpoint, with the missions if they changed. */
+    void save_checkpoint();
+
+    void observe_solve(std::chrono::steady_clock::time_point begin);
+
+    struct Metrics {
+        MetricsCounter *state_time[state::waiting + 1]{};
+        MetricsCounter *blocked{nullptr};
+        MetricsCounter *instructions{nullptr};
+        MetricsCounter *overruns{nullptr};
+        MetricsHistogram *cycle_time{nullptr};
+        MetricsHistogram *solve_time{nullptr};
+        MetricsGauge *state{nullptr};
+        MetricsGauge *instructions_left{nullptr};
+        long cycle_budget_ns{0};
+        std::chrono::steady_clock::time_point last_cycle{};
+    };
+
+    struct MissionData {
+        std::list<drive_instruction_t> drive_instructions{};
+        std::list<std::string> road_segments{};
+        std::list<std::string> finished_id_buffer{};
+        PathFinder path_finder{};
+        std::unique_ptr<PlannerClient> planner{};
+        std::shared_ptr<IntersectionManager> intersections{};
+        std::string vehicle_id{};            // At the intersection manager
+        std::string occupancy_vehicle_id{};  // In the occupancy table
+        std::string slot_intersection{};  // Where a slot is held, "" if nowhere
+        std::unique_ptr<DetourPlanner> detours{};
+        std::shared_ptr<OccupancyTable> occupancy{};
+
+        // Length of the mission up to the end of each instruction
+        std::vector<double> instruction_ends{};
+        std::vector<uint32_t> stop_indices{};
+        size_t eta_first{0};  // Current instruction in instruction_ends
+    };
+
+    // Every cycle
     enum state::ControlState state{state::stop_line};
     enum state::ControlState stop_reason{state::stop_line};
+    instruction::InstructionNumber next_instruction{instruction::forward};
+    uint32_t instruction_count{0};
     bool finish_when_stopped{false};
-    std::list<drive_instruction_t> drive_instructions{};
-    std::list<std::string> finished_id_buffer{};
-    unsigned consecutive_0_status_codes{INT_MAX};
-    int last_image_status_code{0};
+    bool mission_changed{false};
+    bool progress_changed{false};
+    bool reserve_slots{false};
+    bool slot_requested{false};
+    bool eta_enabled{false};
+    int speed_limit{DEFAULT_SPEED};
+    int64_t slot_start_ms{-1};
     int last_angle{0};
-    std::list<std::string> road_segments{};
-    LineDetector stop_line_detector;
-    PathFinder path_finder{};
+    int last_image_status_code{0};
+    unsigned consecutive_0_status_codes{INT_MAX};
     unsigned status_code_threshold;
+    LineDetector stop_line_detector;
+    Filter<int> obstacle_distance_filter;
+    Filter<int> stop_distance_filter;
+    std::unique_ptr<MissionData> mission_data{new MissionData{}};
+    std::unique_ptr<TelemetryPublisher> telemetry{};
+    std::unique_ptr<Metrics> metrics{};
+    std::unique_ptr<DropoutPredictor> dropouts{};
+    std::unique_ptr<CheckpointFile> checkpoint{};  // Only read when something changed
+
+    // By optional features only
+    sensor_data_t input_sensor_data{};
+    image_proc_t input_image_data{};
+    double eta_scale{0};          // Edge weight per second and unit of speed
+    double speed_estimate{DEFAULT_SPEED};
+    double segment_length{0};     // Of the current instruction
+    double segment_driven{0};     // Speed times seconds on the current one
+    double eta_rate{0};           // Edge weight per second
+    std::chrono::steady_clock::time_point last_eta_cycle{};
+    std::chrono::steady_clock::time_point eta_base{};  // Current instruction done
+
+    // At instruction boundaries and when planning
+    uint32_t instructions_done{0};  // Since the missions were last saved
+    uint32_t segments_done{0};
 };
 
 #endif // CONTROLCENTER_H
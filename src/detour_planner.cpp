@@ -0,0 +1,164 @@
+#include "detour_planner.h"
+#include "graph_search.h"
+#include "log.h"
+
+#include <algorithm>
+#include <mutex>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+namespace {
+    /* A MapGraph without one of its edges. */
+    class AvoidEdgeGraph {
+    public:
+        AvoidEdgeGraph(MapGraph const &graph, uint32_t from, uint32_t to)
+        : graph{graph}, from{from}, to{to} {
+        }
+
+        size_t size() const {
+            return graph.size();
+        }
+        unsigned get_edges(unsigned id, MapEdge out[2]) const {
+            unsigned degree = graph.get_edges(id, out);
+            if (id != from)
+                return degree;
+            unsigned kept{0};
+            for (unsigned i{0}; i < degree; ++i) {
+                if (out[i].node != to)
+                    out[kept++] = out[i];
+            }
+            return kept;
+        }
+
+    private:
+        MapGraph const &graph;
+        uint32_t from;
+        uint32_t to;
+    };
+}
+
+DetourPlanner::DetourPlanner(shared_ptr<MapGraph const> map, unsigned lookahead)
+: map{map}, lookahead{lookahead} {
+    worker = thread{&DetourPlanner::run, this};
+}
+
+DetourPlanner::~DetourPlanner() {
+    {
+        lock_guard<mutex> lock{planner_mutex};
+        stopping = true;
+    }
+    changed.notify_all();
+    worker.join();
+}
+
+void DetourPlanner::set_route(vector<string> road_segments) {
+    // The stop each segment leads to, from the back
+    vector<Segment> new_segments(road_segments.size());
+    uint32_t target{NO_NODE};
+    for (size_t i = road_segments.size(); i-- > 0;) {
+        string const &name = road_segments[i];
+        size_t arrow = name.find("->");
+        if (arrow == string::npos) {
+            int stop = map->get_id(name);
+            target = stop < 0 ? NO_NODE : stop;
+            continue;
+        }
+        int from = map->get_id(name.substr(0, arrow));
+        int to = map->get_id(name.substr(arrow + 2));
+        if (from < 0 || to < 0) {
+            Logger::log(WARNING, __FILE__, "set_route", "Unknown road segment " + name);
+            continue;
+        }
+        if (target == NO_NODE && i + 1 == road_segments.size())
+            target = to;
+        new_segments[i] = Segment{static_cast<uint32_t>(from), static_cast<uint32_t>(to), target};
+    }
+
+    {
+        lock_guard<mutex> lock{planner_mutex};
+        segments.swap(new_segments);
+        detours.assign(segments.size(), nullptr);
+        done.assign(segments.size(), false);
+        position = 0;
+        ++generation;
+    }
+    changed.notify_all();
+}
+
+void DetourPlanner::advance() {
+    {
+        lock_guard<mutex> lock{planner_mutex};
+        if (position < detours.size())
+            detours[position].reset();  // Behind the vehicle now
+        ++position;
+    }
+    changed.notify_all();
+}
+
+shared_ptr<Detour const> DetourPlanner::get_detour(size_t ahead) const {
+    lock_guard<mutex> lock{planner_mutex};
+    size_t index = position + ahead;
+    return index < detours.size() ? detours[index] : nullptr;
+}
+
+void DetourPlanner::wait() const {
+    unique_lock<mutex> lock{planner_mutex};
+    changed.wait(lock, [this] { return !busy && next_job() == segments.size(); });
+}
+
+size_t DetourPlanner::next_job() const {
+    size_t end = min(segments.size(), position + lookahead);
+    for (size_t i = position; i < end; ++i) {
+        if (!done[i])
+            return i;
+    }
+    return segments.size();
+}
+
+void DetourPlanner::run() {
+    unique_lock<mutex> lock{planner_mutex};
+    while (true) {
+        changed.wait(lock, [this] { return stopping || next_job() < segments.size(); });
+        if (stopping)
+            return;
+        size_t index = next_job();
+        Segment segment = segments[index];
+        unsigned long job_generation = generation;
+        busy = true;
+        lock.unlock();
+
+        shared_ptr<Detour const> detour{};
+        if (segment.target != NO_NODE)
+            detour = find_detour(segment);
+
+        lock.lock();
+        busy = false;
+        if (job_generation == generation && index >= position) {
+            detours[index] = detour;
+            done[index] = true;
+        }
+        changed.notify_all();
+    }
+}
+
+shared_ptr<Detour const> DetourPlanner::find_detour(Segment const &segment) {
+    shared_ptr<Detour> detour{new Detour{}};
+    AvoidEdgeGraph graph{*map, segment.from, segment.to};
+    shortest_paths(graph, segment.from, segment.target, weights, parents, queue);
+    if (weights[segment.target] == UINT_MAX)
+        return detour;
+
+    vector<uint32_t> route{};
+    for (uint32_t node = segment.target; node != NO_NODE; node = parents[node]) {
+        route.push_back(node);
+    }
+    reverse(route.begin(), route.end());
+    detour->distance = weights[segment.target];
+    detour->drive_mission = route_instructions(*map, route);
+    for (size_t i{0}; i + 1 < route.size(); ++i) {
+        detour->road_segments.push_back(map->get_name(route[i]) + "->" + map->get_name(route[i + 1]));
+    }
+    return detour;
+}
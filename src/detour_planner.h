@@ -0,0 +1,101 @@
+/*
+ * Detours around blocked road segments, computed in the background before
+ * they are needed.
+ *
+ * For every segment of the route within lookahead instructions of the
+ * vehicle, a worker thread finds the shortest route from the start of the
+ * segment to the next stop of the mission that does not use the segment.
+ * Nearest segments are done first, and the window moves along as the
+ * vehicle finishes instructions. When a segment turns out to be blocked,
+ * switching to its detour only takes the detour that is already there.
+ *
+ * Use: DetourPlanner detours{map};
+ *      detours.set_route({"A1", "A1->K1", "K1->J1", ...});  // One per instruction
+ *      detours.advance();                                 // Instruction finished
+ *      std::shared_ptr<Detour const> detour = detours.get_detour(2);
+ */
+
+#ifndef DETOUR_PLANNER_H
+#define DETOUR_PLANNER_H
+
+#include "raspi_common.h"
+#include "map_graph.h"
+
+#include <climits>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#define DETOUR_LOOKAHEAD 8
+
+struct Detour {
+    // From the start of the avoided segment to the stop, empty if there is
+    // no other way
+    std::vector<std::string> road_segments{};
+    std::vector<instruction::InstructionNumber> drive_mission{};
+    unsigned distance{UINT_MAX};
+};
+
+class DetourPlanner {
+public:
+    DetourPlanner(std::shared_ptr<MapGraph const> map, unsigned lookahead=DETOUR_LOOKAHEAD);
+    ~DetourPlanner();
+
+    DetourPlanner(DetourPlanner const&) = delete;
+    DetourPlanner operator=(DetourPlanner const&) = delete;
+
+    /* A new route: the road segment of every instruction, the current one
+     * first. Entries without "->" are stops, which end the detours of the
+     * segments before them; after the last stop the detours end where the
+     * last segment does. Forgets all detours of the old route. */
+    void set_route(std::vector<std::string> road_segments);
+
+    /* The vehicle finished the current instruction. */
+    void advance();
+
+    /* Detour around the segment of the instruction ahead of the current
+     * one (0), nullptr if it has not been computed yet. */
+    std::shared_ptr<Detour const> get_detour(size_t ahead) const;
+
+    /* Block until every detour within the lookahead is computed. */
+    void wait() const;
+
+private:
+    struct Segment {
+        uint32_t from{NO_NODE};
+        uint32_t to{NO_NODE};
+        uint32_t target{NO_NODE};  // NO_NODE for stops, which have no detour
+    };
+
+    /* Next segment in the window without a detour, segments.size() if
+     * there is none. */
+    size_t next_job() const;
+    void run();
+    std::shared_ptr<Detour const> find_detour(Segment const &segment);
+
+    std::shared_ptr<MapGraph const> map;
+    unsigned lookahead;
+
+    mutable std::mutex planner_mutex{};
+    mutable std::condition_variable changed{};
+    std::vector<Segment> segments{};
+    std::vector<std::shared_ptr<Detour const>> detours{};
+    std::vector<bool> done{};
+    size_t position{0};
+    unsigned long generation{0};  // Results for an older route are dropped
+    bool busy{false};
+    bool stopping{false};
+
+    // Search state of the worker
+    std::vector<unsigned> weights{};
+    std::vector<uint32_t> parents{};
+    std::vector<std::pair<unsigned, uint32_t>> queue{};
+
+    std::thread worker{};
+};
+
+#endif // DETOUR_PLANNER_H
@@ -0,0 +1,53 @@
+#include "dropout_predictor.h"
+
+#include <algorithm>
+
+using namespace std;
+
+DropoutPredictor::DropoutPredictor(unsigned horizon_ms)
+: horizon_ms{horizon_ms} {
+}
+
+void DropoutPredictor::update(image_proc_t const &image, int64_t now_ms) {
+    double const frame[channels]{static_cast<double>(image.angle_left),
+                                 static_cast<double>(image.angle_right),
+                                 static_cast<double>(image.lateral_left),
+                                 static_cast<double>(image.lateral_right)};
+    int64_t elapsed = now_ms - last_ms;
+    for (int i{0}; i < channels; ++i) {
+        if (good_frames > 0 && elapsed > 0) {
+            double rate = (frame[i] - values[i]) / elapsed;
+            rates[i] += (good_frames == 1 ? 1 : DROPOUT_RATE_SMOOTHING) * (rate - rates[i]);
+        }
+        values[i] = frame[i];
+    }
+    stop_distance = image.stop_distance;
+    last_ms = now_ms;
+    ++good_frames;
+}
+
+bool DropoutPredictor::predict(image_proc_t &image, int speed, int64_t now_ms) const {
+    if (good_frames < 2 || get_confidence(now_ms) <= 0)
+        return false;
+
+    // The rates fade out with the confidence, integrated over the dropout
+    double elapsed = max<int64_t>(0, now_ms - last_ms);
+    double moved = elapsed - elapsed * elapsed / (2.0 * horizon_ms);
+    image.angle_left = static_cast<int>(values[angle_left] + rates[angle_left] * moved);
+    image.angle_right = static_cast<int>(values[angle_right] + rates[angle_right] * moved);
+    image.lateral_left = static_cast<int>(values[lateral_left] + rates[lateral_left] * moved);
+    image.lateral_right = static_cast<int>(values[lateral_right] + rates[lateral_right] * moved);
+
+    // No line in sight stays that way, a line in sight comes closer
+    image.stop_distance = stop_distance;
+    if (stop_distance < 1000)
+        image.stop_distance = max(0, static_cast<int>(stop_distance - speed * elapsed / 1000));
+    return true;
+}
+
+double DropoutPredictor::get_confidence(int64_t now_ms) const {
+    if (good_frames == 0 || horizon_ms == 0)
+        return 0;
+    double elapsed = max<int64_t>(0, now_ms - last_ms);
+    return max(0.0, 1 - elapsed / horizon_ms);
+}
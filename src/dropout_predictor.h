@@ -0,0 +1,55 @@
+/*
+ * Stand-in image data for short dropouts of the image processing.
+ *
+ * Every good frame (status code 0) updates the last values and how fast
+ * the angles and lateral positions change. When frames go bad, predict()
+ * extrapolates them from there, and moves the stop line closer by the
+ * distance driven at the measured speed (stop distance units per second,
+ * as for the intersection ETA). The confidence in a prediction falls from
+ * 1 at the last good frame to 0 after horizon_ms, and the extrapolated
+ * rates fade with it, so a prediction never runs far from the last frame.
+ * After the horizon there is no prediction.
+ *
+ * Times are milliseconds on any steady clock.
+ *
+ * Use: DropoutPredictor predictor{};
+ *      predictor.update(image_data, now_ms);         // Good frame
+ *      predictor.predict(image_data, speed, now_ms);  // Bad frame
+ */
+
+#ifndef DROPOUT_PREDICTOR_H
+#define DROPOUT_PREDICTOR_H
+
+#include "raspi_common.h"
+#include "constants.h"
+
+#include <cstdint>
+
+class DropoutPredictor {
+public:
+    DropoutPredictor(unsigned horizon_ms=DROPOUT_HORIZON_MS);
+
+    /* A good frame. */
+    void update(image_proc_t const &image, int64_t now_ms);
+
+    /* Replace angles, lateral positions and stop distance of image with
+     * the predicted ones. Return false, and leave image as it is, if
+     * there is no prediction: before two good frames or after the
+     * horizon. */
+    bool predict(image_proc_t &image, int speed, int64_t now_ms) const;
+
+    /* From 1 at the last good frame down to 0 at the horizon. */
+    double get_confidence(int64_t now_ms) const;
+
+private:
+    enum {angle_left, angle_right, lateral_left, lateral_right, channels};
+
+    unsigned horizon_ms;
+    double values[channels]{};
+    double rates[channels]{};  // Per millisecond
+    int stop_distance{1000};
+    int64_t last_ms{0};
+    unsigned good_frames{0};
+};
+
+#endif // DROPOUT_PREDICTOR_H
@@ -0,0 +1,99 @@
+#include "frontier_argmin.h"
+
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define FRONTIER_AVX2
+#include <immintrin.h>
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#define FRONTIER_NEON
+#include <arm_neon.h>
+#endif
+
+using namespace std;
+
+namespace {
+#ifdef FRONTIER_AVX2
+    __attribute__((target("avx2")))
+    uint32_t argmin_avx2(unsigned const *values, size_t count) {
+        // Smallest value, 8 lanes at a time, then across the lanes
+        __m256i minimum = _mm256_loadu_si256(reinterpret_cast<__m256i const *>(values));
+        for (size_t i{8}; i < count; i += 8) {
+            __m256i block = _mm256_loadu_si256(reinterpret_cast<__m256i const *>(values + i));
+            minimum = _mm256_min_epu32(minimum, block);
+        }
+        __m128i half = _mm_min_epu32(_mm256_castsi256_si128(minimum),
+                                     _mm256_extracti128_si256(minimum, 1));
+        half = _mm_min_epu32(half, _mm_shuffle_epi32(half, 0x4e));
+        half = _mm_min_epu32(half, _mm_shuffle_epi32(half, 0xb1));
+
+        // First block that has it
+        __m256i target = _mm256_broadcastd_epi32(half);
+        for (size_t i{0};; i += 8) {
+            __m256i block = _mm256_loadu_si256(reinterpret_cast<__m256i const *>(values + i));
+            int mask = _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(block, target)));
+            if (mask != 0)
+                return i + __builtin_ctz(mask);
+        }
+    }
+#endif
+
+#ifdef FRONTIER_NEON
+    uint32_t argmin_neon(unsigned const *values, size_t count) {
+        uint32x4_t minimum = vld1q_u32(values);
+        for (size_t i{4}; i < count; i += 4) {
+            minimum = vminq_u32(minimum, vld1q_u32(values + i));
+        }
+        uint32x4_t target = vdupq_n_u32(vminvq_u32(minimum));
+        for (size_t i{0};; i += 4) {
+            uint32x4_t equal = vceqq_u32(vld1q_u32(values + i), target);
+            if (vmaxvq_u32(equal) != 0) {
+                while (values[i] != vgetq_lane_u32(target, 0))
+                    ++i;
+                return i;
+            }
+        }
+    }
+#endif
+
+    struct Choice {
+        FrontierArgmin argmin;
+        char const *kind;
+    };
+
+    Choice choose() {
+#ifdef FRONTIER_AVX2
+        if (__builtin_cpu_supports("avx2"))
+            return Choice{argmin_avx2, "avx2"};
+#endif
+#ifdef FRONTIER_NEON
+        return Choice{argmin_neon, "neon"};
+#endif
+        return Choice{frontier_argmin_scalar, "scalar"};
+    }
+
+    /* Chosen on first use, whatever the order of static initialization. */
+    Choice const &chosen() {
+        static Choice const choice{choose()};
+        return choice;
+    }
+}
+
+FrontierArgmin get_frontier_argmin() {
+    return chosen().argmin;
+}
+
+uint32_t frontier_argmin_scalar(unsigned const *values, size_t count) {
+    // Smallest value first, a loop the compiler can vectorize
+    unsigned best{values[0]};
+    for (size_t i{1}; i < count; ++i) {
+        best = values[i] < best ? values[i] : best;
+    }
+    uint32_t i{0};
+    while (values[i] != best)
+        ++i;
+    return i;
+}
+
+char const *frontier_argmin_kind() {
+    return chosen().kind;
+}
@@ -0,0 +1,32 @@
+/*
+ * Position of the smallest value in a dense array of tentative distances,
+ * the step that picks the next node in dense_shortest_paths()
+ * (graph_search.h).
+ *
+ * Uses AVX2 on x86 processors that have it (checked once at run time, so
+ * the rest of the program needs no -mavx2), NEON on 64 bit ARM, and plain
+ * C++ everywhere else.
+ */
+
+#ifndef FRONTIER_ARGMIN_H
+#define FRONTIER_ARGMIN_H
+
+#include <cstddef>
+#include <cstdint>
+
+/* Index of the first smallest of values[0..count), count must be > 0 and
+ * a multiple of FRONTIER_PADDING. */
+typedef uint32_t (*FrontierArgmin)(unsigned const *values, size_t count);
+
+#define FRONTIER_PADDING 8
+
+/* The fastest one for this processor. */
+FrontierArgmin get_frontier_argmin();
+
+/* Without vector instructions. */
+uint32_t frontier_argmin_scalar(unsigned const *values, size_t count);
+
+/* "avx2", "neon" or "scalar", whichever get_frontier_argmin() returns. */
+char const *frontier_argmin_kind();
+
+#endif // FRONTIER_ARGMIN_H
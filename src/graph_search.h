@@ -0,0 +1,285 @@
+/*
+ * Search algorithms shared by the different map representations. Graph is
+ * any class with size() and get_edges(id, MapEdge edges[2]) returning the
+ * number of outgoing edges, e.g. MapGraph and CompactMapGraph.
+ */
+
+#ifndef GRAPH_SEARCH_H
+#define GRAPH_SEARCH_H
+
+#include "raspi_common.h"
+#include "map_graph.h"
+#include "frontier_argmin.h"
+#include "lane_relax.h"
+
+#include <algorithm>
+#include <climits>
+#include <cstdint>
+#include <functional>
+#include <utility>
+#include <vector>
+
+// Graphs of this many nodes are faster to search with
+// dense_shortest_paths() and a vector argmin, see prefer_dense_search()
+#define DENSE_SEARCH_MIN_NODES 40
+#define DENSE_SEARCH_MAX_NODES 512
+
+typedef std::vector<std::pair<unsigned, uint32_t>> SearchQueue;
+
+struct ReachableNode {
+    uint32_t node;
+    uint32_t distance;
+};
+
+/* Dijkstra from start. Stops when stop is settled, searches the whole map
+ * if stop is NO_NODE. weights (UINT_MAX if unreachable) and parents (NO_NODE
+ * for start) get one entry per node. All weights include start_weight, the
+ * cost of getting to start. */
+template <class Graph>
+void shortest_paths(Graph const &graph, uint32_t start, uint32_t stop,
+                    std::vector<unsigned> &weights, std::vector<uint32_t> &parents,
+                    SearchQueue &queue, unsigned start_weight=0) {
+    weights.assign(graph.size(), UINT_MAX);
+    parents.assign(graph.size(), NO_NODE);
+    queue.clear();
+
+    weights[start] = start_weight;
+    queue.emplace_back(start_weight, start);
+    MapEdge edges[2];
+    while (!queue.empty()) {
+        // Make sure the node with the lowest weight is searched first
+        std::pop_heap(queue.begin(), queue.end(), std::greater<std::pair<unsigned, uint32_t>>());
+        auto [weight, active_node] = queue.back();
+        queue.pop_back();
+        if (weight > weights[active_node])
+            continue;  // Already visited with a lower weight
+        if (active_node == stop)
+            break;
+
+        // Update neighbours' weights if bigger than active nodes weight + edge weight
+        unsigned degree = graph.get_edges(active_node, edges);
+        for (unsigned i{0}; i < degree; ++i) {
+            MapEdge edge = edges[i];
+            if (weight + edge.weight < weights[edge.node]) {
+                weights[edge.node] = weight + edge.weight;
+                parents[edge.node] = active_node;
+                queue.emplace_back(weights[edge.node], edge.node);
+                std::push_heap(queue.begin(), queue.end(), std::greater<std::pair<unsigned, uint32_t>>());
+            }
+        }
+    }
+}
+
+/* Same as shortest_paths(), ties included, without a heap. frontier
+ * holds the tentative weight of every node not yet settled (UINT_MAX for
+ * settled and unreached ones) and each step scans all of it for the
+ * smallest with argmin (see frontier_argmin.h, nullptr for the fastest).
+ * That is size() work per settled node whatever the graph looks like,
+ * less than a heap costs on small graphs. */
+template <class Graph>
+void dense_shortest_paths(Graph const &graph, uint32_t start, uint32_t stop,
+                          std::vector<unsigned> &weights, std::vector<uint32_t> &parents,
+                          std::vector<unsigned> &frontier, unsigned start_weight=0,
+                          FrontierArgmin argmin=nullptr) {
+    if (argmin == nullptr)
+        argmin = get_frontier_argmin();
+    size_t size = graph.size();
+    size_t padded = (size + FRONTIER_PADDING - 1) / FRONTIER_PADDING * FRONTIER_PADDING;
+    weights.assign(size, UINT_MAX);
+    parents.assign(size, NO_NODE);
+    frontier.assign(padded, UINT_MAX);
+
+    weights[start] = start_weight;
+    frontier[start] = start_weight;
+    MapEdge edges[2];
+    while (true) {
+        uint32_t active_node = argmin(frontier.data(), padded);
+        unsigned weight = frontier[active_node];
+        if (weight == UINT_MAX)
+            break;  // Nothing left that can be reached
+        frontier[active_node] = UINT_MAX;
+        if (active_node == stop)
+            break;
+
+        unsigned degree = graph.get_edges(active_node, edges);
+        for (unsigned i{0}; i < degree; ++i) {
+            MapEdge edge = edges[i];
+            if (weight + edge.weight < weights[edge.node]) {
+                weights[edge.node] = weight + edge.weight;
+                parents[edge.node] = active_node;
+                frontier[edge.node] = weights[edge.node];
+            }
+        }
+    }
+}
+
+/* Is dense_shortest_paths() faster than shortest_paths() for a graph of
+ * size nodes on this processor? Below DENSE_SEARCH_MIN_NODES the heap of
+ * shortest_paths() holds a handful of entries and is cheaper than
+ * scanning; without vector instructions the scan never pays. */
+inline bool prefer_dense_search(size_t size) {
+    return size >= DENSE_SEARCH_MIN_NODES && size <= DENSE_SEARCH_MAX_NODES
+            && get_frontier_argmin() != frontier_argmin_scalar;
+}
+
+namespace graph_search_detail {
+    /* multi_source_distances() over edges(node, list), which points list
+     * at the edges to follow out of node and returns how many there are. */
+    template <class Edges>
+    void lane_search(size_t size, uint32_t const *sources, size_t count,
+                     std::vector<unsigned> &distances, std::vector<unsigned> &queued,
+                     SearchQueue &queue, LaneRelax relax, Edges edges) {
+        if (relax == nullptr)
+            relax = get_lane_relax();
+        distances.assign(size * MULTI_SOURCE_LANES, UINT_MAX);
+        queued.assign(size, UINT_MAX);
+        queue.clear();
+        for (size_t i{0}; i < count && i < MULTI_SOURCE_LANES; ++i) {
+            distances[sources[i] * MULTI_SOURCE_LANES + i] = 0;
+            if (queued[sources[i]] != 0) {
+                queued[sources[i]] = 0;
+                queue.emplace_back(0, sources[i]);  // All 0, already a heap
+            }
+        }
+        MapEdge const *list{nullptr};
+        while (!queue.empty()) {
+            std::pop_heap(queue.begin(), queue.end(), std::greater<std::pair<unsigned, uint32_t>>());
+            auto [key, active_node] = queue.back();
+            queue.pop_back();
+            if (key != queued[active_node])
+                continue;  // Queued again with a lower key, or scanned since
+            queued[active_node] = UINT_MAX;
+
+            unsigned const *from = &distances[active_node * MULTI_SOURCE_LANES];
+            unsigned degree = edges(active_node, list);
+            for (unsigned i{0}; i < degree; ++i) {
+                MapEdge edge = list[i];
+                unsigned lowest = relax(from, edge.weight, &distances[edge.node * MULTI_SOURCE_LANES]);
+                if (lowest < queued[edge.node]) {
+                    queued[edge.node] = lowest;
+                    queue.emplace_back(lowest, edge.node);
+                    std::push_heap(queue.begin(), queue.end(), std::greater<std::pair<unsigned, uint32_t>>());
+                }
+            }
+        }
+    }
+}
+
+/* Distances from up to MULTI_SOURCE_LANES sources in one search, for
+ * distance tables and landmarks: distances[node * MULTI_SOURCE_LANES + i]
+ * is the distance from sources[i] (UINT_MAX if unreachable or i >= count).
+ *
+ * Label correcting rather than Dijkstra: a node is scanned again whenever
+ * any of its lanes gets lower, relaxing all lanes of each edge at once
+ * with relax (see lane_relax.h, nullptr for the fastest), and the queue
+ * is ordered by the lowest lane that changed. Pays when the sources are
+ * close together (the boundary nodes of a region, vehicles around a
+ * depot): their waves reach a node at about the same time and it is
+ * scanned once or twice instead of once per source. For sources far apart
+ * (landmarks) it scans about as often as separate searches and is slower.
+ * queued holds the key each node is queued with. */
+template <class Graph>
+void multi_source_distances(Graph const &graph, uint32_t const *sources, size_t count,
+                            std::vector<unsigned> &distances, std::vector<unsigned> &queued,
+                            SearchQueue &queue, LaneRelax relax=nullptr) {
+    MapEdge buffer[2];
+    graph_search_detail::lane_search(graph.size(), sources, count, distances, queued, queue, relax,
+                                     [&graph, &buffer] (uint32_t node, MapEdge const *&list) {
+        list = buffer;
+        return graph.get_edges(node, buffer);
+    });
+}
+
+/* Same, distances to each of sources along incoming edges. */
+inline void multi_source_reverse_distances(MapGraph const &graph, uint32_t const *sources,
+                                           size_t count, std::vector<unsigned> &distances,
+                                           std::vector<unsigned> &queued, SearchQueue &queue,
+                                           LaneRelax relax=nullptr) {
+    graph_search_detail::lane_search(graph.size(), sources, count, distances, queued, queue, relax,
+                                     [&graph] (uint32_t node, MapEdge const *&list) {
+        list = graph.get_incoming(node);
+        return graph.get_in_degree(node);
+    });
+}
+
+/* Every node at most budget from start, with its distance, in order of
+ * distance (start first). Needs no per-node state, only memory in
+ * proportion to the result, and can run in any number of threads at once. */
+template <class Graph>
+std::vector<ReachableNode> bounded_search(Graph const &graph, uint32_t start, unsigned budget) {
+    std::vector<ReachableNode> reached{};
+
+    // Tentative distances in an open addressing table, NO_NODE is empty
+    std::vector<ReachableNode> table(64, ReachableNode{NO_NODE, UINT_MAX});
+    size_t used{0};
+    auto find = [&table] (uint32_t node) -> ReachableNode & {
+        size_t mask = table.size() - 1;
+        size_t slot = ((node * 0x9e3779b97f4a7c15ull) >> 32) & mask;
+        while (table[slot].node != NO_NODE && table[slot].node != node)
+            slot = (slot + 1) & mask;
+        return table[slot];
+    };
+    auto grow = [&table, &find] () {
+        std::vector<ReachableNode> old(2 * table.size(), ReachableNode{NO_NODE, UINT_MAX});
+        old.swap(table);
+        for (ReachableNode const &moved : old) {
+            if (moved.node != NO_NODE)
+                find(moved.node) = moved;
+        }
+    };
+
+    SearchQueue queue{{0, start}};
+    find(start) = ReachableNode{start, 0};
+    ++used;
+    MapEdge edges[2];
+    while (!queue.empty()) {
+        std::pop_heap(queue.begin(), queue.end(), std::greater<std::pair<unsigned, uint32_t>>());
+        auto [weight, active_node] = queue.back();
+        queue.pop_back();
+        if (weight > find(active_node).distance)
+            continue;  // Already visited with a lower weight
+        reached.push_back(ReachableNode{active_node, weight});
+
+        unsigned degree = graph.get_edges(active_node, edges);
+        for (unsigned i{0}; i < degree; ++i) {
+            unsigned next_weight = weight + edges[i].weight;
+            if (next_weight > budget)
+                continue;
+            ReachableNode *entry = &find(edges[i].node);
+            if (entry->node == NO_NODE) {
+                if (2 * ++used > table.size()) {
+                    grow();
+                    entry = &find(edges[i].node);
+                }
+                entry->node = edges[i].node;
+            }
+            if (next_weight < entry->distance) {
+                entry->distance = next_weight;
+                queue.emplace_back(next_weight, edges[i].node);
+                std::push_heap(queue.begin(), queue.end(), std::greater<std::pair<unsigned, uint32_t>>());
+            }
+        }
+    }
+    return reached;
+}
+
+/* Drive instructions along a route of ids: forward out of nodes with one
+ * edge, else left or right depending on which edge the route takes. */
+template <class Graph>
+std::vector<instruction::InstructionNumber> route_instructions(Graph const &graph,
+                                                               std::vector<uint32_t> const &route) {
+    std::vector<instruction::InstructionNumber> instructions{};
+    MapEdge edges[2];
+    for (size_t i{0}; i + 1 < route.size(); ++i) {
+        if (graph.get_edges(route[i], edges) == 1) {
+            instructions.push_back(instruction::forward);
+        } else if (edges[0].node == route[i+1]) {
+            instructions.push_back(instruction::left);
+        } else {
+            instructions.push_back(instruction::right);
+        }
+    }
+    return instructions;
+}
+
+#endif // GRAPH_SEARCH_H
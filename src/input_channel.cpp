@@ -0,0 +1,212 @@
+#include "input_channel.h"
+#include "log.h"
+
+#include <cerrno>
+#include <chrono>
+#include <climits>
+#include <cstring>
+#include <new>
+#include <string>
+
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+using namespace std;
+
+namespace {
+
+long futex(atomic<uint32_t> *word, int op, uint32_t value, timespec const *timeout) {
+    return syscall(SYS_futex, reinterpret_cast<uint32_t*>(word), op, value, timeout, nullptr, 0);
+}
+
+int64_t now_ns() {
+    return chrono::duration_cast<chrono::nanoseconds>(
+            chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+}  // namespace
+
+InputChannelProducer::InputChannelProducer(string name) {
+    int fd = shm_open(name.c_str(), O_RDWR, 0);
+    if (fd < 0) {
+        Logger::log(WARNING, __FILE__, "InputChannelProducer", "No input channel " + name);
+        return;
+    }
+    struct stat info{};
+    if (fstat(fd, &info) != 0 || static_cast<size_t>(info.st_size) < sizeof(InputChannelHeader)) {
+        close(fd);
+        return;
+    }
+    void *memory = mmap(nullptr, info.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (memory == MAP_FAILED)
+        return;
+
+    size = info.st_size;
+    header = static_cast<InputChannelHeader*>(memory);
+    records = reinterpret_cast<InputRecord*>(static_cast<char*>(memory) + sizeof(InputChannelHeader));
+    atomic_thread_fence(memory_order_acquire);
+    if (header->magic != INPUT_CHANNEL_MAGIC || header->version != INPUT_CHANNEL_VERSION
+            || header->record_size != sizeof(InputRecord)
+            || size < sizeof(InputChannelHeader) + sizeof(InputRecord) * header->capacity) {
+        Logger::log(WARNING, __FILE__, "InputChannelProducer", "Incompatible input channel " + name);
+        munmap(memory, size);
+        header = nullptr;
+        records = nullptr;
+    }
+}
+
+InputChannelProducer::~InputChannelProducer() {
+    if (header != nullptr)
+        munmap(header, size);
+}
+
+InputRecord *InputChannelProducer::claim() {
+    if (header == nullptr)
+        return nullptr;
+    uint64_t head = header->head.load(memory_order_relaxed);
+    uint64_t tail = header->tail.load(memory_order_acquire);
+    if (head - tail >= header->capacity) {
+        // Drop the oldest record, unless the consumer just released it
+        if (header->tail.compare_exchange_strong(tail, tail + 1, memory_order_acq_rel,
+                                                 memory_order_acquire))
+            header->dropped.fetch_add(1, memory_order_relaxed);
+    }
+    return &records[head & (header->capacity - 1)];
+}
+
+void InputChannelProducer::commit(input::Kind kind) {
+    if (header == nullptr)
+        return;
+    uint64_t head = header->head.load(memory_order_relaxed);
+    InputRecord &record = records[head & (header->capacity - 1)];
+    record.sequence = head;
+    record.timestamp_ns = now_ns();
+    record.kind = kind;
+
+    // Only make a system call if the consumer is asleep
+    header->head.store(head + 1, memory_order_seq_cst);
+    if (header->sleeping.load(memory_order_seq_cst)) {
+        header->wakeup.fetch_add(1, memory_order_seq_cst);
+        futex(&header->wakeup, FUTEX_WAKE, 1, nullptr);
+    }
+}
+
+bool InputChannelProducer::push(image_proc_t const &image) {
+    InputRecord *record = claim();
+    if (record == nullptr)
+        return false;
+    record->image = image;
+    commit(input::image);
+    return true;
+}
+
+bool InputChannelProducer::push(sensor_data_t const &sensor) {
+    InputRecord *record = claim();
+    if (record == nullptr)
+        return false;
+    record->sensor = sensor;
+    commit(input::sensor);
+    return true;
+}
+
+InputChannelConsumer::InputChannelConsumer(string name, uint32_t capacity, bool busy_poll)
+: name{name}, busy_poll{busy_poll} {
+    // Power of two so the ring index is a mask
+    uint32_t rounded{1};
+    while (rounded < capacity) {
+        rounded <<= 1;
+    }
+    size = sizeof(InputChannelHeader) + sizeof(InputRecord) * rounded;
+
+    int fd = shm_open(name.c_str(), O_RDWR | O_CREAT, 0666);
+    if (fd < 0 || ftruncate(fd, 0) != 0 || ftruncate(fd, size) != 0) {
+        Logger::log(ERROR, __FILE__, "InputChannelConsumer", strerror(errno));
+        if (fd >= 0)
+            close(fd);
+        return;
+    }
+    void *memory = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (memory == MAP_FAILED) {
+        Logger::log(ERROR, __FILE__, "InputChannelConsumer", strerror(errno));
+        return;
+    }
+
+    header = new (memory) InputChannelHeader{};
+    records = reinterpret_cast<InputRecord*>(static_cast<char*>(memory) + sizeof(InputChannelHeader));
+    header->version = INPUT_CHANNEL_VERSION;
+    header->capacity = rounded;
+    header->record_size = sizeof(InputRecord);
+    atomic_thread_fence(memory_order_release);
+    header->magic = INPUT_CHANNEL_MAGIC;
+    Logger::log(INFO, __FILE__, "InputChannelConsumer", "Reading input from " + name);
+}
+
+InputChannelConsumer::~InputChannelConsumer() {
+    if (header != nullptr) {
+        munmap(header, size);
+        shm_unlink(name.c_str());
+    }
+}
+
+InputRecord const *InputChannelConsumer::peek() {
+    if (header == nullptr)
+        return nullptr;
+    peeked = header->tail.load(memory_order_acquire);
+    if (header->head.load(memory_order_acquire) == peeked)
+        return nullptr;
+    return &records[peeked & (header->capacity - 1)];
+}
+
+bool InputChannelConsumer::release() {
+    if (header == nullptr)
+        return false;
+    // Fails if the producer moved tail on to drop this record
+    uint64_t tail = peeked;
+    return header->tail.compare_exchange_strong(tail, tail + 1, memory_order_release,
+                                                memory_order_relaxed);
+}
+
+bool InputChannelConsumer::wait(long timeout_us) {
+    if (header == nullptr)
+        return false;
+    auto ready = [this] {
+        return header->head.load(memory_order_seq_cst) != header->tail.load(memory_order_relaxed);
+    };
+    int64_t deadline = now_ns() + timeout_us * 1000;
+
+    if (busy_poll) {
+        while (!ready()) {
+            if (now_ns() >= deadline)
+                return false;
+        }
+        return true;
+    }
+
+    while (!ready()) {
+        int64_t left = deadline - now_ns();
+        if (left <= 0)
+            return false;
+        timespec timeout{left / 1000000000, left % 1000000000};
+
+        // Announce that we sleep before the last look, so the producer
+        // either sees the flag or we see its record
+        header->sleeping.store(1, memory_order_seq_cst);
+        uint32_t wakeup = header->wakeup.load(memory_order_seq_cst);
+        if (!ready())
+            futex(&header->wakeup, FUTEX_WAIT, wakeup, &timeout);
+        header->sleeping.store(0, memory_order_relaxed);
+    }
+    return true;
+}
+
+uint64_t InputChannelConsumer::get_dropped() const {
+    if (header == nullptr)
+        return 0;
+    return header->dropped.load(memory_order_relaxed);
+}
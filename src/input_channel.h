@@ -0,0 +1,138 @@
+/*
+ * Shared-memory input channel from the image processing process (and
+ * sensor reader) to the control center.
+ *
+ * A single-producer/single-consumer ring of InputRecords in a POSIX shared
+ * memory object. The consumer creates the channel, the producer opens it.
+ * Records are written and read in place in the ring, so nothing is copied
+ * on the way except the record itself.
+ *
+ * Only the newest input matters to the control center, so a full ring
+ * drops its oldest record to make room for the new one. The consumer may
+ * be reading that record: release() then returns false and what was read
+ * must be thrown away.
+ *
+ * Producer:
+ *     InputRecord *record = producer.claim();
+ *     if (record) { record->image = ...; producer.commit(input::image); }
+ *
+ * Consumer:
+ *     consumer.wait(timeout_us);
+ *     while (InputRecord const *record = consumer.peek()) {
+ *         InputRecord copy = *record;
+ *         if (consumer.release())
+ *             use(copy);
+ *     }
+ *
+ * wait() sleeps on a futex and the producer only makes the wake-up system
+ * call when the consumer is actually sleeping. With busy_poll the consumer
+ * spins instead and hand-off latency is that of a cache line transfer.
+ */
+
+#ifndef INPUT_CHANNEL_H
+#define INPUT_CHANNEL_H
+
+#include "raspi_common.h"
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+#define INPUT_CHANNEL_MAGIC 0x494e5043
+#define INPUT_CHANNEL_VERSION 2
+
+namespace input {
+    enum Kind : uint32_t {image, sensor};
+}
+
+struct alignas(64) InputRecord {
+    uint64_t sequence;     // Consecutive, starts at 0
+    int64_t timestamp_ns;  // Steady clock, set by commit()
+    input::Kind kind;      // Which of image and sensor is set
+    image_proc_t image;
+    sensor_data_t sensor;
+};
+
+struct InputChannelHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t capacity;
+    uint32_t record_size;
+    alignas(64) std::atomic<uint64_t> head;  // Written by the producer
+    std::atomic<uint64_t> dropped;           // Oldest records dropped on a full ring
+    std::atomic<uint32_t> wakeup;            // Futex word
+    alignas(64) std::atomic<uint64_t> tail;  // Written by the consumer, and the producer on a full ring
+    std::atomic<uint32_t> sleeping;
+};
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free
+              && std::atomic<uint32_t>::is_always_lock_free,
+              "The input channel needs lock free atomics in shared memory");
+
+class InputChannelProducer {
+public:
+    InputChannelProducer(std::string name);
+    ~InputChannelProducer();
+
+    InputChannelProducer(InputChannelProducer const&) = delete;
+    InputChannelProducer operator=(InputChannelProducer const&) = delete;
+
+    bool is_open() const {
+        return header != nullptr;
+    }
+
+    /* Next free record, nullptr if the channel is not open. On a full ring
+     * the oldest unread record is dropped (and counted) to free one. */
+    InputRecord *claim();
+
+    /* Publish the claimed record and wake the consumer if it sleeps. Does
+     * nothing if the channel is not open. */
+    void commit(input::Kind kind);
+
+    bool push(image_proc_t const &image);
+    bool push(sensor_data_t const &sensor);
+
+private:
+    size_t size{0};
+    InputChannelHeader *header{nullptr};
+    InputRecord *records{nullptr};
+};
+
+class InputChannelConsumer {
+public:
+    /* Create the shared memory object name with room for capacity records
+     * (rounded up to a power of two). */
+    InputChannelConsumer(std::string name, uint32_t capacity=64, bool busy_poll=false);
+    ~InputChannelConsumer();
+
+    InputChannelConsumer(InputChannelConsumer const&) = delete;
+    InputChannelConsumer operator=(InputChannelConsumer const&) = delete;
+
+    bool is_open() const {
+        return header != nullptr;
+    }
+
+    /* Oldest unread record, nullptr if there is none. Read it before
+     * release(). */
+    InputRecord const *peek();
+
+    /* Done with the record of peek(). Return false if the producer dropped
+     * it in the meantime, it may then have been overwritten while read. */
+    bool release();
+
+    /* Wait until there is a record to read, at most timeout_us
+     * microseconds. Return false on timeout. */
+    bool wait(long timeout_us);
+
+    uint64_t get_dropped() const;
+
+private:
+    std::string name;
+    bool busy_poll;
+    size_t size{0};
+    InputChannelHeader *header{nullptr};
+    InputRecord *records{nullptr};
+    uint64_t peeked{0};  // Index of the record of peek()
+};
+
+#endif // INPUT_CHANNEL_H
@@ -0,0 +1,91 @@
+#include "intersection_manager.h"
+#include "log.h"
+
+#include <algorithm>
+#include <mutex>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+IntersectionManager::IntersectionManager(unsigned crossing_ms, unsigned headway_ms,
+                                         unsigned horizon_ms)
+: crossing_ms{crossing_ms}, headway_ms{headway_ms}, horizon_ms{horizon_ms} {
+}
+
+bool IntersectionManager::conflicting(string const &approach_a, instruction::InstructionNumber turn_a,
+                                      string const &approach_b, instruction::InstructionNumber turn_b) {
+    if (approach_a == approach_b)
+        return false;  // Following each other, see headway_ms
+    return !(turn_a == instruction::right && turn_b == instruction::right);
+}
+
+IntersectionSlot IntersectionManager::reserve(string const &vehicle, string const &intersection,
+                                              string const &approach,
+                                              instruction::InstructionNumber turn, int64_t eta_ms,
+                                              unsigned vehicle_crossing_ms) {
+    int64_t duration = max(crossing_ms, vehicle_crossing_ms);
+    lock_guard<mutex> lock{manager_mutex};
+    vector<Reservation> &reservations = intersections[intersection];
+    reservations.erase(remove_if(reservations.begin(), reservations.end(),
+                                 [&vehicle] (Reservation const &r) { return r.vehicle == vehicle; }),
+                       reservations.end());
+
+    // Move the start past every slot it collides with until none is left
+    int64_t start = eta_ms;
+    bool moved{true};
+    while (moved && start <= eta_ms + horizon_ms) {
+        moved = false;
+        for (Reservation const &r : reservations) {
+            if (r.approach == approach) {
+                if (start < r.start_ms + headway_ms && r.start_ms < start + headway_ms) {
+                    start = r.start_ms + headway_ms;
+                    moved = true;
+                }
+            } else if (conflicting(approach, turn, r.approach, r.turn)
+                       && start < r.end_ms && r.start_ms < start + duration) {
+                start = r.end_ms;
+                moved = true;
+            }
+        }
+    }
+    IntersectionSlot slot{};
+    if (start > eta_ms + horizon_ms) {
+        Logger::log(WARNING, __FILE__, "reserve", "No slot at " + intersection + " for " + vehicle);
+        return slot;
+    }
+    slot.start_ms = start;
+    slot.end_ms = start + duration;
+    reservations.push_back(Reservation{vehicle, approach, turn, slot.start_ms, slot.end_ms});
+    return slot;
+}
+
+void IntersectionManager::release(string const &vehicle, string const &intersection) {
+    lock_guard<mutex> lock{manager_mutex};
+    auto found = intersections.find(intersection);
+    if (found == intersections.end())
+        return;
+    vector<Reservation> &reservations = found->second;
+    reservations.erase(remove_if(reservations.begin(), reservations.end(),
+                                 [&vehicle] (Reservation const &r) { return r.vehicle == vehicle; }),
+                       reservations.end());
+}
+
+void IntersectionManager::expire(int64_t now_ms) {
+    lock_guard<mutex> lock{manager_mutex};
+    for (auto &intersection : intersections) {
+        vector<Reservation> &reservations = intersection.second;
+        reservations.erase(remove_if(reservations.begin(), reservations.end(),
+                                     [now_ms] (Reservation const &r) { return r.end_ms < now_ms; }),
+                           reservations.end());
+    }
+}
+
+size_t IntersectionManager::get_reservation_count() const {
+    lock_guard<mutex> lock{manager_mutex};
+    size_t count{0};
+    for (auto const &intersection : intersections) {
+        count += intersection.second.size();
+    }
+    return count;
+}
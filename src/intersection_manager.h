@@ -0,0 +1,94 @@
+/*
+ * Time slot reservations for vehicles crossing intersections, shared by
+ * all control centers of a fleet in one process (a simulator or a
+ * dispatcher running many vehicles).
+ *
+ * A vehicle asks for a slot when it sees the stop line before an
+ * intersection, with its ETA at the line, the node it comes from and the
+ * instruction it will follow through the intersection. It gets the
+ * earliest slot at or after the ETA that does not conflict with the slots
+ * already granted, and adjusts its speed to arrive when the slot starts
+ * instead of stopping at the line.
+ *
+ * Two crossings conflict if they come from different approaches, unless
+ * both turn right. Vehicles from the same approach follow each other at
+ * least headway_ms apart. The manager does not know where they are in the
+ * queue, a vehicle should not ask for an ETA before the slot of the one
+ * ahead of it.
+ *
+ * Times are milliseconds on any clock the callers agree on.
+ *
+ * Use: IntersectionManager manager{};
+ *      IntersectionSlot slot = manager.reserve("car1", "K1", "A1", instruction::left, eta_ms);
+ */
+
+#ifndef INTERSECTION_MANAGER_H
+#define INTERSECTION_MANAGER_H
+
+#include "raspi_common.h"
+
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+struct IntersectionSlot {
+    int64_t start_ms{-1};  // -1 if there was no slot within the horizon
+    int64_t end_ms{-1};
+};
+
+class IntersectionManager {
+public:
+    /* A crossing occupies the intersection for crossing_ms. Slots are not
+     * granted more than horizon_ms after the ETA. */
+    IntersectionManager(unsigned crossing_ms=1500, unsigned headway_ms=500,
+                        unsigned horizon_ms=60000);
+
+    IntersectionManager(IntersectionManager const&) = delete;
+    IntersectionManager operator=(IntersectionManager const&) = delete;
+
+    /* Reserve the earliest free slot at or after eta_ms. A new request from
+     * the same vehicle at the same intersection replaces its old slot. A
+     * vehicle that will cross slower than usual, e.g. from standstill, can
+     * ask for a longer vehicle_crossing_ms than the manager's crossing_ms. */
+    IntersectionSlot reserve(std::string const &vehicle, std::string const &intersection,
+                             std::string const &approach, instruction::InstructionNumber turn,
+                             int64_t eta_ms, unsigned vehicle_crossing_ms=0);
+
+    /* Give back the vehicle's slot at the intersection, e.g. when it is
+     * replanned to another route. */
+    void release(std::string const &vehicle, std::string const &intersection);
+
+    /* Forget the slots that ended before now_ms. ControlCenter calls it
+     * whenever it asks for a slot, other users must call it now and then
+     * or old slots pile up. */
+    void expire(int64_t now_ms);
+
+    /* Can the two crossings be in the intersection at the same time? */
+    static bool conflicting(std::string const &approach_a, instruction::InstructionNumber turn_a,
+                            std::string const &approach_b, instruction::InstructionNumber turn_b);
+
+    size_t get_reservation_count() const;
+
+    unsigned get_crossing_ms() const {
+        return crossing_ms;
+    }
+
+private:
+    struct Reservation {
+        std::string vehicle{};
+        std::string approach{};
+        instruction::InstructionNumber turn{instruction::forward};
+        int64_t start_ms{0};
+        int64_t end_ms{0};
+    };
+
+    unsigned crossing_ms;
+    unsigned headway_ms;
+    unsigned horizon_ms;
+    mutable std::mutex manager_mutex{};
+    std::unordered_map<std::string, std::vector<Reservation>> intersections{};
+};
+
+#endif // INTERSECTION_MANAGER_H
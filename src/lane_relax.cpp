@@ -0,0 +1,104 @@
+#include "lane_relax.h"
+
+#include <climits>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define LANE_AVX2
+#include <immintrin.h>
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#define LANE_NEON
+#include <arm_neon.h>
+#endif
+
+using namespace std;
+
+static_assert(MULTI_SOURCE_LANES == 8, "The vector versions relax 8 lanes");
+
+namespace {
+#ifdef LANE_AVX2
+    __attribute__((target("avx2")))
+    unsigned relax_avx2(unsigned const *from, unsigned weight, unsigned *to) {
+        __m256i unreached = _mm256_set1_epi32(-1);
+        __m256i old_weights = _mm256_loadu_si256(reinterpret_cast<__m256i const *>(to));
+        __m256i source = _mm256_loadu_si256(reinterpret_cast<__m256i const *>(from));
+        // Adding to UINT_MAX would wrap around, keep those lanes UINT_MAX
+        __m256i sum = _mm256_or_si256(_mm256_add_epi32(source, _mm256_set1_epi32(weight)),
+                                      _mm256_cmpeq_epi32(source, unreached));
+        __m256i new_weights = _mm256_min_epu32(old_weights, sum);
+        __m256i same = _mm256_cmpeq_epi32(new_weights, old_weights);
+        if (_mm256_movemask_epi8(same) == -1)
+            return UINT_MAX;
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(to), new_weights);
+
+        // Smallest of the lanes that changed
+        __m256i changed = _mm256_or_si256(new_weights, same);
+        __m128i half = _mm_min_epu32(_mm256_castsi256_si128(changed),
+                                     _mm256_extracti128_si256(changed, 1));
+        half = _mm_min_epu32(half, _mm_shuffle_epi32(half, 0x4e));
+        half = _mm_min_epu32(half, _mm_shuffle_epi32(half, 0xb1));
+        return _mm_cvtsi128_si32(half);
+    }
+#endif
+
+#ifdef LANE_NEON
+    unsigned relax_neon(unsigned const *from, unsigned weight, unsigned *to) {
+        uint32x4_t unreached = vdupq_n_u32(UINT_MAX);
+        uint32x4_t add = vdupq_n_u32(weight);
+        unsigned smallest{UINT_MAX};
+        for (unsigned i{0}; i < 8; i += 4) {
+            uint32x4_t old_weights = vld1q_u32(to + i);
+            uint32x4_t source = vld1q_u32(from + i);
+            uint32x4_t sum = vorrq_u32(vaddq_u32(source, add), vceqq_u32(source, unreached));
+            uint32x4_t new_weights = vminq_u32(old_weights, sum);
+            uint32x4_t same = vceqq_u32(new_weights, old_weights);
+            if (vminvq_u32(same) != 0)
+                continue;
+            vst1q_u32(to + i, new_weights);
+            unsigned lowest = vminvq_u32(vorrq_u32(new_weights, same));
+            smallest = lowest < smallest ? lowest : smallest;
+        }
+        return smallest;
+    }
+#endif
+
+    struct Choice {
+        LaneRelax relax;
+        char const *kind;
+    };
+
+    Choice choose() {
+#ifdef LANE_AVX2
+        if (__builtin_cpu_supports("avx2"))
+            return Choice{relax_avx2, "avx2"};
+#endif
+#ifdef LANE_NEON
+        return Choice{relax_neon, "neon"};
+#endif
+        return Choice{lane_relax_scalar, "scalar"};
+    }
+
+    /* Chosen on first use, whatever the order of static initialization. */
+    Choice const &chosen() {
+        static Choice const choice{choose()};
+        return choice;
+    }
+}
+
+LaneRelax get_lane_relax() {
+    return chosen().relax;
+}
+
+unsigned lane_relax_scalar(unsigned const *from, unsigned weight, unsigned *to) {
+    unsigned smallest{UINT_MAX};
+    for (unsigned i{0}; i < MULTI_SOURCE_LANES; ++i) {
+        if (from[i] != UINT_MAX && from[i] + weight < to[i]) {
+            to[i] = from[i] + weight;
+            smallest = to[i] < smallest ? to[i] : smallest;
+        }
+    }
+    return smallest;
+}
+
+char const *lane_relax_kind() {
+    return chosen().kind;
+}
@@ -0,0 +1,30 @@
+/*
+ * Edge relaxation for MULTI_SOURCE_LANES searches at once, the step of
+ * multi_source_distances() (graph_search.h): one lane per source, the
+ * lanes of a node next to each other.
+ *
+ * Uses AVX2 on x86 processors that have it (checked once at run time, so
+ * the rest of the program needs no -mavx2), NEON on 64 bit ARM, and plain
+ * C++ everywhere else.
+ */
+
+#ifndef LANE_RELAX_H
+#define LANE_RELAX_H
+
+#define MULTI_SOURCE_LANES 8
+
+/* to[i] = min(to[i], from[i] + weight) for every lane, UINT_MAX in from
+ * staying UINT_MAX. Return the smallest to[i] that got lower, UINT_MAX if
+ * none did. */
+typedef unsigned (*LaneRelax)(unsigned const *from, unsigned weight, unsigned *to);
+
+/* The fastest one for this processor. */
+LaneRelax get_lane_relax();
+
+/* Without vector instructions. */
+unsigned lane_relax_scalar(unsigned const *from, unsigned weight, unsigned *to);
+
+/* "avx2", "neon" or "scalar", whichever get_lane_relax() returns. */
+char const *lane_relax_kind();
+
+#endif // LANE_RELAX_H
@@ -99,3 +99,15 @@ bool LineDetector::at_line(int distance) {
     return retval;
 }
 
+LineDetectorState LineDetector::get_state() const {
+    return LineDetectorState{state, consecutive_decreasing_distances, last_distance,
+                             far_stop_counter, signaled};
+}
+
+void LineDetector::set_state(LineDetectorState const &saved) {
+    state = static_cast<stop_line_state::StopLineState>(saved.state);
+    consecutive_decreasing_distances = saved.consecutive_decreasing_distances;
+    last_distance = saved.last_distance;
+    far_stop_counter = saved.far_stop_counter;
+    signaled = saved.signaled;
+}
@@ -1,10 +1,21 @@
 #ifndef LINE_DETECTOR_H
 #define LINE_DETECTOR_H
 
+#include <cstdint>
+
 namespace stop_line_state {
     enum StopLineState {close, mid, far};
 }
 
+/* Everything that changes while detecting, for checkpoints. */
+struct LineDetectorState {
+    int32_t state;
+    int32_t consecutive_decreasing_distances;
+    int32_t last_distance;
+    int32_t far_stop_counter;
+    int32_t signaled;
+};
+
 class LineDetector {
 public:
     LineDetector(int consecutive_param, int high_count_param);
@@ -15,6 +26,9 @@ public:
      * Note, this method must be called exactly once per program cycle. */
     bool at_line(int line_distance);
 
+    LineDetectorState get_state() const;
+    void set_state(LineDetectorState const &saved);
+
 private:
     void update_state(int line_distance);
     bool decreasing(int line_distance);
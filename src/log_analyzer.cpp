@@ -0,0 +1,358 @@
+#include "log_analyzer.h"
+#include "control_center.h"
+#include "log.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+
+namespace {
+    namespace event {
+        enum Kind : uint8_t {
+            state_change,      // value: state::ControlState
+            stopping_blocked,  // "Path blocked, stopping"
+            stopping_line,     // "At stop line, stopping"
+            stopped,           // "Stopped", state becomes the stop reason
+            finish,            // "Finishing instruction <id>"
+            line,              // at_line trace, value: stop_line_state::StopLineState
+            still_at_line
+        };
+    }
+
+    struct Event {
+        double time;
+        event::Kind kind;
+        uint8_t value;
+        string_view id;
+    };
+
+    struct Chunk {
+        vector<Event> events{};
+        size_t lines{0};
+    };
+
+    bool digits(char const *p, char const *end, int count, int &value) {
+        value = 0;
+        if (end - p < count)
+            return false;
+        for (int i{0}; i < count; ++i) {
+            if (p[i] < '0' || p[i] > '9')
+                return false;
+            value = 10 * value + (p[i] - '0');
+        }
+        return true;
+    }
+
+    // Days since 1970-01-01 of a date in the proleptic Gregorian calendar
+    long days_from_civil(int year, int month, int day) {
+        year -= month <= 2;
+        long era = (year >= 0 ? year : year - 399) / 400;
+        long year_of_era = year - era * 400;
+        long day_of_year = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+        long day_of_era = year_of_era * 365 + year_of_era / 4 - year_of_era / 100 + day_of_year;
+        return era * 146097 + day_of_era - 719468;
+    }
+
+    // Time stamp at the start of a line in seconds, NAN if there is none
+    double parse_time(char const *p, char const *end) {
+        if (p < end && p[0] == '[')
+            ++p;
+        double seconds{0};
+        int year, month, day, hours, minutes, secs;
+        if (digits(p, end, 4, year) && end - p > 10 && p[4] == '-'
+                && digits(p + 5, end, 2, month) && p[7] == '-' && digits(p + 8, end, 2, day)
+                && (p[10] == ' ' || p[10] == 'T')) {
+            seconds = 86400.0 * days_from_civil(year, month, day);
+            p += 11;
+        }
+        if (digits(p, end, 2, hours) && end - p >= 8 && p[2] == ':'
+                && digits(p + 3, end, 2, minutes) && p[5] == ':' && digits(p + 6, end, 2, secs)) {
+            seconds += hours * 3600 + minutes * 60 + secs;
+            p += 8;
+        } else if (p < end && *p >= '0' && *p <= '9') {
+            // Plain seconds
+            for (; p < end && *p >= '0' && *p <= '9'; ++p) {
+                seconds = 10 * seconds + (*p - '0');
+            }
+        } else {
+            return NAN;
+        }
+        if (p < end && (*p == '.' || *p == ',')) {
+            double scale{0.1};
+            for (++p; p < end && *p >= '0' && *p <= '9'; ++p, scale /= 10) {
+                seconds += (*p - '0') * scale;
+            }
+        }
+        return seconds;
+    }
+
+    // The message after a context, without separators and trailing space
+    string_view message_after(string_view line, size_t context_end) {
+        size_t start = line.find_first_not_of(" \t:,|]-", context_end);
+        if (start == string_view::npos)
+            return {};
+        size_t stop = line.find_last_not_of(" \t\r");
+        return line.substr(start, stop + 1 - start);
+    }
+
+    bool starts_with(string_view text, string_view prefix) {
+        return text.substr(0, prefix.size()) == prefix;
+    }
+
+    void parse_line(string_view line, double time, vector<Event> &events) {
+        size_t found;
+        if ((found = line.find("Finishing instruction")) != string_view::npos) {
+            string_view id = message_after(line, found + 21);
+            events.push_back(Event{time, event::finish, 0, id});
+        } else if ((found = line.find("state=")) != string_view::npos) {
+            char first = found + 6 < line.size() ? line[found + 6] : ' ';
+            string_view name = line.substr(found + 6, 5);
+            if (first >= '0' && first <= '9') {
+                // Cycle summary ("done"), state as a number
+                int value = first - '0';
+                if (value < LOG_STATE_COUNT)
+                    events.push_back(Event{time, event::state_change, static_cast<uint8_t>(value), {}});
+            } else if (starts_with(name, "close")) {
+                events.push_back(Event{time, event::line, stop_line_state::close, {}});
+            } else if (starts_with(name, "mid")) {
+                events.push_back(Event{time, event::line, stop_line_state::mid, {}});
+            } else if (starts_with(name, "far")) {
+                events.push_back(Event{time, event::line, stop_line_state::far, {}});
+            }
+        } else if ((found = line.find("Set new state")) != string_view::npos) {
+            string_view name = message_after(line, found + 13);
+            if (name.empty() || name == "stop_line") {
+                events.push_back(Event{time, event::state_change, state::stop_line, {}});
+            } else if (name == "normal") {
+                events.push_back(Event{time, event::state_change, state::normal, {}});
+            } else if (name == "intersection") {
+                events.push_back(Event{time, event::state_change, state::intersection, {}});
+            } else if (name == "stopping") {
+                events.push_back(Event{time, event::state_change, state::stopping, {}});
+            }
+        } else if ((found = line.find("Update state")) != string_view::npos) {
+            string_view message = message_after(line, found + 12);
+            if (message == "Path blocked, stopping") {
+                events.push_back(Event{time, event::stopping_blocked, 0, {}});
+            } else if (message == "At stop line, stopping") {
+                events.push_back(Event{time, event::stopping_line, 0, {}});
+            } else if (message == "Path blocked") {
+                events.push_back(Event{time, event::state_change, state::blocked, {}});
+            } else if (message == "Stopped") {
+                events.push_back(Event{time, event::stopped, 0, {}});
+            } else if (message == "Still at stop line") {
+                events.push_back(Event{time, event::still_at_line, 0, {}});
+            }
+        }
+    }
+
+    void parse_chunk(char const *begin, char const *end, Chunk &chunk) {
+        double time{NAN};
+        for (char const *p = begin; p < end; ) {
+            char const *newline = static_cast<char const*>(memchr(p, '\n', end - p));
+            char const *line_end = newline ? newline : end;
+            double line_time = parse_time(p, line_end);
+            if (!std::isnan(line_time))
+                time = line_time;
+            parse_line(string_view(p, line_end - p), time, chunk.events);
+            ++chunk.lines;
+            p = line_end + 1;
+        }
+    }
+
+    // Parses chunks of logs in parallel, then builds the report in order
+    class Analyzer {
+    public:
+        Analyzer(unsigned threads)
+        : threads{threads > 0 ? threads : max(1u, thread::hardware_concurrency())} {
+        }
+
+        void add_text(char const *text, size_t size) {
+            report.bytes += size;
+            vector<Chunk> chunks(threads);
+            vector<thread> workers{};
+            char const *end = text + size;
+            char const *begin = text;
+            for (unsigned i{0}; i < threads; ++i) {
+                // Chunks end after a newline
+                char const *stop = i + 1 == threads ? end : text + size * (i + 1) / threads;
+                if (stop < begin)
+                    stop = begin;
+                char const *newline = static_cast<char const*>(memchr(stop, '\n', end - stop));
+                stop = newline && i + 1 < threads ? newline + 1 : end;
+                workers.emplace_back(parse_chunk, begin, stop, ref(chunks[i]));
+                begin = stop;
+            }
+            for (unsigned i{0}; i < threads; ++i) {
+                workers[i].join();
+                report.lines += chunks[i].lines;
+                for (Event const &event : chunks[i].events) {
+                    handle(event);
+                }
+            }
+        }
+
+        LogReport finish() {
+            if (in_mission) {
+                mission.end = last_time;
+                report.missions.push_back(mission);
+            }
+            if (current_state >= 0)
+                report.dwell[current_state] += last_time - state_since;
+            return report;
+        }
+
+    private:
+        void handle(Event event) {
+            // Lines before the first time stamp of a chunk use the time before
+            if (std::isnan(event.time))
+                event.time = last_time;
+            last_time = event.time;
+            switch (event.kind) {
+                case event::state_change:
+                    set_state(event.value, event.time);
+                    break;
+                case event::stopping_blocked:
+                    stop_reason = state::blocked;
+                    set_state(state::stopping, event.time);
+                    break;
+                case event::stopping_line:
+                    stop_reason = state::stop_line;
+                    final_finish = in_mission;
+                    set_state(state::stopping, event.time);
+                    break;
+                case event::stopped:
+                    set_state(stop_reason, event.time);
+                    break;
+                case event::finish:
+                    finish_instruction(event);
+                    break;
+                case event::line:
+                    if (event.value == stop_line_state::close && last_line == stop_line_state::far)
+                        ++report.false_stop_lines;
+                    last_line = event.value;
+                    break;
+                case event::still_at_line:
+                    ++report.still_at_stop_line;
+                    break;
+            }
+        }
+
+        void set_state(int new_state, double time) {
+            if (new_state == current_state)
+                return;
+            if (current_state >= 0) {
+                report.dwell[current_state] += time - state_since;
+                if (in_mission && (current_state == state::blocked
+                                   || (current_state == state::stopping && stop_reason == state::blocked)))
+                    mission.blocked += time - state_since;
+            }
+            ++report.entered[new_state];
+
+            if (!in_mission && (new_state == state::normal || new_state == state::intersection)) {
+                // Leaving a stop line, the stop instruction was just finished
+                in_mission = true;
+                mission = MissionTimeline{};
+                mission.start = time;
+                if (!last_outside_id.empty())
+                    mission.instructions.emplace_back(last_outside_time, last_outside_id);
+                last_outside_id.clear();
+                last_finish = time;
+            } else if (in_mission && new_state == state::stop_line) {
+                in_mission = false;
+                mission.end = time;
+                mission.finished = true;
+                report.missions.push_back(mission);
+            }
+            current_state = new_state;
+            state_since = time;
+        }
+
+        void finish_instruction(Event const &event) {
+            string id{event.id};
+            if (in_mission) {
+                add_segment(id, event.time - last_finish);
+                mission.instructions.emplace_back(event.time, id);
+                last_finish = event.time;
+            } else if (final_finish && !report.missions.empty()) {
+                // The last instruction finishes once stopped at the line
+                MissionTimeline &last = report.missions.back();
+                add_segment(id, event.time - last_finish);
+                last.instructions.emplace_back(event.time, id);
+                final_finish = false;
+            } else {
+                last_outside_id = id;
+                last_outside_time = event.time;
+            }
+        }
+
+        void add_segment(string const &id, double seconds) {
+            SegmentTimes &times = report.segments[id];
+            times.min = times.count == 0 ? seconds : min(times.min, seconds);
+            times.max = times.count == 0 ? seconds : max(times.max, seconds);
+            times.total += seconds;
+            ++times.count;
+        }
+
+        unsigned threads;
+        LogReport report{};
+        double last_time{0};
+        int current_state{-1};
+        double state_since{0};
+        int stop_reason{state::stop_line};
+        int last_line{stop_line_state::close};
+        bool in_mission{false};
+        bool final_finish{false};
+        MissionTimeline mission{};
+        double last_finish{0};
+        string last_outside_id{};
+        double last_outside_time{0};
+    };
+}
+
+LogReport analyze_log_text(char const *text, size_t size, unsigned threads) {
+    Analyzer analyzer{threads};
+    analyzer.add_text(text, size);
+    return analyzer.finish();
+}
+
+LogReport analyze_logs(vector<string> const &paths, unsigned threads) {
+    Analyzer analyzer{threads};
+    for (string const &path : paths) {
+        int fd = open(path.c_str(), O_RDONLY);
+        struct stat status{};
+        if (fd < 0 || fstat(fd, &status) < 0) {
+            Logger::log(WARNING, __FILE__, "analyze_logs", "Could not open " + path + ": " + strerror(errno));
+            if (fd >= 0)
+                close(fd);
+            continue;
+        }
+        size_t size = status.st_size;
+        if (size > 0) {
+            void *text = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (text == MAP_FAILED) {
+                Logger::log(WARNING, __FILE__, "analyze_logs", "Could not map " + path + ": " + strerror(errno));
+            } else {
+                madvise(text, size, MADV_SEQUENTIAL);
+                analyzer.add_text(static_cast<char const*>(text), size);
+                munmap(text, size);
+            }
+        }
+        close(fd);
+    }
+    return analyzer.finish();
+}
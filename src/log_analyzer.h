@@ -0,0 +1,69 @@
+/*
+ * Offline analysis of the text logs written through Logger::log by the
+ * control center.
+ *
+ * Log files are memory-mapped, split into chunks at line boundaries and
+ * the chunks parsed in parallel into small events. One sequential pass
+ * over the events then builds:
+ * - the time spent in each state::ControlState,
+ * - a timeline per mission (from leaving a stop line to stopping at the
+ *   next) with the instructions finished on the way,
+ * - travel times per road segment (time between finishing an instruction
+ *   and finishing the one before it),
+ * - suspected false stop lines: the line detector going from far to close
+ *   without passing mid, and "Still at stop line" errors.
+ *
+ * Lines are expected to start with a time stamp, either
+ * "YYYY-MM-DD HH:MM:SS.fff", "HH:MM:SS.fff" or seconds as a number
+ * (optionally in square brackets); lines without one get the time of the
+ * line before. The rest of the line is searched for the messages of
+ * ControlCenter and LineDetector, so the level and file name columns can
+ * be in any format. Old logs without the id after "Finishing instruction"
+ * count their segments under "".
+ */
+
+#ifndef LOG_ANALYZER_H
+#define LOG_ANALYZER_H
+
+#include <cstddef>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+#define LOG_STATE_COUNT 6  // Number of state::ControlState values
+
+struct SegmentTimes {
+    unsigned count{0};
+    double total{0};
+    double min{0};
+    double max{0};
+};
+
+struct MissionTimeline {
+    double start{0};
+    double end{0};  // Time of the stop, or of the last event if unfinished
+    bool finished{false};
+    std::vector<std::pair<double, std::string>> instructions{};  // Finished ids
+    double blocked{0};  // Seconds spent blocked or stopping for obstacles
+};
+
+struct LogReport {
+    size_t bytes{0};
+    size_t lines{0};
+    double dwell[LOG_STATE_COUNT]{};  // Seconds per state::ControlState
+    unsigned entered[LOG_STATE_COUNT]{};
+    std::vector<MissionTimeline> missions{};
+    std::map<std::string, SegmentTimes> segments{};
+    unsigned false_stop_lines{0};
+    unsigned still_at_stop_line{0};
+};
+
+/* Analyze log files, in the given order, with threads threads (0 = one
+ * per core). Unreadable files are logged and skipped. */
+LogReport analyze_logs(std::vector<std::string> const &paths, unsigned threads=0);
+
+/* Same for a log already in memory. */
+LogReport analyze_log_text(char const *text, size_t size, unsigned threads=0);
+
+#endif // LOG_ANALYZER_H
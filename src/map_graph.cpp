@@ -0,0 +1,224 @@
+#include "map_graph.h"
+#include "contracted_graph.h"
+#include "log.h"
+
+#include <algorithm>
+#include <memory>
+#include <numeric>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+shared_ptr<MapGraph const> MapGraph::from_json(json const &m, bool reorder) {
+    shared_ptr<MapGraph> graph{new MapGraph{}};
+    if (!m.contains("MapData")) {
+        Logger::log(WARNING, __FILE__, "from_json", "No MapData in map");
+        graph->finish(false);
+        return graph;
+    }
+    // Assumes json_map preserve order when iterating
+    for (auto &node : m["MapData"].items()) {
+        graph->add_node(node.key());
+    }
+    unsigned id{0};
+    for (auto &node : m["MapData"].items()) {
+        for (auto &edge : node.value().items()) {
+            graph->add_edge(id, edge.value().begin().key(), edge.value().begin().value());
+        }
+        ++id;
+    }
+    graph->finish(reorder);
+    return graph;
+}
+
+shared_ptr<MapGraph const> MapGraph::from_nodes(list<MapNode*> const &nodes, bool reorder) {
+    shared_ptr<MapGraph> graph{new MapGraph{}};
+    for (MapNode *node : nodes) {
+        graph->add_node(node->get_name());
+    }
+    unsigned id{0};
+    for (MapNode *node : nodes) {
+        for (Edge edge : {node->get_left(), node->get_right()}) {
+            if (edge.node != nullptr)
+                graph->add_edge(id, edge.node->get_name(), edge.weight);
+        }
+        ++id;
+    }
+    graph->finish(reorder);
+    return graph;
+}
+
+void MapGraph::add_node(string const &name) {
+    ids.emplace(name, names.size());
+    names.push_back(name);
+    edges.resize(2 * names.size());
+}
+
+void MapGraph::add_edge(unsigned from, string const &to, int weight) {
+    int to_id = get_id(to);
+    if (to_id < 0) {
+        Logger::log(WARNING, __FILE__, "add_edge", "Edge to unknown node " + to);
+        return;
+    }
+    MapEdge edge{static_cast<uint32_t>(to_id), static_cast<uint32_t>(weight)};
+    if (edges[2 * from].node == NO_NODE) {
+        edges[2 * from] = edge;
+    } else if (edges[2 * from + 1].node == NO_NODE) {
+        edges[2 * from + 1] = edge;
+    } else {
+        Logger::log(WARNING, __FILE__, "add_edge", "More than two edges from " + names[from]);
+    }
+}
+
+void MapGraph::finish(bool reorder) {
+    // FNV-1a over node names, neighbour names and edge weights in map order
+    uint32_t hash{2166136261u};
+    auto add = [&hash] (string const &data) {
+        for (char c : data) {
+            hash = (hash ^ static_cast<uint8_t>(c)) * 16777619u;
+        }
+        hash = (hash ^ 0xff) * 16777619u;
+    };
+    for (unsigned id{0}; id < names.size(); ++id) {
+        add(names[id]);
+        for (MapEdge edge : {get_left(id), get_right(id)}) {
+            if (edge.node != NO_NODE) {
+                add(names[edge.node]);
+                add(to_string(edge.weight));
+            }
+        }
+    }
+    version = hash;
+
+    map_ids.resize(names.size());
+    iota(map_ids.begin(), map_ids.end(), 0);
+    internal_ids = map_ids;
+    if (reorder)
+        renumber(locality_order());
+    add_incoming();
+    contracted = make_shared<ContractedGraph const>(*this);
+}
+
+void MapGraph::add_incoming() {
+    in_first.assign(names.size() + 1, 0);
+    for (MapEdge edge : edges) {
+        if (edge.node != NO_NODE)
+            ++in_first[edge.node + 1];
+    }
+    for (unsigned id{0}; id < names.size(); ++id) {
+        in_first[id + 1] += in_first[id];
+    }
+    incoming.resize(in_first.back());
+    vector<uint32_t> fill(in_first.begin(), in_first.end() - 1);
+    for (unsigned id{0}; id < names.size(); ++id) {
+        for (MapEdge edge : {get_left(id), get_right(id)}) {
+            if (edge.node != NO_NODE)
+                incoming[fill[edge.node]++] = MapEdge{id, edge.weight};
+        }
+    }
+}
+
+vector<uint32_t> MapGraph::locality_order() const {
+    // Undirected neighbour lists, in and out edges together
+    vector<uint32_t> first(names.size() + 1, 0);
+    for (MapEdge edge : edges) {
+        if (edge.node != NO_NODE)
+            ++first[edge.node + 1];
+    }
+    for (unsigned id{0}; id < names.size(); ++id) {
+        first[id + 1] += first[id] + get_degree(id);
+    }
+    vector<uint32_t> neighbours(first.back());
+    vector<uint32_t> fill(first.begin(), first.end() - 1);
+    for (unsigned id{0}; id < names.size(); ++id) {
+        for (MapEdge edge : {get_left(id), get_right(id)}) {
+            if (edge.node != NO_NODE) {
+                neighbours[fill[id]++] = edge.node;
+                neighbours[fill[edge.node]++] = id;
+            }
+        }
+    }
+    auto degree = [&first] (uint32_t id) { return first[id + 1] - first[id]; };
+
+    // Breadth first from a low degree node in every component, neighbours
+    // in order of increasing degree
+    vector<uint32_t> by_degree(names.size());
+    iota(by_degree.begin(), by_degree.end(), 0);
+    stable_sort(by_degree.begin(), by_degree.end(), [&] (uint32_t a, uint32_t b) {
+        return degree(a) < degree(b);
+    });
+    vector<uint32_t> order{};
+    order.reserve(names.size());
+    vector<bool> placed(names.size(), false);
+    for (uint32_t root : by_degree) {
+        if (placed[root])
+            continue;
+        placed[root] = true;
+        order.push_back(root);
+        for (size_t next{order.size() - 1}; next < order.size(); ++next) {
+            size_t level_start = order.size();
+            uint32_t id = order[next];
+            for (uint32_t i{first[id]}; i < first[id + 1]; ++i) {
+                if (!placed[neighbours[i]]) {
+                    placed[neighbours[i]] = true;
+                    order.push_back(neighbours[i]);
+                }
+            }
+            stable_sort(order.begin() + level_start, order.end(), [&] (uint32_t a, uint32_t b) {
+                return degree(a) < degree(b);
+            });
+        }
+    }
+    reverse(order.begin(), order.end());
+    return order;
+}
+
+void MapGraph::renumber(vector<uint32_t> const &order) {
+    // order[new id] = old id
+    vector<uint32_t> new_ids(order.size());
+    for (uint32_t id{0}; id < order.size(); ++id) {
+        new_ids[order[id]] = id;
+    }
+
+    vector<string> new_names(names.size());
+    vector<MapEdge> new_edges(edges.size());
+    for (uint32_t old_id{0}; old_id < order.size(); ++old_id) {
+        uint32_t id = new_ids[old_id];
+        new_names[id] = move(names[old_id]);
+        for (int side{0}; side < 2; ++side) {
+            MapEdge edge = edges[2 * old_id + side];
+            if (edge.node != NO_NODE)
+                edge.node = new_ids[edge.node];
+            new_edges[2 * id + side] = edge;
+        }
+        ids[new_names[id]] = id;
+        map_ids[id] = old_id;
+        internal_ids[old_id] = id;
+    }
+    names.swap(new_names);
+    edges.swap(new_edges);
+}
+
+int MapGraph::get_id(string const &name) const {
+    auto found = ids.find(name);
+    return found != ids.end() ? static_cast<int>(found->second) : -1;
+}
+
+size_t MapGraph::get_memory_usage() const {
+    size_t bytes = sizeof(*this) + names.capacity() * sizeof(string)
+                 + (edges.capacity() + incoming.capacity()) * sizeof(MapEdge)
+                 + in_first.capacity() * sizeof(uint32_t)
+                 + (map_ids.capacity() + internal_ids.capacity()) * sizeof(uint32_t)
+                 + ids.bucket_count() * sizeof(void*);
+    for (string const &name : names) {
+        // Short names live inside the string object, count both copies
+        bytes += 2 * (name.capacity() > 15 ? name.capacity() + 1 : 0);
+    }
+    bytes += ids.size() * (sizeof(pair<string const, unsigned>) + 2 * sizeof(void*));
+    return bytes + contracted->get_memory_usage();
+}
+
+uint32_t map_version(json const &m) {
+    return MapGraph::from_json(m)->get_version();
+}
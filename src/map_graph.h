@@ -0,0 +1,136 @@
+/*
+ * Immutable road map that any number of PathFinders (and so ControlCenters)
+ * can share. Create it once with MapGraph::from_json(m) and hand the
+ * shared pointer to every user; it is freed when the last user is gone.
+ *
+ * Like MapNode every node has at most two outgoing edges, left and right.
+ * A node with a single edge has it as its left edge.
+ *
+ * Nodes have two numberings. The map id is the position in the map file,
+ * which is what other programs (e.g. the dispatcher) know. The id used by
+ * everything else in MapGraph is assigned at load time by a reverse
+ * Cuthill-McKee ordering so that nodes that are close in the graph are
+ * close in memory, which keeps searches in cache on large maps. Pass
+ * reorder=false to keep map order.
+ *
+ * Loading also builds a ContractedGraph of the map (contracted_graph.h),
+ * which PathFinder routes on.
+ *
+ * Nothing in a MapGraph changes after creation, so it can be read from any
+ * number of threads. All search state lives in the PathFinders.
+ */
+
+#ifndef MAP_GRAPH_H
+#define MAP_GRAPH_H
+
+#include "map_node.h"
+
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <nlohmann/json.hpp>
+
+using json = nlohmann::json;
+
+#define NO_NODE UINT32_MAX
+
+class ContractedGraph;
+
+struct MapEdge {
+    uint32_t node{NO_NODE};
+    uint32_t weight{0};
+};
+
+class MapGraph {
+public:
+    static std::shared_ptr<MapGraph const> from_json(json const &m, bool reorder=true);
+    static std::shared_ptr<MapGraph const> from_nodes(std::list<MapNode*> const &nodes,
+                                                      bool reorder=true);
+
+    size_t size() const {
+        return names.size();
+    }
+
+    /* Return -1 for unknown names. */
+    int get_id(std::string const &name) const;
+    std::string const &get_name(unsigned id) const {
+        return names[id];
+    }
+
+    MapEdge get_left(unsigned id) const {
+        return edges[2 * id];
+    }
+    MapEdge get_right(unsigned id) const {
+        return edges[2 * id + 1];
+    }
+    unsigned get_degree(unsigned id) const {
+        return (edges[2 * id].node != NO_NODE) + (edges[2 * id + 1].node != NO_NODE);
+    }
+    /* Copy the outgoing edges, left first, and return how many there are. */
+    unsigned get_edges(unsigned id, MapEdge out[2]) const {
+        out[0] = edges[2 * id];
+        out[1] = edges[2 * id + 1];
+        return get_degree(id);
+    }
+
+    /* Edges into the node: get_in_degree(id) edges from get_incoming(id)
+     * on, each with the node it comes from. */
+    unsigned get_in_degree(unsigned id) const {
+        return in_first[id + 1] - in_first[id];
+    }
+    MapEdge const *get_incoming(unsigned id) const {
+        return incoming.data() + in_first[id];
+    }
+
+    /* Convert between ids and map ids (position in the map file). */
+    uint32_t get_map_id(unsigned id) const {
+        return map_ids[id];
+    }
+    uint32_t from_map_id(unsigned map_id) const {
+        return internal_ids[map_id];
+    }
+
+    /* Fingerprint of the map, the same for every copy of the same map.
+     * Used to check that a mission refers to the map we have. */
+    uint32_t get_version() const {
+        return version;
+    }
+
+    /* The map with its single-successor chains collapsed. */
+    ContractedGraph const &get_contracted() const {
+        return *contracted;
+    }
+
+    /* Approximate heap usage in bytes, the contracted graph included. */
+    size_t get_memory_usage() const;
+
+private:
+    MapGraph() = default;
+
+    /* Number the nodes, then add edges by name. */
+    void add_node(std::string const &name);
+    void add_edge(unsigned from, std::string const &to, int weight);
+    void finish(bool reorder);
+
+    /* Reverse Cuthill-McKee order of the nodes, ignoring edge directions. */
+    std::vector<uint32_t> locality_order() const;
+    void renumber(std::vector<uint32_t> const &order);
+    void add_incoming();
+
+    std::vector<std::string> names{};
+    std::vector<MapEdge> edges{};  // Left and right edge of each node
+    std::vector<uint32_t> in_first{};
+    std::vector<MapEdge> incoming{};
+    std::unordered_map<std::string, unsigned> ids{};
+    std::vector<uint32_t> map_ids{};
+    std::vector<uint32_t> internal_ids{};
+    uint32_t version{0};
+    std::shared_ptr<ContractedGraph const> contracted{};
+};
+
+uint32_t map_version(json const &m);
+
+#endif // MAP_GRAPH_H
@@ -0,0 +1,137 @@
+#include "map_partition.h"
+#include "map_graph.h"
+#include "graph_search.h"
+#include "log.h"
+
+#include <algorithm>
+#include <climits>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+namespace {
+    /* The nodes first to last - 1 of a MapGraph, numbered from 0, without
+     * the edges that leave them. */
+    class RegionGraph {
+    public:
+        RegionGraph(MapGraph const &graph, uint32_t first, uint32_t last)
+        : graph{graph}, first{first}, last{last} {
+        }
+
+        size_t size() const {
+            return last - first;
+        }
+        unsigned get_edges(unsigned id, MapEdge out[2]) const {
+            MapEdge edges[2];
+            unsigned degree = graph.get_edges(id + first, edges);
+            unsigned inside{0};
+            for (unsigned i{0}; i < degree; ++i) {
+                if (edges[i].node >= first && edges[i].node < last)
+                    out[inside++] = MapEdge{edges[i].node - first, edges[i].weight};
+            }
+            return inside;
+        }
+
+    private:
+        MapGraph const &graph;
+        uint32_t first;
+        uint32_t last;
+    };
+}
+
+MapPartition partition_map(json const &m, unsigned parts) {
+    MapPartition partition{};
+    shared_ptr<MapGraph const> graph = MapGraph::from_json(m);
+    size_t n = graph->size();
+    if (parts == 0 || parts > n) {
+        Logger::log(WARNING, __FILE__, "partition_map", "Bad number of parts");
+        parts = n > 0 ? 1 : 0;
+    }
+
+    // Equal ranges of the locality order
+    vector<uint32_t> first(parts + 1);
+    for (unsigned part{0}; part <= parts; ++part) {
+        first[part] = (static_cast<uint64_t>(part) * n + parts - 1) / parts;
+    }
+    vector<uint32_t> region(n);
+    for (unsigned part{0}; part < parts; ++part) {
+        for (uint32_t id{first[part]}; id < first[part + 1]; ++id) {
+            region[id] = part;
+        }
+    }
+
+    vector<bool> is_boundary(n, false);
+    json overlay_edges = json::array();
+    for (uint32_t id{0}; id < n; ++id) {
+        MapEdge edges[2];
+        unsigned degree = graph->get_edges(id, edges);
+        for (unsigned i{0}; i < degree; ++i) {
+            if (region[edges[i].node] != region[id]) {
+                is_boundary[id] = true;
+                is_boundary[edges[i].node] = true;
+                overlay_edges.push_back({graph->get_name(id), graph->get_name(edges[i].node),
+                                         edges[i].weight});
+            }
+        }
+    }
+
+    json nodes = json::object();
+    json boundary = json::array();
+    vector<unsigned> weights{};
+    vector<unsigned> queued{};
+    SearchQueue queue{};
+    for (unsigned part{0}; part < parts; ++part) {
+        json map_data = json::object();
+        json region_boundary = json::array();
+        vector<uint32_t> boundary_ids{};
+        for (uint32_t id{first[part]}; id < first[part + 1]; ++id) {
+            string const &name = graph->get_name(id);
+            nodes[name] = part;
+            json edges_json = json::array();
+            MapEdge edges[2];
+            unsigned degree = graph->get_edges(id, edges);
+            for (unsigned i{0}; i < degree; ++i) {
+                string const &to = graph->get_name(edges[i].node);
+                edges_json.push_back({{to, edges[i].weight}});
+                if (region[edges[i].node] != part && !map_data.contains(to))
+                    map_data[to] = json::array();
+            }
+            map_data[name] = edges_json;
+            if (is_boundary[id]) {
+                region_boundary.push_back(name);
+                boundary_ids.push_back(id);
+            }
+        }
+
+        // Shortest distances inside the region between its boundary nodes,
+        // MULTI_SOURCE_LANES boundary nodes at a time
+        RegionGraph region_graph{*graph, first[part], first[part + 1]};
+        vector<uint32_t> sources{};
+        for (uint32_t from : boundary_ids) {
+            sources.push_back(from - first[part]);
+        }
+        for (size_t batch{0}; batch < sources.size(); batch += MULTI_SOURCE_LANES) {
+            size_t count = min<size_t>(MULTI_SOURCE_LANES, sources.size() - batch);
+            multi_source_distances(region_graph, &sources[batch], count, weights, queued, queue);
+            for (size_t lane{0}; lane < count; ++lane) {
+                uint32_t from = boundary_ids[batch + lane];
+                for (uint32_t to : boundary_ids) {
+                    unsigned weight = weights[(to - first[part]) * MULTI_SOURCE_LANES + lane];
+                    if (to != from && weight != UINT_MAX)
+                        overlay_edges.push_back({graph->get_name(from), graph->get_name(to), weight});
+                }
+            }
+        }
+
+        json region_map{};
+        region_map["MapData"] = map_data;
+        region_map["Boundary"] = region_boundary;
+        partition.regions.push_back(region_map);
+        boundary.push_back(region_boundary);
+    }
+    partition.overlay["Nodes"] = nodes;
+    partition.overlay["Boundary"] = boundary;
+    partition.overlay["Edges"] = overlay_edges;
+    return partition;
+}
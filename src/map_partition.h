@@ -0,0 +1,39 @@
+/*
+ * Split a map into regions for partitioned routing (partitioned_planner.h).
+ *
+ * Regions are contiguous ranges of MapGraph's locality order, so nodes
+ * that are close in the graph end up in the same region and few edges
+ * cross regions. A node with an edge to or from another region is a
+ * boundary node.
+ *
+ * Every region becomes a map of its own, served by an ordinary planner
+ * daemon (planner_server.h). It has:
+ * - "MapData": the region's nodes with all their edges in the original
+ *   order. Edges to other regions end at copies of the nodes on the other
+ *   side, which have no edges, so drive instructions at boundary nodes
+ *   come out the same as in the whole map.
+ * - "Boundary": the region's boundary nodes.
+ *
+ * The overlay has the region of every node ("Nodes"), the boundary nodes
+ * of every region ("Boundary") and the overlay graph over all boundary
+ * nodes ("Edges", [from, to, weight]): the edges between regions, plus
+ * the shortest distance inside the region between every pair of boundary
+ * nodes of a region.
+ */
+
+#ifndef MAP_PARTITION_H
+#define MAP_PARTITION_H
+
+#include <vector>
+#include <nlohmann/json.hpp>
+
+using json = nlohmann::json;
+
+struct MapPartition {
+    std::vector<json> regions{};
+    json overlay{};
+};
+
+MapPartition partition_map(json const &m, unsigned parts);
+
+#endif // MAP_PARTITION_H
@@ -0,0 +1,281 @@
+#include "metrics.h"
+#include "log.h"
+
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+using namespace std;
+
+uint64_t MetricsCounter::get() const {
+    uint64_t sum{0};
+    for (Shard const &shard : shards) {
+        sum += shard.value.load(memory_order_relaxed);
+    }
+    return sum;
+}
+
+MetricsHistogram::MetricsHistogram(vector<uint64_t> bounds, double scale)
+: bounds{bounds}, scale{scale} {
+    // Buckets, the one above all bounds and the sum
+    size_t per_line = METRICS_CACHE_LINE / sizeof(atomic<uint64_t>);
+    stride = (bounds.size() + 2 + per_line - 1) / per_line * per_line;
+    counts.reset(new atomic<uint64_t>[METRICS_SHARDS * stride + per_line]());
+    // Start the shards on a cache line boundary
+    size_t misalignment = reinterpret_cast<uintptr_t>(counts.get()) % METRICS_CACHE_LINE;
+    offset = misalignment == 0 ? 0 : (METRICS_CACHE_LINE - misalignment) / sizeof(atomic<uint64_t>);
+}
+
+vector<uint64_t> MetricsHistogram::get_counts() const {
+    vector<uint64_t> sums(bounds.size() + 1, 0);
+    for (unsigned shard{0}; shard < METRICS_SHARDS; ++shard) {
+        atomic<uint64_t> const *shard_counts = counts.get() + offset + shard * stride;
+        for (size_t bucket{0}; bucket < sums.size(); ++bucket) {
+            sums[bucket] += shard_counts[bucket].load(memory_order_relaxed);
+        }
+    }
+    return sums;
+}
+
+uint64_t MetricsHistogram::get_sum() const {
+    uint64_t sum{0};
+    for (unsigned shard{0}; shard < METRICS_SHARDS; ++shard) {
+        sum += counts[offset + shard * stride + bounds.size() + 1].load(memory_order_relaxed);
+    }
+    return sum;
+}
+
+MetricsRegistry::Family &MetricsRegistry::family(string const &name, string const &help,
+                                                 string const &type) {
+    Family &family = families[name];
+    if (family.type.empty()) {
+        family.help = help;
+        family.type = type;
+    } else if (family.type != type) {
+        Logger::log(WARNING, __FILE__, "MetricsRegistry", name + " registered as " + family.type
+                                                          + " and " + type);
+    }
+    return family;
+}
+
+MetricsCounter &MetricsRegistry::counter(string const &name, string const &help,
+                                         string const &labels, double scale) {
+    lock_guard<mutex> lock{registry_mutex};
+    unique_ptr<MetricsCounter> &metric = family(name, help, "counter").counters[labels];
+    if (!metric)
+        metric.reset(new MetricsCounter{scale});
+    return *metric;
+}
+
+MetricsGauge &MetricsRegistry::gauge(string const &name, string const &help,
+                                     string const &labels, double scale) {
+    lock_guard<mutex> lock{registry_mutex};
+    unique_ptr<MetricsGauge> &metric = family(name, help, "gauge").gauges[labels];
+    if (!metric)
+        metric.reset(new MetricsGauge{scale});
+    return *metric;
+}
+
+MetricsHistogram &MetricsRegistry::histogram(string const &name, string const &help,
+                                             vector<uint64_t> const &bounds,
+                                             string const &labels, double scale) {
+    lock_guard<mutex> lock{registry_mutex};
+    unique_ptr<MetricsHistogram> &metric = family(name, help, "histogram").histograms[labels];
+    if (!metric)
+        metric.reset(new MetricsHistogram{bounds, scale});
+    return *metric;
+}
+
+namespace {
+    string with_labels(string const &name, string const &labels, string const &extra="") {
+        if (labels.empty() && extra.empty())
+            return name;
+        string separator = labels.empty() || extra.empty() ? "" : ",";
+        return name + "{" + labels + separator + extra + "}";
+    }
+}
+
+string MetricsRegistry::render() const {
+    ostringstream out;
+    out.precision(15);
+    lock_guard<mutex> lock{registry_mutex};
+    for (auto const &named : families) {
+        string const &name = named.first;
+        Family const &family = named.second;
+        out << "# HELP " << name << " " << family.help << "\n"
+            << "# TYPE " << name << " " << family.type << "\n";
+        for (auto const &metric : family.counters) {
+            out << with_labels(name, metric.first) << " " << metric.second->get_scaled() << "\n";
+        }
+        for (auto const &metric : family.gauges) {
+            out << with_labels(name, metric.first) << " " << metric.second->get_scaled() << "\n";
+        }
+        for (auto const &metric : family.histograms) {
+            MetricsHistogram const &histogram = *metric.second;
+            vector<uint64_t> counts = histogram.get_counts();
+            uint64_t cumulative{0};
+            for (size_t bucket{0}; bucket < counts.size(); ++bucket) {
+                cumulative += counts[bucket];
+                ostringstream bound;
+                if (bucket < histogram.get_bounds().size()) {
+                    bound << histogram.get_bounds()[bucket] * histogram.get_scale();
+                } else {
+                    bound << "+Inf";
+                }
+                out << with_labels(name + "_bucket", metric.first, "le=\"" + bound.str() + "\"")
+                    << " " << cumulative << "\n";
+            }
+            out << with_labels(name + "_sum", metric.first) << " "
+                << histogram.get_sum() * histogram.get_scale() << "\n"
+                << with_labels(name + "_count", metric.first) << " " << cumulative << "\n";
+        }
+    }
+    return out.str();
+}
+
+MetricsExporter::MetricsExporter(MetricsRegistry const &registry, string target, unsigned interval_ms)
+: registry{registry}, path{target}, interval_ms{interval_ms} {
+    if (target.compare(0, 5, "unix:") == 0) {
+        use_socket = true;
+        path = target.substr(5);
+    }
+    if (pipe(wakeup_pipe) != 0) {
+        Logger::log(ERROR, __FILE__, "MetricsExporter", "Could not create wakeup pipe");
+        return;
+    }
+    if (use_socket && !open_socket())
+        return;
+    update();
+    open = true;
+    exporter = thread{&MetricsExporter::run, this};
+}
+
+MetricsExporter::~MetricsExporter() {
+    if (exporter.joinable()) {
+        char byte{0};
+        ssize_t ignored = write(wakeup_pipe[1], &byte, 1);
+        static_cast<void>(ignored);
+        exporter.join();
+    }
+    if (listen_fd >= 0) {
+        close(listen_fd);
+        unlink(path.c_str());
+    }
+    for (int fd : wakeup_pipe) {
+        if (fd >= 0)
+            close(fd);
+    }
+}
+
+bool MetricsExporter::open_socket() {
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(address.sun_path)) {
+        Logger::log(ERROR, __FILE__, "MetricsExporter", "Socket path too long");
+        return false;
+    }
+    strcpy(address.sun_path, path.c_str());
+
+    listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listen_fd < 0) {
+        Logger::log(ERROR, __FILE__, "MetricsExporter", strerror(errno));
+        return false;
+    }
+    unlink(path.c_str());
+    if (bind(listen_fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0
+            || listen(listen_fd, SOMAXCONN) != 0) {
+        Logger::log(ERROR, __FILE__, "MetricsExporter", strerror(errno));
+        close(listen_fd);
+        listen_fd = -1;
+        return false;
+    }
+    Logger::log(INFO, __FILE__, "MetricsExporter", "Serving metrics on " + path);
+    return true;
+}
+
+void MetricsExporter::run() {
+    pollfd poll_fds[2]{{wakeup_pipe[0], POLLIN, 0}, {listen_fd, POLLIN, 0}};
+    auto next_update = chrono::steady_clock::now() + chrono::milliseconds(interval_ms);
+    while (true) {
+        long timeout_ms = chrono::duration_cast<chrono::milliseconds>(
+                next_update - chrono::steady_clock::now()).count();
+        int ready = poll(poll_fds, use_socket ? 2 : 1, timeout_ms > 0 ? timeout_ms : 0);
+        if (ready < 0 && errno != EINTR) {
+            Logger::log(ERROR, __FILE__, "MetricsExporter", strerror(errno));
+            return;
+        }
+        if (ready > 0 && poll_fds[0].revents != 0)
+            return;
+        if (ready > 0 && use_socket && poll_fds[1].revents != 0)
+            serve_client();
+        if (chrono::steady_clock::now() >= next_update) {
+            update();
+            next_update += chrono::milliseconds(interval_ms);
+        }
+    }
+}
+
+void MetricsExporter::update() {
+    text = registry.render();
+    if (!use_socket) {
+        // Rename over the old file so that readers see all of one update
+        string temporary = path + ".tmp";
+        FILE *file = fopen(temporary.c_str(), "w");
+        bool written = file != nullptr && fwrite(text.data(), 1, text.size(), file) == text.size();
+        int error = errno;
+        if (file != nullptr && fclose(file) != 0 && written) {
+            written = false;
+            error = errno;
+        }
+        if (written && rename(temporary.c_str(), path.c_str()) != 0) {
+            written = false;
+            error = errno;
+        }
+        if (!written) {
+            Logger::log(WARNING, __FILE__, "MetricsExporter", "Could not write " + path + ": "
+                                                              + strerror(error));
+            if (file != nullptr)
+                remove(temporary.c_str());
+            return;
+        }
+    }
+    ++update_count;
+}
+
+void MetricsExporter::serve_client() {
+    int fd = accept(listen_fd, nullptr, nullptr);
+    if (fd < 0) {
+        Logger::log(WARNING, __FILE__, "MetricsExporter", strerror(errno));
+        return;
+    }
+    // Answer HTTP clients in HTTP, wait briefly for a request
+    string reply = text;
+    pollfd request{fd, POLLIN, 0};
+    char data[512];
+    if (poll(&request, 1, 100) > 0) {
+        ssize_t received = recv(fd, data, sizeof(data), MSG_DONTWAIT);
+        if (received >= 4 && memcmp(data, "GET ", 4) == 0) {
+            reply = "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\n"
+                    "Content-Length: " + to_string(text.size()) + "\r\n\r\n" + text;
+        }
+    }
+    size_t sent{0};
+    while (sent < reply.size()) {
+        ssize_t n = send(fd, reply.data() + sent, reply.size() - sent, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0)
+            break;
+        sent += n;
+    }
+    close(fd);
+}
@@ -0,0 +1,213 @@
+/*
+ * Operational metrics: counters, gauges and histograms in a registry that
+ * renders them in the Prometheus text format, and an exporter that writes
+ * the text to a file or serves it on a Unix domain socket.
+ *
+ * Register metrics once at startup and keep the returned references:
+ *     MetricsCounter &blocked = registry.counter("control_center_blocked_total",
+ *                                                "Times the path was blocked");
+ *     blocked.add();  // In the hot path
+ *
+ * Updates are relaxed atomic adds and stores, never locks. Counters and
+ * histograms are split into METRICS_SHARDS cache-line sized shards and
+ * every thread adds to its own, so threads updating the same metric do
+ * not bounce a cache line between them. Reading sums the shards.
+ *
+ * Values are integers in a unit of the caller's choice, e.g. nanoseconds,
+ * and scaled to the exported unit (seconds) when rendered.
+ */
+
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#define METRICS_SHARDS 16
+#define METRICS_CACHE_LINE 64
+
+/* Shard of the calling thread, assigned round robin on first use. */
+inline unsigned metrics_shard() {
+    static std::atomic<unsigned> next_shard{0};
+    thread_local unsigned shard = next_shard.fetch_add(1, std::memory_order_relaxed) % METRICS_SHARDS;
+    return shard;
+}
+
+class MetricsCounter {
+public:
+    MetricsCounter(double scale=1) : scale{scale} {
+    }
+
+    MetricsCounter(MetricsCounter const&) = delete;
+    MetricsCounter operator=(MetricsCounter const&) = delete;
+
+    void add(uint64_t value=1) {
+        shards[metrics_shard()].value.fetch_add(value, std::memory_order_relaxed);
+    }
+
+    uint64_t get() const;
+    double get_scaled() const {
+        return get() * scale;
+    }
+
+private:
+    struct alignas(METRICS_CACHE_LINE) Shard {
+        std::atomic<uint64_t> value{0};
+    };
+
+    double scale;
+    Shard shards[METRICS_SHARDS]{};
+};
+
+class MetricsGauge {
+public:
+    MetricsGauge(double scale=1) : scale{scale} {
+    }
+
+    MetricsGauge(MetricsGauge const&) = delete;
+    MetricsGauge operator=(MetricsGauge const&) = delete;
+
+    void set(int64_t new_value) {
+        value.store(new_value, std::memory_order_relaxed);
+    }
+    void add(int64_t delta) {
+        value.fetch_add(delta, std::memory_order_relaxed);
+    }
+
+    int64_t get() const {
+        return value.load(std::memory_order_relaxed);
+    }
+    double get_scaled() const {
+        return get() * scale;
+    }
+
+private:
+    double scale;
+    std::atomic<int64_t> value{0};
+};
+
+/* Counts of observations at or below fixed bucket bounds, plus their sum. */
+class MetricsHistogram {
+public:
+    /* bounds in increasing order, in the unit of the observations. */
+    MetricsHistogram(std::vector<uint64_t> bounds, double scale=1);
+
+    MetricsHistogram(MetricsHistogram const&) = delete;
+    MetricsHistogram operator=(MetricsHistogram const&) = delete;
+
+    void observe(uint64_t value) {
+        // Few buckets, a linear search is as fast as any
+        size_t bucket{0};
+        while (bucket < bounds.size() && value > bounds[bucket]) {
+            ++bucket;
+        }
+        std::atomic<uint64_t> *shard = counts.get() + offset + metrics_shard() * stride;
+        shard[bucket].fetch_add(1, std::memory_order_relaxed);
+        shard[bounds.size() + 1].fetch_add(value, std::memory_order_relaxed);
+    }
+
+    std::vector<uint64_t> const &get_bounds() const {
+        return bounds;
+    }
+    double get_scale() const {
+        return scale;
+    }
+
+    /* Observations per bucket, the last one above all bounds, and the sum. */
+    std::vector<uint64_t> get_counts() const;
+    uint64_t get_sum() const;
+
+private:
+    std::vector<uint64_t> bounds;
+    double scale;
+    size_t stride{0};  // Counters per shard, rounded up to whole cache lines
+    size_t offset{0};  // First counter on a cache line boundary
+    std::unique_ptr<std::atomic<uint64_t>[]> counts{};
+};
+
+class MetricsRegistry {
+public:
+    MetricsRegistry() = default;
+
+    MetricsRegistry(MetricsRegistry const&) = delete;
+    MetricsRegistry operator=(MetricsRegistry const&) = delete;
+
+    /* Register a metric, or get the one already registered with the same
+     * name and labels. labels is in Prometheus syntax without the braces,
+     * e.g. "state=\"normal\"". The reference stays valid as long as the
+     * registry. */
+    MetricsCounter &counter(std::string const &name, std::string const &help,
+                            std::string const &labels="", double scale=1);
+    MetricsGauge &gauge(std::string const &name, std::string const &help,
+                        std::string const &labels="", double scale=1);
+    MetricsHistogram &histogram(std::string const &name, std::string const &help,
+                                std::vector<uint64_t> const &bounds,
+                                std::string const &labels="", double scale=1);
+
+    /* All metrics in the Prometheus text exposition format. */
+    std::string render() const;
+
+private:
+    struct Family {
+        std::string help{};
+        std::string type{};
+        std::map<std::string, std::unique_ptr<MetricsCounter>> counters{};
+        std::map<std::string, std::unique_ptr<MetricsGauge>> gauges{};
+        std::map<std::string, std::unique_ptr<MetricsHistogram>> histograms{};
+    };
+
+    Family &family(std::string const &name, std::string const &help, std::string const &type);
+
+    mutable std::mutex registry_mutex{};
+    std::map<std::string, Family> families{};
+};
+
+/* Render a registry every interval_ms milliseconds in a thread of its own.
+ * With a target of "unix:PATH" the text is served to every client that
+ * connects to the Unix domain socket PATH (plain text, or an HTTP response
+ * if the client sends an HTTP request, so
+ * curl --unix-socket PATH http://localhost/metrics works). Any other
+ * target is a file, replaced atomically on every update so readers never
+ * see half of it. */
+class MetricsExporter {
+public:
+    MetricsExporter(MetricsRegistry const &registry, std::string target, unsigned interval_ms=1000);
+    ~MetricsExporter();
+
+    MetricsExporter(MetricsExporter const&) = delete;
+    MetricsExporter operator=(MetricsExporter const&) = delete;
+
+    bool is_open() const {
+        return open;
+    }
+
+    /* Number of updates written so far. */
+    unsigned long get_update_count() const {
+        return update_count;
+    }
+
+private:
+    bool open_socket();
+    void run();
+    void update();
+    void serve_client();
+
+    MetricsRegistry const &registry;
+    std::string path;
+    bool use_socket{false};
+    unsigned interval_ms;
+    bool open{false};
+    int listen_fd{-1};
+    int wakeup_pipe[2]{-1, -1};
+    std::string text{};
+    std::atomic<unsigned long> update_count{0};
+    std::thread exporter{};
+};
+
+#endif // METRICS_H
@@ -0,0 +1,56 @@
+#include "mission_message.h"
+
+#include <vector>
+
+using namespace std;
+
+namespace {
+
+void put_u32(vector<uint8_t> &buffer, uint32_t value) {
+    for (int i{0}; i < 4; ++i) {
+        buffer.push_back(value >> (8 * i));
+    }
+}
+
+}  // namespace
+
+mission::Status MissionView::decode(uint8_t const *data, size_t size,
+                                    uint32_t expected_map_version, size_t node_count) {
+    targets = nullptr;
+    count = 0;
+    if (size < MISSION_HEADER_SIZE)
+        return mission::truncated;
+    if (read_u32(data) != MISSION_MAGIC)
+        return mission::bad_magic;
+    if (read_u32(data + 4) != expected_map_version)
+        return mission::wrong_map_version;
+    size_t target_count = data[8] | data[9] << 8;
+    if (size < MISSION_HEADER_SIZE + target_count * MISSION_TARGET_SIZE)
+        return mission::truncated;
+
+    uint8_t const *first = data + MISSION_HEADER_SIZE;
+    for (size_t i{0}; i < target_count; ++i) {
+        if (read_u32(first + i * MISSION_TARGET_SIZE) >= node_count)
+            return mission::unknown_node;
+    }
+    targets = first;
+    count = target_count;
+    return mission::ok;
+}
+
+vector<uint8_t> encode_mission(uint32_t map_version, vector<MissionTarget> const &targets) {
+    vector<uint8_t> buffer{};
+    buffer.reserve(MISSION_HEADER_SIZE + targets.size() * MISSION_TARGET_SIZE);
+    put_u32(buffer, MISSION_MAGIC);
+    put_u32(buffer, map_version);
+    buffer.push_back(targets.size());
+    buffer.push_back(targets.size() >> 8);
+    buffer.push_back(0);
+    buffer.push_back(0);
+    for (MissionTarget const &target : targets) {
+        put_u32(buffer, target.node);
+        put_u32(buffer, target.mission_id);
+        buffer.push_back(target.flags);
+    }
+    return buffer;
+}
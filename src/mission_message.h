@@ -0,0 +1,77 @@
+/*
+ * Binary mission upload format.
+ *
+ * A mission message is a list of targets on a given map version. The first
+ * target is where the vehicle starts. Nodes are referred to by their id,
+ * i.e. their position in the map (see PathFinder::get_node_id()).
+ *
+ * Layout, all integers little endian:
+ *   uint32 magic, uint32 map version, uint16 target count, uint16 unused,
+ *   then per target: uint32 node id, uint32 mission id, uint8 flags
+ *
+ * MissionView decodes in place: it checks the message once and then reads
+ * the targets straight out of the caller's buffer, so decoding allocates
+ * nothing. The buffer must outlive the view.
+ */
+
+#ifndef MISSION_MESSAGE_H
+#define MISSION_MESSAGE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#define MISSION_MAGIC 0x314e534d
+#define MISSION_HEADER_SIZE 12
+#define MISSION_TARGET_SIZE 9
+
+namespace mission {
+    enum Status {ok, truncated, bad_magic, wrong_map_version, unknown_node};
+
+    /* Target flags */
+    enum Flag : uint8_t {
+        pass_through = 1 << 0  // Drive past the target without stopping
+    };
+}
+
+struct MissionTarget {
+    uint32_t node{0};
+    uint32_t mission_id{0};
+    uint8_t flags{0};
+};
+
+class MissionView {
+public:
+    MissionView() = default;
+
+    /* Check the message and point the view at it. node_count is the number
+     * of nodes in the map, every node id must be below it. */
+    mission::Status decode(uint8_t const *data, size_t size,
+                           uint32_t expected_map_version, size_t node_count);
+
+    size_t size() const {
+        return count;
+    }
+    uint32_t get_node(size_t i) const {
+        return read_u32(targets + i * MISSION_TARGET_SIZE);
+    }
+    uint32_t get_mission_id(size_t i) const {
+        return read_u32(targets + i * MISSION_TARGET_SIZE + 4);
+    }
+    uint8_t get_flags(size_t i) const {
+        return targets[i * MISSION_TARGET_SIZE + 8];
+    }
+
+    static uint32_t read_u32(uint8_t const *p) {
+        return p[0] | p[1] << 8 | p[2] << 16 | static_cast<uint32_t>(p[3]) << 24;
+    }
+
+private:
+    uint8_t const *targets{nullptr};
+    size_t count{0};
+};
+
+/* For the dispatcher: build a message for targets on map_version. */
+std::vector<uint8_t> encode_mission(uint32_t map_version, std::vector<MissionTarget> const &targets);
+
+#endif // MISSION_MESSAGE_H
@@ -0,0 +1,102 @@
+#include "occupancy_table.h"
+#include "log.h"
+
+#include <list>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+OccupancyTable::OccupancyTable(shared_ptr<MapGraph const> map, unsigned vehicle_percent,
+                               unsigned planned_percent)
+: map{map}, vehicle_percent{vehicle_percent}, planned_percent{planned_percent},
+  vehicles(2 * map->size(), 0), planned(2 * map->size(), 0),
+  penalties(2 * map->size()), core_penalties(2 * map->get_contracted().size()) {
+    Logger::log(DEBUG, __FILE__, "constructor", "OccupancyTable created");
+}
+
+void OccupancyTable::set_route(string const &vehicle, list<string> const &road_segments) {
+    lock_guard<mutex> lock{table_mutex};
+    deque<uint32_t> &route = routes[vehicle];
+    for (size_t i{0}; i < route.size(); ++i) {
+        count(route[i], i == 0, -1);
+    }
+    route.clear();
+    for (string const &road_segment : road_segments) {
+        route.push_back(find_edge(road_segment));
+        count(route.back(), route.size() == 1, 1);
+    }
+}
+
+void OccupancyTable::advance(string const &vehicle) {
+    lock_guard<mutex> lock{table_mutex};
+    auto found = routes.find(vehicle);
+    if (found == routes.end() || found->second.empty())
+        return;
+    deque<uint32_t> &route = found->second;
+    count(route.front(), true, -1);
+    route.pop_front();
+    if (!route.empty()) {
+        count(route.front(), false, -1);
+        count(route.front(), true, 1);
+    }
+}
+
+void OccupancyTable::remove_vehicle(string const &vehicle) {
+    lock_guard<mutex> lock{table_mutex};
+    auto found = routes.find(vehicle);
+    if (found == routes.end())
+        return;
+    for (size_t i{0}; i < found->second.size(); ++i) {
+        count(found->second[i], i == 0, -1);
+    }
+    routes.erase(found);
+}
+
+unsigned OccupancyTable::get_vehicles(string const &road_segment) const {
+    uint32_t edge = find_edge(road_segment);
+    lock_guard<mutex> lock{table_mutex};
+    return edge == NO_NODE ? 0 : vehicles[edge];
+}
+
+unsigned OccupancyTable::get_planned(string const &road_segment) const {
+    uint32_t edge = find_edge(road_segment);
+    lock_guard<mutex> lock{table_mutex};
+    return edge == NO_NODE ? 0 : planned[edge];
+}
+
+uint32_t OccupancyTable::find_edge(string const &road_segment) const {
+    size_t arrow = road_segment.find("->");
+    if (arrow == string::npos)
+        return NO_NODE;
+    int from = map->get_id(road_segment.substr(0, arrow));
+    int to = map->get_id(road_segment.substr(arrow + 2));
+    if (from < 0 || to < 0)
+        return NO_NODE;
+    if (map->get_left(from).node == static_cast<uint32_t>(to))
+        return 2 * from;
+    if (map->get_right(from).node == static_cast<uint32_t>(to))
+        return 2 * from + 1;
+    return NO_NODE;
+}
+
+void OccupancyTable::count(uint32_t edge, bool on, int change) {
+    if (edge == NO_NODE)
+        return;
+    (on ? vehicles : planned)[edge] += change;
+
+    // Weight times the percentages, rounded up
+    MapEdge map_edge = edge % 2 == 0 ? map->get_left(edge / 2) : map->get_right(edge / 2);
+    unsigned long percent = static_cast<unsigned long>(vehicle_percent) * vehicles[edge]
+            + static_cast<unsigned long>(planned_percent) * planned[edge];
+    uint32_t penalty = (map_edge.weight * percent + 99) / 100;
+    uint32_t old_penalty = penalties[edge].load(memory_order_relaxed);
+    penalties[edge].store(penalty, memory_order_relaxed);
+
+    // The contracted edge that has this one in its chain
+    ContractedGraph const &graph = map->get_contracted();
+    uint32_t from = edge / 2;
+    uint32_t core = graph.get_core(from);
+    uint32_t core_edge = core != NO_NODE ? 2 * core + edge % 2 : graph.get_position(from).edge;
+    core_penalties[core_edge].fetch_add(penalty - old_penalty, memory_order_relaxed);
+}
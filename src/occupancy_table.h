@@ -0,0 +1,132 @@
+/*
+ * Live occupancy of the road segments of a map, shared by all control
+ * centers of a fleet in one process (a simulator or a dispatcher running
+ * many vehicles), and the congestion penalties routing adds for it.
+ *
+ * Every vehicle reports its route: the road segment it is on, then the
+ * ones it plans to drive. A segment costs its weight plus, rounded up,
+ * vehicle_percent of it for every vehicle on it and planned_percent for
+ * every vehicle that plans to drive it, so vehicles with the same target
+ * spread over parallel roads instead of all taking the shortest one.
+ *
+ * Penalties are kept per edge of the MapGraph and per edge of its
+ * ContractedGraph and updated as reports come in, only for the segments
+ * that changed; the map is never rebuilt. Reports take a lock, reading
+ * penalties does not, so PathFinders in other threads search while
+ * vehicles report (see PathFinder::set_occupancy()).
+ *
+ * Use: shared_ptr<OccupancyTable> table{new OccupancyTable{map}};
+ *      table->set_route("car1", {"A1->K1", "K1->J1", "J1->I1"});
+ *      table->advance("car1");   // Now on K1->J1
+ */
+
+#ifndef OCCUPANCY_TABLE_H
+#define OCCUPANCY_TABLE_H
+
+#include "map_graph.h"
+#include "contracted_graph.h"
+
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#define OCCUPANCY_VEHICLE_PERCENT 100  // A vehicle on the segment
+#define OCCUPANCY_PLANNED_PERCENT 25   // A vehicle planning to drive it
+
+class OccupancyTable {
+public:
+    OccupancyTable(std::shared_ptr<MapGraph const> map,
+                   unsigned vehicle_percent=OCCUPANCY_VEHICLE_PERCENT,
+                   unsigned planned_percent=OCCUPANCY_PLANNED_PERCENT);
+
+    OccupancyTable(OccupancyTable const&) = delete;
+    OccupancyTable operator=(OccupancyTable const&) = delete;
+
+    /* The vehicle is on road_segments.front() and plans to drive the rest,
+     * e.g. ControlCenter's road segments. Replaces its last route. Entries
+     * that are not segments of the map (stops) are kept but count nowhere. */
+    void set_route(std::string const &vehicle, std::list<std::string> const &road_segments);
+
+    /* The vehicle moved on to the next entry of its route. */
+    void advance(std::string const &vehicle);
+
+    void remove_vehicle(std::string const &vehicle);
+
+    /* Vehicles on and planning to drive road_segment, e.g. "A1->K1". */
+    unsigned get_vehicles(std::string const &road_segment) const;
+    unsigned get_planned(std::string const &road_segment) const;
+
+    /* Added weight of the MapGraph edge (2 * id + side) and of the
+     * ContractedGraph edge (2 * core + side). */
+    unsigned get_penalty(unsigned edge) const {
+        return penalties[edge].load(std::memory_order_relaxed);
+    }
+    unsigned get_core_penalty(unsigned edge) const {
+        return core_penalties[edge].load(std::memory_order_relaxed);
+    }
+
+    MapGraph const &get_map() const {
+        return *map;
+    }
+
+private:
+    /* MapGraph edge of a road segment, NO_NODE if there is none. */
+    uint32_t find_edge(std::string const &road_segment) const;
+
+    /* Count the vehicle on (or planning to drive) edge, or not, and update
+     * the penalties of edge and of the contracted edge it is part of. */
+    void count(uint32_t edge, bool on, int change);
+
+    std::shared_ptr<MapGraph const> map;
+    unsigned vehicle_percent;
+    unsigned planned_percent;
+    mutable std::mutex table_mutex{};
+    // MapGraph edges of each vehicle's route, NO_NODE for entries that are
+    // no edge
+    std::unordered_map<std::string, std::deque<uint32_t>> routes{};
+    std::vector<uint32_t> vehicles{};  // Per MapGraph edge
+    std::vector<uint32_t> planned{};
+    std::vector<std::atomic<uint32_t>> penalties{};
+    std::vector<std::atomic<uint32_t>> core_penalties{};
+};
+
+/* The contracted graph of a table's map with the penalties added to its
+ * edges, for the searches of graph_search.h. */
+class CongestedGraph {
+public:
+    CongestedGraph(OccupancyTable const &table)
+    : graph{table.get_map().get_contracted()}, table{table} {
+    }
+
+    size_t size() const {
+        return graph.size();
+    }
+    unsigned get_edges(unsigned core, MapEdge out[2]) const {
+        unsigned degree = graph.get_edges(core, out);
+        for (unsigned i{0}; i < degree; ++i) {
+            out[i].weight += table.get_core_penalty(2 * core + i);
+        }
+        return degree;
+    }
+
+    /* The cheaper edge (2 * core + side) from core node from to to. */
+    unsigned find_edge(unsigned from, unsigned to) const {
+        MapEdge out[2];
+        unsigned degree = get_edges(from, out);
+        bool right = degree == 2 && out[1].node == to
+                && (out[0].node != to || out[1].weight < out[0].weight);
+        return 2 * from + right;
+    }
+
+private:
+    ContractedGraph const &graph;
+    OccupancyTable const &table;
+};
+
+#endif // OCCUPANCY_TABLE_H
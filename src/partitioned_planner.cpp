@@ -0,0 +1,205 @@
+#include "partitioned_planner.h"
+#include "map_graph.h"
+#include "log.h"
+
+#include <algorithm>
+#include <climits>
+#include <functional>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+PartitionedPlanner::PartitionedPlanner(json const &overlay, vector<string> socket_paths) {
+    for (auto &node : overlay["Nodes"].items()) {
+        node_regions[node.key()] = node.value();
+    }
+    unsigned region{0};
+    for (auto &region_boundary : overlay["Boundary"]) {
+        for (auto &name : region_boundary) {
+            overlay_ids[name] = overlay_names.size();
+            overlay_names.push_back(name);
+            overlay_regions.push_back(region);
+        }
+        ++region;
+    }
+    if (region != socket_paths.size())
+        Logger::log(WARNING, __FILE__, "PartitionedPlanner", "Not one planner per region");
+
+    // Edges grouped by the node they leave
+    vector<pair<uint32_t, pair<uint32_t, unsigned>>> overlay_edges{};
+    for (auto &edge : overlay["Edges"]) {
+        auto from = overlay_ids.find(edge[0]);
+        auto to = overlay_ids.find(edge[1]);
+        if (from == overlay_ids.end() || to == overlay_ids.end()) {
+            Logger::log(WARNING, __FILE__, "PartitionedPlanner", "Overlay edge between unknown nodes");
+            continue;
+        }
+        overlay_edges.push_back({from->second, {to->second, edge[2]}});
+    }
+    sort(overlay_edges.begin(), overlay_edges.end());
+    first_edge.assign(overlay_names.size() + 1, 0);
+    for (auto const &edge : overlay_edges) {
+        ++first_edge[edge.first + 1];
+        edges.push_back(edge.second);
+    }
+    for (size_t id{0}; id < overlay_names.size(); ++id) {
+        first_edge[id + 1] += first_edge[id];
+    }
+
+    for (string const &path : socket_paths) {
+        clients.emplace_back(new PlannerClient{path});
+    }
+}
+
+bool PartitionedPlanner::connected() const {
+    return all_of(clients.begin(), clients.end(),
+                  [] (unique_ptr<PlannerClient> const &client) { return client->connected(); });
+}
+
+vector<vector<PlannerReply>> PartitionedPlanner::ask(vector<vector<PlannerQuery>> const &queries) {
+    // All daemons work at the same time while the replies are collected
+    vector<vector<PlannerReply>> replies(queries.size());
+    for (size_t region{0}; region < queries.size(); ++region) {
+        if (!queries[region].empty())
+            clients[region]->send_queries(queries[region]);
+    }
+    for (size_t region{0}; region < queries.size(); ++region) {
+        if (!queries[region].empty())
+            replies[region] = clients[region]->receive_replies();
+    }
+    return replies;
+}
+
+PlannerReply PartitionedPlanner::route(string const &start, string const &stop) {
+    PlannerReply reply{};
+    auto start_region = node_regions.find(start);
+    auto stop_region = node_regions.find(stop);
+    if (start_region == node_regions.end() || stop_region == node_regions.end()
+            || start_region->second >= clients.size() || stop_region->second >= clients.size()) {
+        reply.status = planner::unknown_node;
+        return reply;
+    }
+    unsigned first_region = start_region->second;
+    unsigned last_region = stop_region->second;
+
+    // Distances to and from the boundaries of the start and stop regions
+    vector<vector<PlannerQuery>> queries(clients.size());
+    PlannerQuery query{};
+    query.type = planner::boundary_from;
+    query.start = start;
+    queries[first_region].push_back(query);
+    query = PlannerQuery{};
+    query.type = planner::boundary_to;
+    query.stop = stop;
+    queries[last_region].push_back(query);
+    size_t to_stop_index = queries[last_region].size() - 1;
+    if (first_region == last_region) {
+        // The route may also stay inside the region
+        query = PlannerQuery{};
+        query.type = planner::route;
+        query.start = start;
+        query.stop = stop;
+        queries[first_region].push_back(query);
+    }
+    vector<vector<PlannerReply>> replies = ask(queries);
+    PlannerReply const &from_start = replies[first_region][0];
+    PlannerReply const &to_stop_reply = replies[last_region][to_stop_index];
+    if (from_start.status != planner::ok || to_stop_reply.status != planner::ok) {
+        reply.status = from_start.status != planner::ok ? from_start.status : to_stop_reply.status;
+        return reply;
+    }
+    unsigned best{UINT_MAX};
+    if (first_region == last_region && replies[first_region][2].status == planner::ok)
+        best = replies[first_region][2].distance;
+
+    // Dijkstra over the overlay until no boundary node can beat the best
+    weights.assign(overlay_names.size(), UINT_MAX);
+    parents.assign(overlay_names.size(), NO_NODE);
+    to_stop.assign(overlay_names.size(), UINT_MAX);
+    queue.clear();
+    for (size_t i{0}; i < to_stop_reply.nodes.size(); ++i) {
+        to_stop[overlay_ids.at(to_stop_reply.nodes[i])] = to_stop_reply.distances[i];
+    }
+    for (size_t i{0}; i < from_start.nodes.size(); ++i) {
+        uint32_t id = overlay_ids.at(from_start.nodes[i]);
+        weights[id] = from_start.distances[i];
+        queue.emplace_back(weights[id], id);
+    }
+    make_heap(queue.begin(), queue.end(), greater<pair<unsigned, uint32_t>>());
+    uint32_t best_exit{NO_NODE};
+    while (!queue.empty()) {
+        pop_heap(queue.begin(), queue.end(), greater<pair<unsigned, uint32_t>>());
+        auto [weight, active_node] = queue.back();
+        queue.pop_back();
+        if (weight > weights[active_node])
+            continue;  // Already visited with a lower weight
+        if (weight >= best)
+            break;
+        if (to_stop[active_node] != UINT_MAX && weight + to_stop[active_node] < best) {
+            best = weight + to_stop[active_node];
+            best_exit = active_node;
+        }
+        for (uint32_t i{first_edge[active_node]}; i < first_edge[active_node + 1]; ++i) {
+            auto [node, edge_weight] = edges[i];
+            if (weight + edge_weight < weights[node]) {
+                weights[node] = weight + edge_weight;
+                parents[node] = active_node;
+                queue.emplace_back(weights[node], node);
+                push_heap(queue.begin(), queue.end(), greater<pair<unsigned, uint32_t>>());
+            }
+        }
+    }
+    if (best_exit == NO_NODE) {
+        if (first_region == last_region)
+            return replies[first_region][2];
+        reply.status = planner::no_route;
+        return reply;
+    }
+
+    // One piece per region passed, each ends where the next region starts
+    vector<uint32_t> path{};
+    for (uint32_t node = best_exit; node != NO_NODE; node = parents[node]) {
+        path.push_back(node);
+    }
+    reverse(path.begin(), path.end());
+    vector<Piece> pieces{};
+    string piece_start = start;
+    for (size_t i{1}; i < path.size(); ++i) {
+        if (overlay_regions[path[i - 1]] != overlay_regions[path[i]]) {
+            pieces.push_back(Piece{overlay_regions[path[i - 1]], piece_start, overlay_names[path[i]]});
+            piece_start = overlay_names[path[i]];
+        }
+    }
+    pieces.push_back(Piece{last_region, piece_start, stop});
+
+    queries.assign(clients.size(), {});
+    vector<size_t> indices{};
+    for (Piece const &piece : pieces) {
+        query = PlannerQuery{};
+        query.type = planner::route;
+        query.start = piece.start;
+        query.stop = piece.stop;
+        indices.push_back(queries[piece.region].size());
+        queries[piece.region].push_back(query);
+    }
+    replies = ask(queries);
+
+    reply.status = planner::ok;
+    reply.distance = best;
+    for (size_t i{0}; i < pieces.size(); ++i) {
+        PlannerReply const &part = replies[pieces[i].region][indices[i]];
+        if (part.status != planner::ok) {
+            Logger::log(WARNING, __FILE__, "route", "No route for " + pieces[i].start + "->"
+                                                    + pieces[i].stop + " in its region");
+            reply = PlannerReply{};
+            reply.status = part.status;
+            return reply;
+        }
+        reply.instructions.insert(reply.instructions.end(), part.instructions.begin(),
+                                  part.instructions.end());
+        reply.nodes.insert(reply.nodes.end(), part.nodes.begin() + (reply.nodes.empty() ? 0 : 1),
+                           part.nodes.end());
+    }
+    return reply;
+}
@@ -0,0 +1,86 @@
+/*
+ * Route planning on a map split into regions (map_partition.h), each
+ * served by its own planner daemon (planner_server.h), for maps that are
+ * too big for one planner process.
+ *
+ * A route from start to stop is found in two rounds of queries, each
+ * sent to all daemons involved before waiting for any of them:
+ * 1. The daemon of start's region finds the distances from start to its
+ *    boundary nodes, the daemon of stop's region those from its boundary
+ *    nodes to stop (and the route inside the region if both are in it).
+ * 2. A search over the overlay graph, seeded with the first distances,
+ *    finds the best boundary node to leave the overlay at. The route is
+ *    cut into one piece per region it passes, and every piece is solved
+ *    by the daemon of its region.
+ *
+ * Use: PartitionedPlanner planner{partition.overlay, {"/tmp/region0.sock", ...}};
+ *      PlannerReply reply = planner.route("A1", "K2");
+ */
+
+#ifndef PARTITIONED_PLANNER_H
+#define PARTITIONED_PLANNER_H
+
+#include "planner_client.h"
+#include "planner_protocol.h"
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include <nlohmann/json.hpp>
+
+using json = nlohmann::json;
+
+class PartitionedPlanner {
+public:
+    /* socket_paths[r] is the daemon serving region r of overlay. */
+    PartitionedPlanner(json const &overlay, std::vector<std::string> socket_paths);
+
+    PartitionedPlanner(PartitionedPlanner const&) = delete;
+    PartitionedPlanner operator=(PartitionedPlanner const&) = delete;
+
+    /* Are the daemons of all regions connected? */
+    bool connected() const;
+
+    /* Same reply as PlannerClient::route(). All daemons share one
+     * deadline per round, one that does not reply in time is disconnected
+     * and the route is planner::no_planner. */
+    PlannerReply route(std::string const &start, std::string const &stop);
+
+    size_t get_region_count() const {
+        return clients.size();
+    }
+    size_t get_overlay_size() const {
+        return overlay_names.size();
+    }
+
+private:
+    struct Piece {
+        unsigned region;
+        std::string start;
+        std::string stop;
+    };
+
+    /* Send each region's queries, then collect the replies. */
+    std::vector<std::vector<PlannerReply>> ask(std::vector<std::vector<PlannerQuery>> const &queries);
+
+    std::unordered_map<std::string, unsigned> node_regions{};
+    std::vector<std::unique_ptr<PlannerClient>> clients{};
+
+    // Overlay graph over the boundary nodes, edges in CSR form
+    std::unordered_map<std::string, uint32_t> overlay_ids{};
+    std::vector<std::string> overlay_names{};
+    std::vector<unsigned> overlay_regions{};
+    std::vector<uint32_t> first_edge{};
+    std::vector<std::pair<uint32_t, unsigned>> edges{};  // Node, weight
+
+    // Search state
+    std::vector<unsigned> weights{};
+    std::vector<uint32_t> parents{};
+    std::vector<unsigned> to_stop{};
+    std::vector<std::pair<unsigned, uint32_t>> queue{};
+};
+
+#endif // PARTITIONED_PLANNER_H
@@ -1,9 +1,12 @@
 #include "path_finder.h"
+#include "contracted_graph.h"
 #include "map_node.h"
 #include "log.h"
-#include "drive_mission_generator.h"
 
+#include <algorithm>
+#include <functional>
 #include <list>
+#include <numeric>
 #include <vector>
 #include <string>
 #include <nlohmann/json.hpp>
@@ -12,26 +15,30 @@ using namespace std;
 using json = nlohmann::json;
 
 /* Constructors and destructors */
-PathFinder::PathFinder() {
+PathFinder::PathFinder()
+: map{MapGraph::from_nodes({})} {
     Logger::log(DEBUG, __FILE__, "constructor", "PathFinder created");
 }
 
-PathFinder::PathFinder(json m, std::string start_node_name) {
+PathFinder::PathFinder(shared_ptr<MapGraph const> map)
+: map{map} {
+    Logger::log(DEBUG, __FILE__, "constructor", "PathFinder created with shared map");
+}
+
+PathFinder::PathFinder(json m, std::string start_node_name)
+: map{MapGraph::from_json(m)} {
     Logger::log(DEBUG, __FILE__, "constructor", "PathFinder created");
-    make_MapNode_list(m);
-    Logger::log(DEBUG, __FILE__, "make_MapNode_list", "Successfuly created list of MapNode*");
     solve(start_node_name);
 }
 
-PathFinder::PathFinder(list<MapNode*> map_nodes, std::string start_node_name) {
+PathFinder::PathFinder(list<MapNode*> map_nodes, std::string start_node_name)
+: map{MapGraph::from_nodes(map_nodes)}, owned_nodes{map_nodes} {
     Logger::log(DEBUG, __FILE__, "constructor", "PathFinder created");
-    nodes = map_nodes;
-    Logger::log(DEBUG, __FILE__, "make_MapNode_list", "Successfuly set list of MapNode*");
     solve(start_node_name);
 }
 
 PathFinder::~PathFinder() {
-    for (MapNode *ptr : nodes) {
+    for (MapNode *ptr : owned_nodes) {
         delete ptr;
     }
 }
@@ -39,213 +46,371 @@ PathFinder::~PathFinder() {
 /* Set drive_mission for entire graph */
 /* Not for normal use */
 void PathFinder::solve(string start_node_name) {
-    // Inititate map
-    MapNode *active_node = initiate_map_graph(start_node_name);
-    std::list<MapNode*> nodes_to_visit{active_node};
-
-    // Set new starting-node and remove from list
-    while (!(nodes_to_visit.empty())) {
-        // Make sure the node with the lowest weight is searched first
-        nodes_to_visit.sort(Comparator());
-        active_node = nodes_to_visit.front();
-        nodes_to_visit.pop_front();
-        active_node->set_visited(true);
-
-        // Update left neighbour's weight if bigger than active nodes weight + edge weight
-        MapNode *left_neighbour = active_node->get_left().node;
-        if (!(left_neighbour == nullptr)) {
-            if (left_neighbour->get_weight() >= active_node->get_weight() + active_node->get_left().weight) {
-                left_neighbour->set_weight(active_node->get_weight() + active_node->get_left().weight);
-            }
-        }
+    drive_mission.clear();
+    route.clear();
+    int start = map->get_id(start_node_name);
+    if (start < 0) {
+        Logger::log(WARNING, __FILE__, "solve", "Unknown start node");
+        return;
+    }
+    search(start, NO_NODE);
 
-        // Update right neighbour's weight if bigger than active nodes weight + edge weight
-        MapNode *right_neighbour = active_node->get_right().node;
-        if (!(right_neighbour == nullptr)) {
-            if (right_neighbour->get_weight() >= active_node->get_weight() + active_node->get_right().weight) {
-                right_neighbour->set_weight(active_node->get_weight() + active_node->get_right().weight);
-            }
+    /* Sort nodes by increasing node-weight */
+    vector<uint32_t> order(map->size());
+    iota(order.begin(), order.end(), 0);
+    sort(order.begin(), order.end(), [this] (uint32_t a, uint32_t b) {
+        if (weights[a] != weights[b])
+            return weights[a] < weights[b];
+        return map->get_map_id(a) < map->get_map_id(b);
+    });
+
+    // An instruction for every node followed by one of its neighbours
+    for (size_t i{0}; i + 1 < order.size(); ++i) {
+        uint32_t next = order[i+1];
+        MapEdge left = map->get_left(order[i]);
+        MapEdge right = map->get_right(order[i]);
+        if (map->get_degree(order[i]) == 1 && left.node == next) {
+            drive_mission.push_back(instruction::forward);
+        } else if (map->get_degree(order[i]) == 2 && left.node == next) {
+            drive_mission.push_back(instruction::left);
+        } else if (map->get_degree(order[i]) == 2 && right.node == next) {
+            drive_mission.push_back(instruction::right);
         }
+    }
+    Logger::log(DEBUG, __FILE__, "solve", "Ordered vector of drive instructions created");
+}
 
-        // Add nodes to nodes_to_visit list if they are not already visited
-        if (left_neighbour != nullptr) {
-            if (!(left_neighbour->is_visited())) {
-                nodes_to_visit.push_back(left_neighbour);
-            }
+/* Sets drive_mission for a limited Drive Mission */
+void PathFinder::solve(string start_node_name, string stop_node_name) {
+    int start = map->get_id(start_node_name);
+    int stop = map->get_id(stop_node_name);
+    solve_ids(start < 0 ? NO_NODE : start, stop < 0 ? NO_NODE : stop);
+}
+
+void PathFinder::solve(unsigned start_id, unsigned stop_id) {
+    solve_ids(start_id < map->size() ? map->from_map_id(start_id) : NO_NODE,
+              stop_id < map->size() ? map->from_map_id(stop_id) : NO_NODE);
+}
+
+void PathFinder::solve_ids(uint32_t start_id, uint32_t stop_id) {
+    // Forget the previous route so a failed solve never returns it
+    drive_mission.clear();
+    route.clear();
+    distance = UINT_MAX;
+
+    if (start_id >= map->size() || stop_id >= map->size()) {
+        Logger::log(WARNING, __FILE__, "solve", "No Map before DriveMission");
+        return;
+    }
+    contracted_route(start_id, stop_id, 0, NO_NODE);
+}
+
+void PathFinder::solve_from_segment(string const &road_segment, unsigned offset,
+                                    string const &stop_node_name) {
+    drive_mission.clear();
+    route.clear();
+    distance = UINT_MAX;
+
+    unsigned length = get_segment_length(road_segment);
+    int stop = map->get_id(stop_node_name);
+    if (stop < 0 || length == UINT_MAX) {
+        Logger::log(WARNING, __FILE__, "solve_from_segment", "Unknown road segment or stop node");
+        return;
+    }
+    size_t arrow = road_segment.find("->");
+    int from = map->get_id(road_segment.substr(0, arrow));
+    int to = map->get_id(road_segment.substr(arrow + 2));
+
+    // Start at the segment's head with the rest of the segment as cost
+    unsigned remaining = offset < length ? length - offset : 0;
+    contracted_route(to, stop, remaining, from);
+}
+
+unsigned PathFinder::get_segment_length(string const &road_segment) const {
+    size_t arrow = road_segment.find("->");
+    if (!map || arrow == string::npos)
+        return UINT_MAX;
+    int from = map->get_id(road_segment.substr(0, arrow));
+    int to = map->get_id(road_segment.substr(arrow + 2));
+    if (from < 0 || to < 0)
+        return UINT_MAX;
+    MapEdge left = map->get_left(from);
+    MapEdge right = map->get_right(from);
+    MapEdge edge = left.node == static_cast<uint32_t>(to) ? left : right;
+    return edge.node == static_cast<uint32_t>(to) ? edge.weight : UINT_MAX;
+}
+
+void PathFinder::contracted_route(uint32_t start, uint32_t stop, unsigned start_weight,
+                                  uint32_t before_start) {
+    ContractedGraph const &graph = map->get_contracted();
+    ContractedGraph::ChainPosition from = graph.get_position(start);
+    ContractedGraph::ChainPosition to = graph.get_position(stop);
+    if (before_start != NO_NODE)
+        route.push_back(before_start);
+
+    if (from.edge != NO_NODE && from.edge == to.edge && from.index <= to.index) {
+        // Further along the same chain, nothing to search
+        uint32_t const *chain = graph.get_chain(from.edge);
+        route.insert(route.end(), chain + from.index, chain + to.index + 1);
+        distance = start_weight + to.offset - from.offset;
+        make_drive_mission();
+        return;
+    }
+
+    // Down the chain of start to its core node, search between core nodes
+    // and up the chain of stop from its core node
+    uint32_t start_core = graph.get_core(start);
+    if (from.edge != NO_NODE) {
+        uint32_t const *chain = graph.get_chain(from.edge);
+        route.insert(route.end(), chain + from.index, chain + graph.get_chain_length(from.edge));
+        start_core = graph.get_edge(from.edge).node;
+        start_weight += graph.get_edge(from.edge).weight - from.offset;
+    }
+    uint32_t stop_core = to.edge == NO_NODE ? graph.get_core(stop) : to.edge / 2;
+    bool congested = occupancy && &occupancy->get_map() == map.get();
+    auto search = [&] (auto const &searched) {
+        if (prefer_dense_search(searched.size())) {
+            dense_shortest_paths(searched, start_core, stop_core, weights, parents, frontier,
+                                 start_weight);
+        } else {
+            shortest_paths(searched, start_core, stop_core, weights, parents, queue, start_weight);
         }
+    };
+    if (congested) {
+        search(CongestedGraph{*occupancy});
+    } else {
+        search(graph);
+    }
+    if (weights[stop_core] == UINT_MAX) {
+        Logger::log(WARNING, __FILE__, "solve", "No route to stop node");
+        route.clear();
+        return;
+    }
+    unsigned stop_offset = to.edge == NO_NODE ? 0 : to.offset;
+    distance = weights[stop_core] + stop_offset;
 
-        if (right_neighbour != nullptr) {
-            if (!(right_neighbour->is_visited())) {
-                nodes_to_visit.push_back(right_neighbour);
-            }
+    core_route.clear();
+    for (uint32_t core = stop_core; core != NO_NODE; core = parents[core]) {
+        core_route.push_back(core);
+    }
+    reverse(core_route.begin(), core_route.end());
+    if (congested) {
+        // The penalties may have changed since the search, add up the
+        // plain weights of the edges taken instead
+        CongestedGraph congested_graph{*occupancy};
+        distance = start_weight + stop_offset;
+        for (size_t i{0}; i + 1 < core_route.size(); ++i) {
+            unsigned edge = congested_graph.find_edge(core_route[i], core_route[i + 1]);
+            distance += graph.get_edge(edge).weight;
+            graph.unpack_edge(edge, route);
+        }
+    } else {
+        for (size_t i{0}; i + 1 < core_route.size(); ++i) {
+            graph.unpack(core_route[i], core_route[i + 1], route);
         }
     }
+    route.push_back(graph.get_node(stop_core));
+    if (to.edge != NO_NODE) {
+        uint32_t const *chain = graph.get_chain(to.edge);
+        route.insert(route.end(), chain, chain + to.index + 1);
+    }
+    make_drive_mission();
+}
 
-    /* Sort nodes by increasing node-weight */
-    nodes.sort(Comparator());
+void PathFinder::search(unsigned start, unsigned stop, unsigned start_weight) {
+    shortest_paths(*map, start, stop, weights, parents, queue, start_weight);
+}
 
-    DriveMissionGenerator drive_mission_generator{nodes};
-    drive_mission = drive_mission_generator.get_drive_mission();
+void PathFinder::make_drive_mission() {
+    drive_mission = route_instructions(*map, route);
     Logger::log(DEBUG, __FILE__, "solve", "Ordered vector of drive instructions created");
 }
 
-/* Sets drive_mission for a limited Drive Mission */
-void PathFinder::solve(string start_node_name, string stop_node_name) {
-    // Inititate map
-    MapNode *active_node = initiate_map_graph(start_node_name);
-    if (active_node != nullptr && !nodes.empty()) {
-        active_node->set_parent_node(nullptr);
-
-        // Place start node as first to visit
-        std::list<MapNode*> nodes_to_visit{active_node};
-
-        // Set new starting-node and remove from list
-        while (!(nodes_to_visit.empty())) {
-            // Make sure the node with the lowest weight is searched first
-            nodes_to_visit.sort(Comparator());
-            active_node = nodes_to_visit.front();
-            nodes_to_visit.pop_front();
-            active_node->set_visited(true);
-
-            // Update left neighbour's weight if bigger than active nodes weight + edge weight
-            MapNode *left_neighbour = active_node->get_left().node;
-            if (left_neighbour != nullptr) {
-                if (left_neighbour->get_weight() >= active_node->get_weight() + active_node->get_left().weight) {
-                    left_neighbour->set_weight(active_node->get_weight() + active_node->get_left().weight);
-                    left_neighbour->set_parent_node(active_node);
-                    active_node->set_child_node(left_neighbour);
-                    if (left_neighbour->get_name() == stop_node_name) {
-                        find_path(left_neighbour, stop_node_name);
-                        break;
-                    }
-                }
-            }
+vector<ReachableNode> PathFinder::reachable_within(unsigned start_id, unsigned budget) const {
+    if (start_id >= map->size()) {
+        Logger::log(WARNING, __FILE__, "reachable_within", "Unknown start node");
+        return {};
+    }
+    vector<ReachableNode> reached = bounded_search(*map, map->from_map_id(start_id), budget);
+    for (ReachableNode &node : reached) {
+        node.node = map->get_map_id(node.node);
+    }
+    return reached;
+}
 
-            // Update right neighbour's weight if bigger than active nodes weight + edge weight
-            MapNode *right_neighbour = active_node->get_right().node;
-            if (right_neighbour != nullptr) {
-                if (right_neighbour->get_weight() >= active_node->get_weight() + active_node->get_right().weight) {
-                    right_neighbour->set_weight(active_node->get_weight() + active_node->get_right().weight);
-                    right_neighbour->set_parent_node(active_node);
-                    active_node->set_child_node(right_neighbour);
-                    if (right_neighbour->get_name() == stop_node_name) {
-                        find_path(right_neighbour, stop_node_name);
-                        break;
-                    }
-                }
-            }
+vector<ReachableNode> PathFinder::reachable_within(string const &start_node_name,
+                                                   unsigned budget) const {
+    int start = get_node_id(start_node_name);
+    return reachable_within(start < 0 ? UINT_MAX : start, budget);
+}
+
+void PathFinder::set_vehicle_node(uint32_t vehicle, unsigned node_id) {
+    if (node_id >= map->size()) {
+        Logger::log(WARNING, __FILE__, "set_vehicle_node", "Unknown node");
+        return;
+    }
+    remove_vehicle(vehicle);
+    uint32_t node = map->from_map_id(node_id);
+    vehicle_nodes[vehicle] = node;
+    vehicles_at[node].push_back(vehicle);
+}
+
+void PathFinder::remove_vehicle(uint32_t vehicle) {
+    auto found = vehicle_nodes.find(vehicle);
+    if (found == vehicle_nodes.end())
+        return;
+    vector<uint32_t> &here = vehicles_at[found->second];
+    here.erase(std::find(here.begin(), here.end(), vehicle));
+    if (here.empty())
+        vehicles_at.erase(found->second);
+    vehicle_nodes.erase(found);
+}
 
-            // Add nodes to nodes_to_visit list if they are not already visited
-            if (left_neighbour != nullptr) {
-                if (!(left_neighbour->is_visited())) {
-                        nodes_to_visit.push_back(left_neighbour);
-                }
+vector<VehicleMatch> PathFinder::nearest_vehicles(unsigned target_id, unsigned k) {
+    vector<VehicleMatch> matches{};
+    if (target_id >= map->size()) {
+        Logger::log(WARNING, __FILE__, "nearest_vehicles", "Unknown target node");
+        return matches;
+    }
+    if (k == 0 || vehicles_at.empty())
+        return matches;
+
+    // Dijkstra over incoming edges, parents point towards the target
+    uint32_t target = map->from_map_id(target_id);
+    weights.assign(map->size(), UINT_MAX);
+    parents.assign(map->size(), NO_NODE);
+    queue.clear();
+    weights[target] = 0;
+    queue.emplace_back(0, target);
+    while (!queue.empty() && matches.size() < k) {
+        pop_heap(queue.begin(), queue.end(), greater<pair<unsigned, uint32_t>>());
+        auto [weight, active_node] = queue.back();
+        queue.pop_back();
+        if (weight > weights[active_node])
+            continue;  // Already visited with a lower weight
+
+        auto here = vehicles_at.find(active_node);
+        if (here != vehicles_at.end()) {
+            vector<uint32_t> route{};
+            for (uint32_t node = active_node; node != NO_NODE; node = parents[node]) {
+                route.push_back(node);
             }
-            if (right_neighbour != nullptr) {
-                if (!(right_neighbour->is_visited())) {
-                    nodes_to_visit.push_back(right_neighbour);
-                }
+            vector<instruction::InstructionNumber> instructions = route_instructions(*map, route);
+            for (uint32_t &node : route) {
+                node = map->get_map_id(node);
+            }
+            for (uint32_t vehicle : here->second) {
+                if (matches.size() == k)
+                    break;
+                matches.push_back(VehicleMatch{vehicle, weight, route, instructions});
+            }
+        }
+
+        MapEdge const *incoming = map->get_incoming(active_node);
+        for (unsigned i{0}; i < map->get_in_degree(active_node); ++i) {
+            MapEdge edge = incoming[i];
+            if (weight + edge.weight < weights[edge.node]) {
+                weights[edge.node] = weight + edge.weight;
+                parents[edge.node] = active_node;
+                queue.emplace_back(weights[edge.node], edge.node);
+                push_heap(queue.begin(), queue.end(), greater<pair<unsigned, uint32_t>>());
             }
         }
-    } else {
-        Logger::log(WARNING, __FILE__, "solve", "No Map before DriveMission");
     }
+    return matches;
 }
 
-/* Sets nodes */
-void PathFinder::update_map(json m) {
-    make_MapNode_list(m);
-}
-
-/*
- * Set all non-starting-node-weights to UINT_MAX and as unvisited,
- * set starting node weight to 0. Returns starting node
- */
-MapNode* PathFinder::initiate_map_graph(string &start_node_name) {
-    MapNode *start_node{};
-    for (MapNode *node : nodes) {
-        if (node->get_name() != start_node_name) {
-            node->set_weight(UINT_MAX);
-            node->set_visited(false);
+vector<unsigned> PathFinder::distances(unsigned start_id, vector<uint32_t> const &node_ids,
+                                      bool backward) {
+    vector<unsigned> found(node_ids.size(), UINT_MAX);
+    if (start_id >= map->size()) {
+        Logger::log(WARNING, __FILE__, "distances", "Unknown start node");
+        return found;
+    }
+    if (node_ids.empty())
+        return found;
+
+    // Stop once every node asked for is settled
+    vector<bool> wanted(map->size(), false);
+    size_t remaining{0};
+    for (uint32_t node_id : node_ids) {
+        if (node_id < map->size() && !wanted[map->from_map_id(node_id)]) {
+            wanted[map->from_map_id(node_id)] = true;
+            ++remaining;
+        }
+    }
+    uint32_t start = map->from_map_id(start_id);
+    weights.assign(map->size(), UINT_MAX);
+    queue.clear();
+    weights[start] = 0;
+    queue.emplace_back(0, start);
+    MapEdge edges[2];
+    while (!queue.empty() && remaining > 0) {
+        pop_heap(queue.begin(), queue.end(), greater<pair<unsigned, uint32_t>>());
+        auto [weight, active_node] = queue.back();
+        queue.pop_back();
+        if (weight > weights[active_node])
+            continue;  // Already visited with a lower weight
+        if (wanted[active_node])
+            --remaining;
+
+        // Outgoing edges, or incoming edges backward
+        MapEdge const *next = edges;
+        unsigned degree;
+        if (backward) {
+            next = map->get_incoming(active_node);
+            degree = map->get_in_degree(active_node);
         } else {
-            node->set_weight(0);
-            start_node = node;
+            degree = map->get_edges(active_node, edges);
+        }
+        for (unsigned i{0}; i < degree; ++i) {
+            MapEdge edge = next[i];
+            if (weight + edge.weight < weights[edge.node]) {
+                weights[edge.node] = weight + edge.weight;
+                queue.emplace_back(weights[edge.node], edge.node);
+                push_heap(queue.begin(), queue.end(), greater<pair<unsigned, uint32_t>>());
+            }
         }
     }
-    Logger::log(DEBUG, __FILE__, "initiate_map_graph", "Map initiated");
-    return start_node;
+    for (size_t i{0}; i < node_ids.size(); ++i) {
+        if (node_ids[i] < map->size())
+            found[i] = weights[map->from_map_id(node_ids[i])];
+    }
+    return found;
 }
 
-vector<instruction::InstructionNumber> PathFinder::get_drive_mission() {
-    return drive_mission;
+/* Sets nodes */
+void PathFinder::update_map(json m) {
+    set_map(MapGraph::from_json(m));
 }
 
-/* Create the MapNode*s and add their edges */
-void PathFinder::make_MapNode_list(json json_map) {
-    // Create MapNode pointers and places in "nodes"
-    // Assumes json_map preserve order when iterating
-    for (auto &node : json_map["MapData"].items()) {
-        MapNode *active_node = new MapNode{node.key()};
-        nodes.push_back(active_node);
-    }
-
-    int node_index{};
-    // For every node in json_map, e.g. A, B, C, ...
-    for (auto &node : json_map["MapData"].items()) {
-        // Get node at index node_index, sets it as active_node, increases node_index
-        auto active_node = nodes.begin();
-        advance(active_node, node_index++);
-
-        // For all neighbouring nodes
-        for (auto &edge : node.value().items()) {
-            // Get neighbours name and edge-weight
-            string neighbour_name = edge.value().begin().key();
-            int neightbour_distance = edge.value().begin().value();
-
-            // Find the node that matches neighbour_name
-            auto found = std::find_if(nodes.begin(), nodes.end(), [&] (MapNode *ptr) {return ptr->get_name() == neighbour_name; });
-            if (found != nodes.end()) {
-                // Node was found and an edge is added
-                (*active_node)->add_edge(neightbour_distance, *found);
-            }
-        }
-    }
-    vector<MapNode*> n_v(nodes.size());
-    copy(nodes.begin(), nodes.end(), n_v.begin());
-    nodes_vector = n_v;
+void PathFinder::set_map(shared_ptr<MapGraph const> new_map) {
+    map = new_map;
+    vehicles_at.clear();
+    vehicle_nodes.clear();
+    route.clear();
+    drive_mission.clear();
+    distance = UINT_MAX;
+}
+
+vector<instruction::InstructionNumber> PathFinder::get_drive_mission() {
+    return drive_mission;
 }
 
 /* Returns string with edge identification e.g. "A1K1" meaning from A1 to K1 */
 list<string> PathFinder::get_road_segments() {
     // Names of node just passed and node we're heading towards
     list<string> road_segments{};
-    if (!nodes_vector.empty()) {
-        for (unsigned i{0}; i < nodes_vector.size() - 1; ++i) {
-            if (nodes_vector.size() > 1) {
-                if (nodes_vector[i] != nullptr || nodes_vector[i+1] != nullptr) {
-                    string from = nodes_vector[i]->get_name();
-                    string to = nodes_vector[i+1]->get_name();
-                    road_segments.push_back(from + "->" + to);
-                } else {
-                    Logger::log(WARNING, __FILE__, "get_road_segments", "nodes_vector[i] is nullptr");
-                }
-            }
-        }
+    for (size_t i{0}; i + 1 < route.size(); ++i) {
+        road_segments.push_back(map->get_name(route[i]) + "->" + map->get_name(route[i+1]));
     }
     return road_segments;
 }
 
-/* Trace back from stop node to start node */
-void PathFinder::find_path(MapNode *neighbour, string stop_node_name) {
-    vector<MapNode*> new_nodes_vector{};
-    new_nodes_vector.push_back(neighbour);
-    while (new_nodes_vector.front()->get_parent_node() != nullptr) {
-        new_nodes_vector.insert(new_nodes_vector.begin(), new_nodes_vector.front()->get_parent_node());
+vector<string> PathFinder::get_route() const {
+    vector<string> names{};
+    for (uint32_t node : route) {
+        names.push_back(map->get_name(node));
     }
-    nodes_vector = new_nodes_vector;
-
-    // Generate drive instructions based on node vector
-    DriveMissionGenerator drive_mission_generator{new_nodes_vector, stop_node_name};
-    drive_mission = drive_mission_generator.get_drive_mission();
-    Logger::log(DEBUG, __FILE__, "solve", "Ordered vector of drive instructions created");
+    return names;
 }
@@ -7,6 +7,10 @@
  * OR
  * Use PathFinder(list<MapNode*> map_nodes, std::string start_node_name) +
  * get_drive_mission()
+ *
+ * Several PathFinders can share one map: create it with
+ * MapGraph::from_json(m) and pass it to PathFinder(map) or set_map(map).
+ * Each PathFinder only keeps its own search state (a few bytes per node).
  */
 
 #ifndef DIJKSTRA_SOLVER_H
@@ -14,24 +18,31 @@
 
 #include "raspi_common.h"
 #include "map_node.h"
+#include "map_graph.h"
+#include "graph_search.h"
+#include "occupancy_table.h"
 #include "drive_mission_generator.h"
 
 #include <list>
+#include <memory>
+#include <unordered_map>
 #include <vector>
 #include <string>
 #include <nlohmann/json.hpp>
 
 using json = nlohmann::json;
 
-struct Comparator {
-    bool operator()(const MapNode *a, const MapNode *b) const {
-        return a->get_weight() < b->get_weight();
-    }
+struct VehicleMatch {
+    uint32_t vehicle{0};
+    unsigned distance{0};
+    std::vector<uint32_t> route{};  // Map ids from the vehicle's node to the target
+    std::vector<instruction::InstructionNumber> drive_mission{};
 };
 
 class PathFinder {
 public:
     PathFinder();
+    PathFinder(std::shared_ptr<MapGraph const> map);
     PathFinder(json m, std::string start_node_name);
     PathFinder(std::list<MapNode*> m, std::string start_node_name);
     ~PathFinder();
@@ -41,19 +52,132 @@ public:
 
     void solve(std::string start_node_name);
     void solve(std::string start_node_name, std::string stop_node_name);
-    void find_path(MapNode *neighbour, std::string stop_node_name);
+
+    /* Same as solve(start_node_name, stop_node_name) with node ids, see
+     * get_node_id(). */
+    void solve(unsigned start_id, unsigned stop_id);
+    /* Same as solve(start_node_name, stop_node_name) for a vehicle that is
+     * offset (in edge weight units) into road_segment, e.g. "A1->K1". The
+     * route starts with the rest of that segment, so the first instruction
+     * and road segment are the ones the vehicle is already on. */
+    void solve_from_segment(std::string const &road_segment, unsigned offset,
+                            std::string const &stop_node_name);
     std::vector<instruction::InstructionNumber> get_drive_mission();
     void update_map(json m);
-    void make_MapNode_list(json m);
+
+    /* Use a (shared) map. Nothing is copied. */
+    void set_map(std::shared_ptr<MapGraph const> new_map);
+    std::shared_ptr<MapGraph const> const &get_map() const {
+        return map;
+    }
+
+    /* Route around congestion: solve() and solve_from_segment() add the
+     * table's penalties to the segments (see occupancy_table.h) while it
+     * is for the current map. get_distance() stays the plain length of
+     * the route. nullptr to stop. */
+    void set_occupancy(std::shared_ptr<OccupancyTable const> table) {
+        occupancy = table;
+    }
+
+    /* Every node that can be reached from start within budget, as map
+     * ids with their distances, nearest first (start itself at 0). Does
+     * not change the PathFinder, so it can be called from any number of
+     * threads, also while solve() runs. */
+    std::vector<ReachableNode> reachable_within(unsigned start_id, unsigned budget) const;
+    std::vector<ReachableNode> reachable_within(std::string const &start_node_name,
+                                                unsigned budget) const;
+
+    /* Vehicles for nearest_vehicles(), at map ids. A vehicle is at one
+     * node at a time; set_map() forgets all vehicles. */
+    void set_vehicle_node(uint32_t vehicle, unsigned node_id);
+    void remove_vehicle(uint32_t vehicle);
+
+    /* The k vehicles with the shortest routes to target, nearest first.
+     * Searches backward from the target and stops at the k-th vehicle, so
+     * the cost does not depend on the number of vehicles. */
+    std::vector<VehicleMatch> nearest_vehicles(unsigned target_id, unsigned k);
+
+    /* Distances from start to each of nodes, or from each of nodes to
+     * start if backward, all map ids. UINT_MAX for nodes that can not be
+     * reached. One search however many nodes there are; the last route
+     * is kept. */
+    std::vector<unsigned> distances(unsigned start_id, std::vector<uint32_t> const &node_ids,
+                                    bool backward=false);
 
     std::list<std::string> get_road_segments();
 
+    /* Names of the nodes along the route found by the last
+     * solve(start, stop), start and stop included. */
+    std::vector<std::string> get_route() const;
+
+    bool has_node(std::string const &name) const {
+        return map->get_id(name) >= 0;
+    }
+
+    /* Nodes are numbered in map order from 0 (map ids, see map_graph.h).
+     * Return -1 for unknown names. */
+    int get_node_id(std::string const &name) const {
+        int id = map->get_id(name);
+        return id < 0 ? -1 : static_cast<int>(map->get_map_id(id));
+    }
+    std::string get_node_name(unsigned id) const {
+        return id < map->size() ? map->get_name(map->from_map_id(id)) : "";
+    }
+    size_t get_node_count() const {
+        return map->size();
+    }
+    uint32_t get_map_version() const {
+        return map->get_version();
+    }
+
+    /* Weight of the edge of a road segment, e.g. "A1->K1", UINT_MAX if
+     * there is no such edge. */
+    unsigned get_segment_length(std::string const &road_segment) const;
+
+    /* Length of the route found by the last solve(start, stop), UINT_MAX
+     * if there was none. */
+    unsigned get_distance() const {
+        return distance;
+    }
+
 private:
-    MapNode *initiate_map_graph(std::string &start_node_name);
-    std::list<MapNode*> nodes{};
-    std::vector<instruction::InstructionNumber> drive_mission{};
-    std::vector<MapNode*> nodes_vector{};
+    /* solve() with MapGraph's own node ids. */
+    void solve_ids(uint32_t start, uint32_t stop);
 
+    /* Route, distance and drive mission from start to stop, with
+     * before_start (if not NO_NODE) in front of the start node. Searches
+     * the contracted graph, without a heap if that is faster (see
+     * prefer_dense_search()) and with the congestion penalties if there
+     * is an occupancy table, and unpacks the chains along the route. */
+    void contracted_route(uint32_t start, uint32_t stop, unsigned start_weight,
+                          uint32_t before_start);
+
+    /* Dijkstra from start, which costs start_weight to get to. Stops when
+     * stop is settled, searches the whole map if stop is NO_NODE. */
+    void search(unsigned start, unsigned stop, unsigned start_weight=0);
+
+    /* Drive instructions along route */
+    void make_drive_mission();
+
+    std::shared_ptr<MapGraph const> map;
+    std::list<MapNode*> owned_nodes{};
+    std::shared_ptr<OccupancyTable const> occupancy{};
+
+    // Search state, one entry per node
+    std::vector<unsigned> weights{};
+    std::vector<uint32_t> parents{};
+    std::vector<std::pair<unsigned, uint32_t>> queue{};
+    std::vector<uint32_t> core_route{};
+    std::vector<unsigned> frontier{};  // See dense_shortest_paths()
+
+    // Vehicles by node id and node id by vehicle
+    std::unordered_map<uint32_t, std::vector<uint32_t>> vehicles_at{};
+    std::unordered_map<uint32_t, uint32_t> vehicle_nodes{};
+
+    // Result of the last solve
+    std::vector<uint32_t> route{};
+    std::vector<instruction::InstructionNumber> drive_mission{};
+    unsigned distance{UINT_MAX};
 };
 
 #endif // DIJKSTRA_SOLVER_H
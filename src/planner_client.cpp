@@ -0,0 +1,167 @@
+#include "planner_client.h"
+#include "log.h"
+
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+using namespace std;
+
+PlannerClient::PlannerClient(string socket_path, unsigned timeout_ms)
+: socket_path{socket_path}, timeout{timeout_ms} {
+    connect_daemon();
+}
+
+PlannerClient::~PlannerClient() {
+    disconnect();
+}
+
+void PlannerClient::connect_daemon() {
+    if (fd >= 0 || chrono::steady_clock::now() < next_attempt)
+        return;
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    if (socket_path.size() >= sizeof(address.sun_path)) {
+        Logger::log(ERROR, __FILE__, "PlannerClient", "Socket path too long");
+        next_attempt = chrono::steady_clock::time_point::max();
+        return;
+    }
+    strcpy(address.sun_path, socket_path.c_str());
+
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0 || connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0) {
+        Logger::log(WARNING, __FILE__, "PlannerClient", "No planner at " + socket_path);
+        disconnect();
+    }
+}
+
+void PlannerClient::disconnect() {
+    if (fd >= 0)
+        close(fd);
+    fd = -1;
+    in.clear();
+    next_attempt = chrono::steady_clock::now() + retry;
+    retry = min(2 * retry, chrono::milliseconds{PLANNER_MAX_RETRY_MS});
+}
+
+vector<PlannerReply> PlannerClient::query(vector<PlannerQuery> queries) {
+    send_queries(queries);
+    return receive_replies();
+}
+
+bool PlannerClient::send_queries(vector<PlannerQuery> queries) {
+    first_pending = next_id;
+    pending = queries.size();
+    deadline = chrono::steady_clock::now() + timeout;
+
+    // Send everything in one write so the daemon sees it as one batch
+    out.clear();
+    for (PlannerQuery &query : queries) {
+        query.id = next_id++;
+        encode_query(query, out);
+    }
+    bool reused = connected();
+    chrono::milliseconds backoff = retry;
+    connect_daemon();
+    if (send_all())
+        return true;
+    if (!reused)
+        return false;
+
+    // The daemon restarted since the last queries, try a new connection now
+    retry = backoff;
+    next_attempt = chrono::steady_clock::time_point{};
+    connect_daemon();
+    return send_all();
+}
+
+bool PlannerClient::send_all() {
+    if (!connected())
+        return false;
+    size_t sent{0};
+    while (sent < out.size()) {
+        ssize_t n = send(fd, out.data() + sent, out.size() - sent, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0) {
+            Logger::log(ERROR, __FILE__, "query", strerror(errno));
+            disconnect();
+            return false;
+        }
+        sent += n;
+    }
+    return true;
+}
+
+vector<PlannerReply> PlannerClient::receive_replies() {
+    vector<PlannerReply> replies(pending);
+    pending = 0;
+    if (!connected())
+        return replies;
+
+    size_t received{0};
+    uint8_t data[16384];
+    while (received < replies.size()) {
+        PlannerReply reply{};
+        long len = decode_reply(in.data(), in.size(), reply);
+        if (len > 0) {
+            in.erase(in.begin(), in.begin() + len);
+            uint32_t index = reply.id - first_pending;
+            if (index < replies.size()) {
+                replies[index] = reply;
+                ++received;
+            }
+            continue;
+        }
+        if (len < 0) {
+            Logger::log(ERROR, __FILE__, "query", "Malformed reply");
+            disconnect();
+            return replies;
+        }
+        // Wait no longer than the deadline, a hung daemon must not hang us
+        auto left = chrono::duration_cast<chrono::milliseconds>(deadline - chrono::steady_clock::now());
+        pollfd poll_fd{fd, POLLIN, 0};
+        int ready = left.count() > 0 ? poll(&poll_fd, 1, left.count()) : 0;
+        if (ready < 0 && errno == EINTR)
+            continue;
+        if (ready <= 0) {
+            Logger::log(ERROR, __FILE__, "query", ready == 0 ? "Planner timed out" : strerror(errno));
+            disconnect();
+            return replies;
+        }
+        ssize_t n = recv(fd, data, sizeof(data), 0);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0) {
+            Logger::log(ERROR, __FILE__, "query", "Planner closed the connection");
+            disconnect();
+            return replies;
+        }
+        in.insert(in.end(), data, data + n);
+    }
+    retry = chrono::milliseconds{PLANNER_RETRY_MS};
+    return replies;
+}
+
+PlannerReply PlannerClient::route(string start, string stop) {
+    PlannerQuery query{};
+    query.type = planner::route;
+    query.start = start;
+    query.stop = stop;
+    return this->query({query}).front();
+}
+
+uint32_t PlannerClient::distance(string start, string stop) {
+    PlannerQuery query{};
+    query.type = planner::distance;
+    query.start = start;
+    query.stop = stop;
+    return this->query({query}).front().distance;
+}
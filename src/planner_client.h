@@ -0,0 +1,82 @@
+/*
+ * Client side of the route-planning daemon (see planner_server.h).
+ *
+ * Use PlannerClient client{"/tmp/planner.sock"}; and then either
+ * client.route(start, stop) / client.distance(start, stop) for single
+ * queries, or client.query(queries) to send several queries at once so
+ * the daemon can solve them as a batch.
+ *
+ * If the daemon can not be reached, or does not reply within timeout_ms
+ * of the queries being sent, the client disconnects and every missing
+ * reply has status planner::no_planner. Later queries connect again, at
+ * most every PLANNER_RETRY_MS at first and backing off to
+ * PLANNER_MAX_RETRY_MS while the daemon stays away.
+ */
+
+#ifndef PLANNER_CLIENT_H
+#define PLANNER_CLIENT_H
+
+#include "planner_protocol.h"
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#define PLANNER_TIMEOUT_MS 1000
+#define PLANNER_RETRY_MS 100
+#define PLANNER_MAX_RETRY_MS 10000
+
+class PlannerClient {
+public:
+    PlannerClient(std::string socket_path, unsigned timeout_ms=PLANNER_TIMEOUT_MS);
+    ~PlannerClient();
+
+    PlannerClient(PlannerClient const&) = delete;
+    PlannerClient operator=(PlannerClient const&) = delete;
+
+    bool connected() const {
+        return fd >= 0;
+    }
+
+    /* Send all queries, then wait for all replies. Replies are returned in
+     * the same order as the queries and the query ids are set by the
+     * client. */
+    std::vector<PlannerReply> query(std::vector<PlannerQuery> queries);
+
+    /* query() in two halves, to have queries to several daemons in flight
+     * at once: send_queries() does not wait, receive_replies() waits for
+     * the replies to the queries sent last. Return false if the queries
+     * could not be sent. */
+    bool send_queries(std::vector<PlannerQuery> queries);
+    std::vector<PlannerReply> receive_replies();
+
+    PlannerReply route(std::string start, std::string stop);
+
+    /* Return UINT32_MAX if there is no route. */
+    uint32_t distance(std::string start, std::string stop);
+
+private:
+    /* Connect if not connected and the retry time has come. */
+    void connect_daemon();
+
+    /* Close the connection, the next attempt is a backoff later. */
+    void disconnect();
+
+    /* Send out on the connection, disconnect on failure. */
+    bool send_all();
+
+    std::string socket_path;
+    int fd{-1};
+    std::chrono::milliseconds timeout;
+    std::chrono::milliseconds retry{PLANNER_RETRY_MS};
+    std::chrono::steady_clock::time_point next_attempt{};
+    std::chrono::steady_clock::time_point deadline{};  // For the pending replies
+    uint32_t next_id{0};
+    uint32_t first_pending{0};
+    size_t pending{0};
+    std::vector<uint8_t> out{};
+    std::vector<uint8_t> in{};
+};
+
+#endif // PLANNER_CLIENT_H
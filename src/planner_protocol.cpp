@@ -0,0 +1,189 @@
+#include "planner_protocol.h"
+
+#include <cstring>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+namespace {
+
+template <class T>
+void put(vector<uint8_t> &buffer, T value) {
+    uint8_t bytes[sizeof(T)];
+    memcpy(bytes, &value, sizeof(T));
+    buffer.insert(buffer.end(), bytes, bytes + sizeof(T));
+}
+
+void put_name(vector<uint8_t> &buffer, string const &name) {
+    // Names are at most 255 bytes long on the wire
+    size_t len = name.size() < 255 ? name.size() : 255;
+    put<uint8_t>(buffer, len);
+    buffer.insert(buffer.end(), name.begin(), name.begin() + len);
+}
+
+/* Reads fields from a frame body and remembers if it ran out of data. */
+class Reader {
+public:
+    Reader(uint8_t const *data, size_t size): data{data}, size{size} {}
+
+    Reader(Reader const&) = delete;
+    Reader operator=(Reader const&) = delete;
+
+    template <class T>
+    T get() {
+        T value{};
+        if (pos + sizeof(T) > size) {
+            bad = true;
+            return value;
+        }
+        memcpy(&value, data + pos, sizeof(T));
+        pos += sizeof(T);
+        return value;
+    }
+    string get_name() {
+        size_t len = get<uint8_t>();
+        if (pos + len > size) {
+            bad = true;
+            return "";
+        }
+        string name{reinterpret_cast<char const*>(data + pos), len};
+        pos += len;
+        return name;
+    }
+    bool ok() const {
+        return !bad && pos == size;
+    }
+
+private:
+    uint8_t const *data;
+    size_t size;
+    size_t pos{0};
+    bool bad{false};
+};
+
+/* Reserve room for the frame length, return where it is. */
+size_t begin_frame(vector<uint8_t> &buffer) {
+    size_t start = buffer.size();
+    put<uint32_t>(buffer, 0);
+    return start;
+}
+
+void end_frame(vector<uint8_t> &buffer, size_t start) {
+    uint32_t len = buffer.size() - start - sizeof(uint32_t);
+    memcpy(buffer.data() + start, &len, sizeof(len));
+}
+
+/* Replace the reply begun at start, after its id, with an empty one of
+ * status planner::too_long. */
+void encode_too_long(vector<uint8_t> &buffer, size_t start) {
+    buffer.resize(start + sizeof(uint32_t) + sizeof(uint32_t));
+    put<uint8_t>(buffer, planner::too_long);
+    put<uint32_t>(buffer, UINT32_MAX);
+    for (int list{0}; list < 3; ++list) {
+        put<uint16_t>(buffer, 0);
+    }
+    end_frame(buffer, start);
+}
+
+/* Length of the body of the first frame, 0 if incomplete, -1 if bad. No
+ * message has an empty body, so a zero length is bad too. */
+long frame_length(uint8_t const *data, size_t size) {
+    uint32_t len{};
+    if (size < sizeof(len))
+        return 0;
+    memcpy(&len, data, sizeof(len));
+    if (len == 0 || len > PLANNER_MAX_FRAME)
+        return -1;
+    if (size < sizeof(len) + len)
+        return 0;
+    return len;
+}
+
+}  // namespace
+
+vector<string> PlannerReply::get_road_segments() const {
+    vector<string> road_segments{};
+    for (size_t i{1}; i < nodes.size(); ++i) {
+        road_segments.push_back(nodes[i-1] + "->" + nodes[i]);
+    }
+    return road_segments;
+}
+
+void encode_query(PlannerQuery const &query, vector<uint8_t> &buffer) {
+    size_t start = begin_frame(buffer);
+    put<uint32_t>(buffer, query.id);
+    put<uint8_t>(buffer, query.type);
+    put_name(buffer, query.start);
+    put_name(buffer, query.stop);
+    end_frame(buffer, start);
+}
+
+void encode_reply(PlannerReply const &reply, vector<uint8_t> &buffer) {
+    size_t start = begin_frame(buffer);
+    put<uint32_t>(buffer, reply.id);
+    if (reply.instructions.size() > UINT16_MAX || reply.nodes.size() > UINT16_MAX
+            || reply.distances.size() > UINT16_MAX) {
+        encode_too_long(buffer, start);
+        return;
+    }
+    put<uint8_t>(buffer, reply.status);
+    put<uint32_t>(buffer, reply.distance);
+    put<uint16_t>(buffer, reply.instructions.size());
+    for (instruction::InstructionNumber instr : reply.instructions) {
+        put<uint8_t>(buffer, instr);
+    }
+    put<uint16_t>(buffer, reply.nodes.size());
+    for (string const &name : reply.nodes) {
+        put_name(buffer, name);
+    }
+    put<uint16_t>(buffer, reply.distances.size());
+    for (uint32_t distance : reply.distances) {
+        put<uint32_t>(buffer, distance);
+    }
+    if (buffer.size() - start - sizeof(uint32_t) > PLANNER_MAX_FRAME) {
+        encode_too_long(buffer, start);
+        return;
+    }
+    end_frame(buffer, start);
+}
+
+long decode_query(uint8_t const *data, size_t size, PlannerQuery &query) {
+    long len = frame_length(data, size);
+    if (len <= 0)
+        return len;
+    Reader reader{data + sizeof(uint32_t), static_cast<size_t>(len)};
+    query.id = reader.get<uint32_t>();
+    uint8_t type = reader.get<uint8_t>();
+    query.start = reader.get_name();
+    query.stop = reader.get_name();
+    if (!reader.ok() || type > planner::boundary_to)
+        return -1;
+    query.type = static_cast<planner::QueryType>(type);
+    return sizeof(uint32_t) + len;
+}
+
+long decode_reply(uint8_t const *data, size_t size, PlannerReply &reply) {
+    long len = frame_length(data, size);
+    if (len <= 0)
+        return len;
+    Reader reader{data + sizeof(uint32_t), static_cast<size_t>(len)};
+    reply.id = reader.get<uint32_t>();
+    reply.status = static_cast<planner::Status>(reader.get<uint8_t>());
+    reply.distance = reader.get<uint32_t>();
+    reply.instructions.resize(reader.get<uint16_t>());
+    for (instruction::InstructionNumber &instr : reply.instructions) {
+        instr = static_cast<instruction::InstructionNumber>(reader.get<uint8_t>());
+    }
+    reply.nodes.resize(reader.get<uint16_t>());
+    for (string &name : reply.nodes) {
+        name = reader.get_name();
+    }
+    reply.distances.resize(reader.get<uint16_t>());
+    for (uint32_t &distance : reply.distances) {
+        distance = reader.get<uint32_t>();
+    }
+    if (!reader.ok())
+        return -1;
+    return sizeof(uint32_t) + len;
+}
@@ -0,0 +1,74 @@
+/*
+ * Binary protocol spoken between PlannerClient and PlannerServer over a
+ * Unix domain socket. Both ends always run on the same machine, so all
+ * integers are sent in native byte order.
+ *
+ * Every message is a frame: a uint32 with the number of bytes that follow,
+ * then the body.
+ *
+ * Query body:
+ *   uint32 id, uint8 type, uint8 len + start name, uint8 len + stop name
+ *
+ * Reply body:
+ *   uint32 id, uint8 status, uint32 distance,
+ *   uint16 count + one uint8 per drive instruction,
+ *   uint16 count + (uint8 len + name) per node on the route,
+ *   uint16 count + uint32 per distance
+ *
+ * Distance queries get a reply without instructions and nodes. A reply
+ * with more than 65535 entries in a list, or a body longer than
+ * PLANNER_MAX_FRAME, is sent as status planner::too_long and nothing else.
+ *
+ * Boundary queries are for partitioned routing (see partitioned_planner.h)
+ * and need a daemon with boundary nodes. boundary_from has only a start,
+ * boundary_to only a stop. The reply lists the boundary nodes that can be
+ * reached from start (or that stop can be reached from) in nodes, with
+ * their distances in distances.
+ */
+
+#ifndef PLANNER_PROTOCOL_H
+#define PLANNER_PROTOCOL_H
+
+#include "raspi_common.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#define PLANNER_MAX_FRAME 65536
+
+namespace planner {
+    enum QueryType : uint8_t {route, distance, boundary_from, boundary_to};
+    enum Status : uint8_t {ok, unknown_node, no_route, bad_query, no_planner, too_long};
+}
+
+struct PlannerQuery {
+    uint32_t id{0};
+    planner::QueryType type{planner::route};
+    std::string start{};
+    std::string stop{};
+};
+
+struct PlannerReply {
+    uint32_t id{0};
+    planner::Status status{planner::no_planner};
+    uint32_t distance{UINT32_MAX};
+    std::vector<instruction::InstructionNumber> instructions{};
+    std::vector<std::string> nodes{};
+    std::vector<uint32_t> distances{};  // Boundary queries only
+
+    /* Road segments ("A->B") along the route, same format as
+     * PathFinder::get_road_segments(). */
+    std::vector<std::string> get_road_segments() const;
+};
+
+/* Append an encoded frame to buffer. */
+void encode_query(PlannerQuery const &query, std::vector<uint8_t> &buffer);
+void encode_reply(PlannerReply const &reply, std::vector<uint8_t> &buffer);
+
+/* Decode the first frame in data. Return the number of bytes used, 0 if the
+ * frame is not complete yet and -1 if the data is malformed. */
+long decode_query(uint8_t const *data, size_t size, PlannerQuery &query);
+long decode_reply(uint8_t const *data, size_t size, PlannerReply &reply);
+
+#endif // PLANNER_PROTOCOL_H
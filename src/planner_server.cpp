@@ -0,0 +1,342 @@
+#include "planner_server.h"
+#include "log.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+using namespace std;
+
+PlannerServer::PlannerServer(json m, string socket_path, unsigned worker_count)
+: socket_path{socket_path} {
+    if (worker_count == 0)
+        worker_count = max(1u, thread::hardware_concurrency());
+
+    // One map shared by all workers, each with its own search state
+    shared_ptr<MapGraph const> map = MapGraph::from_json(m);
+    if (m.contains("Boundary")) {
+        // Region of a partitioned map, see map_partition.h
+        for (auto &name : m["Boundary"]) {
+            int id = map->get_id(name);
+            if (id < 0) {
+                Logger::log(WARNING, __FILE__, "PlannerServer", "Unknown boundary node");
+                continue;
+            }
+            boundary.push_back(map->get_map_id(id));
+            boundary_names.push_back(name);
+        }
+    }
+    for (unsigned i{0}; i < worker_count; ++i) {
+        path_finders.emplace_back(new PathFinder{map});
+    }
+    for (unsigned i{0}; i < worker_count; ++i) {
+        workers.emplace_back(&PlannerServer::worker, this, i);
+    }
+
+    if (pipe(wakeup_pipe) != 0) {
+        Logger::log(ERROR, __FILE__, "PlannerServer", "Could not create wakeup pipe");
+    }
+    stringstream ss;
+    ss << "PlannerServer created with " << worker_count << " workers";
+    Logger::log(INFO, __FILE__, "PlannerServer", ss.str());
+}
+
+PlannerServer::~PlannerServer() {
+    {
+        lock_guard<mutex> lock{batch_mutex};
+        shutting_down = true;
+    }
+    batch_ready.notify_all();
+    for (thread &t : workers) {
+        t.join();
+    }
+    for (Connection &connection : connections) {
+        close(connection.fd);
+    }
+    if (listen_fd >= 0) {
+        close(listen_fd);
+        unlink(socket_path.c_str());
+    }
+    for (int fd : wakeup_pipe) {
+        if (fd >= 0)
+            close(fd);
+    }
+}
+
+void PlannerServer::stop() {
+    // Nothing sensible to do on failure, stop() may run in a signal handler
+    char byte{0};
+    ssize_t ignored = write(wakeup_pipe[1], &byte, 1);
+    static_cast<void>(ignored);
+}
+
+bool PlannerServer::open_socket() {
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    if (socket_path.size() >= sizeof(address.sun_path)) {
+        Logger::log(ERROR, __FILE__, "open_socket", "Socket path too long");
+        return false;
+    }
+    strcpy(address.sun_path, socket_path.c_str());
+
+    listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listen_fd < 0) {
+        Logger::log(ERROR, __FILE__, "open_socket", strerror(errno));
+        return false;
+    }
+    unlink(socket_path.c_str());
+    if (bind(listen_fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0
+            || listen(listen_fd, SOMAXCONN) != 0) {
+        Logger::log(ERROR, __FILE__, "open_socket", strerror(errno));
+        close(listen_fd);
+        listen_fd = -1;
+        return false;
+    }
+    Logger::log(INFO, __FILE__, "open_socket", "Listening on " + socket_path);
+    return true;
+}
+
+bool PlannerServer::run() {
+    if (listen_fd < 0 && !open_socket())
+        return false;
+
+    vector<pollfd> poll_fds{};
+    while (true) {
+        poll_fds.clear();
+        poll_fds.push_back({wakeup_pipe[0], POLLIN, 0});
+        poll_fds.push_back({listen_fd, POLLIN, 0});
+        for (Connection &connection : connections) {
+            short events = POLLIN | (connection.out.empty() ? 0 : POLLOUT);
+            poll_fds.push_back({connection.fd, events, 0});
+        }
+
+        if (poll(poll_fds.data(), poll_fds.size(), -1) < 0) {
+            if (errno == EINTR)
+                continue;
+            Logger::log(ERROR, __FILE__, "run", strerror(errno));
+            return false;
+        }
+        if (poll_fds[0].revents != 0) {
+            char byte{};
+            ssize_t ignored = read(wakeup_pipe[0], &byte, 1);
+            static_cast<void>(ignored);
+            Logger::log(INFO, __FILE__, "run", "Stopping");
+            return true;
+        }
+
+        // Everything readable in this round becomes one batch
+        auto poll_fd = poll_fds.begin() + 2;
+        for (auto itr = connections.begin(); itr != connections.end(); ++poll_fd) {
+            bool open = (poll_fd->revents & POLLOUT) == 0 || send_replies(&*itr);
+            if (open && (poll_fd->revents & ~POLLOUT) != 0)
+                open = read_queries(&*itr);
+            if (!open) {
+                // Drop the connection along with its unanswered queries
+                int fd = itr->fd;
+                batch.erase(remove_if(batch.begin(), batch.end(),
+                                      [&] (Job const &job) { return job.connection == &*itr; }),
+                            batch.end());
+                close(fd);
+                itr = connections.erase(itr);
+            } else {
+                ++itr;
+            }
+        }
+        if (!batch.empty())
+            run_batch();
+
+        if (poll_fds[1].revents != 0)
+            accept_connection();
+    }
+}
+
+void PlannerServer::accept_connection() {
+    int fd = accept(listen_fd, nullptr, nullptr);
+    if (fd < 0) {
+        Logger::log(WARNING, __FILE__, "accept_connection", strerror(errno));
+        return;
+    }
+    // Replies are queued and sent on POLLOUT, see send_replies()
+    if (fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK) != 0) {
+        Logger::log(WARNING, __FILE__, "accept_connection", strerror(errno));
+        close(fd);
+        return;
+    }
+    connections.push_back(Connection{});
+    connections.back().fd = fd;
+    Logger::log(DEBUG, __FILE__, "accept_connection", "New client");
+}
+
+bool PlannerServer::read_queries(Connection *connection) {
+    uint8_t data[16384];
+    ssize_t received = recv(connection->fd, data, sizeof(data), MSG_DONTWAIT);
+    if (received == 0)
+        return false;
+    if (received < 0)
+        return errno == EAGAIN || errno == EINTR;
+    connection->in.insert(connection->in.end(), data, data + received);
+
+    size_t used{0};
+    while (true) {
+        Job job{};
+        job.connection = connection;
+        long len = decode_query(connection->in.data() + used, connection->in.size() - used, job.query);
+        if (len < 0) {
+            Logger::log(WARNING, __FILE__, "read_queries", "Malformed query, closing connection");
+            return false;
+        }
+        if (len == 0)
+            break;
+        used += len;
+        batch.push_back(job);
+    }
+    connection->in.erase(connection->in.begin(), connection->in.begin() + used);
+    return true;
+}
+
+void PlannerServer::run_batch() {
+    {
+        lock_guard<mutex> lock{batch_mutex};
+        next_job = 0;
+        workers_done = 0;
+        ++batch_generation;
+    }
+    batch_ready.notify_all();
+    {
+        unique_lock<mutex> lock{batch_mutex};
+        batch_done.wait(lock, [this] { return workers_done == workers.size(); });
+    }
+    ++batch_count;
+    query_count += batch.size();
+    if (metric_batches)
+        metric_batches->add();
+
+    // Send replies, one write per connection; what does not fit in the
+    // socket is sent on POLLOUT
+    for (Job const &job : batch) {
+        encode_reply(job.reply, job.connection->out);
+    }
+    batch.clear();
+    for (Connection &connection : connections) {
+        if (!connection.out.empty() && !send_replies(&connection)) {
+            // The next poll round sees the end of the stream and closes it
+            connection.out.clear();
+            shutdown(connection.fd, SHUT_RDWR);
+        }
+    }
+}
+
+bool PlannerServer::send_replies(Connection *connection) {
+    size_t sent{0};
+    while (sent < connection->out.size()) {
+        ssize_t n = send(connection->fd, connection->out.data() + sent,
+                         connection->out.size() - sent, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            break;
+        if (n < 0) {
+            Logger::log(WARNING, __FILE__, "send_replies", strerror(errno));
+            return false;
+        }
+        sent += n;
+    }
+    connection->out.erase(connection->out.begin(), connection->out.begin() + sent);
+    if (connection->out.size() > PLANNER_MAX_UNSENT) {
+        Logger::log(WARNING, __FILE__, "send_replies", "Client not reading replies, closing connection");
+        return false;
+    }
+    return true;
+}
+
+void PlannerServer::worker(unsigned worker_id) {
+    PathFinder &path_finder = *path_finders.at(worker_id);
+    unsigned long seen_generation{0};
+    while (true) {
+        {
+            unique_lock<mutex> lock{batch_mutex};
+            batch_ready.wait(lock, [&] { return shutting_down || batch_generation != seen_generation; });
+            if (shutting_down)
+                return;
+            seen_generation = batch_generation;
+        }
+        for (size_t i = next_job++; i < batch.size(); i = next_job++) {
+            if (!metric_solve_time) {
+                answer(path_finder, batch[i]);
+                continue;
+            }
+            auto begin = chrono::steady_clock::now();
+            answer(path_finder, batch[i]);
+            metric_solve_time->observe(chrono::duration_cast<chrono::nanoseconds>(
+                    chrono::steady_clock::now() - begin).count());
+            metric_queries[batch[i].reply.status]->add();
+        }
+        {
+            lock_guard<mutex> lock{batch_mutex};
+            ++workers_done;
+        }
+        batch_done.notify_one();
+    }
+}
+
+void PlannerServer::record_metrics(MetricsRegistry &registry) {
+    char const *status_names[]{"ok", "unknown_node", "no_route"};
+    for (int status{0}; status <= planner::no_route; ++status) {
+        metric_queries[status] = &registry.counter("planner_queries_total", "Queries answered",
+                                                   string("status=\"") + status_names[status] + "\"");
+    }
+    metric_batches = &registry.counter("planner_batches_total", "Batches of queries solved");
+    metric_solve_time = &registry.histogram("planner_solve_seconds", "Time to answer one query",
+                                            {10000, 100000, 1000000, 10000000, 100000000},
+                                            "", 1e-9);
+}
+
+void PlannerServer::answer(PathFinder &path_finder, Job &job) const {
+    PlannerQuery const &query = job.query;
+    PlannerReply &reply = job.reply;
+    reply.id = query.id;
+
+    if (query.type == planner::boundary_from || query.type == planner::boundary_to) {
+        bool backward = query.type == planner::boundary_to;
+        int node = path_finder.get_node_id(backward ? query.stop : query.start);
+        if (node < 0) {
+            reply.status = planner::unknown_node;
+            return;
+        }
+        vector<unsigned> distances = path_finder.distances(node, boundary, backward);
+        for (size_t i{0}; i < distances.size(); ++i) {
+            if (distances[i] != UINT_MAX) {
+                reply.nodes.push_back(boundary_names[i]);
+                reply.distances.push_back(distances[i]);
+            }
+        }
+        reply.status = planner::ok;
+        return;
+    }
+    if (!path_finder.has_node(query.start) || !path_finder.has_node(query.stop)) {
+        reply.status = planner::unknown_node;
+        return;
+    }
+    path_finder.solve(query.start, query.stop);
+    reply.distance = path_finder.get_distance();
+    if (reply.distance == UINT_MAX) {
+        reply.status = planner::no_route;
+        reply.distance = UINT32_MAX;
+        return;
+    }
+    reply.status = planner::ok;
+    if (query.type == planner::route) {
+        reply.instructions = path_finder.get_drive_mission();
+        reply.nodes = path_finder.get_route();
+    }
+}
@@ -0,0 +1,121 @@
+/*
+ * Route-planning daemon. Loads the map once and answers PlannerQuery
+ * messages from any number of local clients over a Unix domain socket.
+ *
+ * Queries that arrive together (everything readable in one poll round) are
+ * solved as one batch, spread over a pool of worker threads which each own
+ * a PathFinder on the shared map. Replies are sent in the order the queries arrived.
+ * Sockets do not block: replies a client is not reading yet wait in its
+ * connection, and a client with more than PLANNER_MAX_UNSENT bytes
+ * waiting is dropped, so one client can not hold up the others.
+ *
+ * Use: PlannerServer server{m, "/tmp/planner.sock"}; server.run();
+ * and server.stop() from another thread or a signal handler.
+ *
+ * A region map made by partition_map() (map_partition.h) lists its
+ * boundary nodes, which the server then answers boundary queries for.
+ */
+
+#ifndef PLANNER_SERVER_H
+#define PLANNER_SERVER_H
+
+#include "planner_protocol.h"
+#include "path_finder.h"
+#include "metrics.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#define PLANNER_MAX_UNSENT (1 << 20)
+
+class PlannerServer {
+public:
+    PlannerServer(json m, std::string socket_path, unsigned workers=0);
+    ~PlannerServer();
+
+    PlannerServer(PlannerServer const&) = delete;
+    PlannerServer operator=(PlannerServer const&) = delete;
+
+    /* Serve until stop() is called. Return false if the socket could not
+     * be opened. */
+    bool run();
+
+    /* Make run() return. Safe to call from any thread and from signal
+     * handlers. */
+    void stop();
+
+    /* Count queries, batches and solve times in registry (see metrics.h),
+     * which must outlive the server. Call before run(). */
+    void record_metrics(MetricsRegistry &registry);
+
+    /* Number of batches and queries served so far. */
+    unsigned long get_batch_count() const {
+        return batch_count;
+    }
+    unsigned long get_query_count() const {
+        return query_count;
+    }
+
+private:
+    struct Connection {
+        int fd{-1};
+        std::vector<uint8_t> in{};
+        std::vector<uint8_t> out{};
+    };
+    struct Job {
+        Connection *connection{nullptr};
+        PlannerQuery query{};
+        PlannerReply reply{};
+    };
+
+    bool open_socket();
+    void accept_connection();
+
+    /* Read what is available and queue every complete query as a job.
+     * Return false if the connection should be closed. */
+    bool read_queries(Connection *connection);
+
+    /* Solve all jobs on the worker pool and send the replies. */
+    void run_batch();
+
+    /* Send as much of the connection's replies as the socket takes. Return
+     * false if the connection should be closed. */
+    bool send_replies(Connection *connection);
+
+    void worker(unsigned worker_id);
+    void answer(PathFinder &path_finder, Job &job) const;
+
+    std::string socket_path;
+    int listen_fd{-1};
+    int wakeup_pipe[2]{-1, -1};
+    std::list<Connection> connections{};
+
+    std::vector<Job> batch{};
+    std::vector<std::unique_ptr<PathFinder>> path_finders{};
+    std::vector<uint32_t> boundary{};  // Map ids
+    std::vector<std::string> boundary_names{};
+    std::vector<std::thread> workers{};
+    std::mutex batch_mutex{};
+    std::condition_variable batch_ready{};
+    std::condition_variable batch_done{};
+    unsigned long batch_generation{0};
+    unsigned workers_done{0};
+    std::atomic<size_t> next_job{0};
+    bool shutting_down{false};
+
+    MetricsCounter *metric_queries[planner::no_route + 1]{};
+    MetricsCounter *metric_batches{nullptr};
+    MetricsHistogram *metric_solve_time{nullptr};
+
+    std::atomic<unsigned long> batch_count{0};
+    std::atomic<unsigned long> query_count{0};
+};
+
+#endif // PLANNER_SERVER_H
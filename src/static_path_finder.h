@@ -0,0 +1,297 @@
+/*
+ * Shortest routes on maps of at most MaxNodes nodes and MaxEdges edges
+ * without any heap memory, for planning inside the control thread.
+ *
+ * Everything, the map included, is in fixed size arrays of the object.
+ * Only load() and the convenience getters that return a std::vector or
+ * std::list allocate; solve() and the indexed getters never do. Node
+ * names longer than STATIC_NAME_LEN - 1 characters are not supported.
+ *
+ * Bounds, from the template parameters alone:
+ *  - memory: sizeof(StaticPathFinder<MaxNodes, MaxEdges>), about
+ *    MaxNodes * (STATIC_NAME_LEN + 40) + MaxEdges * 8 bytes;
+ *  - solve(): Dijkstra with an indexed binary heap of at most MaxNodes
+ *    entries, so at most MaxNodes extractions and MaxEdges decrease-keys,
+ *    each O(log2 MaxNodes), plus O(MaxNodes) to reset and trace the route;
+ *  - solve() by name: two binary searches of O(log2 MaxNodes) name
+ *    comparisons each on top.
+ *
+ * The object is large for big maps; make it static or a member rather
+ * than a local variable on a thread's stack.
+ *
+ * Use: static StaticPathFinder<256, 512> finder{};
+ *      finder.load(MapGraph::from_json(m));   // At start up, false if too big
+ *      finder.solve("A1", "K2");
+ *      for (size_t i{0}; i < finder.get_instruction_count(); ++i)
+ *          finder.get_instruction(i);
+ */
+
+#ifndef STATIC_PATH_FINDER_H
+#define STATIC_PATH_FINDER_H
+
+#include "raspi_common.h"
+#include "map_graph.h"
+#include "log.h"
+
+#include <algorithm>
+#include <array>
+#include <bitset>
+#include <climits>
+#include <cstdint>
+#include <cstring>
+#include <list>
+#include <memory>
+#include <string>
+#include <vector>
+
+#define STATIC_NAME_LEN 16
+
+template <size_t MaxNodes, size_t MaxEdges>
+class StaticPathFinder {
+    static_assert(MaxNodes > 0 && MaxNodes < NO_NODE, "Node ids must fit in uint32_t");
+
+public:
+    StaticPathFinder() = default;
+
+    StaticPathFinder(StaticPathFinder const&) = delete;
+    StaticPathFinder operator=(StaticPathFinder const&) = delete;
+
+    /* Copy the map in. Return false, and keep no map, if it does not fit. */
+    bool load(MapGraph const &graph) {
+        count = 0;
+        route_length = 0;
+        distance = UINT_MAX;
+        if (graph.size() > MaxNodes) {
+            Logger::log(WARNING, __FILE__, "load", "Too many nodes for StaticPathFinder");
+            return false;
+        }
+        size_t edge_count{0};
+        MapEdge out[2];
+        for (uint32_t id{0}; id < graph.size(); ++id) {
+            edge_first[id] = edge_count;
+            unsigned degree = graph.get_edges(id, out);
+            if (edge_count + degree > MaxEdges) {
+                Logger::log(WARNING, __FILE__, "load", "Too many edges for StaticPathFinder");
+                return false;
+            }
+            for (unsigned i{0}; i < degree; ++i) {
+                edges[edge_count++] = out[i];
+            }
+            std::string const &name = graph.get_name(id);
+            if (name.size() >= STATIC_NAME_LEN) {
+                Logger::log(WARNING, __FILE__, "load", "Node name too long: " + name);
+                return false;
+            }
+            names[id].fill('\0');
+            std::copy(name.begin(), name.end(), names[id].begin());
+            map_ids[id] = graph.get_map_id(id);
+            internal_ids[graph.get_map_id(id)] = id;
+            sorted[id] = id;
+        }
+        edge_first[graph.size()] = edge_count;
+        std::sort(sorted.begin(), sorted.begin() + graph.size(), [this] (uint32_t a, uint32_t b) {
+            return std::strcmp(names[a].data(), names[b].data()) < 0;
+        });
+        count = graph.size();
+        return true;
+    }
+    bool load(std::shared_ptr<MapGraph const> const &graph) {
+        return load(*graph);
+    }
+
+    void solve(char const *start_node_name, char const *stop_node_name) {
+        solve_ids(find(start_node_name), find(stop_node_name));
+    }
+    void solve(std::string const &start_node_name, std::string const &stop_node_name) {
+        solve(start_node_name.c_str(), stop_node_name.c_str());
+    }
+
+    /* Same with map ids (position in the map file). */
+    void solve(unsigned start_id, unsigned stop_id) {
+        solve_ids(start_id < count ? internal_ids[start_id] : NO_NODE,
+                  stop_id < count ? internal_ids[stop_id] : NO_NODE);
+    }
+
+    /* Length of the last route, UINT_MAX if there was none or a node was
+     * unknown. */
+    unsigned get_distance() const {
+        return distance;
+    }
+
+    /* Drive instructions of the last route, one per road segment. */
+    size_t get_instruction_count() const {
+        return route_length > 0 ? route_length - 1 : 0;
+    }
+    instruction::InstructionNumber get_instruction(size_t i) const {
+        return instructions[i];
+    }
+
+    /* Nodes of the last route, start and stop included. */
+    size_t get_route_length() const {
+        return route_length;
+    }
+    char const *get_route_name(size_t i) const {
+        return names[route[i]].data();
+    }
+
+    /* Return -1 for unknown names. */
+    int get_id(std::string const &name) const {
+        uint32_t id = find(name.c_str());
+        return id == NO_NODE ? -1 : static_cast<int>(id);
+    }
+    size_t get_node_count() const {
+        return count;
+    }
+
+    // Same as PathFinder, allocating
+    std::vector<instruction::InstructionNumber> get_drive_mission() const {
+        return std::vector<instruction::InstructionNumber>(
+                instructions.begin(), instructions.begin() + get_instruction_count());
+    }
+    std::list<std::string> get_road_segments() const {
+        std::list<std::string> road_segments{};
+        for (size_t i{0}; i + 1 < route_length; ++i) {
+            road_segments.push_back(std::string{get_route_name(i)} + "->" + get_route_name(i + 1));
+        }
+        return road_segments;
+    }
+    std::vector<std::string> get_route() const {
+        std::vector<std::string> route_names{};
+        for (size_t i{0}; i < route_length; ++i) {
+            route_names.push_back(get_route_name(i));
+        }
+        return route_names;
+    }
+
+private:
+    uint32_t find(char const *name) const {
+        if (std::strlen(name) >= STATIC_NAME_LEN)
+            return NO_NODE;
+        uint32_t const *found = std::lower_bound(
+                sorted.data(), sorted.data() + count, name, [this] (uint32_t id, char const *key) {
+                    return std::strcmp(names[id].data(), key) < 0;
+                });
+        if (found == sorted.data() + count || std::strcmp(names[*found].data(), name) != 0)
+            return NO_NODE;
+        return *found;
+    }
+
+    void solve_ids(uint32_t start, uint32_t stop) {
+        // No logging here, it would allocate; get_distance() tells
+        route_length = 0;
+        distance = UINT_MAX;
+        if (start == NO_NODE || stop == NO_NODE)
+            return;
+
+        std::fill(weights.begin(), weights.begin() + count, UINT_MAX);
+        visited.reset();
+        heap_size = 0;
+        weights[start] = 0;
+        parents[start] = NO_NODE;
+        push(start);
+        while (heap_size > 0) {
+            uint32_t active_node = pop();
+            visited.set(active_node);
+            if (active_node == stop)
+                break;
+            unsigned weight = weights[active_node];
+            for (uint32_t e = edge_first[active_node]; e < edge_first[active_node + 1]; ++e) {
+                MapEdge edge = edges[e];
+                if (visited.test(edge.node) || weight + edge.weight >= weights[edge.node])
+                    continue;
+                bool queued = weights[edge.node] != UINT_MAX;
+                weights[edge.node] = weight + edge.weight;
+                parents[edge.node] = active_node;
+                if (queued) {
+                    sift_up(positions[edge.node]);
+                } else {
+                    push(edge.node);
+                }
+            }
+        }
+        if (!visited.test(stop))
+            return;
+
+        // Trace back from the stop node, then turn around
+        distance = weights[stop];
+        for (uint32_t node = stop; node != NO_NODE; node = parents[node]) {
+            route[route_length++] = node;
+        }
+        std::reverse(route.begin(), route.begin() + route_length);
+        for (size_t i{0}; i + 1 < route_length; ++i) {
+            uint32_t first = edge_first[route[i]];
+            if (edge_first[route[i] + 1] - first == 1) {
+                instructions[i] = instruction::forward;
+            } else if (edges[first].node == route[i + 1]) {
+                instructions[i] = instruction::left;
+            } else {
+                instructions[i] = instruction::right;
+            }
+        }
+    }
+
+    // Indexed binary heap of node ids by weight, positions[node] is where
+    // the node is in heap
+    void push(uint32_t node) {
+        heap[heap_size] = node;
+        positions[node] = heap_size;
+        sift_up(heap_size++);
+    }
+    uint32_t pop() {
+        uint32_t top = heap[0];
+        heap[0] = heap[--heap_size];
+        positions[heap[0]] = 0;
+        sift_down(0);
+        return top;
+    }
+    void sift_up(size_t i) {
+        uint32_t node = heap[i];
+        while (i > 0 && weights[heap[(i - 1) / 2]] > weights[node]) {
+            heap[i] = heap[(i - 1) / 2];
+            positions[heap[i]] = i;
+            i = (i - 1) / 2;
+        }
+        heap[i] = node;
+        positions[node] = i;
+    }
+    void sift_down(size_t i) {
+        uint32_t node = heap[i];
+        while (2 * i + 1 < heap_size) {
+            size_t child = 2 * i + 1;
+            if (child + 1 < heap_size && weights[heap[child + 1]] < weights[heap[child]])
+                ++child;
+            if (weights[heap[child]] >= weights[node])
+                break;
+            heap[i] = heap[child];
+            positions[heap[i]] = i;
+            i = child;
+        }
+        heap[i] = node;
+        positions[node] = i;
+    }
+
+    // Map
+    size_t count{0};
+    std::array<uint32_t, MaxNodes + 1> edge_first{};
+    std::array<MapEdge, MaxEdges> edges{};
+    std::array<std::array<char, STATIC_NAME_LEN>, MaxNodes> names{};
+    std::array<uint32_t, MaxNodes> sorted{};  // Ids in name order
+    std::array<uint32_t, MaxNodes> map_ids{};
+    std::array<uint32_t, MaxNodes> internal_ids{};
+
+    // Search state
+    std::array<unsigned, MaxNodes> weights{};
+    std::array<uint32_t, MaxNodes> parents{};
+    std::array<uint32_t, MaxNodes> heap{};
+    std::array<uint32_t, MaxNodes> positions{};
+    std::bitset<MaxNodes> visited{};
+    size_t heap_size{0};
+
+    // Result of the last solve
+    std::array<uint32_t, MaxNodes> route{};
+    std::array<instruction::InstructionNumber, MaxNodes> instructions{};
+    size_t route_length{0};
+    unsigned distance{UINT_MAX};
+};
+
+#endif // STATIC_PATH_FINDER_H
@@ -0,0 +1,135 @@
+#include "telemetry.h"
+#include "log.h"
+
+#include <cerrno>
+#include <cstring>
+#include <new>
+#include <string>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+
+TelemetryPublisher::TelemetryPublisher(string name, uint32_t capacity)
+: name{name} {
+    if (capacity == 0)
+        capacity = 1;
+    size = sizeof(TelemetryHeader) + sizeof(TelemetrySlot) * capacity;
+
+    int fd = shm_open(name.c_str(), O_RDWR | O_CREAT, 0644);
+    if (fd < 0 || ftruncate(fd, 0) != 0 || ftruncate(fd, size) != 0) {
+        Logger::log(ERROR, __FILE__, "TelemetryPublisher", strerror(errno));
+        if (fd >= 0)
+            close(fd);
+        return;
+    }
+    void *memory = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (memory == MAP_FAILED) {
+        Logger::log(ERROR, __FILE__, "TelemetryPublisher", strerror(errno));
+        return;
+    }
+
+    // The object was just truncated so everything is zero
+    header = new (memory) TelemetryHeader{};
+    slots = reinterpret_cast<TelemetrySlot*>(static_cast<char*>(memory) + sizeof(TelemetryHeader));
+    for (uint32_t i{0}; i < capacity; ++i) {
+        new (&slots[i]) TelemetrySlot{};
+    }
+    header->version = TELEMETRY_VERSION;
+    header->capacity = capacity;
+    header->record_size = sizeof(TelemetryRecord);
+    atomic_thread_fence(memory_order_release);
+    header->magic = TELEMETRY_MAGIC;
+    Logger::log(INFO, __FILE__, "TelemetryPublisher", "Publishing telemetry in " + name);
+}
+
+TelemetryPublisher::~TelemetryPublisher() {
+    if (header != nullptr) {
+        munmap(header, size);
+        shm_unlink(name.c_str());
+    }
+}
+
+void TelemetryPublisher::publish(TelemetryRecord record) {
+    if (header == nullptr)
+        return;
+    uint64_t cycle = header->published.load(memory_order_relaxed);
+    TelemetrySlot &slot = slots[cycle % header->capacity];
+    record.cycle = cycle;
+
+    slot.sequence.store(2 * cycle + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    memcpy(&slot.record, &record, sizeof(record));
+    slot.sequence.store(2 * cycle + 2, memory_order_release);
+    header->published.store(cycle + 1, memory_order_release);
+}
+
+TelemetryReader::TelemetryReader(string name) {
+    int fd = shm_open(name.c_str(), O_RDONLY, 0);
+    if (fd < 0) {
+        Logger::log(WARNING, __FILE__, "TelemetryReader", "No telemetry in " + name);
+        return;
+    }
+    struct stat info{};
+    if (fstat(fd, &info) != 0 || static_cast<size_t>(info.st_size) < sizeof(TelemetryHeader)) {
+        close(fd);
+        return;
+    }
+    void *memory = mmap(nullptr, info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (memory == MAP_FAILED)
+        return;
+
+    size = info.st_size;
+    header = static_cast<TelemetryHeader const*>(memory);
+    slots = reinterpret_cast<TelemetrySlot const*>(static_cast<char const*>(memory) + sizeof(TelemetryHeader));
+    atomic_thread_fence(memory_order_acquire);
+    if (header->magic != TELEMETRY_MAGIC || header->version != TELEMETRY_VERSION
+            || header->record_size != sizeof(TelemetryRecord)
+            || size < sizeof(TelemetryHeader) + sizeof(TelemetrySlot) * header->capacity) {
+        Logger::log(WARNING, __FILE__, "TelemetryReader", "Incompatible telemetry in " + name);
+        munmap(memory, size);
+        header = nullptr;
+        slots = nullptr;
+    }
+}
+
+TelemetryReader::~TelemetryReader() {
+    if (header != nullptr)
+        munmap(const_cast<TelemetryHeader*>(header), size);
+}
+
+uint64_t TelemetryReader::get_published() const {
+    if (header == nullptr)
+        return 0;
+    return header->published.load(memory_order_acquire);
+}
+
+bool TelemetryReader::read(uint64_t cycle, TelemetryRecord &record) const {
+    if (header == nullptr)
+        return false;
+    TelemetrySlot const &slot = slots[cycle % header->capacity];
+    uint64_t done = 2 * cycle + 2;
+    uint64_t before = slot.sequence.load(memory_order_acquire);
+    if (before != done)
+        return false;  // Not yet written, being written or overwritten
+    memcpy(&record, &slot.record, sizeof(record));
+    atomic_thread_fence(memory_order_acquire);
+    return slot.sequence.load(memory_order_relaxed) == before;
+}
+
+bool TelemetryReader::read_latest(TelemetryRecord &record) const {
+    // Retry if the newest record got lapped while copying it
+    for (int attempt{0}; attempt < 8; ++attempt) {
+        uint64_t published = get_published();
+        if (published == 0)
+            return false;
+        if (read(published - 1, record))
+            return true;
+    }
+    return false;
+}
@@ -0,0 +1,111 @@
+/*
+ * Live controller telemetry in shared memory.
+ *
+ * The control thread owns a TelemetryPublisher and publishes one
+ * TelemetryRecord per cycle into a ring in a POSIX shared memory object.
+ * Any number of other processes open a TelemetryReader on the same name
+ * and read records without system calls and without ever blocking the
+ * publisher.
+ *
+ * Every slot in the ring is a seqlock: the publisher makes the slot's
+ * sequence number odd while writing and even when done. A reader copies
+ * the record and discards the copy if the sequence number changed while
+ * copying, i.e. if the publisher lapped the reader.
+ */
+
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include "raspi_common.h"
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+#define TELEMETRY_MAGIC 0x54454c4d
+#define TELEMETRY_VERSION 1
+#define TELEMETRY_SEGMENT_LEN 32
+
+struct TelemetryRecord {
+    uint64_t cycle;
+    int64_t timestamp_ns;  // steady clock
+    int32_t state;         // state::ControlState
+    int32_t instruction;   // instruction::InstructionNumber, -1 if none
+    char road_segment[TELEMETRY_SEGMENT_LEN];  // Null terminated
+    int32_t obstacle_distance;  // Filtered
+    int32_t stop_distance;      // Filtered
+    int32_t speed;
+    control_t control;
+};
+
+struct alignas(64) TelemetrySlot {
+    std::atomic<uint64_t> sequence;
+    TelemetryRecord record;
+};
+
+struct TelemetryHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t capacity;
+    uint32_t record_size;
+    alignas(64) std::atomic<uint64_t> published;  // Records published so far
+};
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free,
+              "Telemetry needs lock free 64 bit atomics in shared memory");
+
+class TelemetryPublisher {
+public:
+    /* Create (or take over) the shared memory object name, e.g.
+     * "/control_center_telemetry", with room for capacity records. */
+    TelemetryPublisher(std::string name, uint32_t capacity=1024);
+    ~TelemetryPublisher();
+
+    TelemetryPublisher(TelemetryPublisher const&) = delete;
+    TelemetryPublisher operator=(TelemetryPublisher const&) = delete;
+
+    bool is_open() const {
+        return header != nullptr;
+    }
+
+    /* Write a record into the ring. No system calls, never blocks. The
+     * cycle field is set by the publisher. */
+    void publish(TelemetryRecord record);
+
+private:
+    std::string name;
+    size_t size{0};
+    TelemetryHeader *header{nullptr};
+    TelemetrySlot *slots{nullptr};
+};
+
+class TelemetryReader {
+public:
+    TelemetryReader(std::string name);
+    ~TelemetryReader();
+
+    TelemetryReader(TelemetryReader const&) = delete;
+    TelemetryReader operator=(TelemetryReader const&) = delete;
+
+    bool is_open() const {
+        return header != nullptr;
+    }
+
+    /* Number of records published so far. The newest has cycle
+     * get_published() - 1. */
+    uint64_t get_published() const;
+
+    /* Copy the record with the given cycle number. Return false if it is
+     * not published yet, is being written or has been overwritten. */
+    bool read(uint64_t cycle, TelemetryRecord &record) const;
+
+    /* Copy the newest record. Return false if there is none. */
+    bool read_latest(TelemetryRecord &record) const;
+
+private:
+    size_t size{0};
+    TelemetryHeader const *header{nullptr};
+    TelemetrySlot const *slots{nullptr};
+};
+
+#endif // TELEMETRY_H
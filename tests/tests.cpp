@@ -6,12 +6,45 @@
 #include "log.h"
 #include "raspi_common.h"
 #include "filter.h"
+#include "planner_protocol.h"
+#include "planner_server.h"
+#include "planner_client.h"
+#include "telemetry.h"
+#include "input_channel.h"
+#include "mission_message.h"
+#include "map_graph.h"
+#include "compact_map_graph.h"
+#include "contracted_graph.h"
+#include "anytime_planner.h"
+#include "checkpoint.h"
+#include "log_analyzer.h"
+#include "metrics.h"
+#include "map_partition.h"
+#include "partitioned_planner.h"
+#include "intersection_manager.h"
+#include "detour_planner.h"
+#include "dropout_predictor.h"
+#include "static_path_finder.h"
+#include "frontier_argmin.h"
+#include "lane_relax.h"
+#include "occupancy_table.h"
 
 #include <string>
 #include <list>
+#include <map>
+#include <fstream>
+#include <numeric>
+#include <cstring>
 #include <iostream>
+#include <thread>
 #include <nlohmann/json.hpp>
 
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
 
 using namespace std;
 using json = nlohmann::json;
@@ -101,6 +134,36 @@ TEST_CASE("Path Finder") {
         finder.solve("L2", "L1");
         vector<instruction::InstructionNumber> drive_mission = finder.get_drive_mission();
     }
+    SECTION("Solve from segment") {
+        json json_map = json::parse(map_string);
+        PathFinder finder{};
+        finder.update_map(json_map);
+
+        finder.solve_from_segment("A->B", 1, "D");
+        CHECK(finder.get_distance() == 4);
+        CHECK(finder.get_route() == vector<string>{"A", "B", "D"});
+        CHECK(finder.get_drive_mission() == vector<instruction::InstructionNumber>{instruction::left, instruction::forward});
+        CHECK(finder.get_road_segments() == list<string>{"A->B", "B->D"});
+
+        finder.solve_from_segment("A->C", 0, "D");
+        CHECK(finder.get_distance() == 4);
+        CHECK(finder.get_route() == vector<string>{"A", "C", "B", "D"});
+        CHECK(finder.get_drive_mission().front() == instruction::right);
+
+        // Past the end of the segment is at its head
+        finder.solve_from_segment("A->B", 10, "D");
+        CHECK(finder.get_distance() == 2);
+        finder.solve_from_segment("A->B", 3, "B");
+        CHECK(finder.get_distance() == 0);
+        CHECK(finder.get_route() == vector<string>{"A", "B"});
+
+        finder.solve_from_segment("A->D", 1, "D");
+        CHECK(finder.get_distance() == UINT_MAX);
+        finder.solve_from_segment("AB", 1, "D");
+        CHECK(finder.get_route().empty());
+        finder.solve_from_segment("A->B", 1, "A");
+        CHECK(finder.get_distance() == UINT_MAX);
+    }
     SECTION("Multiple drive missions on large Map") {
         string map_string = "{\"MapData\":{\"A1\":[{\"K1\":5}],\"A2\":[{\"B2\":1}],\"B1\":[{\"A1\":1}],\"B2\":[{\"L2\":2},{\"C2\":2}],\"C1\":[{\"B1\":2},{\"L2\":2}],\"C2\":[{\"D2\":1}],\"D1\":[{\"C1\":1}],\"D2\":[{\"E2\":1}],\"E1\":[{\"D1\":1}],\"E2\":[{\"F2\":2}],\"F1\":[{\"E1\":2}],\"F2\":[{\"G2\":3}],\"G1\":[{\"F1\":3}],\"G2\":[{\"H2\":1}],\"H1\":[{\"G1\":1}],\"H2\":[{\"M1\":2},{\"I2\":2}],\"I1\":[{\"H1\":2},{\"M1\":2}],\"I2\":[{\"J2\":1}],\"J1\":[{\"I1\":1}],\"J2\":[{\"K2\":1}],\"K1\":[{\"J1\":1}],\"K2\":[{\"A2\":5}],\"L1\":[{\"C2\":2},{\"B1\":2}],\"L2\":[{\"M2\":1}],\"M1\":[{\"L1\":1}],\"M2\":[{\"I2\":2},{\"H1\":2}]}}";
         json json_map = json::parse(map_string);
@@ -126,6 +189,11 @@ TEST_CASE("Filter") {
         Filter<int> f2{1, 0};
         CHECK( f2(4) == 4 );
         CHECK( f2(5) == 5 );
+
+        // Longer than the inline window
+        Filter<int> f3{6, 6};
+        CHECK( f3(0) == 5 );
+        CHECK( f3(0) == 4 );
     }
 }
 
@@ -723,6 +791,86 @@ TEST_CASE("Control Center") {
         CHECK(control_center.get_current_road_segment() == "K1->J1");
         CHECK(control_center.get_finished_instruction_id() == "A1->K1");
     }
+    SECTION("Replan from mid-segment") {
+        Logger::init();
+        string map_string = "{\"MapData\":{\"A1\":[{\"K1\":5}],\"A2\":[{\"B2\":1}],\"B1\":[{\"A1\":1}],\"B2\":[{\"L2\":2},{\"C2\":2}],\"C1\":[{\"B1\":2},{\"L2\":2}],\"C2\":[{\"D2\":1}],\"D1\":[{\"C1\":1}],\"D2\":[{\"E2\":1}],\"E1\":[{\"D1\":1}],\"E2\":[{\"F2\":2}],\"F1\":[{\"E1\":2}],\"F2\":[{\"G2\":3}],\"G1\":[{\"F1\":3}],\"G2\":[{\"H2\":1}],\"H1\":[{\"G1\":1}],\"H2\":[{\"M1\":2},{\"I2\":2}],\"I1\":[{\"H1\":2},{\"M1\":2}],\"I2\":[{\"J2\":1}],\"J1\":[{\"I1\":1}],\"J2\":[{\"K2\":1}],\"K1\":[{\"J1\":1}],\"K2\":[{\"A2\":5}],\"L1\":[{\"C2\":2},{\"B1\":2}],\"L2\":[{\"M2\":1}],\"M1\":[{\"L1\":1}],\"M2\":[{\"I2\":2},{\"H1\":2}]}}";
+        ControlCenter control_center{};
+        control_center.update_map(json::parse(map_string));
+        control_center.set_drive_missions({"A1", "K2", "H1"});
+
+        // Leave A1 and drive into A1->K1
+        control_center(OBST_DISTANCE_CLOSE+10, STOP_DISTANCE_CLOSE, 0, 0, 0, 0, 0, 0);
+        control_center(OBST_DISTANCE_CLOSE+10, STOP_DISTANCE_FAR, DEFAULT_SPEED, 0, 0, 0, 0, 0);
+        CHECK(control_center.get_current_road_segment() == "A1->K1");
+        CHECK(control_center.get_state() == state::normal);
+
+        // A failed replan keeps the route being driven
+        string current_id = control_center.get_current_drive_instruction().id;
+        CHECK_FALSE(control_center.set_drive_missions("X1->Y1", 3, {"I1", "L1"}));
+        CHECK_FALSE(control_center.set_drive_missions("A1->K1", 3, {"I1", "Z9"}));
+        CHECK(control_center.get_current_road_segment() == "A1->K1");
+        CHECK(control_center.get_current_drive_instruction().id == current_id);
+        CHECK(control_center.get_state() == state::normal);
+
+        // New mission halfway along the segment takes effect at once
+        CHECK(control_center.set_drive_missions("A1->K1", 3, {"I1", "L1"}));
+        CHECK(control_center.get_state() == state::normal);
+        CHECK(control_center.get_current_road_segment() == "A1->K1");
+        CHECK(control_center.get_current_drive_instruction().number == instruction::forward);
+        control_t control_data = control_center(OBST_DISTANCE_CLOSE+10, STOP_DISTANCE_FAR, DEFAULT_SPEED, 0, 0, 0, 0, 0);
+        CHECK(control_data.speed_ref == DEFAULT_SPEED);
+
+        // At K1
+        control_center(OBST_DISTANCE_CLOSE+10, STOP_DISTANCE_MID, DEFAULT_SPEED, 0, 0, 0, 0, 0);
+        control_center(OBST_DISTANCE_CLOSE+10, STOP_DISTANCE_CLOSE, DEFAULT_SPEED, 0, 0, 0, 0, 0);
+        CHECK(control_center.get_finished_instruction_id() == "A1");
+        CHECK(control_center.get_finished_instruction_id() == "A1->K1");
+        CHECK(control_center.get_current_road_segment() == "K1->J1");
+    }
+    SECTION("ETA") {
+        string map_string = "{\"MapData\":{\"A1\":[{\"K1\":5}],\"A2\":[{\"B2\":1}],\"B1\":[{\"A1\":1}],\"B2\":[{\"L2\":2},{\"C2\":2}],\"C1\":[{\"B1\":2},{\"L2\":2}],\"C2\":[{\"D2\":1}],\"D1\":[{\"C1\":1}],\"D2\":[{\"E2\":1}],\"E1\":[{\"D1\":1}],\"E2\":[{\"F2\":2}],\"F1\":[{\"E1\":2}],\"F2\":[{\"G2\":3}],\"G1\":[{\"F1\":3}],\"G2\":[{\"H2\":1}],\"H1\":[{\"G1\":1}],\"H2\":[{\"M1\":2},{\"I2\":2}],\"I1\":[{\"H1\":2},{\"M1\":2}],\"I2\":[{\"J2\":1}],\"J1\":[{\"I1\":1}],\"J2\":[{\"K2\":1}],\"K1\":[{\"J1\":1}],\"K2\":[{\"A2\":5}],\"L1\":[{\"C2\":2},{\"B1\":2}],\"L2\":[{\"M2\":1}],\"M1\":[{\"L1\":1}],\"M2\":[{\"I2\":2},{\"H1\":2}]}}";
+        json json_map = json::parse(map_string);
+        PathFinder finder{};
+        finder.update_map(json_map);
+        finder.solve("A1", "K2");
+        double first_leg = finder.get_distance();
+        finder.solve("K2", "H1");
+        double total = first_leg + finder.get_distance();
+
+        // 6 edge weight units per second at DEFAULT_SPEED
+        ControlCenter control_center{};
+        control_center.update_map(json_map);
+        control_center.set_drive_missions({"A1", "K2", "H1"});
+        control_center.track_eta(6.0 / DEFAULT_SPEED);
+
+        // Leave A1
+        control_center(OBST_DISTANCE_CLOSE+10, STOP_DISTANCE_CLOSE, 0, 0, 0, 0, 0, 0);
+        control_center(OBST_DISTANCE_CLOSE+10, STOP_DISTANCE_FAR, DEFAULT_SPEED, 0, 0, 0, 0, 0);
+        CHECK(control_center.get_current_road_segment() == "A1->K1");
+        auto seconds = [] (chrono::steady_clock::duration d) { return chrono::duration<double>(d).count(); };
+        auto current = control_center.get_instruction_eta();
+        CHECK(seconds(current - chrono::steady_clock::now()) == Approx(5 / 6.0).margin(0.05));
+        CHECK(seconds(control_center.get_instruction_eta(1) - current) == Approx(1 / 6.0));
+        CHECK(seconds(control_center.get_mission_eta() - current) == Approx((total - 5) / 6));
+        vector<chrono::steady_clock::time_point> stops = control_center.get_stop_etas();
+        REQUIRE(stops.size() == 1);
+        CHECK(seconds(stops[0] - current) == Approx((first_leg - 5) / 6));
+
+        // The segment takes much less time than estimated, later ones will too
+        this_thread::sleep_for(chrono::milliseconds(20));
+        control_center(OBST_DISTANCE_CLOSE+10, STOP_DISTANCE_MID, DEFAULT_SPEED, 0, 0, 0, 0, 0);
+        control_center(OBST_DISTANCE_CLOSE+10, STOP_DISTANCE_CLOSE, DEFAULT_SPEED, 0, 0, 0, 0, 0);
+        CHECK(control_center.get_current_road_segment() == "K1->J1");
+        double left = seconds(control_center.get_mission_eta() - chrono::steady_clock::now());
+        CHECK(left > 0);
+        CHECK(left < (total - 5) / 6 / 2);
+
+        // Standing still, the estimate moves with the clock
+        auto before = control_center.get_mission_eta();
+        this_thread::sleep_for(chrono::milliseconds(5));
+        control_center(OBST_DISTANCE_CLOSE-10, -1, 0, 0, 0, 0, 0, 0);
+        CHECK(control_center.get_mission_eta() > before);
+    }
     SECTION("Dijkstra without map") {
         Logger::init();
         // Make control_center
@@ -732,3 +880,1651 @@ TEST_CASE("Control Center") {
     }
 }
 
+
+TEST_CASE("Planner daemon") {
+    string map_string = "{\"MapData\":{\"A1\":[{\"K1\":5}],\"A2\":[{\"B2\":1}],\"B1\":[{\"A1\":1}],\"B2\":[{\"L2\":2},{\"C2\":2}],\"C1\":[{\"B1\":2},{\"L2\":2}],\"C2\":[{\"D2\":1}],\"D1\":[{\"C1\":1}],\"D2\":[{\"E2\":1}],\"E1\":[{\"D1\":1}],\"E2\":[{\"F2\":2}],\"F1\":[{\"E1\":2}],\"F2\":[{\"G2\":3}],\"G1\":[{\"F1\":3}],\"G2\":[{\"H2\":1}],\"H1\":[{\"G1\":1}],\"H2\":[{\"M1\":2},{\"I2\":2}],\"I1\":[{\"H1\":2},{\"M1\":2}],\"I2\":[{\"J2\":1}],\"J1\":[{\"I1\":1}],\"J2\":[{\"K2\":1}],\"K1\":[{\"J1\":1}],\"K2\":[{\"A2\":5}],\"L1\":[{\"C2\":2},{\"B1\":2}],\"L2\":[{\"M2\":1}],\"M1\":[{\"L1\":1}],\"M2\":[{\"I2\":2},{\"H1\":2}]}}";
+    json json_map = json::parse(map_string);
+    string socket_path = "/tmp/control_center_test_planner.sock";
+
+    SECTION("Protocol") {
+        PlannerQuery query{};
+        query.id = 7;
+        query.type = planner::distance;
+        query.start = "A1";
+        query.stop = "K2";
+        vector<uint8_t> buffer{};
+        encode_query(query, buffer);
+
+        PlannerQuery decoded{};
+        CHECK(decode_query(buffer.data(), buffer.size() - 1, decoded) == 0);
+        CHECK(decode_query(buffer.data(), buffer.size(), decoded) == static_cast<long>(buffer.size()));
+        CHECK(decoded.id == 7);
+        CHECK(decoded.type == planner::distance);
+        CHECK(decoded.start == "A1");
+        CHECK(decoded.stop == "K2");
+
+        PlannerReply reply{};
+        reply.id = 7;
+        reply.status = planner::ok;
+        reply.distance = 3;
+        reply.instructions = {instruction::left, instruction::forward};
+        reply.nodes = {"C1", "B1", "A1"};
+        reply.distances = {4, 9};
+        buffer.clear();
+        encode_reply(reply, buffer);
+        PlannerReply decoded_reply{};
+        CHECK(decode_reply(buffer.data(), buffer.size(), decoded_reply) == static_cast<long>(buffer.size()));
+        CHECK(decoded_reply.distance == 3);
+        CHECK(decoded_reply.instructions == reply.instructions);
+        CHECK(decoded_reply.distances == reply.distances);
+        CHECK(decoded_reply.get_road_segments() == vector<string>{"C1->B1", "B1->A1"});
+
+        // Garbage length
+        buffer.assign(8, 0xff);
+        CHECK(decode_reply(buffer.data(), buffer.size(), decoded_reply) == -1);
+        buffer.assign(8, 0);
+        CHECK(decode_reply(buffer.data(), buffer.size(), decoded_reply) == -1);
+        CHECK(decode_query(buffer.data(), buffer.size(), decoded) == -1);
+
+        // Too long for a frame
+        reply.instructions.assign(70000, instruction::forward);
+        buffer.clear();
+        encode_reply(reply, buffer);
+        CHECK(decode_reply(buffer.data(), buffer.size(), decoded_reply) == static_cast<long>(buffer.size()));
+        CHECK(decoded_reply.id == 7);
+        CHECK(decoded_reply.status == planner::too_long);
+        CHECK(decoded_reply.instructions.empty());
+        reply.instructions.clear();
+        reply.nodes.assign(30000, "A_long_name");
+        buffer.clear();
+        encode_reply(reply, buffer);
+        CHECK(decode_reply(buffer.data(), buffer.size(), decoded_reply) == static_cast<long>(buffer.size()));
+        CHECK(decoded_reply.status == planner::too_long);
+        CHECK(decoded_reply.nodes.empty());
+    }
+    SECTION("Server and client") {
+        Logger::init();
+        PlannerServer server{json_map, socket_path, 2};
+        thread server_thread{[&] { server.run(); }};
+
+        // Wait for the socket to appear
+        PlannerClient *client{nullptr};
+        for (int i{0}; i < 100; ++i) {
+            client = new PlannerClient{socket_path};
+            if (client->connected())
+                break;
+            delete client;
+            client = nullptr;
+            this_thread::sleep_for(chrono::milliseconds(10));
+        }
+        REQUIRE(client != nullptr);
+
+        PathFinder finder{};
+        finder.update_map(json_map);
+        finder.solve("L2", "L1");
+        PlannerReply reply = client->route("L2", "L1");
+        CHECK(reply.status == planner::ok);
+        CHECK(reply.instructions == finder.get_drive_mission());
+        CHECK(reply.distance == finder.get_distance());
+        list<string> segments = finder.get_road_segments();
+        CHECK(reply.get_road_segments() == vector<string>(segments.begin(), segments.end()));
+
+        CHECK(client->distance("A1", "A1") == 0);
+        CHECK(client->route("A1", "X9").status == planner::unknown_node);
+
+        // A batch
+        vector<PlannerQuery> queries(3);
+        queries[0].start = "A1";
+        queries[0].stop = "K2";
+        queries[1].type = planner::distance;
+        queries[1].start = "K2";
+        queries[1].stop = "H1";
+        queries[2].start = "G1";
+        queries[2].stop = "J2";
+        vector<PlannerReply> replies = client->query(queries);
+        REQUIRE(replies.size() == 3);
+        for (PlannerReply const &r : replies) {
+            CHECK(r.status == planner::ok);
+        }
+        CHECK(replies[1].instructions.empty());
+        finder.solve("G1", "J2");
+        CHECK(replies[2].instructions == finder.get_drive_mission());
+
+        // Control center planning through the daemon
+        ControlCenter control_center{};
+        control_center.use_planner(socket_path);
+        control_center.set_drive_missions({"A1", "K2", "H1"});
+        CHECK(control_center.get_current_drive_instruction().number == instruction::stop);
+        CHECK(control_center.get_current_road_segment() == "A1");
+
+        // A client that sends but never reads does not hold up the others
+        int stalled = socket(AF_UNIX, SOCK_STREAM, 0);
+        sockaddr_un address{};
+        address.sun_family = AF_UNIX;
+        strcpy(address.sun_path, socket_path.c_str());
+        REQUIRE(connect(stalled, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == 0);
+        vector<uint8_t> flood{};
+        for (int i{0}; i < 20000; ++i) {
+            encode_query(queries[0], flood);
+        }
+        CHECK(send(stalled, flood.data(), flood.size(), MSG_NOSIGNAL) == static_cast<ssize_t>(flood.size()));
+        for (int i{0}; i < 10; ++i) {
+            CHECK(client->route("L2", "L1").status == planner::ok);
+        }
+        close(stalled);
+
+        delete client;
+        server.stop();
+        server_thread.join();
+        CHECK(server.get_query_count() >= 7);
+    }
+    SECTION("Daemon restart") {
+        Logger::init();
+        unique_ptr<PlannerServer> server{new PlannerServer{json_map, socket_path, 1}};
+        thread server_thread{[&server] { server->run(); }};
+        unique_ptr<PlannerClient> client{};
+        for (int i{0}; i < 100; ++i) {
+            client.reset(new PlannerClient{socket_path});
+            if (client->connected())
+                break;
+            this_thread::sleep_for(chrono::milliseconds(10));
+        }
+        REQUIRE(client->connected());
+        CHECK(client->route("L2", "L1").status == planner::ok);
+
+        // Queries while the daemon is away fall back, then it is back
+        server->stop();
+        server_thread.join();
+        server.reset();
+        CHECK(client->route("L2", "L1").status == planner::no_planner);
+        CHECK(!client->connected());
+        server.reset(new PlannerServer{json_map, socket_path, 1});
+        server_thread = thread{[&server] { server->run(); }};
+        this_thread::sleep_for(chrono::milliseconds(PLANNER_RETRY_MS + 50));
+        CHECK(client->route("L2", "L1").status == planner::ok);
+        CHECK(client->connected());
+
+        // A restart between two queries is not noticed
+        server->stop();
+        server_thread.join();
+        server.reset(new PlannerServer{json_map, socket_path, 1});
+        server_thread = thread{[&server] { server->run(); }};
+        this_thread::sleep_for(chrono::milliseconds(50));
+        CHECK(client->route("L2", "L1").status == planner::ok);
+
+        server->stop();
+        server_thread.join();
+    }
+    SECTION("Partitioned map") {
+        Logger::init();
+        MapPartition partition = partition_map(json_map, 3);
+        REQUIRE(partition.regions.size() == 3);
+        CHECK(partition.overlay["Nodes"].size() == 26);
+        CHECK(partition.overlay["Nodes"]["A1"] < 3);
+
+        vector<unique_ptr<PlannerServer>> servers{};
+        vector<thread> server_threads{};
+        vector<string> paths{};
+        for (unsigned region{0}; region < 3; ++region) {
+            paths.push_back("/tmp/control_center_test_region" + to_string(region) + ".sock");
+            servers.emplace_back(new PlannerServer{partition.regions[region], paths.back(), 1});
+            server_threads.emplace_back([&servers, region] { servers[region]->run(); });
+        }
+        unique_ptr<PartitionedPlanner> planner{};
+        for (int i{0}; i < 100; ++i) {
+            planner.reset(new PartitionedPlanner{partition.overlay, paths});
+            if (planner->connected())
+                break;
+            this_thread::sleep_for(chrono::milliseconds(10));
+        }
+        REQUIRE(planner->connected());
+        CHECK(planner->get_overlay_size() > 0);
+
+        // The same routes as on the whole map
+        PathFinder finder{};
+        finder.update_map(json_map);
+        for (auto &start : json_map["MapData"].items()) {
+            for (auto &stop : json_map["MapData"].items()) {
+                finder.solve(start.key(), stop.key());
+                PlannerReply reply = planner->route(start.key(), stop.key());
+                CHECK(reply.status == planner::ok);
+                CHECK(reply.distance == finder.get_distance());
+                CHECK(reply.nodes.front() == start.key());
+                CHECK(reply.nodes.back() == stop.key());
+                REQUIRE(reply.instructions.size() + 1 == reply.nodes.size());
+                if (reply.nodes == finder.get_route())
+                    CHECK(reply.instructions == finder.get_drive_mission());
+            }
+        }
+        CHECK(planner->route("A1", "X9").status == planner::unknown_node);
+
+        for (unsigned region{0}; region < 3; ++region) {
+            servers[region]->stop();
+            server_threads[region].join();
+        }
+    }
+    SECTION("Hung daemon") {
+        Logger::init();
+        string hung_path = "/tmp/control_center_test_hung.sock";
+        unlink(hung_path.c_str());
+        int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+        sockaddr_un address{};
+        address.sun_family = AF_UNIX;
+        strcpy(address.sun_path, hung_path.c_str());
+        REQUIRE(bind(listener, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == 0);
+        REQUIRE(listen(listener, 4) == 0);
+
+        // Connects, but the queries are never answered
+        PlannerClient client{hung_path, 50};
+        REQUIRE(client.connected());
+        auto begin = chrono::steady_clock::now();
+        CHECK(client.route("A1", "K2").status == planner::no_planner);
+        CHECK(chrono::steady_clock::now() - begin < chrono::seconds(5));
+        CHECK(!client.connected());
+
+        ControlCenter control_center{};
+        control_center.update_map(json_map);
+        control_center.use_planner(hung_path, 50);
+        begin = chrono::steady_clock::now();
+        control_center.set_drive_missions({"A1", "K2"});
+        CHECK(chrono::steady_clock::now() - begin < chrono::seconds(5));
+        CHECK(control_center.get_current_road_segment() == "A1");
+
+        close(listener);
+        unlink(hung_path.c_str());
+    }
+    SECTION("No daemon") {
+        ControlCenter control_center{};
+        control_center.update_map(json_map);
+        control_center.use_planner("/tmp/control_center_no_planner.sock");
+        control_center.set_drive_missions({"A1", "K2"});
+        CHECK(control_center.get_current_road_segment() == "A1");
+    }
+}
+
+TEST_CASE("Telemetry") {
+    SECTION("Ring") {
+        TelemetryPublisher publisher{"/control_center_test_ring", 4};
+        REQUIRE(publisher.is_open());
+        TelemetryReader reader{"/control_center_test_ring"};
+        REQUIRE(reader.is_open());
+
+        TelemetryRecord record{};
+        CHECK(!reader.read_latest(record));
+        for (int i{0}; i < 6; ++i) {
+            record.speed = i;
+            publisher.publish(record);
+        }
+        CHECK(reader.get_published() == 6);
+        CHECK(reader.read_latest(record));
+        CHECK(record.cycle == 5);
+        CHECK(record.speed == 5);
+
+        // Cycles 0 and 1 have been overwritten, 6 is not published yet
+        CHECK(!reader.read(1, record));
+        CHECK(reader.read(2, record));
+        CHECK(record.speed == 2);
+        CHECK(!reader.read(6, record));
+    }
+    SECTION("Control center") {
+        ControlCenter control_center{};
+        control_center.publish_telemetry("/control_center_test_telemetry", 16);
+        TelemetryReader reader{"/control_center_test_telemetry"};
+        REQUIRE(reader.is_open());
+
+        control_center.add_drive_instruction(instruction::left, "A->B");
+        control_center(1000, 200, 0, 3, 5, 0, 0, 0);
+        control_center(1000, 200, DEFAULT_SPEED, 3, 5, 0, 0, 0);
+
+        TelemetryRecord record{};
+        REQUIRE(reader.read_latest(record));
+        CHECK(record.cycle == 1);
+        CHECK(record.state == state::intersection);
+        CHECK(record.instruction == instruction::left);
+        CHECK(record.speed == DEFAULT_SPEED);
+        CHECK(record.control.angle == 3);
+        CHECK(record.control.speed_ref == INTERSECTION_SPEED);
+    }
+}
+
+TEST_CASE("Input channel") {
+    SECTION("Ring") {
+        InputChannelConsumer consumer{"/control_center_test_input", 3};
+        REQUIRE(consumer.is_open());
+        InputChannelProducer producer{"/control_center_test_input"};
+        REQUIRE(producer.is_open());
+
+        CHECK(consumer.peek() == nullptr);
+        CHECK(!consumer.wait(1000));
+
+        // Capacity is rounded up to 4, a full ring drops the oldest
+        sensor_data_t sensor_data{};
+        for (int i{0}; i < 5; ++i) {
+            sensor_data.speed = i;
+            CHECK(producer.push(sensor_data));
+        }
+        CHECK(consumer.get_dropped() == 1);
+        CHECK(consumer.wait(1000));
+        for (int i{1}; i < 5; ++i) {
+            InputRecord const *record = consumer.peek();
+            REQUIRE(record != nullptr);
+            CHECK(record->sequence == static_cast<uint64_t>(i));
+            CHECK(record->kind == input::sensor);
+            CHECK(record->sensor.speed == i);
+            CHECK(consumer.release());
+        }
+        CHECK(consumer.peek() == nullptr);
+
+        // The record being read is dropped
+        for (int i{5}; i < 9; ++i) {
+            sensor_data.speed = i;
+            producer.push(sensor_data);
+        }
+        REQUIRE(consumer.peek() != nullptr);
+        sensor_data.speed = 9;
+        producer.push(sensor_data);
+        CHECK(!consumer.release());
+        CHECK(consumer.get_dropped() == 2);
+        REQUIRE(consumer.peek() != nullptr);
+        CHECK(consumer.peek()->sensor.speed == 6);
+
+        // A producer without a channel does nothing
+        InputChannelProducer closed{"/control_center_test_no_input"};
+        CHECK(!closed.is_open());
+        CHECK(closed.claim() == nullptr);
+        closed.commit(input::sensor);
+        CHECK(!closed.push(sensor_data));
+    }
+    SECTION("Futex wake-up") {
+        InputChannelConsumer consumer{"/control_center_test_input"};
+        InputChannelProducer producer{"/control_center_test_input"};
+        thread producer_thread{[&] {
+            this_thread::sleep_for(chrono::milliseconds(20));
+            image_proc_t image_data{};
+            image_data.angle_left = 7;
+            producer.push(image_data);
+        }};
+        CHECK(consumer.wait(2000000));
+        producer_thread.join();
+        REQUIRE(consumer.peek() != nullptr);
+        CHECK(consumer.peek()->image.angle_left == 7);
+    }
+    SECTION("Control center") {
+        InputChannelConsumer consumer{"/control_center_test_input", 8, true};
+        InputChannelProducer producer{"/control_center_test_input"};
+        ControlCenter control_center{};
+        control_center.add_drive_instruction(instruction::forward, "1");
+
+        sensor_data_t sensor_data{};
+        sensor_data.obstacle_distance = OBST_DISTANCE_CLOSE + 10;
+        image_proc_t image_data{};
+        image_data.stop_distance = STOP_DISTANCE_FAR;
+        image_data.angle_left = 100;
+        producer.push(image_data);
+        image_data.angle_left = 4;
+        image_data.angle_right = 6;
+        producer.push(image_data);
+        producer.push(sensor_data);
+
+        CHECK(consumer.wait(1000));
+        control_t control_data = control_center(consumer);
+        CHECK(consumer.peek() == nullptr);
+        CHECK(control_center.get_state() == state::normal);
+        CHECK(control_data.angle == 5);
+    }
+}
+
+TEST_CASE("Mission message") {
+    string map_string = "{\"MapData\":{\"A1\":[{\"K1\":5}],\"A2\":[{\"B2\":1}],\"B1\":[{\"A1\":1}],\"B2\":[{\"L2\":2},{\"C2\":2}],\"C1\":[{\"B1\":2},{\"L2\":2}],\"C2\":[{\"D2\":1}],\"D1\":[{\"C1\":1}],\"D2\":[{\"E2\":1}],\"E1\":[{\"D1\":1}],\"E2\":[{\"F2\":2}],\"F1\":[{\"E1\":2}],\"F2\":[{\"G2\":3}],\"G1\":[{\"F1\":3}],\"G2\":[{\"H2\":1}],\"H1\":[{\"G1\":1}],\"H2\":[{\"M1\":2},{\"I2\":2}],\"I1\":[{\"H1\":2},{\"M1\":2}],\"I2\":[{\"J2\":1}],\"J1\":[{\"I1\":1}],\"J2\":[{\"K2\":1}],\"K1\":[{\"J1\":1}],\"K2\":[{\"A2\":5}],\"L1\":[{\"C2\":2},{\"B1\":2}],\"L2\":[{\"M2\":1}],\"M1\":[{\"L1\":1}],\"M2\":[{\"I2\":2},{\"H1\":2}]}}";
+    json json_map = json::parse(map_string);
+    PathFinder finder{};
+    finder.update_map(json_map);
+
+    SECTION("Map version") {
+        CHECK(finder.get_map_version() == map_version(json_map));
+        json other = json_map;
+        other["MapData"]["A1"][0]["K1"] = 6;
+        CHECK(map_version(other) != map_version(json_map));
+        CHECK(finder.get_node_id("A1") == 0);
+        CHECK(finder.get_node_id("M2") == 25);
+        CHECK(finder.get_node_id("X") == -1);
+        CHECK(finder.get_node_name(1) == "A2");
+    }
+    SECTION("Encode and decode") {
+        vector<MissionTarget> targets(2);
+        targets[0].node = 3;
+        targets[0].mission_id = 70000;
+        targets[1].node = 25;
+        targets[1].mission_id = 2;
+        targets[1].flags = mission::pass_through;
+        vector<uint8_t> message = encode_mission(1234, targets);
+        CHECK(message.size() == MISSION_HEADER_SIZE + 2 * MISSION_TARGET_SIZE);
+
+        MissionView view{};
+        CHECK(view.decode(message.data(), message.size(), 1234, 26) == mission::ok);
+        CHECK(view.size() == 2);
+        CHECK(view.get_node(0) == 3);
+        CHECK(view.get_mission_id(0) == 70000);
+        CHECK(view.get_flags(0) == 0);
+        CHECK(view.get_node(1) == 25);
+        CHECK(view.get_flags(1) == mission::pass_through);
+
+        CHECK(view.decode(message.data(), message.size(), 1235, 26) == mission::wrong_map_version);
+        CHECK(view.size() == 0);
+        CHECK(view.decode(message.data(), message.size() - 1, 1234, 26) == mission::truncated);
+        CHECK(view.decode(message.data(), message.size(), 1234, 25) == mission::unknown_node);
+        message[0] = 0;
+        CHECK(view.decode(message.data(), message.size(), 1234, 26) == mission::bad_magic);
+    }
+    SECTION("Id based solve") {
+        finder.solve("L2", "L1");
+        vector<instruction::InstructionNumber> by_name = finder.get_drive_mission();
+        list<string> segments_by_name = finder.get_road_segments();
+        finder.solve(finder.get_node_id("L2"), finder.get_node_id("L1"));
+        CHECK(finder.get_drive_mission() == by_name);
+        CHECK(finder.get_road_segments() == segments_by_name);
+    }
+    SECTION("Control center") {
+        ControlCenter text_center{};
+        text_center.update_map(json_map);
+        text_center.set_drive_missions({"A1", "K2", "H1"});
+
+        ControlCenter control_center{};
+        control_center.update_map(json_map);
+        vector<MissionTarget> targets(3);
+        targets[0].node = finder.get_node_id("A1");
+        targets[0].mission_id = 10;
+        targets[1].node = finder.get_node_id("K2");
+        targets[1].mission_id = 11;
+        targets[2].node = finder.get_node_id("H1");
+        targets[2].mission_id = 12;
+        vector<uint8_t> message = encode_mission(map_version(json_map), targets);
+
+        // Wrong map version is rejected
+        vector<uint8_t> old_message = encode_mission(map_version(json_map) + 1, targets);
+        CHECK(control_center.set_drive_missions(old_message.data(), old_message.size()) == mission::wrong_map_version);
+        CHECK(control_center.get_current_road_segment() == "end");
+
+        CHECK(control_center.set_drive_missions(message.data(), message.size()) == mission::ok);
+        CHECK(control_center.get_current_drive_instruction().number == instruction::stop);
+        CHECK(control_center.get_current_drive_instruction().id == "10");
+        CHECK(control_center.get_current_road_segment() == "A1");
+
+        // Same drive as with node names
+        control_center(OBST_DISTANCE_CLOSE+10, STOP_DISTANCE_CLOSE, 0, 0, 0, 0, 0, 0);
+        text_center(OBST_DISTANCE_CLOSE+10, STOP_DISTANCE_CLOSE, 0, 0, 0, 0, 0, 0);
+        CHECK(control_center.get_finished_instruction_id() == "10");
+        CHECK(text_center.get_finished_instruction_id() == "A1");
+        CHECK(control_center.get_current_road_segment() == text_center.get_current_road_segment());
+        CHECK(control_center.get_current_drive_instruction().id == text_center.get_current_drive_instruction().id);
+
+        // Pass through K2 without stopping
+        targets[1].flags = mission::pass_through;
+        message = encode_mission(map_version(json_map), targets);
+        CHECK(control_center.set_drive_missions(message.data(), message.size()) == mission::ok);
+        control_center(OBST_DISTANCE_CLOSE+10, STOP_DISTANCE_CLOSE, 0, 0, 0, 0, 0, 0);
+        CHECK(control_center.get_finished_instruction_id() == "10");
+        while (control_center.get_current_road_segment() != "K2->A2") {
+            CHECK(control_center.get_current_drive_instruction().number != instruction::stop);
+            control_center(OBST_DISTANCE_CLOSE+10, STOP_DISTANCE_MID, DEFAULT_SPEED, 0, 0, 0, 0, 0);
+            control_center(OBST_DISTANCE_CLOSE+10, STOP_DISTANCE_CLOSE, DEFAULT_SPEED, 0, 0, 0, 0, 0);
+            control_center(OBST_DISTANCE_CLOSE+10, STOP_DISTANCE_FAR + 10, DEFAULT_SPEED, 0, 0, 0, 0, 0);
+        }
+        CHECK(control_center.get_state() == state::normal);
+    }
+}
+
+TEST_CASE("Shared map") {
+    string map_string = "{\"MapData\":{\"A1\":[{\"K1\":5}],\"A2\":[{\"B2\":1}],\"B1\":[{\"A1\":1}],\"B2\":[{\"L2\":2},{\"C2\":2}],\"C1\":[{\"B1\":2},{\"L2\":2}],\"C2\":[{\"D2\":1}],\"D1\":[{\"C1\":1}],\"D2\":[{\"E2\":1}],\"E1\":[{\"D1\":1}],\"E2\":[{\"F2\":2}],\"F1\":[{\"E1\":2}],\"F2\":[{\"G2\":3}],\"G1\":[{\"F1\":3}],\"G2\":[{\"H2\":1}],\"H1\":[{\"G1\":1}],\"H2\":[{\"M1\":2},{\"I2\":2}],\"I1\":[{\"H1\":2},{\"M1\":2}],\"I2\":[{\"J2\":1}],\"J1\":[{\"I1\":1}],\"J2\":[{\"K2\":1}],\"K1\":[{\"J1\":1}],\"K2\":[{\"A2\":5}],\"L1\":[{\"C2\":2},{\"B1\":2}],\"L2\":[{\"M2\":1}],\"M1\":[{\"L1\":1}],\"M2\":[{\"I2\":2},{\"H1\":2}]}}";
+    json json_map = json::parse(map_string);
+
+    SECTION("Map graph") {
+        shared_ptr<MapGraph const> map = MapGraph::from_json(json_map, false);
+        CHECK(map->size() == 26);
+        CHECK(map->get_id("B2") == 3);
+        CHECK(map->get_name(3) == "B2");
+        CHECK(map->get_degree(3) == 2);
+        CHECK(map->get_left(3).node == static_cast<uint32_t>(map->get_id("L2")));
+        CHECK(map->get_right(3).weight == 2);
+        CHECK(map->get_degree(0) == 1);
+        CHECK(map->get_right(0).node == NO_NODE);
+        CHECK(map->get_memory_usage() > 0);
+    }
+    SECTION("Locality reordering") {
+        shared_ptr<MapGraph const> plain = MapGraph::from_json(json_map, false);
+        shared_ptr<MapGraph const> map = MapGraph::from_json(json_map);
+        REQUIRE(map->size() == plain->size());
+        CHECK(map->get_version() == plain->get_version());
+
+        // Same names, same edges, only the numbering differs
+        for (unsigned map_id{0}; map_id < plain->size(); ++map_id) {
+            unsigned id = map->from_map_id(map_id);
+            CHECK(map->get_map_id(id) == map_id);
+            CHECK(map->get_name(id) == plain->get_name(map_id));
+            CHECK(map->get_id(map->get_name(id)) == static_cast<int>(id));
+            CHECK(map->get_degree(id) == plain->get_degree(map_id));
+            CHECK(map->get_left(id).weight == plain->get_left(map_id).weight);
+            if (plain->get_left(map_id).node != NO_NODE) {
+                CHECK(map->get_name(map->get_left(id).node) == plain->get_name(plain->get_left(map_id).node));
+            }
+            if (plain->get_right(map_id).node != NO_NODE) {
+                CHECK(map->get_name(map->get_right(id).node) == plain->get_name(plain->get_right(map_id).node));
+            }
+        }
+
+        // Equally short routes (ties may be broken differently)
+        PathFinder finder{map};
+        PathFinder plain_finder{plain};
+        for (unsigned start{0}; start < plain->size(); start += 5) {
+            for (unsigned stop{0}; stop < plain->size(); stop += 3) {
+                finder.solve(start, stop);
+                plain_finder.solve(start, stop);
+                CHECK(finder.get_distance() == plain_finder.get_distance());
+                CHECK(finder.get_route().front() == plain_finder.get_route().front());
+                CHECK(finder.get_route().back() == plain_finder.get_route().back());
+            }
+        }
+    }
+    SECTION("Shortest routes") {
+        PathFinder finder{};
+        finder.update_map(json_map);
+        finder.solve("L2", "L1");
+        CHECK(finder.get_distance() == 24);
+        CHECK(finder.get_route() == vector<string>{"L2", "M2", "I2", "J2", "K2", "A2", "B2", "C2", "D2", "E2", "F2", "G2", "H2", "M1", "L1"});
+        finder.solve("C1", "M1");
+        CHECK(finder.get_distance() == 12);
+        CHECK(finder.get_route() == vector<string>{"C1", "B1", "A1", "K1", "J1", "I1", "M1"});
+        CHECK(finder.get_drive_mission() == vector<instruction::InstructionNumber>{
+                instruction::left, instruction::forward, instruction::forward,
+                instruction::forward, instruction::forward, instruction::right});
+        CHECK(finder.get_drive_mission().size() == finder.get_route().size() - 1);
+    }
+    SECTION("Reachable within budget") {
+        PathFinder path_finder{MapGraph::from_json(json_map)};
+        vector<ReachableNode> reached = path_finder.reachable_within("L2", 5);
+        map<string, uint32_t> distances{};
+        for (ReachableNode node : reached) {
+            distances[path_finder.get_node_name(node.node)] = node.distance;
+        }
+        map<string, uint32_t> expected{{"L2", 0}, {"M2", 1}, {"I2", 3}, {"H1", 3},
+                                       {"J2", 4}, {"G1", 4}, {"K2", 5}};
+        CHECK(distances == expected);
+        REQUIRE(reached.size() == 7);
+        CHECK(reached.front().node == static_cast<uint32_t>(path_finder.get_node_id("L2")));
+        for (size_t i{1}; i < reached.size(); ++i) {
+            CHECK(reached[i-1].distance <= reached[i].distance);
+        }
+
+        CHECK(path_finder.reachable_within("L2", 0).size() == 1);
+        CHECK(path_finder.reachable_within("N1", 5).empty());
+        // Everything is reachable from everywhere in this map
+        CHECK(path_finder.reachable_within("A1", 1000).size() == 26);
+
+        // Concurrent calls on one PathFinder, while it solves
+        vector<ReachableNode> other{};
+        std::thread thread{[&] {
+            for (int i{0}; i < 100; ++i) {
+                other = path_finder.reachable_within("C1", 10);
+            }
+        }};
+        for (int i{0}; i < 100; ++i) {
+            path_finder.solve("C1", "M1");
+            reached = path_finder.reachable_within("C1", 10);
+        }
+        thread.join();
+        REQUIRE(other.size() == reached.size());
+        for (size_t i{0}; i < reached.size(); ++i) {
+            CHECK(other[i].node == reached[i].node);
+            CHECK(other[i].distance == reached[i].distance);
+        }
+        CHECK(path_finder.get_distance() == 12);
+    }
+
+    SECTION("Nearest vehicles") {
+        PathFinder path_finder{MapGraph::from_json(json_map)};
+        shared_ptr<MapGraph const> map = path_finder.get_map();
+        for (unsigned id{0}; id < map->size(); ++id) {
+            unsigned in_degree = map->get_in_degree(id);
+            CHECK(in_degree >= 1);
+            for (unsigned i{0}; i < in_degree; ++i) {
+                MapEdge edge = map->get_incoming(id)[i];
+                MapEdge out = map->get_left(edge.node).node == id ? map->get_left(edge.node)
+                                                                  : map->get_right(edge.node);
+                CHECK(out.node == id);
+                CHECK(out.weight == edge.weight);
+            }
+        }
+
+        CHECK(path_finder.nearest_vehicles(path_finder.get_node_id("M1"), 3).empty());
+        vector<string> positions{"A1", "C1", "K2", "H2", "L1", "C1"};
+        for (uint32_t vehicle{0}; vehicle < positions.size(); ++vehicle) {
+            path_finder.set_vehicle_node(100 + vehicle, path_finder.get_node_id(positions[vehicle]));
+        }
+        path_finder.set_vehicle_node(100, path_finder.get_node_id("E2"));  // Moved from A1
+
+        vector<VehicleMatch> matches = path_finder.nearest_vehicles(path_finder.get_node_id("M1"), 4);
+        REQUIRE(matches.size() == 4);
+        for (size_t i{0}; i < matches.size(); ++i) {
+            if (i > 0)
+                CHECK(matches[i-1].distance <= matches[i].distance);
+            string start = positions[matches[i].vehicle - 100];
+            if (matches[i].vehicle == 100)
+                start = "E2";
+            path_finder.solve(start, "M1");
+            CHECK(matches[i].distance == path_finder.get_distance());
+            CHECK(path_finder.get_node_name(matches[i].route.front()) == start);
+            CHECK(path_finder.get_node_name(matches[i].route.back()) == "M1");
+            CHECK(matches[i].drive_mission.size() == matches[i].route.size() - 1);
+        }
+        vector<VehicleMatch> all = path_finder.nearest_vehicles(path_finder.get_node_id("M1"), 6);
+        REQUIRE(all.size() == 6);
+        CHECK(all[4].distance >= matches[3].distance);
+
+        path_finder.remove_vehicle(103);
+        path_finder.remove_vehicle(999);
+        CHECK(path_finder.nearest_vehicles(path_finder.get_node_id("M1"), 10).size() == 5);
+        CHECK(path_finder.nearest_vehicles(path_finder.get_node_id("M1"), 0).empty());
+    }
+
+    SECTION("Many control centers on one map") {
+        shared_ptr<MapGraph const> map = MapGraph::from_json(json_map);
+        vector<unique_ptr<ControlCenter>> fleet{};
+        for (int i{0}; i < 10; ++i) {
+            fleet.emplace_back(new ControlCenter{});
+            fleet.back()->set_map(map);
+        }
+        CHECK(map.use_count() == 11);
+        CHECK(fleet[3]->get_map() == map);
+
+        fleet[0]->set_drive_missions({"A1", "K2"});
+        fleet[1]->set_drive_missions({"L2", "L1"});
+        CHECK(fleet[0]->get_current_road_segment() == "A1");
+        CHECK(fleet[1]->get_current_road_segment() == "L2");
+
+        fleet.clear();
+        CHECK(map.use_count() == 1);
+    }
+}
+
+TEST_CASE("Compact map") {
+    string map_string = "{\"MapData\":{\"A1\":[{\"K1\":5}],\"A2\":[{\"B2\":1}],\"B1\":[{\"A1\":1}],\"B2\":[{\"L2\":2},{\"C2\":2}],\"C1\":[{\"B1\":2},{\"L2\":2}],\"C2\":[{\"D2\":1}],\"D1\":[{\"C1\":1}],\"D2\":[{\"E2\":1}],\"E1\":[{\"D1\":1}],\"E2\":[{\"F2\":2}],\"F1\":[{\"E1\":2}],\"F2\":[{\"G2\":3}],\"G1\":[{\"F1\":3}],\"G2\":[{\"H2\":1}],\"H1\":[{\"G1\":1}],\"H2\":[{\"M1\":2},{\"I2\":2}],\"I1\":[{\"H1\":2},{\"M1\":2}],\"I2\":[{\"J2\":1}],\"J1\":[{\"I1\":1}],\"J2\":[{\"K2\":1}],\"K1\":[{\"J1\":1}],\"K2\":[{\"A2\":5}],\"L1\":[{\"C2\":2},{\"B1\":2}],\"L2\":[{\"M2\":1}],\"M1\":[{\"L1\":1}],\"M2\":[{\"I2\":2},{\"H1\":2}]}}";
+    json json_map = json::parse(map_string);
+
+    SECTION("Same graph") {
+        for (bool reorder : {false, true}) {
+            shared_ptr<MapGraph const> map = MapGraph::from_json(json_map, reorder);
+            shared_ptr<CompactMapGraph const> compact = CompactMapGraph::from_graph(*map);
+            REQUIRE(compact->size() == map->size());
+            CHECK(compact->get_version() == map->get_version());
+            CHECK(compact->get_memory_usage() < map->get_memory_usage());
+            CHECK(compact->get_id("N1") == -1);
+            CHECK(compact->get_id("") == -1);
+            CHECK(compact->get_id("ZZ") == -1);
+            MapEdge edges[2];
+            MapEdge compact_edges[2];
+            for (unsigned id{0}; id < map->size(); ++id) {
+                CHECK(compact->get_name(id) == map->get_name(id));
+                CHECK(compact->get_id(map->get_name(id)) == static_cast<int>(id));
+                CHECK(compact->get_map_id(id) == map->get_map_id(id));
+                CHECK(compact->from_map_id(id) == map->from_map_id(id));
+                unsigned degree = map->get_edges(id, edges);
+                REQUIRE(compact->get_edges(id, compact_edges) == degree);
+                for (unsigned i{0}; i < degree; ++i) {
+                    CHECK(compact_edges[i].node == edges[i].node);
+                    CHECK(compact_edges[i].weight == edges[i].weight);
+                }
+            }
+        }
+    }
+
+    SECTION("Large weights") {
+        json m = json::parse("{\"MapData\":{\"A\":[{\"B\":70000}],\"B\":[{\"A\":300},{\"C\":1}],\"C\":[]}}");
+        shared_ptr<CompactMapGraph const> compact = CompactMapGraph::from_json(m);
+        MapEdge edges[2];
+        REQUIRE(compact->get_edges(compact->get_id("B"), edges) == 2);
+        CHECK(edges[0].weight == 300);
+        CHECK(edges[1].node == static_cast<uint32_t>(compact->get_id("C")));
+        REQUIRE(compact->get_edges(compact->get_id("A"), edges) == 1);
+        CHECK(edges[0].weight == 70000);
+        CHECK(compact->get_edges(compact->get_id("C"), edges) == 0);
+    }
+
+    SECTION("Routing") {
+        shared_ptr<MapGraph const> map = MapGraph::from_json(json_map);
+        PathFinder path_finder{map};
+        CompactPathFinder compact_path_finder{CompactMapGraph::from_graph(*map)};
+
+        compact_path_finder.solve("L2", "L1");
+        path_finder.solve("L2", "L1");
+        CHECK(compact_path_finder.get_distance() == 24);
+        CHECK(compact_path_finder.get_route() == path_finder.get_route());
+        CHECK(compact_path_finder.get_drive_mission() == path_finder.get_drive_mission());
+
+        compact_path_finder.solve(path_finder.get_node_id("C1"), path_finder.get_node_id("M1"));
+        CHECK(compact_path_finder.get_distance() == 12);
+        vector<instruction::InstructionNumber> expected{instruction::left, instruction::forward,
+            instruction::forward, instruction::forward, instruction::forward, instruction::right};
+        CHECK(compact_path_finder.get_drive_mission() == expected);
+
+        compact_path_finder.solve("L2", "N1");
+        CHECK(compact_path_finder.get_distance() == UINT_MAX);
+        CHECK(compact_path_finder.get_route().empty());
+    }
+}
+
+TEST_CASE("Contracted map") {
+    string map_string = "{\"MapData\":{\"A1\":[{\"K1\":5}],\"A2\":[{\"B2\":1}],\"B1\":[{\"A1\":1}],\"B2\":[{\"L2\":2},{\"C2\":2}],\"C1\":[{\"B1\":2},{\"L2\":2}],\"C2\":[{\"D2\":1}],\"D1\":[{\"C1\":1}],\"D2\":[{\"E2\":1}],\"E1\":[{\"D1\":1}],\"E2\":[{\"F2\":2}],\"F1\":[{\"E1\":2}],\"F2\":[{\"G2\":3}],\"G1\":[{\"F1\":3}],\"G2\":[{\"H2\":1}],\"H1\":[{\"G1\":1}],\"H2\":[{\"M1\":2},{\"I2\":2}],\"I1\":[{\"H1\":2},{\"M1\":2}],\"I2\":[{\"J2\":1}],\"J1\":[{\"I1\":1}],\"J2\":[{\"K2\":1}],\"K1\":[{\"J1\":1}],\"K2\":[{\"A2\":5}],\"L1\":[{\"C2\":2},{\"B1\":2}],\"L2\":[{\"M2\":1}],\"M1\":[{\"L1\":1}],\"M2\":[{\"I2\":2},{\"H1\":2}]}}";
+    json json_map = json::parse(map_string);
+
+    SECTION("Same routes as the full map") {
+        shared_ptr<MapGraph const> map = MapGraph::from_json(json_map);
+        ContractedGraph const &contracted = map->get_contracted();
+        CHECK(contracted.size() == 12);
+        PathFinder path_finder{map};
+        vector<unsigned> weights{};
+        vector<uint32_t> parents{};
+        SearchQueue queue{};
+        for (uint32_t start{0}; start < map->size(); ++start) {
+            shortest_paths(*map, start, NO_NODE, weights, parents, queue);
+            for (uint32_t stop{0}; stop < map->size(); ++stop) {
+                path_finder.solve(map->get_name(start), map->get_name(stop));
+                REQUIRE(path_finder.get_distance() == weights[stop]);
+                vector<string> route = path_finder.get_route();
+                REQUIRE(route.front() == map->get_name(start));
+                REQUIRE(route.back() == map->get_name(stop));
+                CHECK(path_finder.get_drive_mission().size() + 1 == route.size());
+                unsigned length{0};
+                for (size_t i{0}; i + 1 < route.size(); ++i) {
+                    length += path_finder.get_segment_length(route[i] + "->" + route[i + 1]);
+                }
+                CHECK(length == weights[stop]);
+            }
+        }
+    }
+
+    SECTION("Chains") {
+        shared_ptr<MapGraph const> map = MapGraph::from_json(json_map);
+        ContractedGraph const &contracted = map->get_contracted();
+        uint32_t k1 = map->get_id("K1");
+        CHECK(contracted.get_core(k1) == NO_NODE);
+        ContractedGraph::ChainPosition position = contracted.get_position(k1);
+        CHECK(map->get_name(contracted.get_node(position.edge / 2)) == "B1");
+        CHECK(position.index == 1);  // B1->A1->K1->J1->I1
+        CHECK(position.offset == 6);
+        CHECK(contracted.get_edge(position.edge).weight == 8);
+        CHECK(map->get_name(contracted.get_node(contracted.get_edge(position.edge).node)) == "I1");
+
+        PathFinder path_finder{map};
+        path_finder.solve("K1", "J1");
+        CHECK(path_finder.get_route() == vector<string>{"K1", "J1"});
+        CHECK(path_finder.get_distance() == 1);
+        path_finder.solve("J1", "K1");
+        CHECK(path_finder.get_distance() == 12);
+        CHECK(path_finder.get_route() == vector<string>{"J1", "I1", "M1", "L1", "B1", "A1", "K1"});
+        path_finder.solve_from_segment("K1->J1", 0, "I1");
+        CHECK(path_finder.get_route() == vector<string>{"K1", "J1", "I1"});
+        CHECK(path_finder.get_distance() == 2);
+    }
+
+    SECTION("Cycles and parallel chains") {
+        json cycle = json::parse("{\"MapData\":{\"A\":[{\"B\":1}],\"B\":[{\"C\":2}],\"C\":[{\"A\":3}]}}");
+        PathFinder path_finder{};
+        path_finder.update_map(cycle);
+        CHECK(path_finder.get_map()->get_contracted().size() == 1);
+        path_finder.solve("B", "A");
+        CHECK(path_finder.get_distance() == 5);
+        CHECK(path_finder.get_route() == vector<string>{"B", "C", "A"});
+        path_finder.solve("C", "B");
+        CHECK(path_finder.get_route() == vector<string>{"C", "A", "B"});
+        path_finder.solve("B", "B");
+        CHECK(path_finder.get_route() == vector<string>{"B"});
+
+        json parallel = json::parse("{\"MapData\":{\"A\":[{\"B\":1},{\"C\":5}],\"B\":[{\"D\":4}],"
+                                    "\"C\":[{\"D\":1}],\"D\":[{\"A\":1}]}}");
+        path_finder.update_map(parallel);
+        CHECK(path_finder.get_map()->get_contracted().size() == 2);
+        path_finder.solve("A", "D");
+        CHECK(path_finder.get_route() == vector<string>{"A", "B", "D"});
+        CHECK(path_finder.get_drive_mission() == vector<instruction::InstructionNumber>{
+            instruction::left, instruction::forward});
+        path_finder.solve("C", "B");
+        CHECK(path_finder.get_distance() == 3);
+    }
+}
+
+TEST_CASE("Anytime planner") {
+    string map_string = "{\"MapData\":{\"A1\":[{\"K1\":5}],\"A2\":[{\"B2\":1}],\"B1\":[{\"A1\":1}],\"B2\":[{\"L2\":2},{\"C2\":2}],\"C1\":[{\"B1\":2},{\"L2\":2}],\"C2\":[{\"D2\":1}],\"D1\":[{\"C1\":1}],\"D2\":[{\"E2\":1}],\"E1\":[{\"D1\":1}],\"E2\":[{\"F2\":2}],\"F1\":[{\"E1\":2}],\"F2\":[{\"G2\":3}],\"G1\":[{\"F1\":3}],\"G2\":[{\"H2\":1}],\"H1\":[{\"G1\":1}],\"H2\":[{\"M1\":2},{\"I2\":2}],\"I1\":[{\"H1\":2},{\"M1\":2}],\"I2\":[{\"J2\":1}],\"J1\":[{\"I1\":1}],\"J2\":[{\"K2\":1}],\"K1\":[{\"J1\":1}],\"K2\":[{\"A2\":5}],\"L1\":[{\"C2\":2},{\"B1\":2}],\"L2\":[{\"M2\":1}],\"M1\":[{\"L1\":1}],\"M2\":[{\"I2\":2},{\"H1\":2}]}}";
+    shared_ptr<MapGraph const> map = MapGraph::from_json(json::parse(map_string));
+    PathFinder path_finder{map};
+    AnytimePlanner planner{map, 4};
+
+    SECTION("Optimal with enough time") {
+        REQUIRE(planner.plan("L2", "L1", 1000000));
+        AnytimeRoute route = planner.get_route();
+        CHECK(route.distance == 24);
+        CHECK(route.bound == 1);
+        CHECK(route.nodes.front() == "L2");
+        CHECK(route.nodes.back() == "L1");
+        CHECK(route.drive_mission.size() == route.nodes.size() - 1);
+    }
+
+    SECTION("Bound holds for every start epsilon") {
+        for (string start : {"A1", "C1", "H2", "M2"}) {
+            for (string stop : {"B2", "G1", "L1"}) {
+                path_finder.solve(start, stop);
+                for (double epsilon : {1.0, 2.0, 5.0}) {
+                    REQUIRE(planner.plan(start, stop, 1000000, epsilon));
+                    AnytimeRoute route = planner.get_route();
+                    CHECK(route.distance == path_finder.get_distance());
+                    CHECK(route.bound == 1);
+                }
+            }
+        }
+    }
+
+    SECTION("Background improvement") {
+        planner.plan("C1", "M1", 0, 10);
+        planner.improve_in_background();
+        while (planner.is_improving()) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        AnytimeRoute route = planner.get_route();
+        CHECK(route.distance == 12);
+        CHECK(route.bound == 1);
+        vector<instruction::InstructionNumber> expected{instruction::left, instruction::forward,
+            instruction::forward, instruction::forward, instruction::forward, instruction::right};
+        CHECK(route.drive_mission == expected);
+    }
+
+    SECTION("Unknown node") {
+        CHECK_FALSE(planner.plan("C1", "N1", 1000));
+        CHECK(planner.get_route().distance == UINT_MAX);
+        planner.improve_in_background();
+        CHECK_FALSE(planner.is_improving());
+    }
+}
+
+TEST_CASE("Checkpoint") {
+    string map_string = "{\"MapData\":{\"A1\":[{\"K1\":5}],\"A2\":[{\"B2\":1}],\"B1\":[{\"A1\":1}],\"B2\":[{\"L2\":2},{\"C2\":2}],\"C1\":[{\"B1\":2},{\"L2\":2}],\"C2\":[{\"D2\":1}],\"D1\":[{\"C1\":1}],\"D2\":[{\"E2\":1}],\"E1\":[{\"D1\":1}],\"E2\":[{\"F2\":2}],\"F1\":[{\"E1\":2}],\"F2\":[{\"G2\":3}],\"G1\":[{\"F1\":3}],\"G2\":[{\"H2\":1}],\"H1\":[{\"G1\":1}],\"H2\":[{\"M1\":2},{\"I2\":2}],\"I1\":[{\"H1\":2},{\"M1\":2}],\"I2\":[{\"J2\":1}],\"J1\":[{\"I1\":1}],\"J2\":[{\"K2\":1}],\"K1\":[{\"J1\":1}],\"K2\":[{\"A2\":5}],\"L1\":[{\"C2\":2},{\"B1\":2}],\"L2\":[{\"M2\":1}],\"M1\":[{\"L1\":1}],\"M2\":[{\"I2\":2},{\"H1\":2}]}}";
+    json json_map = json::parse(map_string);
+    string path = "/tmp/control_center_test.checkpoint";
+    unlink(path.c_str());
+
+    SECTION("Restore mid-mission") {
+        ControlCenter control_center{};
+        control_center.update_map(json_map);
+        control_center.write_checkpoints(path);
+        control_center.set_drive_missions({"A1", "K2", "H1"});
+
+        // Leave A1 and pass K1 and J1
+        control_center(OBST_DISTANCE_CLOSE+10, STOP_DISTANCE_CLOSE, 0, 0, 0, 0, 0, 0);
+        control_center(OBST_DISTANCE_CLOSE+10, STOP_DISTANCE_FAR, DEFAULT_SPEED, 0, 0, 0, 0, 0);
+        for (int node{0}; node < 2; ++node) {
+            control_center(OBST_DISTANCE_CLOSE+10, STOP_DISTANCE_MID, DEFAULT_SPEED, 0, 0, 0, 0, 0);
+            control_center(OBST_DISTANCE_CLOSE+10, STOP_DISTANCE_CLOSE, DEFAULT_SPEED, 0, 0, 0, 0, 0);
+        }
+        CHECK(control_center.get_finished_instruction_id() == "A1");
+        CHECK(control_center.get_current_road_segment() == "J1->I1");
+
+        // The process restarts
+        ControlCenter restarted{};
+        restarted.update_map(json_map);
+        REQUIRE(restarted.restore_checkpoint(path));
+        CHECK(restarted.get_state() == control_center.get_state());
+        CHECK(restarted.get_current_road_segment() == "J1->I1");
+        CHECK(restarted.get_current_drive_instruction().number
+              == control_center.get_current_drive_instruction().number);
+        CHECK(restarted.get_finished_instruction_id() == "A1->K1");
+        CHECK(restarted.get_finished_instruction_id() == "K1->J1");
+        CHECK_FALSE(restarted.finished_instruction());
+
+        // Both drive on the same way
+        for (int cycle{0}; cycle < 4; ++cycle) {
+            int stop_distance = cycle % 2 ? STOP_DISTANCE_CLOSE : STOP_DISTANCE_MID;
+            control_t expected = control_center(OBST_DISTANCE_CLOSE+10, stop_distance, DEFAULT_SPEED, 0, 0, 0, 0, 0);
+            control_t control_data = restarted(OBST_DISTANCE_CLOSE+10, stop_distance, DEFAULT_SPEED, 0, 0, 0, 0, 0);
+            CHECK(control_data.speed_ref == expected.speed_ref);
+            CHECK(restarted.get_state() == control_center.get_state());
+            CHECK(restarted.get_current_road_segment() == control_center.get_current_road_segment());
+        }
+
+        // The restored control center keeps checkpointing and restarts again
+        string segment = restarted.get_current_road_segment();
+        restarted(OBST_DISTANCE_CLOSE+10, STOP_DISTANCE_MID, DEFAULT_SPEED, 0, 0, 0, 0, 0);
+        restarted(OBST_DISTANCE_CLOSE+10, STOP_DISTANCE_CLOSE, DEFAULT_SPEED, 0, 0, 0, 0, 0);
+        CHECK(restarted.get_current_road_segment() != segment);
+        ControlCenter second_restart{};
+        second_restart.update_map(json_map);
+        REQUIRE(second_restart.restore_checkpoint(path));
+        CHECK(second_restart.get_current_road_segment() == restarted.get_current_road_segment());
+        CHECK(second_restart.get_state() == restarted.get_state());
+        CHECK(second_restart.get_current_drive_instruction().number
+              == restarted.get_current_drive_instruction().number);
+    }
+
+    SECTION("Other map") {
+        ControlCenter control_center{};
+        control_center.update_map(json_map);
+        control_center.write_checkpoints(path);
+        control_center.set_drive_missions({"A1", "K2"});
+
+        json other_map = json::parse("{\"MapData\": {\"A\": [{\"B\": 3}], \"B\": [{\"A\": 2}]}}");
+        ControlCenter restarted{};
+        restarted.update_map(other_map);
+        CHECK_FALSE(restarted.restore_checkpoint(path));
+        CHECK_FALSE(restarted.restore_checkpoint("/tmp/control_center_test.no_checkpoint"));
+        unlink("/tmp/control_center_test.no_checkpoint");
+    }
+
+    SECTION("Interrupted write") {
+        list<drive_instruction_t> instructions{};
+        list<string> segments{"A1", "A1->K1", "K1->J1"};
+        for (string id : segments) {
+            drive_instruction_t instruction{};
+            instruction.number = instruction::forward;
+            instruction.id = id;
+            instructions.push_back(instruction);
+        }
+        CheckpointProgress progress{};
+        {
+            CheckpointFile file{path};
+            REQUIRE(file.is_open());
+            file.write_mission(instructions, segments, progress);
+            progress.instructions_done = 1;
+            file.write_progress(progress);
+            progress.instructions_done = 2;
+            file.write_progress(progress);
+        }
+
+        // Damage the newest slot as if the process died writing it
+        CheckpointFile file{path};
+        CheckpointProgress saved{};
+        list<drive_instruction_t> saved_instructions{};
+        list<string> saved_segments{};
+        REQUIRE(file.read(saved, saved_instructions, saved_segments));
+        CHECK(saved.instructions_done == 2);
+        CHECK(saved_instructions.size() == 1);
+        CHECK(saved_instructions.front().id == "K1->J1");
+        CHECK(saved_segments.size() == 3);
+
+        int fd = open(path.c_str(), O_RDWR);
+        char garbage[8] = "garbage";
+        CHECK(pwrite(fd, garbage, sizeof(garbage), 64 + (saved.sequence % 2) * sizeof(CheckpointProgress) + 40) == sizeof(garbage));
+        close(fd);
+        CheckpointFile damaged{path};
+        REQUIRE(damaged.read(saved, saved_instructions, saved_segments));
+        CHECK(saved.instructions_done == 1);
+        CHECK(saved_instructions.front().id == "A1->K1");
+    }
+    unlink(path.c_str());
+}
+
+TEST_CASE("Log analyzer") {
+    string log =
+        "2024-05-02 10:00:00.000 INFO control_center.cpp ControlCenter: Finishing instruction A1\n"
+        "2024-05-02 10:00:00.000 INFO control_center.cpp Set new state: normal\n"
+        "2024-05-02 10:00:00.010 DEBUG control_center.cpp done: state=0, angle=0, lateral=0, speed_ref=10, drive mode=0\n"
+        "2024-05-02 10:00:02.000 INFO control_center.cpp ControlCenter: Finishing instruction A1->K1\n"
+        "2024-05-02 10:00:03.000 INFO control_center.cpp Update state: Path blocked, stopping\n"
+        "2024-05-02 10:00:03.500 INFO control_center.cpp Update state: Path blocked\n"
+        "2024-05-02 10:00:04.500 INFO control_center.cpp Update state: Path no longer blocked\n"
+        "2024-05-02 10:00:04.500 INFO control_center.cpp Set new state: normal\n"
+        "2024-05-02 10:00:05.000 DEBUG line_detector.cpp at_line: stop_distance=90, consec=0, far_stop_count=0, state=far\n"
+        "2024-05-02 10:00:05.100 DEBUG line_detector.cpp at_line: stop_distance=20, consec=1, far_stop_count=0, state=close\n"
+        "2024-05-02 10:00:06.000 INFO control_center.cpp ControlCenter: Finishing instruction K1->K2\n"
+        "2024-05-02 10:00:07.000 INFO control_center.cpp Update state: At stop line, stopping\n"
+        "2024-05-02 10:00:08.000 INFO control_center.cpp Update state: Stopped\n"
+        "2024-05-02 10:00:08.000 INFO control_center.cpp ControlCenter: Finishing instruction K2->K3\n"
+        "2024-05-02 10:00:08.010 DEBUG control_center.cpp done: state=4, angle=0, lateral=0, speed_ref=0, drive mode=0\n"
+        "2024-05-02 10:00:18.000 INFO control_center.cpp ControlCenter: Finishing instruction K3\n"
+        "2024-05-02 10:00:18.000 INFO control_center.cpp Set new state: intersection\n"
+        "2024-05-02 10:00:20.000 INFO control_center.cpp ControlCenter: Finishing instruction A1->K1\n";
+
+    for (unsigned threads : {1u, 3u, 16u}) {
+        LogReport report = analyze_log_text(log.data(), log.size(), threads);
+        CHECK(report.lines == 18);
+        CHECK(report.bytes == log.size());
+        CHECK(report.dwell[state::normal] == Approx(5.5));
+        CHECK(report.dwell[state::blocked] == Approx(1.0));
+        CHECK(report.dwell[state::stop_line] == Approx(10.0));
+        CHECK(report.entered[state::normal] == 2);
+        CHECK(report.entered[state::stopping] == 2);
+        CHECK(report.false_stop_lines == 1);
+
+        REQUIRE(report.missions.size() == 2);
+        MissionTimeline const &first = report.missions[0];
+        CHECK(first.finished);
+        CHECK(first.end - first.start == Approx(8.0));
+        CHECK(first.blocked == Approx(1.5));
+        REQUIRE(first.instructions.size() == 4);
+        CHECK(first.instructions.front().second == "A1");
+        CHECK(first.instructions.back().second == "K2->K3");
+        CHECK_FALSE(report.missions[1].finished);
+        CHECK(report.missions[1].instructions.front().second == "K3");
+
+        SegmentTimes const &segment = report.segments["A1->K1"];
+        CHECK(segment.count == 2);
+        CHECK(segment.min == Approx(2.0));
+        CHECK(segment.max == Approx(2.0));
+        CHECK(report.segments["K2->K3"].total == Approx(2.0));
+        CHECK(report.segments.count("K3") == 0);
+    }
+
+    SECTION("Files") {
+        string path = "/tmp/control_center_test.log";
+        int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        CHECK(write(fd, log.data(), log.size()) == static_cast<ssize_t>(log.size()));
+        close(fd);
+        LogReport report = analyze_logs({path, "/tmp/control_center_test.no_log", path}, 2);
+        CHECK(report.lines == 36);
+        CHECK(report.bytes == 2 * log.size());
+        unlink(path.c_str());
+    }
+}
+
+TEST_CASE("Metrics") {
+    MetricsRegistry registry{};
+
+    SECTION("Counters from many threads") {
+        MetricsCounter &counter = registry.counter("test_total", "Test counter");
+        CHECK(&registry.counter("test_total", "Test counter") == &counter);
+        vector<thread> threads{};
+        for (int i{0}; i < 8; ++i) {
+            threads.emplace_back([&counter] {
+                for (int j{0}; j < 10000; ++j) {
+                    counter.add();
+                }
+            });
+        }
+        for (thread &t : threads) {
+            t.join();
+        }
+        CHECK(counter.get() == 80000);
+    }
+
+    SECTION("Prometheus text") {
+        registry.counter("test_seconds_total", "Time", "state=\"normal\"", 1e-3).add(1500);
+        registry.gauge("test_gauge", "Gauge").set(-3);
+        MetricsHistogram &histogram = registry.histogram("test_latency_seconds", "Latency",
+                                                         {1, 10}, "", 1e-3);
+        for (uint64_t value : {0, 1, 5, 10, 11, 1000}) {
+            histogram.observe(value);
+        }
+        CHECK(histogram.get_counts() == vector<uint64_t>{2, 2, 2});
+        CHECK(histogram.get_sum() == 1027);
+
+        string text = registry.render();
+        CHECK(text.find("# TYPE test_seconds_total counter\ntest_seconds_total{state=\"normal\"} 1.5\n")
+              != string::npos);
+        CHECK(text.find("test_gauge -3\n") != string::npos);
+        CHECK(text.find("# TYPE test_latency_seconds histogram\n") != string::npos);
+        CHECK(text.find("test_latency_seconds_bucket{le=\"0.001\"} 2\n") != string::npos);
+        CHECK(text.find("test_latency_seconds_bucket{le=\"0.01\"} 4\n") != string::npos);
+        CHECK(text.find("test_latency_seconds_bucket{le=\"+Inf\"} 6\n") != string::npos);
+        CHECK(text.find("test_latency_seconds_sum 1.027\n") != string::npos);
+        CHECK(text.find("test_latency_seconds_count 6\n") != string::npos);
+    }
+
+    SECTION("Control center") {
+        ControlCenter control_center{};
+        control_center.record_metrics(registry);
+        control_center.add_drive_instruction(instruction::forward, "1");
+        control_center.add_drive_instruction(instruction::forward, "2");
+        control_center(OBST_DISTANCE_CLOSE-10, 200, 0, 0, 0, 0, 0, 0);
+        control_center(OBST_DISTANCE_CLOSE+10, 200, 0, 0, 0, 0, 0, 0);
+        control_center(OBST_DISTANCE_CLOSE+10, STOP_DISTANCE_FAR + 10, DEFAULT_SPEED, 0, 0, 0, 0, 0);
+        control_center(OBST_DISTANCE_CLOSE+10, STOP_DISTANCE_CLOSE, DEFAULT_SPEED, 0, 0, 0, 0, 0);
+
+        CHECK(registry.counter("control_center_blocked_total", "").get() == 1);
+        CHECK(registry.counter("control_center_instructions_finished_total", "").get() == 1);
+        CHECK(registry.gauge("control_center_instructions_left", "").get() == 1);
+        CHECK(registry.gauge("control_center_state", "").get() == state::normal);
+        CHECK(registry.histogram("control_center_cycle_seconds", "", {}).get_counts().back() == 0);
+        CHECK(registry.counter("control_center_state_seconds_total", "", "state=\"blocked\"").get() > 0);
+        CHECK(registry.counter("control_center_state_seconds_total", "", "state=\"stop_line\"").get() == 0);
+        vector<uint64_t> cycles = registry.histogram("control_center_cycle_seconds", "", {}).get_counts();
+        CHECK(accumulate(cycles.begin(), cycles.end(), uint64_t{0}) == 4);
+    }
+
+    SECTION("Export to file") {
+        string path = "/tmp/control_center_test.prom";
+        registry.counter("test_total", "Test counter").add(7);
+        {
+            MetricsExporter exporter{registry, path, 10};
+            REQUIRE(exporter.is_open());
+            while (exporter.get_update_count() < 2) {
+                this_thread::sleep_for(chrono::milliseconds(1));
+            }
+        }
+        ifstream file{path};
+        string text{istreambuf_iterator<char>(file), istreambuf_iterator<char>()};
+        CHECK(text.find("test_total 7\n") != string::npos);
+        unlink(path.c_str());
+    }
+
+    SECTION("Failed export") {
+        // A directory that is not empty can not be replaced by the file
+        string path = "/tmp/control_center_test_prom_dir";
+        mkdir(path.c_str(), 0755);
+        ofstream{path + "/keep"} << "x";
+        {
+            MetricsExporter exporter{registry, path, 10};
+            REQUIRE(exporter.is_open());
+            this_thread::sleep_for(chrono::milliseconds(50));
+            CHECK(exporter.get_update_count() == 0);
+        }
+        CHECK(access((path + ".tmp").c_str(), F_OK) != 0);
+        unlink((path + "/keep").c_str());
+        rmdir(path.c_str());
+    }
+
+    SECTION("Serve on a socket") {
+        string path = "/tmp/control_center_test_metrics.sock";
+        registry.gauge("test_gauge", "Gauge").set(42);
+        MetricsExporter exporter{registry, "unix:" + path, 10};
+        REQUIRE(exporter.is_open());
+
+        sockaddr_un address{};
+        address.sun_family = AF_UNIX;
+        strcpy(address.sun_path, path.c_str());
+        int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        REQUIRE(connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == 0);
+        string request = "GET /metrics HTTP/1.0\r\n\r\n";
+        CHECK(send(fd, request.data(), request.size(), 0) == static_cast<ssize_t>(request.size()));
+        string reply{};
+        char data[4096];
+        ssize_t received;
+        while ((received = recv(fd, data, sizeof(data), 0)) > 0) {
+            reply.append(data, received);
+        }
+        close(fd);
+        CHECK(reply.compare(0, 15, "HTTP/1.0 200 OK") == 0);
+        CHECK(reply.find("test_gauge 42\n") != string::npos);
+    }
+}
+
+TEST_CASE("Intersection manager") {
+    SECTION("Slots") {
+        IntersectionManager manager{1000, 200, 10000};
+        IntersectionSlot first = manager.reserve("car1", "K1", "A1", instruction::forward, 5000);
+        CHECK(first.start_ms == 5000);
+        CHECK(first.end_ms == 6000);
+
+        // Crossing traffic waits until the intersection is free
+        CHECK(manager.reserve("car2", "K1", "J1", instruction::left, 5500).start_ms == 6000);
+
+        // Right turns from different approaches do not cross
+        manager.reserve("car3", "K2", "A1", instruction::right, 5000);
+        CHECK(manager.reserve("car4", "K2", "J1", instruction::right, 5100).start_ms == 5100);
+        CHECK(manager.reserve("car5", "K2", "A1", instruction::forward, 4500).start_ms == 6100);
+
+        // Vehicles from the same approach keep the headway
+        CHECK(manager.reserve("car6", "K3", "A1", instruction::forward, 1000).start_ms == 1000);
+        CHECK(manager.reserve("car7", "K3", "A1", instruction::left, 900).start_ms == 1200);
+
+        // A slow crossing holds the intersection longer
+        IntersectionSlot slow = manager.reserve("car8", "K4", "A1", instruction::forward, 0, 3000);
+        CHECK(slow.end_ms == 3000);
+        CHECK(manager.reserve("car9", "K4", "J1", instruction::forward, 0).start_ms == 3000);
+        manager.release("car8", "K4");
+        manager.release("car9", "K4");
+
+        // Asking again replaces the old slot
+        CHECK(manager.get_reservation_count() == 7);
+        CHECK(manager.reserve("car2", "K1", "J1", instruction::left, 6500).start_ms == 6500);
+        CHECK(manager.get_reservation_count() == 7);
+        manager.release("car2", "K1");
+        CHECK(manager.get_reservation_count() == 6);
+
+        manager.expire(6001);
+        CHECK(manager.get_reservation_count() == 2);
+
+        // Nothing within the horizon
+        IntersectionManager busy{20000, 200, 10000};
+        busy.reserve("car1", "K1", "A1", instruction::forward, 0);
+        CHECK(busy.reserve("car2", "K1", "J1", instruction::forward, 0).start_ms == -1);
+    }
+
+    SECTION("Control center slows down for its slot") {
+        string map_string = "{\"MapData\":{\"A1\":[{\"K1\":5}],\"A2\":[{\"B2\":1}],\"B1\":[{\"A1\":1}],\"B2\":[{\"L2\":2},{\"C2\":2}],\"C1\":[{\"B1\":2},{\"L2\":2}],\"C2\":[{\"D2\":1}],\"D1\":[{\"C1\":1}],\"D2\":[{\"E2\":1}],\"E1\":[{\"D1\":1}],\"E2\":[{\"F2\":2}],\"F1\":[{\"E1\":2}],\"F2\":[{\"G2\":3}],\"G1\":[{\"F1\":3}],\"G2\":[{\"H2\":1}],\"H1\":[{\"G1\":1}],\"H2\":[{\"M1\":2},{\"I2\":2}],\"I1\":[{\"H1\":2},{\"M1\":2}],\"I2\":[{\"J2\":1}],\"J1\":[{\"I1\":1}],\"J2\":[{\"K2\":1}],\"K1\":[{\"J1\":1}],\"K2\":[{\"A2\":5}],\"L1\":[{\"C2\":2},{\"B1\":2}],\"L2\":[{\"M2\":1}],\"M1\":[{\"L1\":1}],\"M2\":[{\"I2\":2},{\"H1\":2}]}}";
+        shared_ptr<IntersectionManager> manager{new IntersectionManager{5000}};
+        ControlCenter first{};
+        first.update_map(json::parse(map_string));
+        first.set_drive_missions({"A1", "K2"});
+        first.use_intersection_manager(manager, "car1");
+
+        // Leave A1, the intersection at K1 is free
+        first(OBST_DISTANCE_CLOSE+10, STOP_DISTANCE_CLOSE, 0, 0, 0, 0, 0, 0);
+        control_t control_data = first(OBST_DISTANCE_CLOSE+10, STOP_DISTANCE_FAR, DEFAULT_SPEED, 0, 0, 0, 0, 0);
+        CHECK(first.get_current_road_segment() == "A1->K1");
+        CHECK(control_data.speed_ref == DEFAULT_SPEED);
+        CHECK(manager->get_reservation_count() == 1);
+
+        // Crossing traffic holds K1 for the next seconds
+        int64_t now_ms = chrono::duration_cast<chrono::milliseconds>(
+                chrono::steady_clock::now().time_since_epoch()).count();
+        manager->reserve("car2", "K1", "J2", instruction::forward, now_ms);
+        ControlCenter second{};
+        second.update_map(json::parse(map_string));
+        second.set_drive_missions({"A1", "K2"});
+        second.use_intersection_manager(manager, "car3");
+        second(OBST_DISTANCE_CLOSE+10, STOP_DISTANCE_CLOSE, 0, 0, 0, 0, 0, 0);
+        control_data = second(OBST_DISTANCE_CLOSE+10, STOP_DISTANCE_FAR, DEFAULT_SPEED, 0, 0, 0, 0, 0);
+        CHECK(control_data.speed_ref < DEFAULT_SPEED);
+        CHECK(control_data.speed_ref >= 0);
+
+        CHECK(manager->get_reservation_count() == 3);
+
+        // Past the intersection the speed is back to normal, the slot at K1
+        // is given back and one at J1 taken
+        second(OBST_DISTANCE_CLOSE+10, STOP_DISTANCE_CLOSE, DEFAULT_SPEED, 0, 0, 0, 0, 0);
+        CHECK(second.get_current_road_segment() == "K1->J1");
+        control_data = second(OBST_DISTANCE_CLOSE+10, -1, DEFAULT_SPEED, 0, 0, 0, 0, 0);
+        CHECK(control_data.speed_ref == DEFAULT_SPEED);
+        CHECK(manager->get_reservation_count() == 3);
+
+        // A new route gives back the slot too
+        first.set_drive_missions({"A1", "K2"});
+        CHECK(manager->get_reservation_count() == 2);
+    }
+}
+
+TEST_CASE("Detour planner") {
+    string map_string = "{\"MapData\":{\"A1\":[{\"K1\":5}],\"A2\":[{\"B2\":1}],\"B1\":[{\"A1\":1}],\"B2\":[{\"L2\":2},{\"C2\":2}],\"C1\":[{\"B1\":2},{\"L2\":2}],\"C2\":[{\"D2\":1}],\"D1\":[{\"C1\":1}],\"D2\":[{\"E2\":1}],\"E1\":[{\"D1\":1}],\"E2\":[{\"F2\":2}],\"F1\":[{\"E1\":2}],\"F2\":[{\"G2\":3}],\"G1\":[{\"F1\":3}],\"G2\":[{\"H2\":1}],\"H1\":[{\"G1\":1}],\"H2\":[{\"M1\":2},{\"I2\":2}],\"I1\":[{\"H1\":2},{\"M1\":2}],\"I2\":[{\"J2\":1}],\"J1\":[{\"I1\":1}],\"J2\":[{\"K2\":1}],\"K1\":[{\"J1\":1}],\"K2\":[{\"A2\":5}],\"L1\":[{\"C2\":2},{\"B1\":2}],\"L2\":[{\"M2\":1}],\"M1\":[{\"L1\":1}],\"M2\":[{\"I2\":2},{\"H1\":2}]}}";
+    json json_map = json::parse(map_string);
+
+    SECTION("Detours ahead of the vehicle") {
+        DetourPlanner detours{MapGraph::from_json(json_map), 4};
+        detours.set_route({"A1", "A1->K1", "K1->J1", "J1->I1", "I1->M1", "M1->L1", "L1->C2", "K2",
+                           "K2->A2", "A2->B2"});
+        detours.wait();
+        CHECK(detours.get_detour(0) == nullptr);  // A stop
+        REQUIRE(detours.get_detour(1) != nullptr);
+        CHECK(detours.get_detour(1)->drive_mission.empty());  // No way around A1->K1
+        CHECK(detours.get_detour(4) == nullptr);  // Beyond the lookahead
+
+        // Around I1->M1 to K2
+        detours.advance();
+        detours.advance();
+        detours.wait();
+        shared_ptr<Detour const> detour = detours.get_detour(2);
+        REQUIRE(detour != nullptr);
+        CHECK(detour->distance == 17);
+        CHECK(detour->road_segments.front() == "I1->H1");
+        CHECK(detour->road_segments.back() == "J2->K2");
+        CHECK(detour->drive_mission.size() == detour->road_segments.size());
+        CHECK(find(detour->road_segments.begin(), detour->road_segments.end(), "I1->M1")
+              == detour->road_segments.end());
+
+        // After the last stop the detours end where the route does
+        for (int i{0}; i < 5; ++i) {
+            detours.advance();
+        }
+        detours.wait();
+        REQUIRE(detours.get_detour(1) != nullptr);
+        CHECK(detours.get_detour(1)->drive_mission.empty());  // K2->A2 is the only way
+    }
+
+    SECTION("Control center switches to a detour") {
+        ControlCenter control_center{};
+        control_center.update_map(json_map);
+        control_center.set_drive_missions({"A1", "K2", "H1"});
+        control_center.precompute_detours();
+        CHECK(!control_center.avoid_segment("A1->K1"));  // Already on it
+
+        // Leave A1
+        control_center(OBST_DISTANCE_CLOSE+10, STOP_DISTANCE_CLOSE, 0, 0, 0, 0, 0, 0);
+        control_center(OBST_DISTANCE_CLOSE+10, STOP_DISTANCE_FAR, DEFAULT_SPEED, 0, 0, 0, 0, 0);
+        CHECK(control_center.get_current_road_segment() == "A1->K1");
+        bool switched{false};
+        for (int i{0}; i < 100 && !switched; ++i) {
+            switched = control_center.avoid_segment("I1->M1");
+            if (!switched)
+                this_thread::sleep_for(chrono::milliseconds(10));
+        }
+        REQUIRE(switched);
+        CHECK(!control_center.avoid_segment("I1->M1"));  // Not on the route any more
+
+        // Drive to the stop at K2
+        vector<string> driven{};
+        for (int i{0}; i < 30 && control_center.get_current_road_segment() != "K2"; ++i) {
+            control_center(OBST_DISTANCE_CLOSE+10, STOP_DISTANCE_MID, DEFAULT_SPEED, 0, 0, 0, 0, 0);
+            control_center(OBST_DISTANCE_CLOSE+10, STOP_DISTANCE_CLOSE, DEFAULT_SPEED, 0, 0, 0, 0, 0);
+            driven.push_back(control_center.get_current_road_segment());
+        }
+        REQUIRE(driven.size() >= 3);
+        CHECK(driven[0] == "K1->J1");
+        CHECK(driven[1] == "J1->I1");
+        CHECK(driven[2] == "I1->H1");
+        CHECK(driven.back() == "K2");
+    }
+}
+
+TEST_CASE("Dropout predictor") {
+    SECTION("Extrapolation") {
+        DropoutPredictor predictor{500};
+        image_proc_t image{};
+        image.stop_distance = 200;
+        image.lateral_left = 10;
+        image.lateral_right = 10;
+        predictor.update(image, 1000);
+        CHECK(!predictor.predict(image, 100, 1050));  // One frame is not enough
+
+        image.angle_left = 10;
+        image.angle_right = 10;
+        image.lateral_left = 20;
+        image.lateral_right = 20;
+        image.stop_distance = 180;
+        predictor.update(image, 1100);
+
+        // The rates fade: 100 ms into a 500 ms horizon moves 90 ms worth
+        image_proc_t predicted{};
+        REQUIRE(predictor.predict(predicted, 100, 1200));
+        CHECK(predicted.angle_left == 19);
+        CHECK(predicted.angle_right == 19);
+        CHECK(predicted.lateral_left == 29);
+        CHECK(predicted.stop_distance == 170);
+        CHECK(predictor.get_confidence(1200) == Approx(0.8));
+
+        // The stop line does not move past the vehicle
+        REQUIRE(predictor.predict(predicted, 1000, 1500));
+        CHECK(predicted.stop_distance == 0);
+
+        predicted.angle_left = 77;
+        CHECK(!predictor.predict(predicted, 100, 1600));
+        CHECK(predicted.angle_left == 77);
+        CHECK(predictor.get_confidence(1600) == 0);
+
+        // No line in sight
+        image.stop_distance = 1000;
+        predictor.update(image, 1700);
+        REQUIRE(predictor.predict(predicted, 100, 1750));
+        CHECK(predicted.stop_distance == 1000);
+    }
+
+    SECTION("Control center stays nominal") {
+        ControlCenter plain{};
+        ControlCenter bridging{};
+        bridging.bridge_dropouts();
+        for (int i{0}; i < 3; ++i) {
+            plain(OBST_DISTANCE_CLOSE+10, STOP_DISTANCE_FAR, DEFAULT_SPEED, 5, 5, 10, 10, 0);
+            bridging(OBST_DISTANCE_CLOSE+10, STOP_DISTANCE_FAR, DEFAULT_SPEED, 5, 5, 10, 10, 0);
+        }
+        control_t control = plain(OBST_DISTANCE_CLOSE+10, -1, DEFAULT_SPEED, 90, 90, 0, 0, 1);
+        CHECK(control.regulation_mode == regulation_mode::auto_critical);
+        control = bridging(OBST_DISTANCE_CLOSE+10, -1, DEFAULT_SPEED, 90, 90, 0, 0, 1);
+        CHECK(control.regulation_mode == regulation_mode::auto_nominal);
+        CHECK(control.angle == 5);
+        CHECK(control.lateral_position == 10);
+
+        // Longer than the horizon
+        bridging.bridge_dropouts(20);
+        for (int i{0}; i < 3; ++i) {
+            bridging(OBST_DISTANCE_CLOSE+10, STOP_DISTANCE_FAR, DEFAULT_SPEED, 5, 5, 10, 10, 0);
+        }
+        this_thread::sleep_for(chrono::milliseconds(30));
+        control = bridging(OBST_DISTANCE_CLOSE+10, -1, DEFAULT_SPEED, 90, 90, 0, 0, 1);
+        CHECK(control.regulation_mode == regulation_mode::auto_critical);
+    }
+}
+
+TEST_CASE("Static path finder") {
+    string map_string = "{\"MapData\":{\"A1\":[{\"K1\":5}],\"A2\":[{\"B2\":1}],\"B1\":[{\"A1\":1}],\"B2\":[{\"L2\":2},{\"C2\":2}],\"C1\":[{\"B1\":2},{\"L2\":2}],\"C2\":[{\"D2\":1}],\"D1\":[{\"C1\":1}],\"D2\":[{\"E2\":1}],\"E1\":[{\"D1\":1}],\"E2\":[{\"F2\":2}],\"F1\":[{\"E1\":2}],\"F2\":[{\"G2\":3}],\"G1\":[{\"F1\":3}],\"G2\":[{\"H2\":1}],\"H1\":[{\"G1\":1}],\"H2\":[{\"M1\":2},{\"I2\":2}],\"I1\":[{\"H1\":2},{\"M1\":2}],\"I2\":[{\"J2\":1}],\"J1\":[{\"I1\":1}],\"J2\":[{\"K2\":1}],\"K1\":[{\"J1\":1}],\"K2\":[{\"A2\":5}],\"L1\":[{\"C2\":2},{\"B1\":2}],\"L2\":[{\"M2\":1}],\"M1\":[{\"L1\":1}],\"M2\":[{\"I2\":2},{\"H1\":2}]}}";
+    json json_map = json::parse(map_string);
+    shared_ptr<MapGraph const> map = MapGraph::from_json(json_map);
+    static StaticPathFinder<32, 64> finder{};
+    REQUIRE(finder.load(map));
+    CHECK(finder.get_node_count() == 26);
+
+    SECTION("Same routes as PathFinder") {
+        PathFinder path_finder{map};
+        for (unsigned start{0}; start < map->size(); ++start) {
+            for (unsigned stop{0}; stop < map->size(); ++stop) {
+                path_finder.solve(start, stop);
+                finder.solve(start, stop);
+                REQUIRE(finder.get_distance() == path_finder.get_distance());
+                CHECK(finder.get_route().front() == path_finder.get_node_name(start));
+                CHECK(finder.get_route().back() == path_finder.get_node_name(stop));
+                CHECK(finder.get_instruction_count() == finder.get_route_length() - 1);
+            }
+        }
+
+        finder.solve("L2", "L1");
+        path_finder.solve("L2", "L1");
+        CHECK(finder.get_distance() == 24);
+        CHECK(finder.get_route() == path_finder.get_route());
+        CHECK(finder.get_drive_mission() == path_finder.get_drive_mission());
+        CHECK(finder.get_road_segments() == path_finder.get_road_segments());
+        CHECK(finder.get_instruction(0) == path_finder.get_drive_mission()[0]);
+        CHECK(string{finder.get_route_name(1)} == "M2");
+    }
+
+    SECTION("Unknown nodes and no route") {
+        finder.solve("L2", "N1");
+        CHECK(finder.get_distance() == UINT_MAX);
+        CHECK(finder.get_route_length() == 0);
+        CHECK(finder.get_drive_mission().empty());
+        finder.solve("a very long node name", "L1");
+        CHECK(finder.get_distance() == UINT_MAX);
+        CHECK(finder.get_id("K2") >= 0);
+        CHECK(finder.get_id("K3") == -1);
+
+        json one_way = json::parse("{\"MapData\":{\"A\":[{\"B\":1}],\"B\":[]}}");
+        StaticPathFinder<4, 4> small{};
+        REQUIRE(small.load(MapGraph::from_json(one_way)));
+        small.solve("B", "A");
+        CHECK(small.get_distance() == UINT_MAX);
+        small.solve("A", "A");
+        CHECK(small.get_distance() == 0);
+        CHECK(small.get_route() == vector<string>{"A"});
+    }
+
+    SECTION("Map too big") {
+        StaticPathFinder<16, 64> few_nodes{};
+        CHECK(!few_nodes.load(map));
+        CHECK(few_nodes.get_node_count() == 0);
+        StaticPathFinder<32, 16> few_edges{};
+        CHECK(!few_edges.load(map));
+        json long_name = json::parse("{\"MapData\":{\"A_much_too_long_name\":[]}}");
+        StaticPathFinder<4, 4> small{};
+        CHECK(!small.load(MapGraph::from_json(long_name)));
+    }
+}
+
+TEST_CASE("Dense search") {
+    SECTION("Argmin") {
+        FrontierArgmin argmins[]{get_frontier_argmin(), frontier_argmin_scalar};
+        for (FrontierArgmin argmin : argmins) {
+            vector<unsigned> values(24, UINT_MAX);
+            CHECK(argmin(values.data(), 8) == 0);
+            values[5] = 7;
+            CHECK(argmin(values.data(), 8) == 5);
+            values[17] = 3;
+            values[21] = 3;
+            CHECK(argmin(values.data(), 24) == 17);
+            CHECK(argmin(values.data(), 16) == 5);
+            values[0] = 0;
+            CHECK(argmin(values.data(), 24) == 0);
+        }
+        string kind = frontier_argmin_kind();
+        CHECK((kind == "avx2" || kind == "neon" || kind == "scalar"));
+    }
+
+    SECTION("Same as with a heap") {
+        string map_string = "{\"MapData\":{\"A1\":[{\"K1\":5}],\"A2\":[{\"B2\":1}],\"B1\":[{\"A1\":1}],\"B2\":[{\"L2\":2},{\"C2\":2}],\"C1\":[{\"B1\":2},{\"L2\":2}],\"C2\":[{\"D2\":1}],\"D1\":[{\"C1\":1}],\"D2\":[{\"E2\":1}],\"E1\":[{\"D1\":1}],\"E2\":[{\"F2\":2}],\"F1\":[{\"E1\":2}],\"F2\":[{\"G2\":3}],\"G1\":[{\"F1\":3}],\"G2\":[{\"H2\":1}],\"H1\":[{\"G1\":1}],\"H2\":[{\"M1\":2},{\"I2\":2}],\"I1\":[{\"H1\":2},{\"M1\":2}],\"I2\":[{\"J2\":1}],\"J1\":[{\"I1\":1}],\"J2\":[{\"K2\":1}],\"K1\":[{\"J1\":1}],\"K2\":[{\"A2\":5}],\"L1\":[{\"C2\":2},{\"B1\":2}],\"L2\":[{\"M2\":1}],\"M1\":[{\"L1\":1}],\"M2\":[{\"I2\":2},{\"H1\":2}]}}";
+        shared_ptr<MapGraph const> map = MapGraph::from_json(json::parse(map_string));
+        vector<unsigned> weights{};
+        vector<uint32_t> parents{};
+        SearchQueue queue{};
+        vector<unsigned> dense_weights{};
+        vector<uint32_t> dense_parents{};
+        vector<unsigned> frontier{};
+        for (FrontierArgmin argmin : {get_frontier_argmin(), frontier_argmin_scalar}) {
+            for (uint32_t start{0}; start < map->size(); ++start) {
+                shortest_paths(*map, start, NO_NODE, weights, parents, queue, 3);
+                dense_shortest_paths(*map, start, NO_NODE, dense_weights, dense_parents, frontier, 3,
+                                     argmin);
+                CHECK(dense_weights == weights);
+                CHECK(dense_parents == parents);
+
+                uint32_t stop = (start + 7) % map->size();
+                dense_shortest_paths(*map, start, stop, dense_weights, dense_parents, frontier, 0,
+                                     argmin);
+                CHECK(dense_weights[stop] + 3 == weights[stop]);
+            }
+        }
+
+        json one_way = json::parse("{\"MapData\":{\"A\":[{\"B\":1}],\"B\":[]}}");
+        shared_ptr<MapGraph const> small = MapGraph::from_json(one_way);
+        uint32_t b = small->get_id("B");
+        dense_shortest_paths(*small, b, small->get_id("A"), dense_weights, dense_parents, frontier);
+        CHECK(dense_weights[small->get_id("A")] == UINT_MAX);
+        CHECK(!prefer_dense_search(small->size()));
+    }
+}
+
+TEST_CASE("Multi-source search") {
+    SECTION("Lane relax") {
+        for (LaneRelax relax : {get_lane_relax(), lane_relax_scalar}) {
+            vector<unsigned> from{0, 4, UINT_MAX, 2, 9, UINT_MAX, 1, 3};
+            vector<unsigned> to(8, UINT_MAX);
+            CHECK(relax(from.data(), 2, to.data()) == 2);
+            CHECK(to == vector<unsigned>{2, 6, UINT_MAX, 4, 11, UINT_MAX, 3, 5});
+            CHECK(relax(from.data(), 2, to.data()) == UINT_MAX);
+            from[4] = 5;
+            from[5] = 7;
+            CHECK(relax(from.data(), 1, to.data()) == 1);
+            CHECK(to == vector<unsigned>{1, 5, UINT_MAX, 3, 6, 8, 2, 4});
+            from[4] = 4;
+            CHECK(relax(from.data(), 1, to.data()) == 5);  // Only lane 4 got lower
+        }
+        string kind = lane_relax_kind();
+        CHECK((kind == "avx2" || kind == "neon" || kind == "scalar"));
+    }
+
+    SECTION("Same as one search per source") {
+        string map_string = "{\"MapData\":{\"A1\":[{\"K1\":5}],\"A2\":[{\"B2\":1}],\"B1\":[{\"A1\":1}],\"B2\":[{\"L2\":2},{\"C2\":2}],\"C1\":[{\"B1\":2},{\"L2\":2}],\"C2\":[{\"D2\":1}],\"D1\":[{\"C1\":1}],\"D2\":[{\"E2\":1}],\"E1\":[{\"D1\":1}],\"E2\":[{\"F2\":2}],\"F1\":[{\"E1\":2}],\"F2\":[{\"G2\":3}],\"G1\":[{\"F1\":3}],\"G2\":[{\"H2\":1}],\"H1\":[{\"G1\":1}],\"H2\":[{\"M1\":2},{\"I2\":2}],\"I1\":[{\"H1\":2},{\"M1\":2}],\"I2\":[{\"J2\":1}],\"J1\":[{\"I1\":1}],\"J2\":[{\"K2\":1}],\"K1\":[{\"J1\":1}],\"K2\":[{\"A2\":5}],\"L1\":[{\"C2\":2},{\"B1\":2}],\"L2\":[{\"M2\":1}],\"M1\":[{\"L1\":1}],\"M2\":[{\"I2\":2},{\"H1\":2}]}}";
+        shared_ptr<MapGraph const> map = MapGraph::from_json(json::parse(map_string));
+        size_t size = map->size();
+        vector<vector<unsigned>> single(size);
+        vector<uint32_t> parents{};
+        SearchQueue queue{};
+        for (uint32_t start{0}; start < size; ++start) {
+            shortest_paths(*map, start, NO_NODE, single[start], parents, queue);
+        }
+
+        vector<unsigned> distances{};
+        vector<unsigned> queued{};
+        vector<uint32_t> sources{3, 17, 0, 25, 9, 12, 3, 20};
+        for (LaneRelax relax : {get_lane_relax(), lane_relax_scalar}) {
+            for (size_t count : {size_t{8}, size_t{3}}) {
+                multi_source_distances(*map, sources.data(), count, distances, queued, queue, relax);
+                REQUIRE(distances.size() == size * MULTI_SOURCE_LANES);
+                for (uint32_t id{0}; id < size; ++id) {
+                    for (size_t lane{0}; lane < MULTI_SOURCE_LANES; ++lane) {
+                        unsigned expected = lane < count ? single[sources[lane]][id] : UINT_MAX;
+                        CHECK(distances[id * MULTI_SOURCE_LANES + lane] == expected);
+                    }
+                }
+
+                multi_source_reverse_distances(*map, sources.data(), count, distances, queued, queue,
+                                               relax);
+                for (uint32_t id{0}; id < size; ++id) {
+                    for (size_t lane{0}; lane < count; ++lane) {
+                        CHECK(distances[id * MULTI_SOURCE_LANES + lane] == single[id][sources[lane]]);
+                    }
+                }
+            }
+        }
+
+        json one_way = json::parse("{\"MapData\":{\"A\":[{\"B\":1}],\"B\":[]}}");
+        shared_ptr<MapGraph const> small = MapGraph::from_json(one_way);
+        uint32_t b = small->get_id("B");
+        multi_source_distances(*small, &b, 1, distances, queued, queue);
+        CHECK(distances[small->get_id("A") * MULTI_SOURCE_LANES] == UINT_MAX);
+        CHECK(distances[b * MULTI_SOURCE_LANES] == 0);
+    }
+}
+
+TEST_CASE("Occupancy table") {
+    // Two parallel roads from S to T, the one through A is shorter
+    json m = json::parse("{\"MapData\":{\"S\":[{\"A\":1},{\"B\":1}],\"A\":[{\"A2\":1}],\"A2\":[{\"T\":1}],"
+                         "\"B\":[{\"B2\":1}],\"B2\":[{\"T\":2}],\"T\":[{\"S\":1}]}}");
+    shared_ptr<MapGraph const> map = MapGraph::from_json(m);
+    shared_ptr<OccupancyTable> table{new OccupancyTable{map}};
+    ContractedGraph const &contracted = map->get_contracted();
+    unsigned s_core = contracted.get_core(map->get_id("S"));
+    unsigned s_edge = 2 * map->get_id("S");
+
+    SECTION("Counts and penalties") {
+        table->set_route("car1", {"S", "S->A", "A->A2", "A2->T", "unknown"});
+        CHECK(table->get_vehicles("S->A") == 0);
+        CHECK(table->get_planned("S->A") == 1);
+        CHECK(table->get_penalty(s_edge) == 1);  // 25 % of 1, rounded up
+        CHECK(table->get_core_penalty(2 * s_core) == 3);
+        CHECK(table->get_core_penalty(2 * s_core + 1) == 0);
+
+        table->advance("car1");
+        CHECK(table->get_vehicles("S->A") == 1);
+        CHECK(table->get_planned("S->A") == 0);
+        CHECK(table->get_core_penalty(2 * s_core) == 3);
+        table->advance("car1");
+        CHECK(table->get_vehicles("S->A") == 0);
+        CHECK(table->get_vehicles("A->A2") == 1);
+        CHECK(table->get_penalty(s_edge) == 0);
+
+        table->set_route("car2", {"S->A", "A->A2"});
+        CHECK(table->get_vehicles("A->A2") == 1);
+        CHECK(table->get_planned("A->A2") == 1);
+        CHECK(table->get_penalty(2 * map->get_id("A")) == 2);
+
+        table->remove_vehicle("car1");
+        table->remove_vehicle("car2");
+        table->remove_vehicle("car3");
+        CHECK(table->get_vehicles("A->A2") == 0);
+        CHECK(table->get_planned("A->A2") == 0);
+        CHECK(table->get_core_penalty(2 * s_core) == 0);
+    }
+
+    SECTION("Routing around congestion") {
+        PathFinder path_finder{map};
+        path_finder.set_occupancy(table);
+        path_finder.solve("S", "T");
+        CHECK(path_finder.get_route() == vector<string>{"S", "A", "A2", "T"});
+
+        table->set_route("car1", {"S->A", "A->A2", "A2->T"});
+        path_finder.solve("S", "T");
+        CHECK(path_finder.get_route() == vector<string>{"S", "B", "B2", "T"});
+        CHECK(path_finder.get_distance() == 4);  // Without the penalties
+
+        // A table for another map is ignored
+        path_finder.set_map(MapGraph::from_json(m));
+        path_finder.solve("S", "T");
+        CHECK(path_finder.get_route() == vector<string>{"S", "A", "A2", "T"});
+    }
+
+    SECTION("Control centers spread") {
+        ControlCenter first{};
+        ControlCenter second{};
+        first.set_map(map);
+        second.set_map(map);
+        first.share_occupancy(table, "car1");
+        second.share_occupancy(table, "car2");
+        first.set_drive_missions({"S", "T"});
+        second.set_drive_missions({"S", "T"});
+        CHECK(table->get_planned("S->A") == 1);
+        CHECK(table->get_planned("S->B") == 1);
+
+        // Planning again does not avoid its own route
+        second.set_drive_missions({"S", "T"});
+        CHECK(table->get_planned("S->B") == 1);
+        CHECK(table->get_planned("S->A") == 1);
+
+        // Its name at an intersection manager is not its name in the table
+        shared_ptr<IntersectionManager> manager{new IntersectionManager{}};
+        second.use_intersection_manager(manager, "truck2");
+        second.set_drive_missions({"S", "T"});
+        CHECK(table->get_planned("S->B") == 1);
+        CHECK(table->get_planned("S->A") == 1);
+    }
+}
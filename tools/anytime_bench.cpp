@@ -0,0 +1,68 @@
+/*
+ * Route quality of the anytime planner against its time budget on large
+ * generated maps, compared with the shortest routes from PathFinder. The
+ * city map suits the landmark heuristic well, on the one-way torus it is
+ * weak and the planner needs most of a Dijkstra search for a first route.
+ *
+ * Usage: anytime_bench.out [SIDE] [CHAIN] [QUERIES]
+ */
+
+#include "path_finder.h"
+#include "anytime_planner.h"
+#include "generated_map.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <vector>
+
+using namespace std;
+
+void run(char const *label, json const &m, unsigned queries) {
+    shared_ptr<MapGraph const> map = MapGraph::from_json(m);
+    cout << label << ": ";
+    auto start = chrono::steady_clock::now();
+    AnytimePlanner planner{map};
+    double setup = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    cout << map->size() << " nodes, landmarks in " << setup * 1e3 << " ms" << endl;
+
+    mt19937 random{42};
+    uniform_int_distribution<unsigned> pick{0, static_cast<unsigned>(map->size()) - 1};
+    vector<pair<unsigned, unsigned>> pairs{};
+    vector<unsigned> shortest{};
+    PathFinder path_finder{map};
+    start = chrono::steady_clock::now();
+    for (unsigned i{0}; i < queries; ++i) {
+        pairs.emplace_back(pick(random), pick(random));
+        path_finder.solve(pairs.back().first, pairs.back().second);
+        shortest.push_back(path_finder.get_distance());
+    }
+    double dijkstra = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    cout << "Dijkstra: " << dijkstra * 1e3 / queries << " ms/query" << endl;
+
+    cout << "budget ms  found  cost/optimal  bound" << endl;
+    for (long budget_us : {100L, 250L, 500L, 1000L, 2000L, 5000L, 10000L}) {
+        unsigned found{0};
+        double ratio{0};
+        double bound{0};
+        for (unsigned i{0}; i < queries; ++i) {
+            if (!planner.plan(pairs[i].first, pairs[i].second, budget_us))
+                continue;
+            AnytimeRoute route = planner.get_route();
+            ++found;
+            ratio += shortest[i] > 0 ? static_cast<double>(route.distance) / shortest[i] : 1;
+            bound += route.bound;
+        }
+        cout << budget_us / 1e3 << "\t   " << found * 100 / queries << "%\t  "
+             << (found ? ratio / found : 0) << "\t" << (found ? bound / found : 0) << endl;
+    }
+}
+
+int main(int argc, char *argv[]) {
+    unsigned side = argc > 1 ? atoi(argv[1]) : 200;
+    unsigned chain = argc > 2 ? atoi(argv[2]) : 2;
+    unsigned queries = argc > 3 ? atoi(argv[3]) : 50;
+    run("city", generate_city_map(side, side, chain), queries);
+    run("torus", generate_map(side, side, chain), queries);
+}
@@ -0,0 +1,62 @@
+/*
+ * Memory and query time of CompactMapGraph against MapGraph on the real map
+ * file and on large generated maps.
+ *
+ * Usage: compact_bench.out [MAP_FILE] [QUERIES]
+ */
+
+#include "path_finder.h"
+#include "compact_map_graph.h"
+#include "generated_map.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <random>
+
+using namespace std;
+
+template <class Finder>
+double time_queries(Finder &finder, size_t size, unsigned queries, unsigned long &checksum) {
+    mt19937 random{42};
+    uniform_int_distribution<unsigned> pick{0, static_cast<unsigned>(size) - 1};
+    auto start = chrono::steady_clock::now();
+    for (unsigned i{0}; i < queries; ++i) {
+        finder.solve(pick(random), pick(random));
+        checksum += finder.get_distance();
+    }
+    return chrono::duration<double>(chrono::steady_clock::now() - start).count() * 1e6 / queries;
+}
+
+void compare(char const *label, json const &m, unsigned queries) {
+    shared_ptr<MapGraph const> map = MapGraph::from_json(m);
+    shared_ptr<CompactMapGraph const> compact = CompactMapGraph::from_graph(*map);
+    PathFinder path_finder{map};
+    CompactPathFinder compact_path_finder{compact};
+
+    unsigned long checksum{0};
+    unsigned long compact_checksum{0};
+    double full_time = time_queries(path_finder, map->size(), queries, checksum);
+    double compact_time = time_queries(compact_path_finder, map->size(), queries, compact_checksum);
+
+    cout << label << " (" << map->size() << " nodes)" << endl;
+    cout << "  MapGraph:        " << static_cast<double>(map->get_memory_usage()) / map->size()
+         << " bytes/node, " << full_time << " us/query" << endl;
+    cout << "  CompactMapGraph: " << static_cast<double>(compact->get_memory_usage()) / map->size()
+         << " bytes/node, " << compact_time << " us/query" << endl;
+    cout << "  slowdown " << compact_time / full_time << "x"
+         << (checksum == compact_checksum ? "" : ", ROUTES DIFFER") << endl;
+}
+
+int main(int argc, char *argv[]) {
+    unsigned queries = argc > 2 ? atoi(argv[2]) : 100;
+    if (argc > 1) {
+        ifstream file{argv[1]};
+        json m{};
+        file >> m;
+        compare(argv[1], m, 100 * queries);
+    }
+    compare("generated 50x50, 2 node roads", generate_map(50, 50, 2), queries);
+    compare("generated 200x200, 2 node roads", generate_map(200, 200, 2), queries);
+}
@@ -0,0 +1,108 @@
+/*
+ * Node reduction and query time of routing on the contracted graph
+ * (contracted_graph.h, what PathFinder does) against Dijkstra over every
+ * node of the MapGraph, on the track map, a map file and generated maps.
+ * Both produce the full route and drive mission.
+ *
+ * Usage: contraction_bench.out [MAP_FILE] [QUERIES]
+ */
+
+#include "path_finder.h"
+#include "contracted_graph.h"
+#include "generated_map.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <random>
+
+using namespace std;
+
+namespace {
+    char const *track_map = "{\"MapData\":{\"A1\":[{\"K1\":5}],\"A2\":[{\"B2\":1}],\"B1\":[{\"A1\":1}],\"B2\":[{\"L2\":2},{\"C2\":2}],\"C1\":[{\"B1\":2},{\"L2\":2}],\"C2\":[{\"D2\":1}],\"D1\":[{\"C1\":1}],\"D2\":[{\"E2\":1}],\"E1\":[{\"D1\":1}],\"E2\":[{\"F2\":2}],\"F1\":[{\"E1\":2}],\"F2\":[{\"G2\":3}],\"G1\":[{\"F1\":3}],\"G2\":[{\"H2\":1}],\"H1\":[{\"G1\":1}],\"H2\":[{\"M1\":2},{\"I2\":2}],\"I1\":[{\"H1\":2},{\"M1\":2}],\"I2\":[{\"J2\":1}],\"J1\":[{\"I1\":1}],\"J2\":[{\"K2\":1}],\"K1\":[{\"J1\":1}],\"K2\":[{\"A2\":5}],\"L1\":[{\"C2\":2},{\"B1\":2}],\"L2\":[{\"M2\":1}],\"M1\":[{\"L1\":1}],\"M2\":[{\"I2\":2},{\"H1\":2}]}}";
+
+    /* Route and drive mission like PathFinder did before contraction. */
+    class FullFinder {
+    public:
+        FullFinder(shared_ptr<MapGraph const> map)
+        : map{map} {
+        }
+
+        void solve(unsigned start_id, unsigned stop_id) {
+            uint32_t start = map->from_map_id(start_id);
+            uint32_t stop = map->from_map_id(stop_id);
+            route.clear();
+            shortest_paths(*map, start, stop, weights, parents, queue);
+            distance = weights[stop];
+            if (distance == UINT_MAX)
+                return;
+            for (uint32_t node = stop; node != NO_NODE; node = parents[node]) {
+                route.push_back(node);
+            }
+            reverse(route.begin(), route.end());
+            drive_mission = route_instructions(*map, route);
+        }
+        unsigned get_distance() const {
+            return distance;
+        }
+
+    private:
+        shared_ptr<MapGraph const> map;
+        vector<unsigned> weights{};
+        vector<uint32_t> parents{};
+        SearchQueue queue{};
+        vector<uint32_t> route{};
+        vector<instruction::InstructionNumber> drive_mission{};
+        unsigned distance{UINT_MAX};
+    };
+
+    template <class Finder>
+    double time_queries(Finder &finder, size_t size, unsigned queries, unsigned long &checksum) {
+        mt19937 random{42};
+        uniform_int_distribution<unsigned> pick{0, static_cast<unsigned>(size) - 1};
+        auto start = chrono::steady_clock::now();
+        for (unsigned i{0}; i < queries; ++i) {
+            finder.solve(pick(random), pick(random));
+            checksum += finder.get_distance();
+        }
+        return chrono::duration<double>(chrono::steady_clock::now() - start).count() * 1e6 / queries;
+    }
+
+    void compare(string const &label, json const &m, unsigned queries) {
+        shared_ptr<MapGraph const> map = MapGraph::from_json(m);
+        size_t core = map->get_contracted().size();
+        FullFinder full_finder{map};
+        PathFinder path_finder{map};
+
+        unsigned long checksum{0};
+        unsigned long contracted_checksum{0};
+        double full_time = time_queries(full_finder, map->size(), queries, checksum);
+        double contracted_time = time_queries(path_finder, map->size(), queries, contracted_checksum);
+
+        cout << label << endl;
+        cout << "  nodes " << map->size() << " -> " << core << " ("
+             << 100.0 * (map->size() - core) / map->size() << "% fewer)" << endl;
+        cout << "  full map:   " << full_time << " us/query" << endl;
+        cout << "  contracted: " << contracted_time << " us/query" << endl;
+        cout << "  speedup " << full_time / contracted_time << "x"
+             << (checksum == contracted_checksum ? "" : ", DISTANCES DIFFER") << endl;
+    }
+}
+
+int main(int argc, char *argv[]) {
+    unsigned queries = argc > 2 ? atoi(argv[2]) : 200;
+    compare("track map", json::parse(track_map), 10000 * queries);
+    if (argc > 1) {
+        ifstream file{argv[1]};
+        json m{};
+        file >> m;
+        compare(argv[1], m, 100 * queries);
+    }
+    for (unsigned chain : {1, 2, 4}) {
+        compare("generated 200x200, " + to_string(chain) + " node roads",
+                generate_map(200, 200, chain), queries);
+    }
+    compare("generated city 200x200, 2 node roads", generate_city_map(200, 200, 2), queries);
+}
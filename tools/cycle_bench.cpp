@@ -0,0 +1,78 @@
+/*
+ * Control cycle benchmark: a fleet of control centers, each with its own
+ * drive mission, run one cycle each in turn, as a simulator or a
+ * dispatcher running many vehicles would. With thousands of vehicles the
+ * control centers do not fit in the caches, so the cost per cycle shows
+ * how many cache lines a cycle touches. Reports time and cache misses
+ * (where the kernel allows perf counters) per cycle.
+ *
+ * Usage: cycle_bench.out [VEHICLES] [CYCLES]
+ */
+
+#include "control_center.h"
+#include "perf_counters.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace std;
+using Clock = chrono::steady_clock;
+
+int main(int argc, char *argv[]) {
+    unsigned vehicles = argc > 1 ? atoi(argv[1]) : 4096;
+    unsigned cycles = argc > 2 ? atoi(argv[2]) : 200;
+
+    mt19937 random{1};
+    vector<unique_ptr<ControlCenter>> fleet{};
+    for (unsigned vehicle{0}; vehicle < vehicles; ++vehicle) {
+        fleet.emplace_back(new ControlCenter{3, 3, 1, 0, 1});
+        for (unsigned i{0}; i < 50; ++i) {
+            instruction::InstructionNumber number = static_cast<instruction::InstructionNumber>(
+                    random() % 3 == 0 ? instruction::left : instruction::forward);
+            fleet.back()->add_drive_instruction(number, "N" + to_string(i) + "->N" + to_string(i + 1));
+        }
+    }
+
+    // Stop lines come every 20 cycles, at a different phase per vehicle
+    vector<unsigned> phase(vehicles);
+    for (unsigned &p : phase) {
+        p = random() % 20;
+    }
+    auto run = [&] (unsigned first_cycle, unsigned count) {
+        int checksum{0};
+        for (unsigned cycle{first_cycle}; cycle < first_cycle + count; ++cycle) {
+            for (unsigned vehicle{0}; vehicle < vehicles; ++vehicle) {
+                unsigned step = (cycle + phase[vehicle]) % 20;
+                int stop_distance = step < 15 ? 200 : 200 - 40 * static_cast<int>(step - 14);
+                control_t control = (*fleet[vehicle])(1000, stop_distance, DEFAULT_SPEED,
+                                                      step, -static_cast<int>(step), 5, -5, 0);
+                checksum += control.speed_ref;
+            }
+        }
+        return checksum;
+    };
+
+    run(0, 10);  // Warm up
+    CacheMissCounter misses{};
+    Clock::time_point begin = Clock::now();
+    misses.start();
+    int checksum = run(10, cycles);
+    uint64_t miss_count = misses.stop();
+    double seconds = chrono::duration<double>(Clock::now() - begin).count();
+
+    double total = static_cast<double>(vehicles) * cycles;
+    cout << "sizeof(ControlCenter)=" << sizeof(ControlCenter) << " vehicles=" << vehicles
+         << " cycles=" << cycles << endl
+         << "ns/cycle=" << seconds * 1e9 / total;
+    if (misses.is_available()) {
+        cout << " cache_misses/cycle=" << miss_count / total;
+    } else {
+        cout << " cache_misses/cycle=n/a";
+    }
+    cout << " (checksum " << checksum << ")" << endl;
+}
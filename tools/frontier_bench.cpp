@@ -0,0 +1,80 @@
+/*
+ * Dijkstra with a heap (shortest_paths) against the dense frontier scan
+ * (dense_shortest_paths), with the vector and the scalar argmin, on the
+ * track map and generated maps of 64 to 1024 nodes. Searches the maps
+ * as they are, without contraction, to a random stop node.
+ *
+ * PathFinder uses the dense search between DENSE_SEARCH_MIN_NODES and
+ * DENSE_SEARCH_MAX_NODES nodes (of the contracted graph) when there is a
+ * vector argmin.
+ *
+ * Usage: frontier_bench.out [QUERIES]
+ */
+
+#include "graph_search.h"
+#include "generated_map.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <string>
+
+using namespace std;
+
+namespace {
+    char const *track_map = "{\"MapData\":{\"A1\":[{\"K1\":5}],\"A2\":[{\"B2\":1}],\"B1\":[{\"A1\":1}],\"B2\":[{\"L2\":2},{\"C2\":2}],\"C1\":[{\"B1\":2},{\"L2\":2}],\"C2\":[{\"D2\":1}],\"D1\":[{\"C1\":1}],\"D2\":[{\"E2\":1}],\"E1\":[{\"D1\":1}],\"E2\":[{\"F2\":2}],\"F1\":[{\"E1\":2}],\"F2\":[{\"G2\":3}],\"G1\":[{\"F1\":3}],\"G2\":[{\"H2\":1}],\"H1\":[{\"G1\":1}],\"H2\":[{\"M1\":2},{\"I2\":2}],\"I1\":[{\"H1\":2},{\"M1\":2}],\"I2\":[{\"J2\":1}],\"J1\":[{\"I1\":1}],\"J2\":[{\"K2\":1}],\"K1\":[{\"J1\":1}],\"K2\":[{\"A2\":5}],\"L1\":[{\"C2\":2},{\"B1\":2}],\"L2\":[{\"M2\":1}],\"M1\":[{\"L1\":1}],\"M2\":[{\"I2\":2},{\"H1\":2}]}}";
+
+    template <class Search>
+    double time_queries(MapGraph const &map, unsigned queries, unsigned long &checksum,
+                        Search search) {
+        mt19937 random{42};
+        uniform_int_distribution<uint32_t> pick{0, static_cast<uint32_t>(map.size()) - 1};
+        vector<unsigned> weights{};
+        auto start = chrono::steady_clock::now();
+        for (unsigned i{0}; i < queries; ++i) {
+            uint32_t stop = pick(random);
+            search(pick(random), stop, weights);
+            checksum += weights[stop];
+        }
+        return chrono::duration<double>(chrono::steady_clock::now() - start).count() * 1e9 / queries;
+    }
+
+    void compare(string const &label, json const &m, unsigned queries) {
+        shared_ptr<MapGraph const> map = MapGraph::from_json(m);
+        vector<uint32_t> parents{};
+        SearchQueue queue{};
+        vector<unsigned> frontier{};
+        unsigned long checksums[3]{};
+
+        double heap = time_queries(*map, queries, checksums[0],
+                                   [&] (uint32_t start, uint32_t stop, vector<unsigned> &weights) {
+            shortest_paths(*map, start, stop, weights, parents, queue);
+        });
+        double dense = time_queries(*map, queries, checksums[1],
+                                    [&] (uint32_t start, uint32_t stop, vector<unsigned> &weights) {
+            dense_shortest_paths(*map, start, stop, weights, parents, frontier);
+        });
+        double scalar = time_queries(*map, queries, checksums[2],
+                                     [&] (uint32_t start, uint32_t stop, vector<unsigned> &weights) {
+            dense_shortest_paths(*map, start, stop, weights, parents, frontier, 0,
+                                 frontier_argmin_scalar);
+        });
+
+        cout << label << " (" << map->size() << " nodes): heap " << heap << " ns, dense "
+             << frontier_argmin_kind() << " " << dense << " ns (" << heap / dense << "x), dense scalar "
+             << scalar << " ns (" << heap / scalar << "x)"
+             << (checksums[0] == checksums[1] && checksums[1] == checksums[2] ? "" : ", DIFFERENT")
+             << endl;
+    }
+}
+
+int main(int argc, char *argv[]) {
+    unsigned queries = argc > 1 ? atoi(argv[1]) : 100000;
+    compare("track map", json::parse(track_map), queries);
+    unsigned sizes[][2]{{8, 4}, {8, 6}, {8, 8}, {16, 8}, {16, 16}, {24, 16}, {32, 16}, {32, 32}};
+    for (auto const &size : sizes) {
+        compare("generated " + to_string(size[0]) + "x" + to_string(size[1]),
+                generate_map(size[0], size[1], 0), queries * 32 / (size[0] * size[1]));
+    }
+}
@@ -0,0 +1,90 @@
+/*
+ * Large generated maps for the benchmarks, in the same JSON format as the
+ * real maps.
+ *
+ * generate_map(): intersections sit on a width x height torus. Every
+ * intersection has two outgoing roads, east and south.
+ *
+ * generate_city_map(): a width x height grid of one-way streets in
+ * alternating directions (rows east, west, east, ...; columns north, south,
+ * ...), like Manhattan. Intersections on the border have a single road.
+ * Use even sizes so that every node can reach every other.
+ *
+ * Every road is a chain of `chain` single-successor nodes before the next
+ * intersection, like the lanes in our real maps. Names are random so map
+ * order says nothing about where a node is.
+ */
+
+#ifndef GENERATED_MAP_H
+#define GENERATED_MAP_H
+
+#include <cstdint>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <vector>
+#include <nlohmann/json.hpp>
+
+#define NO_ROAD UINT32_MAX
+
+/* Targets of the two roads out of intersection (x, y), NO_ROAD for none. */
+template <class Roads>
+nlohmann::json generate_grid_map(unsigned width, unsigned height, unsigned chain, unsigned seed,
+                                 Roads roads) {
+    std::mt19937 random{seed};
+    std::uniform_int_distribution<int> weight{1, 9};
+    unsigned intersections = width * height;
+    unsigned count = intersections * (1 + 2 * chain);
+
+    std::vector<std::string> names(count);
+    for (unsigned i{0}; i < count; ++i) {
+        char name[24];
+        snprintf(name, sizeof(name), "%08x%u", static_cast<unsigned>(random()), i);
+        names[i] = name;
+    }
+
+    // Intersection i is node i, the chain nodes of its roads follow
+    auto chain_node = [&] (unsigned intersection, unsigned road, unsigned k) {
+        return intersections + (intersection * 2 + road) * chain + k;
+    };
+    nlohmann::json data = nlohmann::json::object();
+    for (unsigned y{0}; y < height; ++y) {
+        for (unsigned x{0}; x < width; ++x) {
+            unsigned i = y * width + x;
+            unsigned targets[2];
+            roads(x, y, targets);
+            nlohmann::json edges = nlohmann::json::array();
+            for (unsigned road{0}; road < 2; ++road) {
+                if (targets[road] == NO_ROAD)
+                    continue;
+                unsigned next = chain > 0 ? chain_node(i, road, 0) : targets[road];
+                edges.push_back({{names[next], weight(random)}});
+                for (unsigned k{0}; k < chain; ++k) {
+                    unsigned to = k + 1 < chain ? chain_node(i, road, k + 1) : targets[road];
+                    data[names[chain_node(i, road, k)]] = {{{names[to], weight(random)}}};
+                }
+            }
+            data[names[i]] = edges;
+        }
+    }
+    return {{"MapData", data}};
+}
+
+inline nlohmann::json generate_map(unsigned width, unsigned height, unsigned chain, unsigned seed=1) {
+    return generate_grid_map(width, height, chain, seed, [=] (unsigned x, unsigned y, unsigned *targets) {
+        targets[0] = y * width + (x + 1) % width;
+        targets[1] = ((y + 1) % height) * width + x;
+    });
+}
+
+inline nlohmann::json generate_city_map(unsigned width, unsigned height, unsigned chain,
+                                        unsigned seed=1) {
+    return generate_grid_map(width, height, chain, seed, [=] (unsigned x, unsigned y, unsigned *targets) {
+        unsigned next_x = y % 2 == 0 ? x + 1 : x - 1;
+        unsigned next_y = x % 2 == 0 ? y - 1 : y + 1;
+        targets[0] = next_x < width ? y * width + next_x : NO_ROAD;
+        targets[1] = next_y < height ? next_y * width + x : NO_ROAD;
+    });
+}
+
+#endif // GENERATED_MAP_H
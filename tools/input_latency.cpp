@@ -0,0 +1,64 @@
+/*
+ * Measure producer to consumer hand-off latency of the input channel, with
+ * busy polling and with futex wake-up.
+ *
+ * Usage: input_latency.out [RECORDS]
+ */
+
+#include "input_channel.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+using namespace std;
+using Clock = chrono::steady_clock;
+
+void measure(bool busy_poll, unsigned records) {
+    InputChannelConsumer consumer{"/control_center_input_latency", 64, busy_poll};
+    InputChannelProducer producer{"/control_center_input_latency"};
+    if (!consumer.is_open() || !producer.is_open()) {
+        cerr << "Could not open the input channel" << endl;
+        return;
+    }
+
+    thread producer_thread{[&] {
+        image_proc_t image_data{};
+        for (unsigned i{0}; i < records; ++i) {
+            // Give the consumer time to go back to waiting
+            Clock::time_point until = Clock::now() + chrono::microseconds(50);
+            while (Clock::now() < until) {}
+            producer.push(image_data);
+        }
+    }};
+
+    vector<double> latencies{};
+    while (latencies.size() < records) {
+        if (!consumer.wait(1000000))
+            break;
+        int64_t now = chrono::duration_cast<chrono::nanoseconds>(
+                Clock::now().time_since_epoch()).count();
+        while (InputRecord const *record = consumer.peek()) {
+            latencies.push_back(now - record->timestamp_ns);
+            consumer.release();
+        }
+    }
+    producer_thread.join();
+
+    sort(latencies.begin(), latencies.end());
+    if (latencies.empty())
+        return;
+    cout << (busy_poll ? "busy poll" : "futex") << ": records=" << latencies.size()
+         << " latency_ns p50=" << latencies[latencies.size() / 2]
+         << " p99=" << latencies[latencies.size() * 99 / 100]
+         << " max=" << latencies.back() << endl;
+}
+
+int main(int argc, char *argv[]) {
+    unsigned records = argc > 1 ? atoi(argv[1]) : 10000;
+    measure(true, records);
+    measure(false, records);
+}
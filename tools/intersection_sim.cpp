@@ -0,0 +1,282 @@
+/*
+ * Throughput of one four-way intersection with and without slot
+ * reservations (intersection_manager.h), in a simple kinematic simulation.
+ *
+ * Vehicles arrive at random on four approaches, drive at cruise speed and
+ * keep a gap to the vehicle ahead. Without reservations a vehicle that
+ * finds crossing traffic in the intersection brakes, waits at the stop
+ * line and starts from standstill, like the control center does when the
+ * path is blocked. With reservations it asks for a slot when it is
+ * request_distance from the line and adjusts its speed to reach the line
+ * at cruise speed when the slot starts.
+ *
+ * Reports vehicles crossed per minute, mean delay against driving the
+ * same distance at cruise speed, the share of vehicles that came to a
+ * stop and the number of times two crossing vehicles were in the
+ * intersection together (must be 0).
+ *
+ * Usage: intersection_sim.out [SECONDS]
+ */
+
+#include "intersection_manager.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <deque>
+#include <iostream>
+#include <random>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+namespace {
+    double const dt = 0.05;             // s
+    double const cruise = 10;           // m/s
+    double const accel = 2;             // m/s^2
+    double const brake = 4;             // m/s^2
+    double const lane_length = 200;     // m before the stop line
+    double const box_length = 12;       // m through the intersection
+    double const vehicle_length = 4;    // m
+    double const min_gap = 2;           // m between standing vehicles
+    double const time_gap = 1;          // s between moving vehicles
+    double const request_distance = 120;
+    double const warmup = 60;           // s before anything is counted
+    double const standstill_crossing = sqrt(2 * (box_length + vehicle_length) / accel) + 0.5;
+
+    char const *approaches[]{"N", "E", "S", "W"};
+
+    struct Vehicle {
+        unsigned long id;
+        unsigned approach;
+        instruction::InstructionNumber turn;
+        double spawn_time;
+        double x;            // Distance of the front to the stop line
+        double v;
+        bool committed{false};
+        bool stopped{false};
+        bool requested{false};
+        bool slow{false};      // Crossing from standstill
+        double slot_start{0};
+    };
+
+    struct Result {
+        unsigned crossed{0};
+        double delay{0};
+        unsigned stopped{0};
+        unsigned conflicts{0};
+    };
+
+    bool in_box(Vehicle const &vehicle) {
+        return vehicle.x <= 0 && vehicle.x > -(box_length + vehicle_length);
+    }
+
+    bool conflict(Vehicle const &a, Vehicle const &b) {
+        return IntersectionManager::conflicting(approaches[a.approach], a.turn,
+                                                approaches[b.approach], b.turn);
+    }
+
+    /* Time to reach the line at full acceleration. */
+    double earliest_arrival(double distance, double speed) {
+        double ramp = (cruise - speed) / accel;
+        double ramp_distance = (speed + cruise) / 2 * ramp;
+        if (distance <= ramp_distance)
+            return (sqrt(speed * speed + 2 * accel * distance) - speed) / accel;
+        return ramp + (distance - ramp_distance) / cruise;
+    }
+
+    /* Speed to cruise at now so that accelerating later reaches the line
+     * at cruise speed after time seconds. */
+    double arrival_speed(double distance, double time) {
+        if (distance >= cruise * time)
+            return cruise;
+        double low{0};
+        double high{cruise};
+        for (int i{0}; i < 30; ++i) {
+            double u = (low + high) / 2;
+            double ramp = (cruise - u) / accel;
+            double covered = ramp > time ? u * time + accel * time * time / 2
+                                         : u * (time - ramp) + (cruise * cruise - u * u) / (2 * accel);
+            if (covered < distance) {
+                low = u;
+            } else {
+                high = u;
+            }
+        }
+        return low;
+    }
+
+    Result simulate(double rate, bool reservations, double seconds, unsigned seed) {
+        mt19937 random{seed};
+        exponential_distribution<double> interarrival{rate};
+        uniform_real_distribution<double> uniform{0, 1};
+        // Crossing at cruise speed, with a margin for vehicles a little late
+        double headway = (vehicle_length + min_gap) / cruise + time_gap;
+        double crossing = (box_length + vehicle_length) / cruise + 0.3;
+        IntersectionManager manager{static_cast<unsigned>(crossing * 1000),
+                                    static_cast<unsigned>(headway * 1000), 600000};
+
+        vector<deque<Vehicle>> lanes(4);
+        vector<deque<double>> waiting(4);  // Arrival times of vehicles not yet on the lane
+        vector<double> next_arrival(4);
+        for (double &t : next_arrival) {
+            t = interarrival(random);
+        }
+        Result result{};
+        set<pair<unsigned long, unsigned long>> conflict_pairs{};
+        unsigned long vehicle_count{0};
+
+        for (double now{0}; now < seconds + warmup; now += dt) {
+            // Arrivals enter the lane when there is room
+            for (unsigned a{0}; a < 4; ++a) {
+                while (next_arrival[a] <= now) {
+                    waiting[a].push_back(next_arrival[a]);
+                    next_arrival[a] += interarrival(random);
+                }
+                bool room = lanes[a].empty()
+                        || lanes[a].back().x < lane_length - vehicle_length - min_gap - cruise * time_gap;
+                if (!waiting[a].empty() && room) {
+                    double r = uniform(random);
+                    instruction::InstructionNumber turn = r < 0.5 ? instruction::forward
+                            : r < 0.75 ? instruction::left : instruction::right;
+                    lanes[a].push_back(Vehicle{vehicle_count++, a, turn, waiting[a].front(),
+                                               lane_length, cruise});
+                    waiting[a].pop_front();
+                }
+            }
+
+            for (unsigned a{0}; a < 4; ++a) {
+                for (size_t i{0}; i < lanes[a].size(); ++i) {
+                    Vehicle &vehicle = lanes[a][i];
+                    double target = cruise;
+                    double stop_at = 1e9;  // Distance to a point to stop at
+                    if (i > 0) {
+                        double gap = vehicle.x - lanes[a][i - 1].x - vehicle_length - min_gap;
+                        stop_at = gap;
+                        target = min(target, max(0.0, gap / time_gap));
+                    }
+
+                    if (vehicle.x > 0 && !reservations && !vehicle.committed) {
+                        // Enter when nothing crossing is in or committed to the intersection
+                        double braking = vehicle.v * vehicle.v / (2 * brake);
+                        if (vehicle.x <= braking + 1) {
+                            bool free{true};
+                            for (auto const &lane : lanes) {
+                                for (Vehicle const &other : lane) {
+                                    if (other.committed && other.x > -(box_length + vehicle_length)
+                                            && conflict(vehicle, other))
+                                        free = false;
+                                }
+                            }
+                            if (free) {
+                                vehicle.committed = true;
+                            } else {
+                                stop_at = min(stop_at, vehicle.x - 0.1);
+                            }
+                        }
+                    } else if (vehicle.x > 0 && reservations) {
+                        // Late for the slot but still able to stop before the line
+                        double braking = vehicle.v * vehicle.v / (2 * brake);
+                        bool late = vehicle.requested && now > vehicle.slot_start + dt
+                                && vehicle.x > braking + 0.5;
+                        if ((!vehicle.requested && vehicle.x <= request_distance) || late) {
+                            double eta = now + vehicle.x / (late ? max(vehicle.v, 1.0) : cruise);
+                            if (i > 0 && lanes[a][i - 1].requested)
+                                eta = max(eta, lanes[a][i - 1].slot_start + headway);
+                            IntersectionSlot slot = manager.reserve(to_string(vehicle.id), "X", approaches[a],
+                                                                    vehicle.turn, llround(eta * 1000));
+                            vehicle.requested = true;
+                            vehicle.slot_start = slot.start_ms / 1000.0;
+                        }
+                        if (vehicle.requested) {
+                            double time = vehicle.slot_start - now;
+                            if (time > 0) {
+                                // Hold at the line if it could be there too early
+                                if (earliest_arrival(vehicle.x, vehicle.v) < time - dt)
+                                    stop_at = min(stop_at, vehicle.x - 0.1);
+                                // Ask for a longer crossing when starting from the line
+                                if (vehicle.x < 1 && vehicle.v < 1 && !vehicle.slow) {
+                                    vehicle.slow = true;
+                                    IntersectionSlot slot = manager.reserve(
+                                            to_string(vehicle.id), "X", approaches[a], vehicle.turn,
+                                            llround(vehicle.slot_start * 1000),
+                                            llround(standstill_crossing * 1000));
+                                    vehicle.slot_start = slot.start_ms / 1000.0;
+                                }
+                                if (time > (cruise - vehicle.v) / accel + dt)
+                                    target = min(target, arrival_speed(vehicle.x, time));
+                            }
+                        }
+                    }
+
+                    // Brake hard enough to stop in time, otherwise approach the target speed
+                    if (stop_at < 1e9)
+                        target = min(target, sqrt(2 * brake * max(0.0, stop_at)));
+                    if (target > vehicle.v) {
+                        vehicle.v = min(target, vehicle.v + accel * dt);
+                    } else {
+                        vehicle.v = max(target, vehicle.v - brake * dt);
+                    }
+                    if (vehicle.v < 0.5)
+                        vehicle.stopped = true;
+                    if (vehicle.v * dt > stop_at) {
+                        // Stop exactly where it has to
+                        vehicle.v = max(0.0, stop_at) / dt;
+                    }
+                    vehicle.x -= vehicle.v * dt;
+                }
+            }
+
+            // Crossing vehicles in the intersection together
+            for (unsigned a{0}; a < 4; ++a) {
+                for (Vehicle const &vehicle : lanes[a]) {
+                    if (!in_box(vehicle))
+                        continue;
+                    for (unsigned b{a + 1}; b < 4; ++b) {
+                        for (Vehicle const &other : lanes[b]) {
+                            if (in_box(other) && conflict(vehicle, other))
+                                conflict_pairs.insert({vehicle.id, other.id});
+                        }
+                    }
+                }
+            }
+
+            // Leave the intersection
+            for (auto &lane : lanes) {
+                while (!lane.empty() && lane.front().x <= -(box_length + vehicle_length)) {
+                    Vehicle const &vehicle = lane.front();
+                    if (vehicle.spawn_time >= warmup) {
+                        ++result.crossed;
+                        result.delay += now - vehicle.spawn_time
+                                - (lane_length + box_length + vehicle_length) / cruise;
+                        result.stopped += vehicle.stopped;
+                    }
+                    lane.pop_front();
+                }
+            }
+            if (reservations && static_cast<long>(now / dt) % 200 == 0)
+                manager.expire(static_cast<int64_t>((now - 10) * 1000));
+        }
+        result.conflicts = conflict_pairs.size();
+        return result;
+    }
+}
+
+int main(int argc, char *argv[]) {
+    double seconds = argc > 1 ? atof(argv[1]) : 1800;
+
+    cout << "arrivals/min  mode          crossed/min  delay s  stopped  conflicts" << endl;
+    for (double rate : {0.05, 0.1, 0.15, 0.2, 0.25, 0.3}) {
+        for (bool reservations : {false, true}) {
+            Result result = simulate(rate, reservations, seconds, 7);
+            cout << rate * 4 * 60 << "\t      " << (reservations ? "reservations" : "first come  ")
+                 << "  " << result.crossed * 60 / seconds
+                 << "\t   " << (result.crossed ? result.delay / result.crossed : 0)
+                 << "\t    " << (result.crossed ? result.stopped * 100 / result.crossed : 0) << "%"
+                 << "\t     " << result.conflicts << endl;
+        }
+    }
+}
@@ -0,0 +1,72 @@
+/*
+ * Summarize control center text logs: time per state, missions, travel
+ * time per road segment and suspected false stop lines.
+ *
+ * Usage: log_analyzer.out [-j THREADS] LOG...
+ * Logs are read in the order given, so pass rotated logs oldest first.
+ */
+
+#include "log_analyzer.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+int main(int argc, char *argv[]) {
+    unsigned threads{0};
+    vector<string> paths{};
+    for (int i{1}; i < argc; ++i) {
+        if (strcmp(argv[i], "-j") == 0 && i + 1 < argc) {
+            threads = atoi(argv[++i]);
+        } else {
+            paths.push_back(argv[i]);
+        }
+    }
+    if (paths.empty()) {
+        cerr << "Usage: " << argv[0] << " [-j THREADS] LOG..." << endl;
+        return 1;
+    }
+
+    auto begin = chrono::steady_clock::now();
+    LogReport report = analyze_logs(paths, threads);
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - begin).count();
+
+    cout << fixed << setprecision(3);
+    cout << report.lines << " lines, " << report.bytes / 1e6 << " MB in " << seconds << " s ("
+         << report.bytes / 1e6 / seconds << " MB/s)" << endl;
+
+    char const *state_names[LOG_STATE_COUNT]{"normal", "intersection", "stopping",
+                                             "blocked", "stop_line", "waiting"};
+    cout << endl << "state          entered    seconds" << endl;
+    for (int state{0}; state < LOG_STATE_COUNT; ++state) {
+        cout << left << setw(12) << state_names[state] << right << setw(10) << report.entered[state]
+             << setw(11) << report.dwell[state] << endl;
+    }
+
+    cout << endl << report.missions.size() << " missions" << endl;
+    for (MissionTimeline const &mission : report.missions) {
+        cout << "  " << mission.start << " - " << mission.end << " ("
+             << mission.end - mission.start << " s, " << mission.blocked << " s blocked)"
+             << (mission.finished ? "" : " unfinished") << endl;
+        for (auto const &instruction : mission.instructions) {
+            cout << "    " << instruction.first << " " << instruction.second << endl;
+        }
+    }
+
+    cout << endl << "segment                 count       mean        min        max" << endl;
+    for (auto const &segment : report.segments) {
+        SegmentTimes const &times = segment.second;
+        cout << left << setw(20) << segment.first << right << setw(9) << times.count
+             << setw(11) << times.total / times.count << setw(11) << times.min
+             << setw(11) << times.max << endl;
+    }
+
+    cout << endl << report.false_stop_lines << " stop lines from far to close without mid, "
+         << report.still_at_stop_line << " \"Still at stop line\" errors" << endl;
+}
@@ -0,0 +1,55 @@
+/*
+ * Query time and cache misses on large generated maps, with nodes in map
+ * order and after locality reordering.
+ *
+ * Usage: map_bench.out [SIDE] [CHAIN] [QUERIES]
+ */
+
+#include "path_finder.h"
+#include "generated_map.h"
+#include "perf_counters.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+
+using namespace std;
+
+void run(shared_ptr<MapGraph const> map, char const *label, unsigned queries) {
+    PathFinder finder{map};
+    mt19937 random{42};
+    uniform_int_distribution<unsigned> pick{0, static_cast<unsigned>(map->size()) - 1};
+    CacheMissCounter counter{};
+
+    unsigned long total_distance{0};
+    auto start = chrono::steady_clock::now();
+    counter.start();
+    for (unsigned i{0}; i < queries; ++i) {
+        finder.solve(pick(random), pick(random));
+        total_distance += finder.get_distance();
+    }
+    uint64_t misses = counter.stop();
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    cout << label << ": " << seconds * 1e6 / queries << " us/query, cache misses/query: ";
+    if (counter.is_available()) {
+        cout << misses / queries;
+    } else {
+        cout << "n/a";
+    }
+    cout << " (checksum " << total_distance << ")" << endl;
+}
+
+int main(int argc, char *argv[]) {
+    unsigned side = argc > 1 ? atoi(argv[1]) : 200;
+    unsigned chain = argc > 2 ? atoi(argv[2]) : 2;
+    unsigned queries = argc > 3 ? atoi(argv[3]) : 200;
+
+    json m = generate_map(side, side, chain);
+    shared_ptr<MapGraph const> plain = MapGraph::from_json(m, false);
+    shared_ptr<MapGraph const> reordered = MapGraph::from_json(m, true);
+    cout << plain->size() << " nodes, " << queries << " random queries" << endl;
+    run(plain, "map order ", queries);
+    run(reordered, "reordered ", queries);
+}
@@ -0,0 +1,121 @@
+/*
+ * Distance tables: one shortest_paths() per source against
+ * multi_source_distances() with MULTI_SOURCE_LANES sources per search,
+ * with the vector and the scalar lane relax, on the track map, generated
+ * maps and a city map. Sources are either clustered (among the 64 nodes
+ * nearest a random node, like the boundary of a region or vehicles around
+ * a depot) or spread (random, like landmarks). Also times partition_map(),
+ * which builds its overlay from tables of boundary nodes.
+ *
+ * Usage: multi_source_bench.out [TABLES]
+ */
+
+#include "graph_search.h"
+#include "map_partition.h"
+#include "generated_map.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <string>
+
+using namespace std;
+
+namespace {
+    char const *track_map = "{\"MapData\":{\"A1\":[{\"K1\":5}],\"A2\":[{\"B2\":1}],\"B1\":[{\"A1\":1}],\"B2\":[{\"L2\":2},{\"C2\":2}],\"C1\":[{\"B1\":2},{\"L2\":2}],\"C2\":[{\"D2\":1}],\"D1\":[{\"C1\":1}],\"D2\":[{\"E2\":1}],\"E1\":[{\"D1\":1}],\"E2\":[{\"F2\":2}],\"F1\":[{\"E1\":2}],\"F2\":[{\"G2\":3}],\"G1\":[{\"F1\":3}],\"G2\":[{\"H2\":1}],\"H1\":[{\"G1\":1}],\"H2\":[{\"M1\":2},{\"I2\":2}],\"I1\":[{\"H1\":2},{\"M1\":2}],\"I2\":[{\"J2\":1}],\"J1\":[{\"I1\":1}],\"J2\":[{\"K2\":1}],\"K1\":[{\"J1\":1}],\"K2\":[{\"A2\":5}],\"L1\":[{\"C2\":2},{\"B1\":2}],\"L2\":[{\"M2\":1}],\"M1\":[{\"L1\":1}],\"M2\":[{\"I2\":2},{\"H1\":2}]}}";
+
+    /* tables sets of MULTI_SOURCE_LANES sources. */
+    vector<uint32_t> pick_sources(MapGraph const &map, bool clustered, unsigned tables) {
+        mt19937 random{42};
+        uniform_int_distribution<uint32_t> pick{0, static_cast<uint32_t>(map.size()) - 1};
+        vector<uint32_t> sources{};
+        for (unsigned i{0}; i < tables; ++i) {
+            vector<ReachableNode> near{};
+            if (clustered)
+                near = bounded_search(map, pick(random), UINT_MAX);
+            uniform_int_distribution<size_t> nearest{0, min<size_t>(near.size(), 64) - 1};
+            for (unsigned lane{0}; lane < MULTI_SOURCE_LANES; ++lane) {
+                sources.push_back(clustered ? near[nearest(random)].node : pick(random));
+            }
+        }
+        return sources;
+    }
+
+    /* Mean time per table. */
+    template <class Table>
+    double time_tables(vector<uint32_t> const &sources, unsigned long &checksum, Table table) {
+        auto start = chrono::steady_clock::now();
+        for (size_t i{0}; i < sources.size(); i += MULTI_SOURCE_LANES) {
+            checksum += table(&sources[i]);
+        }
+        return chrono::duration<double>(chrono::steady_clock::now() - start).count() * 1e6
+                * MULTI_SOURCE_LANES / sources.size();
+    }
+
+    void compare(string const &label, json const &m, bool clustered, unsigned tables) {
+        shared_ptr<MapGraph const> map = MapGraph::from_json(m);
+        vector<unsigned> weights{};
+        vector<uint32_t> parents{};
+        vector<unsigned> queued{};
+        SearchQueue queue{};
+        vector<uint32_t> sources = pick_sources(*map, clustered, tables);
+        unsigned long checksums[3]{};
+
+        // Sum of all distances in the table, unreachable ones left out
+        double single = time_tables(sources, checksums[0], [&] (uint32_t const *sources) {
+            unsigned long sum{0};
+            for (unsigned i{0}; i < MULTI_SOURCE_LANES; ++i) {
+                shortest_paths(*map, sources[i], NO_NODE, weights, parents, queue);
+                for (unsigned weight : weights) {
+                    sum += weight == UINT_MAX ? 0 : weight;
+                }
+            }
+            return sum;
+        });
+        auto lanes = [&] (LaneRelax relax) {
+            return [&, relax] (uint32_t const *sources) {
+                multi_source_distances(*map, sources, MULTI_SOURCE_LANES, weights, queued, queue, relax);
+                unsigned long sum{0};
+                for (unsigned weight : weights) {
+                    sum += weight == UINT_MAX ? 0 : weight;
+                }
+                return sum;
+            };
+        };
+        double vector_lanes = time_tables(sources, checksums[1], lanes(get_lane_relax()));
+        double scalar_lanes = time_tables(sources, checksums[2], lanes(lane_relax_scalar));
+
+        cout << label << " (" << map->size() << " nodes), " << (clustered ? "clustered" : "spread")
+             << ": " << MULTI_SOURCE_LANES << " searches "
+             << single << " us, lanes " << lane_relax_kind() << " " << vector_lanes << " us ("
+             << single / vector_lanes << "x), lanes scalar " << scalar_lanes << " us ("
+             << single / scalar_lanes << "x)"
+             << (checksums[0] == checksums[1] && checksums[1] == checksums[2] ? "" : ", DIFFERENT")
+             << endl;
+    }
+
+    void partition(string const &label, json const &m, unsigned parts, unsigned runs) {
+        auto start = chrono::steady_clock::now();
+        for (unsigned i{0}; i < runs; ++i) {
+            partition_map(m, parts);
+        }
+        cout << label << ": partition_map() into " << parts << " regions "
+             << chrono::duration<double>(chrono::steady_clock::now() - start).count() * 1e3 / runs
+             << " ms" << endl;
+    }
+}
+
+int main(int argc, char *argv[]) {
+    unsigned tables = argc > 1 ? atoi(argv[1]) : 2000;
+    for (bool clustered : {true, false}) {
+        compare("track map", json::parse(track_map), clustered, 100 * tables);
+        compare("generated 16x16", generate_map(16, 16, 0), clustered, 4 * tables);
+        compare("generated 40x40, 3 node roads", generate_map(40, 40, 3), clustered, tables / 20);
+        compare("city 40x40, 3 node roads", generate_city_map(40, 40, 3), clustered, tables / 20);
+    }
+    for (unsigned parts : {4, 16}) {
+        partition("city 60x60, 3 node roads", generate_city_map(60, 60, 3), parts, 5);
+    }
+}
@@ -0,0 +1,90 @@
+/*
+ * Congestion-aware routing (occupancy_table.h) for a fleet on a generated
+ * city map. VEHICLES vehicles are sent from a handful of depots to random
+ * targets, one after the other, each planning with the routes of the
+ * ones before it in the occupancy table, or without a table.
+ *
+ * Reports the most vehicles on or planned on one segment, the 90th
+ * percentile of that over the segments used, how many are used, the mean
+ * route length, the time to report a route to the table and, for
+ * comparison, to build the map again, which weights baked into the map
+ * would need.
+ *
+ * Usage: occupancy_sim.out [VEHICLES]
+ */
+
+#include "occupancy_table.h"
+#include "path_finder.h"
+#include "generated_map.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <list>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+namespace {
+    void simulate(json const &m, unsigned vehicles, bool congestion) {
+        shared_ptr<MapGraph const> map = MapGraph::from_json(m);
+        shared_ptr<OccupancyTable> table{new OccupancyTable{map}};
+        PathFinder path_finder{map};  // The table only counts without congestion
+        if (congestion)
+            path_finder.set_occupancy(table);
+
+        mt19937 random{42};
+        uniform_int_distribution<unsigned> pick{0, static_cast<unsigned>(map->size()) - 1};
+        vector<unsigned> depots{};
+        for (unsigned i{0}; i < 4; ++i) {
+            depots.push_back(pick(random));
+        }
+        double length{0};
+        double report_us{0};
+        unsigned routed{0};
+        for (unsigned i{0}; i < vehicles; ++i) {
+            path_finder.solve(depots[i % depots.size()], pick(random));
+            if (path_finder.get_distance() == UINT_MAX)
+                continue;
+            list<string> segments = path_finder.get_road_segments();
+            auto begin = chrono::steady_clock::now();
+            table->set_route(to_string(i), segments);
+            report_us += chrono::duration<double>(chrono::steady_clock::now() - begin).count() * 1e6;
+            length += path_finder.get_distance();
+            ++routed;
+        }
+
+        // Load of every segment used
+        vector<unsigned> loads{};
+        MapEdge edges[2];
+        for (uint32_t id{0}; id < map->size(); ++id) {
+            unsigned degree = map->get_edges(id, edges);
+            for (unsigned i{0}; i < degree; ++i) {
+                string segment = map->get_name(id) + "->" + map->get_name(edges[i].node);
+                unsigned load = table->get_vehicles(segment) + table->get_planned(segment);
+                if (load > 0)
+                    loads.push_back(load);
+            }
+        }
+        sort(loads.begin(), loads.end());
+        cout << (congestion ? "  with occupancy:    " : "  without occupancy: ") << "most "
+             << loads.back() << " vehicles on a segment, 90th percentile " << loads[loads.size() * 9 / 10]
+             << ", " << loads.size() << " segments used, mean route " << length / routed << ", "
+             << report_us / routed << " us per route reported" << endl;
+    }
+}
+
+int main(int argc, char *argv[]) {
+    unsigned vehicles = argc > 1 ? atoi(argv[1]) : 200;
+    json m = generate_city_map(20, 20, 2);
+    auto begin = chrono::steady_clock::now();
+    shared_ptr<MapGraph const> map = MapGraph::from_json(m);
+    double build_us = chrono::duration<double>(chrono::steady_clock::now() - begin).count() * 1e6;
+    cout << "city 20x20, 2 node roads (" << map->size() << " nodes, " << build_us
+         << " us to build), " << vehicles << " vehicles" << endl;
+    simulate(m, vehicles, false);
+    simulate(m, vehicles, true);
+}
@@ -0,0 +1,141 @@
+/*
+ * Partitioned routing (partitioned_planner.h) with 1 to 8 region planner
+ * processes on a generated city map. For each number of regions reports
+ * the time to partition the map, the overlay size, the map memory of the
+ * largest region process, and query throughput and latency from CLIENTS client threads.
+ *
+ * Usage: partition_bench.out [SIZE] [QUERIES] [CLIENTS]
+ */
+
+#include "generated_map.h"
+#include "map_partition.h"
+#include "partitioned_planner.h"
+#include "planner_server.h"
+#include "path_finder.h"
+
+#include <algorithm>
+#include <chrono>
+#include <csignal>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+using namespace std;
+using Clock = chrono::steady_clock;
+
+int main(int argc, char *argv[]) {
+    unsigned size = argc > 1 ? atoi(argv[1]) : 200;
+    unsigned queries = argc > 2 ? atoi(argv[2]) : 2000;
+    unsigned clients = argc > 3 ? atoi(argv[3]) : 4;
+
+    json m = generate_city_map(size, size, 0);
+    vector<string> names{};
+    for (auto &node : m["MapData"].items()) {
+        names.push_back(node.key());
+    }
+
+    // Reference distances from one process with the whole map
+    mt19937 random{1};
+    uniform_int_distribution<size_t> pick{0, names.size() - 1};
+    vector<pair<string, string>> pairs{};
+    for (unsigned i{0}; i < queries; ++i) {
+        pairs.emplace_back(names[pick(random)], names[pick(random)]);
+    }
+    PathFinder finder{MapGraph::from_json(m)};
+    vector<unsigned> expected{};
+    for (auto const &pair : pairs) {
+        finder.solve(pair.first, pair.second);
+        expected.push_back(finder.get_distance());
+    }
+
+    cout << names.size() << " nodes, " << queries << " queries from " << clients << " clients, "
+         << thread::hardware_concurrency() << " cores" << endl
+         << "regions  partition_s  overlay_nodes  max_region_mb  queries/s  p50_us  p99_us  wrong" << endl;
+    for (unsigned parts{1}; parts <= 8; ++parts) {
+        Clock::time_point begin = Clock::now();
+        MapPartition partition = partition_map(m, parts);
+        double partition_seconds = chrono::duration<double>(Clock::now() - begin).count();
+        double max_region_mb{0};
+        size_t overlay_nodes{0};
+        for (unsigned region{0}; region < parts; ++region) {
+            size_t bytes = MapGraph::from_json(partition.regions[region])->get_memory_usage();
+            max_region_mb = max(max_region_mb, bytes / 1e6);
+            overlay_nodes += partition.overlay["Boundary"][region].size();
+        }
+
+        vector<string> paths{};
+        vector<pid_t> children{};
+        for (unsigned region{0}; region < parts; ++region) {
+            paths.push_back("/tmp/partition_bench_" + to_string(getpid()) + "_" + to_string(region) + ".sock");
+            pid_t pid = fork();
+            if (pid == 0) {
+                // Only the region's map in the child
+                json region_map = move(partition.regions[region]);
+                partition = MapPartition{};
+                m = json{};
+                PlannerServer server{region_map, paths.back(), 1};
+                server.run();
+                _exit(0);
+            }
+            children.push_back(pid);
+        }
+        partition.regions.clear();
+
+        vector<vector<double>> latencies(clients);
+        vector<unsigned> wrong(clients, 0);
+        vector<thread> threads{};
+        begin = Clock::now();
+        for (unsigned client{0}; client < clients; ++client) {
+            threads.emplace_back([&, client] {
+                unique_ptr<PartitionedPlanner> planner{};
+                for (int i{0}; i < 500; ++i) {
+                    planner.reset(new PartitionedPlanner{partition.overlay, paths});
+                    if (planner->connected())
+                        break;
+                    this_thread::sleep_for(chrono::milliseconds(10));
+                }
+                for (size_t i{client}; i < pairs.size(); i += clients) {
+                    Clock::time_point sent = Clock::now();
+                    PlannerReply reply = planner->route(pairs[i].first, pairs[i].second);
+                    latencies[client].push_back(chrono::duration<double, micro>(Clock::now() - sent).count());
+                    if (reply.distance != expected[i] && !(reply.status == planner::no_route
+                                                           && expected[i] == UINT_MAX))
+                        ++wrong[client];
+                }
+            });
+        }
+        for (thread &t : threads) {
+            t.join();
+        }
+        double seconds = chrono::duration<double>(Clock::now() - begin).count();
+
+        for (pid_t pid : children) {
+            kill(pid, SIGTERM);
+            waitpid(pid, nullptr, 0);
+        }
+        for (string const &path : paths) {
+            unlink(path.c_str());
+        }
+
+        vector<double> all{};
+        unsigned total_wrong{0};
+        for (unsigned client{0}; client < clients; ++client) {
+            all.insert(all.end(), latencies[client].begin(), latencies[client].end());
+            total_wrong += wrong[client];
+        }
+        sort(all.begin(), all.end());
+        cout << fixed << setprecision(2) << setw(7) << parts << setw(13) << partition_seconds
+             << setw(15) << overlay_nodes
+             << setw(15) << max_region_mb << setw(11) << setprecision(0) << all.size() / seconds
+             << setw(8) << all[all.size() / 2] << setw(8) << all[all.size() * 99 / 100]
+             << setw(7) << total_wrong << endl;
+    }
+}
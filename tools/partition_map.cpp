@@ -0,0 +1,39 @@
+/*
+ * Split a map into regions for partitioned routing (map_partition.h).
+ * Writes PREFIX.region<N>.json for every region, to be served by
+ * planner_daemon.out, and PREFIX.overlay.json for PartitionedPlanner.
+ *
+ * Usage: partition_map.out MAP_FILE PARTS PREFIX
+ */
+
+#include "map_partition.h"
+
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string>
+
+using namespace std;
+
+int main(int argc, char *argv[]) {
+    if (argc < 4) {
+        cerr << "Usage: " << argv[0] << " MAP_FILE PARTS PREFIX" << endl;
+        return 1;
+    }
+    ifstream map_file{argv[1]};
+    if (!map_file) {
+        cerr << "Could not open " << argv[1] << endl;
+        return 1;
+    }
+    json m = json::parse(map_file);
+    MapPartition partition = partition_map(m, atoi(argv[2]));
+
+    string prefix = argv[3];
+    for (size_t region{0}; region < partition.regions.size(); ++region) {
+        ofstream{prefix + ".region" + to_string(region) + ".json"} << partition.regions[region];
+        cout << "region " << region << ": " << partition.regions[region]["MapData"].size()
+             << " nodes, " << partition.regions[region]["Boundary"].size() << " boundary nodes" << endl;
+    }
+    ofstream{prefix + ".overlay.json"} << partition.overlay;
+    cout << "overlay: " << partition.overlay["Edges"].size() << " edges" << endl;
+}
@@ -0,0 +1,61 @@
+/*
+ * Hardware cache miss counter for the benchmarks, through perf_event_open.
+ * If the kernel does not allow it (e.g. perf_event_paranoid, containers)
+ * is_available() is false and read() returns 0.
+ */
+
+#ifndef PERF_COUNTERS_H
+#define PERF_COUNTERS_H
+
+#include <cstdint>
+#include <cstring>
+
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+class CacheMissCounter {
+public:
+    CacheMissCounter() {
+        perf_event_attr attr{};
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.size = sizeof(attr);
+        attr.config = PERF_COUNT_HW_CACHE_MISSES;
+        attr.disabled = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        fd = syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+    }
+    ~CacheMissCounter() {
+        if (fd >= 0)
+            close(fd);
+    }
+
+    CacheMissCounter(CacheMissCounter const&) = delete;
+    CacheMissCounter operator=(CacheMissCounter const&) = delete;
+
+    bool is_available() const {
+        return fd >= 0;
+    }
+    void start() {
+        if (fd < 0)
+            return;
+        ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+        ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+    }
+    uint64_t stop() {
+        uint64_t count{0};
+        if (fd < 0)
+            return count;
+        ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+        if (::read(fd, &count, sizeof(count)) != sizeof(count))
+            count = 0;
+        return count;
+    }
+
+private:
+    int fd{-1};
+};
+
+#endif // PERF_COUNTERS_H
@@ -0,0 +1,63 @@
+/*
+ * Route-planning daemon.
+ *
+ * Usage: planner_daemon.out MAP_FILE SOCKET_PATH [WORKERS] [METRICS]
+ *
+ * METRICS is a file or unix:SOCKET_PATH to export metrics to every
+ * second, see metrics.h.
+ */
+
+#include "planner_server.h"
+#include "log.h"
+#include "metrics.h"
+
+#include <csignal>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <nlohmann/json.hpp>
+
+using namespace std;
+using json = nlohmann::json;
+
+PlannerServer *server{nullptr};
+
+void handle_signal(int) {
+    if (server != nullptr)
+        server->stop();
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 3) {
+        cerr << "Usage: " << argv[0] << " MAP_FILE SOCKET_PATH [WORKERS] [METRICS]" << endl;
+        return 1;
+    }
+    ifstream map_file{argv[1]};
+    if (!map_file) {
+        cerr << "Could not open " << argv[1] << endl;
+        return 1;
+    }
+    json m = json::parse(map_file);
+    unsigned workers = argc > 3 ? atoi(argv[3]) : 0;
+
+    Logger::init();
+    // The registry must outlive the server that records into it
+    MetricsRegistry registry{};
+    unique_ptr<MetricsExporter> exporter{};
+    PlannerServer planner_server{m, argv[2], workers};
+    if (argc > 4) {
+        planner_server.record_metrics(registry);
+        exporter.reset(new MetricsExporter{registry, argv[4]});
+    }
+    server = &planner_server;
+    signal(SIGINT, handle_signal);
+    signal(SIGTERM, handle_signal);
+
+    bool ok = planner_server.run();
+    cout << "Served " << planner_server.get_query_count() << " queries in "
+         << planner_server.get_batch_count() << " batches" << endl;
+    server = nullptr;
+    Logger::close();
+    return ok ? 0 : 1;
+}
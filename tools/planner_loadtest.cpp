@@ -0,0 +1,110 @@
+/*
+ * Load test for the route-planning daemon. Every client thread opens its
+ * own connection and sends random route queries between map nodes, BATCH
+ * queries at a time. Reports queries per second and latency percentiles.
+ *
+ * Usage: planner_loadtest.out MAP_FILE SOCKET_PATH [CLIENTS] [QUERIES] [BATCH]
+ */
+
+#include "planner_client.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#include <nlohmann/json.hpp>
+
+using namespace std;
+using json = nlohmann::json;
+using Clock = chrono::steady_clock;
+
+/* Latencies in microseconds, one per query. */
+void run_client(string socket_path, vector<string> const &names, unsigned queries,
+                unsigned batch_size, unsigned seed, vector<double> &latencies, unsigned &failed) {
+    PlannerClient client{socket_path};
+    mt19937 random{seed};
+    uniform_int_distribution<size_t> pick{0, names.size() - 1};
+
+    for (unsigned done{0}; done < queries; done += batch_size) {
+        vector<PlannerQuery> batch{};
+        for (unsigned i{0}; i < batch_size && done + i < queries; ++i) {
+            PlannerQuery query{};
+            query.start = names[pick(random)];
+            query.stop = names[pick(random)];
+            batch.push_back(query);
+        }
+        Clock::time_point start = Clock::now();
+        vector<PlannerReply> replies = client.query(batch);
+        double elapsed = chrono::duration<double, micro>(Clock::now() - start).count();
+        for (PlannerReply const &reply : replies) {
+            latencies.push_back(elapsed);
+            if (reply.status != planner::ok && reply.status != planner::no_route)
+                ++failed;
+        }
+    }
+}
+
+double percentile(vector<double> const &sorted, double p) {
+    if (sorted.empty())
+        return 0;
+    return sorted[min(sorted.size() - 1, static_cast<size_t>(p * sorted.size()))];
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 3) {
+        cerr << "Usage: " << argv[0] << " MAP_FILE SOCKET_PATH [CLIENTS] [QUERIES] [BATCH]" << endl;
+        return 1;
+    }
+    ifstream map_file{argv[1]};
+    if (!map_file) {
+        cerr << "Could not open " << argv[1] << endl;
+        return 1;
+    }
+    json m = json::parse(map_file);
+    vector<string> names{};
+    for (auto &node : m["MapData"].items()) {
+        names.push_back(node.key());
+    }
+    if (names.empty()) {
+        cerr << "Empty map" << endl;
+        return 1;
+    }
+    unsigned clients = argc > 3 ? atoi(argv[3]) : 4;
+    unsigned queries = argc > 4 ? atoi(argv[4]) : 10000;
+    unsigned batch_size = argc > 5 ? max(1, atoi(argv[5])) : 1;
+
+    vector<vector<double>> latencies(clients);
+    vector<unsigned> failed(clients, 0);
+    vector<thread> threads{};
+    Clock::time_point start = Clock::now();
+    for (unsigned i{0}; i < clients; ++i) {
+        threads.emplace_back(run_client, string{argv[2]}, cref(names), queries, batch_size, i,
+                             ref(latencies[i]), ref(failed[i]));
+    }
+    for (thread &t : threads) {
+        t.join();
+    }
+    double seconds = chrono::duration<double>(Clock::now() - start).count();
+
+    vector<double> all{};
+    unsigned total_failed{0};
+    for (unsigned i{0}; i < clients; ++i) {
+        all.insert(all.end(), latencies[i].begin(), latencies[i].end());
+        total_failed += failed[i];
+    }
+    sort(all.begin(), all.end());
+
+    cout << "clients=" << clients << " batch=" << batch_size
+         << " queries=" << all.size() << " failed=" << total_failed << endl
+         << "qps=" << all.size() / seconds << endl
+         << "latency_us p50=" << percentile(all, 0.5)
+         << " p99=" << percentile(all, 0.99)
+         << " p999=" << percentile(all, 0.999)
+         << " max=" << (all.empty() ? 0 : all.back()) << endl;
+    return total_failed == 0 ? 0 : 1;
+}
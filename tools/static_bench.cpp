@@ -0,0 +1,67 @@
+/*
+ * StaticPathFinder against PathFinder: mean and worst query time on the
+ * track map and a generated map.
+ *
+ * Usage: static_bench.out [QUERIES]
+ */
+
+#include "path_finder.h"
+#include "static_path_finder.h"
+#include "generated_map.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+
+using namespace std;
+
+namespace {
+    char const *track_map = "{\"MapData\":{\"A1\":[{\"K1\":5}],\"A2\":[{\"B2\":1}],\"B1\":[{\"A1\":1}],\"B2\":[{\"L2\":2},{\"C2\":2}],\"C1\":[{\"B1\":2},{\"L2\":2}],\"C2\":[{\"D2\":1}],\"D1\":[{\"C1\":1}],\"D2\":[{\"E2\":1}],\"E1\":[{\"D1\":1}],\"E2\":[{\"F2\":2}],\"F1\":[{\"E1\":2}],\"F2\":[{\"G2\":3}],\"G1\":[{\"F1\":3}],\"G2\":[{\"H2\":1}],\"H1\":[{\"G1\":1}],\"H2\":[{\"M1\":2},{\"I2\":2}],\"I1\":[{\"H1\":2},{\"M1\":2}],\"I2\":[{\"J2\":1}],\"J1\":[{\"I1\":1}],\"J2\":[{\"K2\":1}],\"K1\":[{\"J1\":1}],\"K2\":[{\"A2\":5}],\"L1\":[{\"C2\":2},{\"B1\":2}],\"L2\":[{\"M2\":1}],\"M1\":[{\"L1\":1}],\"M2\":[{\"I2\":2},{\"H1\":2}]}}";
+
+    template <class Finder>
+    void time_queries(char const *label, Finder &finder, size_t size, unsigned queries) {
+        mt19937 random{42};
+        uniform_int_distribution<unsigned> pick{0, static_cast<unsigned>(size) - 1};
+        for (unsigned i{0}; i < 10; ++i) {
+            finder.solve(pick(random), pick(random));  // Warm up
+        }
+        double total{0};
+        double worst{0};
+        unsigned long checksum{0};
+        for (unsigned i{0}; i < queries; ++i) {
+            unsigned start = pick(random);
+            unsigned stop = pick(random);
+            auto begin = chrono::steady_clock::now();
+            finder.solve(start, stop);
+            double us = chrono::duration<double>(chrono::steady_clock::now() - begin).count() * 1e6;
+            total += us;
+            worst = max(worst, us);
+            checksum += finder.get_distance();
+        }
+        cout << "  " << label << total / queries << " us/query, worst " << worst
+             << " us (checksum " << checksum << ")" << endl;
+    }
+
+    template <size_t MaxNodes, size_t MaxEdges>
+    void compare(char const *label, json const &m, unsigned queries) {
+        static StaticPathFinder<MaxNodes, MaxEdges> static_finder{};
+        shared_ptr<MapGraph const> map = MapGraph::from_json(m);
+        PathFinder path_finder{map};
+        if (!static_finder.load(map)) {
+            cout << label << ": does not fit" << endl;
+            return;
+        }
+        cout << label << " (" << map->size() << " nodes, StaticPathFinder<" << MaxNodes << ", "
+             << MaxEdges << "> is " << sizeof(static_finder) << " bytes)" << endl;
+        time_queries("PathFinder:       ", path_finder, map->size(), queries);
+        time_queries("StaticPathFinder: ", static_finder, map->size(), queries);
+    }
+}
+
+int main(int argc, char *argv[]) {
+    unsigned queries = argc > 1 ? atoi(argv[1]) : 1000;
+    compare<32, 64>("track map", json::parse(track_map), 100 * queries);
+    compare<12800, 25600>("generated 40x40, 3 node roads", generate_map(40, 40, 3), queries);
+}
@@ -0,0 +1,49 @@
+/*
+ * Print live controller telemetry, one line per control cycle.
+ *
+ * Usage: telemetry_dump.out [SHM_NAME]
+ */
+
+#include "telemetry.h"
+
+#include <chrono>
+#include <iostream>
+#include <thread>
+
+using namespace std;
+
+int main(int argc, char *argv[]) {
+    string name = argc > 1 ? argv[1] : "/control_center_telemetry";
+    TelemetryReader reader{name};
+    if (!reader.is_open()) {
+        cerr << "No telemetry in " << name << endl;
+        return 1;
+    }
+
+    uint64_t next = reader.get_published();
+    while (true) {
+        uint64_t published = reader.get_published();
+        if (published == next) {
+            this_thread::sleep_for(chrono::milliseconds(1));
+            continue;
+        }
+        for (; next < published; ++next) {
+            TelemetryRecord record{};
+            if (!reader.read(next, record)) {
+                cout << "cycle " << next << " lost" << endl;
+                continue;
+            }
+            cout << record.cycle << " t=" << record.timestamp_ns
+                 << " state=" << record.state
+                 << " instruction=" << record.instruction
+                 << " segment=" << record.road_segment
+                 << " obstacle=" << record.obstacle_distance
+                 << " stop=" << record.stop_distance
+                 << " speed=" << record.speed
+                 << " angle=" << record.control.angle
+                 << " lateral=" << record.control.lateral_position
+                 << " speed_ref=" << record.control.speed_ref
+                 << " mode=" << record.control.regulation_mode << endl;
+        }
+    }
+}